@@ -0,0 +1,49 @@
+#!/bin/sh
+# Loopback run of d6taggregate (make bench): many gateways (gateways.c)
+# stream frames to it, reconnect halfway and resend what was not
+# acknowledged, while sink.js stands in for the API server and counts the
+# records of every batch. Every frame must reach the sink exactly once;
+# the aggregator drops the resent ones it already holds.
+#
+# Usage: aggregate.sh [gateways [sensors [frames]]]
+
+BIN=$(cd "$(dirname "$0")/../bin" && pwd)
+BENCH=$(cd "$(dirname "$0")" && pwd)
+GATEWAYS=${1:-500}
+SENSORS=${2:-2}
+FRAMES=${3:-200}
+DIR=$(mktemp -d)
+trap 'kill $SINK $AGG 2>/dev/null; rm -rf "$DIR"' EXIT
+
+cat > "$DIR/config.json" <<JSON
+{
+  "log": {"dir": "$DIR/logs"},
+  "server": {"ip": "127.0.0.1", "port": 18942,
+             "endpoints": {"backfill": "/api/data/batch"}},
+  "aggregator": {"port": 17642, "listen": "127.0.0.1", "batch": 500, "flush_ms": 200,
+                 "concurrency": 2, "queue": 64}
+}
+JSON
+
+ulimit -n $((GATEWAYS + 64))
+node "$BENCH/sink.js" 18942 "$DIR/stats.json" &
+SINK=$!
+"$BIN/d6taggregate" -c "$DIR/config.json" >/dev/null 2>&1 &
+AGG=$!
+sleep 1
+
+"$BIN/gateways" 17642 "$GATEWAYS" "$SENSORS" "$FRAMES" || exit 1
+sleep 1
+awk -v hz="$(getconf CLK_TCK)" '{printf "aggregate: d6taggregate used %.2f s of CPU", ($14 + $15) / hz}' /proc/$AGG/stat
+awk '/VmHWM/ {printf ", peak RSS %d KB\n", $2}' /proc/$AGG/status
+kill -TERM $AGG
+wait $AGG
+grep -h 'Aggregator: [0-9]' "$DIR"/logs/*.log | tail -1 | sed 's/.*Aggregator: /aggregate: /'
+
+EXPECT=$((GATEWAYS * SENSORS * FRAMES))
+node -e '
+const s = require(process.argv[1]), expect = +process.argv[2];
+console.log(`aggregate: sink got ${s.records} records in ${s.batches} batches, ` +
+            `${s.unique} of ${expect} unique, ${s.duplicates} duplicates`);
+process.exit(s.unique === expect && s.duplicates === 0 ? 0 : 1);
+' "$DIR/stats.json" "$EXPECT"
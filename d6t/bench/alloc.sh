@@ -0,0 +1,51 @@
+#!/bin/sh
+# Steady-state allocation check (make bench): run SensorDataApp with four
+# simulated sensors at 25 ms and every frame sink enabled (store, uploader,
+# forwarder to d6taggregate, alert history, summary policy with pre-trigger
+# frames), under alloc_count.so, and report the allocations made after
+# warm-up. The threshold makes the simulated frames turn abnormal and back
+# every few seconds, so alert paths are exercised too.
+#
+# Usage: alloc.sh [seconds [warm-up seconds]]
+
+BIN=$(cd "$(dirname "$0")/../bin" && pwd)
+BENCH=$(cd "$(dirname "$0")" && pwd)
+RUN=${1:-12}
+WARMUP=${2:-4}
+DIR=$(mktemp -d)
+trap 'kill $SINK $AGG 2>/dev/null; rm -rf "$DIR"' EXIT
+
+cat > "$DIR/config.json" <<JSON
+{
+  "log": {"dir": "$DIR/logs"},
+  "interval": 25,
+  "sensors": [
+    {"id": "s1", "device": "sim:clock=0", "address": "0x0A",
+     "upload": {"mode": "summary", "summary_seconds": 2, "pre_trigger": 20, "post_trigger_seconds": 1}},
+    {"id": "s2", "device": "sim:clock=0", "address": "0x0B", "filter": {"type": "ema", "alpha": 0.5},
+     "upload": {"mode": "summary", "summary_seconds": 2, "pre_trigger": 64, "post_trigger_seconds": 1}},
+    {"id": "s3", "device": "sim:clock=0", "address": "0x0C", "filter": {"type": "median3"},
+     "upload": {"mode": "full"}},
+    {"id": "s4", "device": "sim:clock=0", "address": "0x0D"}
+  ],
+  "threshold": {"min": 20.0, "max": 26.5},
+  "alert": {"history_seconds": 3},
+  "server": {"ip": "127.0.0.1", "port": 18941,
+             "endpoints": {"temperature": "/api/data", "alerts": "/api/alerts",
+                           "summary": "/api/summary", "backfill": "/api/backfill"}},
+  "pipe": {"enabled": false},
+  "store": {"enabled": true, "dir": "$DIR/store", "chunk_seconds": 5},
+  "uploader": {"enabled": true, "batch": 8, "flush_ms": 200, "queue": 4096, "alert_queue": 256},
+  "aggregator": {"host": "127.0.0.1", "port": 17641, "window": 1024}
+}
+JSON
+
+node "$BENCH/sink.js" 18941 &
+SINK=$!
+"$BIN/d6taggregate" -c "$DIR/config.json" >/dev/null 2>&1 &
+AGG=$!
+sleep 1
+
+ALLOC_WARMUP=$WARMUP LD_PRELOAD="$BIN/alloc_count.so" \
+    "$BIN/SensorDataApp" -c "$DIR/config.json" -d "${RUN}s" 2>&1 >/dev/null | grep '^allocations'
+grep -h 'Frame pool:' "$DIR"/logs/SensorDataApp_*.log | sed 's/.*Frame pool/frame pool/'
@@ -0,0 +1,60 @@
+/*
+ * alloc_count.so - count the heap allocations of a process (LD_PRELOAD)
+ *
+ * Counts malloc, calloc and realloc calls, split into a warm-up period
+ * (ALLOC_WARMUP seconds after start, default 5) and the steady state after
+ * it, and prints both to stderr at exit. alloc.sh uses it to check that
+ * SensorDataApp does not allocate per frame (see frame.h).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static double start;
+static double warmup = -1;
+static unsigned long warm_allocs, steady_allocs;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void count(void) {
+    if (start > 0 && now() - start > warmup) {
+        steady_allocs++;
+    } else {
+        warm_allocs++;
+    }
+}
+
+void *malloc(size_t size) {
+    count();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    count();
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+    count();
+    return __libc_realloc(p, size);
+}
+
+__attribute__((constructor)) static void init(void) {
+    const char *w = getenv("ALLOC_WARMUP");
+    warmup = w ? atof(w) : 5.0;
+    start = now();
+}
+
+__attribute__((destructor)) static void fini(void) {
+    fprintf(stderr, "allocations: %lu during warm-up (%.0f s), %lu in steady state (%.0f s)\n",
+            warm_allocs, warmup, steady_allocs, now() - start - warmup);
+}
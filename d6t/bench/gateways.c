@@ -0,0 +1,168 @@
+/*
+ * gateways - many gateways streaming frames to d6taggregate over the wire
+ * protocol (wire.h), for aggregate.sh
+ *
+ * Usage: gateways PORT GATEWAYS SENSORS FRAMES
+ *
+ * Every gateway connects, then all of them send one frame per sensor in
+ * turn. Halfway through each gateway closes its side, reads the ACKs that
+ * are left until the aggregator closes too, reconnects and resends every
+ * frame that was not acknowledged, as SensorDataApp does after losing the
+ * connection. The run ends when every gateway has its last frame
+ * acknowledged. Any malformed message from the aggregator stops the run.
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "wire.h"
+
+typedef struct {
+    int fd;
+    uint8_t buf[4096];
+    int len;
+    uint64_t ack;                   // Frames acknowledged on this connection
+} Gateway;
+
+static int port;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void send_all(int fd, const uint8_t *p, int len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) die("gateways: write");
+        p += n;
+        len -= (int)n;
+    }
+}
+
+static void connect_gateway(Gateway *g, int k) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    uint8_t msg[WIRE_MAX_MSG];
+    char name[32];
+
+    g->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (g->fd < 0 || connect(g->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        die("gateways: connect");
+    }
+    g->len = 0;
+    g->ack = 0;
+    snprintf(name, sizeof(name), "gw%03d", k);
+    send_all(g->fd, msg, wire_put_hello(msg, sizeof(msg), 1000 + k, name));
+}
+
+static void send_frame(Gateway *g, int k, int sensor, int seq) {
+    WireFrame f;
+    uint8_t msg[WIRE_MAX_MSG];
+
+    memset(&f, 0, sizeof(f));
+    f.seq = (uint32_t)seq;
+    f.flags = seq % 100 == 0 ? WIRE_FLAG_ABNORMAL : 0;
+    snprintf(f.sensor_id, sizeof(f.sensor_id), "g%03d_s%d", k, sensor);
+    f.frame.t_ms = 1790000000000LL + seq * 300LL;
+    f.frame.ptat = 250;
+    for (int i = 0; i < STORE_N_PIXEL; i++) {
+        f.frame.pix[i] = (int16_t)(200 + (seq + i) % 50);
+    }
+    send_all(g->fd, msg, wire_put_frame(msg, sizeof(msg), &f));
+}
+
+// Read once and take in every complete ACK. Returns 0 at end of stream.
+static int read_acks(Gateway *g) {
+    WireMsg m;
+    int used, off = 0;
+
+    ssize_t n = read(g->fd, g->buf + g->len, sizeof(g->buf) - g->len);
+    if (n < 0) die("gateways: read");
+    g->len += (int)n;
+    while ((used = wire_get(g->buf + off, g->len - off, &m)) > 0) {
+        if (m.type != WIRE_ACK || m.ack < g->ack) {
+            fprintf(stderr, "gateways: unexpected message from the aggregator\n");
+            exit(1);
+        }
+        g->ack = m.ack;
+        off += used;
+    }
+    if (used < 0) {
+        fprintf(stderr, "gateways: malformed stream from the aggregator\n");
+        exit(1);
+    }
+    memmove(g->buf, g->buf + off, g->len - off);
+    g->len -= off;
+    return n > 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s PORT GATEWAYS SENSORS FRAMES\n", argv[0]);
+        return 2;
+    }
+    port = atoi(argv[1]);
+    int n = atoi(argv[2]), sensors = atoi(argv[3]), frames = atoi(argv[4]);
+    Gateway *gw = calloc(n, sizeof(*gw));
+    uint64_t *want = calloc(n, sizeof(*want));
+    long resent = 0;
+
+    double t0 = now();
+    for (int k = 0; k < n; k++) {
+        connect_gateway(&gw[k], k);
+    }
+    double t1 = now();
+    for (int seq = 0; seq < frames; seq++) {
+        if (seq == frames / 2) {
+            for (int k = 0; k < n; k++) {
+                Gateway *g = &gw[k];
+                shutdown(g->fd, SHUT_WR);
+                while (read_acks(g)) {
+                }
+                close(g->fd);
+                uint64_t acked = g->ack;
+                connect_gateway(g, k);
+                for (uint64_t i = acked; i < (uint64_t)seq * sensors; i++) {
+                    send_frame(g, k, (int)(i % sensors), (int)(i / sensors));
+                }
+                want[k] = (uint64_t)seq * sensors - acked;
+                resent += (long)want[k];
+            }
+        }
+        for (int k = 0; k < n; k++) {
+            for (int s = 0; s < sensors; s++) {
+                send_frame(&gw[k], k, s, seq);
+            }
+        }
+    }
+    for (int k = 0; k < n; k++) {
+        want[k] += (uint64_t)(frames - frames / 2) * sensors;
+        while (gw[k].ack < want[k]) {
+            if (!read_acks(&gw[k])) {
+                fprintf(stderr, "gateways: aggregator closed gw%03d before its last ACK\n", k);
+                return 1;
+            }
+        }
+        close(gw[k].fd);
+    }
+    double t2 = now();
+
+    printf("gateways: %d connected in %.1f ms, %ld frames resent after reconnecting\n",
+           n, (t1 - t0) * 1e3, resent);
+    printf("gateways: %ld frames acknowledged in %.2f s (%.0f frames/s)\n",
+           (long)n * sensors * frames, t2 - t1, (double)n * sensors * frames / (t2 - t1));
+    free(gw);
+    free(want);
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * pipeline_bench - per-frame cost of the stage table (pipeline.h) against
+ * the same work hand-inlined behind per-frame config checks
+ *
+ * The stages stand in for the real ones: an EMA filter, min/max/mean and
+ * the threshold check, and three sinks that only touch a small buffer, so
+ * the difference is the dispatch itself.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "pipeline.h"
+
+#define N_PIXEL 16
+#define FRAMES  10000000
+#define RUNS    3
+
+struct PipelineCtx {
+    double pix[N_PIXEL];
+    double prev[N_PIXEL];
+    double min, max, avg;
+    bool abnormal;
+    int16_t deci[N_PIXEL];
+    int64_t sink[64];
+    int pos;
+};
+
+static struct {
+    int filter;
+    bool store, history, forward, upload;
+    double alpha;
+} cfg = {1, true, true, true, false, 0.5};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void do_ema(PipelineCtx *c) {
+    for (int i = 0; i < N_PIXEL; i++) {
+        c->pix[i] = cfg.alpha * c->pix[i] + (1 - cfg.alpha) * c->prev[i];
+    }
+    memcpy(c->prev, c->pix, sizeof(c->pix));
+}
+
+static inline void do_analyze(PipelineCtx *c) {
+    double lo = c->pix[0], hi = lo, sum = 0;
+    for (int i = 0; i < N_PIXEL; i++) {
+        if (c->pix[i] < lo) lo = c->pix[i];
+        if (c->pix[i] > hi) hi = c->pix[i];
+        sum += c->pix[i];
+    }
+    c->min = lo;
+    c->max = hi;
+    c->avg = sum / N_PIXEL;
+    c->abnormal = hi > 70 || lo < 20;
+    for (int i = 0; i < N_PIXEL; i++) {
+        c->deci[i] = (int16_t)(c->pix[i] * 10 + 0.5);
+    }
+}
+
+static inline void do_sink(PipelineCtx *c, int k) {
+    c->sink[(c->pos++ + k) & 63] += c->deci[k] + c->abnormal;
+}
+
+static void stage_ema(PipelineCtx *c) { do_ema(c); }
+static void stage_analyze(PipelineCtx *c) { do_analyze(c); }
+static void stage_store(PipelineCtx *c) { do_sink(c, 1); }
+static void stage_history(PipelineCtx *c) { do_sink(c, 2); }
+static void stage_forward(PipelineCtx *c) { do_sink(c, 3); }
+
+// What sample() did before the stage table
+__attribute__((noinline)) static void inlined(PipelineCtx *c) {
+    if (cfg.filter == 1) do_ema(c);
+    do_analyze(c);
+    if (cfg.store) do_sink(c, 1);
+    if (cfg.history) do_sink(c, 2);
+    if (cfg.forward) do_sink(c, 3);
+    if (cfg.upload) do_sink(c, 4);
+}
+
+int main(void) {
+    static const PipelineStage stages[] = {
+        {"ema", stage_ema}, {"analyze", stage_analyze}, {"store", stage_store},
+        {"history", stage_history}, {"forward", stage_forward},
+    };
+    Pipeline p;
+    PipelineCtx c;
+
+    pipeline_clear(&p);
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+        pipeline_add(&p, &stages[i]);
+    }
+    memset(&c, 0, sizeof(c));
+    for (int i = 0; i < N_PIXEL; i++) {
+        c.pix[i] = 25 + i * 0.1;
+    }
+
+    for (int run = 0; run < RUNS; run++) {
+        double t0 = now();
+        for (int n = 0; n < FRAMES; n++) {
+            c.pix[n & 15] += 0.01;
+            inlined(&c);
+        }
+        double t1 = now();
+        for (int n = 0; n < FRAMES; n++) {
+            c.pix[n & 15] += 0.01;
+            pipeline_run(&p, &c);
+        }
+        double t2 = now();
+        printf("pipeline: hand-inlined %.1f ns/frame, stage table (%d stages) %.1f ns/frame\n",
+               (t1 - t0) / FRAMES * 1e9, p.n, (t2 - t1) / FRAMES * 1e9);
+    }
+    return 0;
+}
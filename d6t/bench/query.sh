@@ -0,0 +1,55 @@
+#!/bin/sh
+# d6tquery on a synthetic store (make bench): generate it with store_gen
+# unless DIR already holds one, then time the query shapes d6tquery is
+# built for, each with its scan statistics. With root the page cache is
+# dropped first, so the first run of each query is cold; the second is
+# always warm.
+#
+# Usage: query.sh [DIR [SENSORS [DAYS]]]
+#
+# With no arguments: 100 sensors x 30 days x 3 Hz (777.6M frames, about
+# 7 GB) in $TMPDIR/d6t-query-store, kept for later runs.
+
+BIN=$(cd "$(dirname "$0")/../bin" && pwd)
+DIR=${1:-${TMPDIR:-/tmp}/d6t-query-store}
+SENSORS=${2:-100}
+DAYS=${3:-30}
+export TZ=UTC
+
+if [ ! -d "$DIR" ]; then
+    "$BIN/store_gen" "$DIR" "$SENSORS" "$DAYS" || exit 1
+    echo "query: store takes $(du -sh "$DIR" | cut -f1)"
+fi
+
+# The same days store_gen puts its hot spot on, and one before it
+day() {
+    date -u -d "2025-10-01 + $1 days" +%F
+}
+HOT=$(day $((DAYS * 2 / 5)))
+ONE_SENSOR=sensor_$(printf %03d $((SENSORS > 42 ? 42 : SENSORS - 1)))
+ONE=$(day $((DAYS * 11 / 30)))
+
+run() {
+    name=$1
+    shift
+    for cache in cold warm; do
+        if [ $cache = cold ]; then
+            sync
+            echo 3 2>/dev/null > /proc/sys/vm/drop_caches || continue
+        fi
+        start=$(date +%s%N)
+        "$BIN/d6tquery" -d "$DIR" -v "$@" 2>"$DIR.stats" | wc -l > "$DIR.rows"
+        end=$(date +%s%N)
+        printf 'query: %-44s %5s %8.2f s, %s rows; %s\n' "$name" $cache \
+            "$(awk -v ns=$((end - start)) 'BEGIN {print ns / 1e9}')" "$(cat "$DIR.rows")" \
+            "$(tr '\n' ' ' < "$DIR.stats" | sed 's/^d6tquery: //')"
+    done
+    rm -f "$DIR.stats" "$DIR.rows"
+}
+
+run "one sensor, one hour, NDJSON" -s $ONE_SENSOR -f "${ONE}T09:00:00" -t "${ONE}T09:59:59" -o ndjson
+run "pixel above 60 degC, all sensors" -A 60
+run "daily frame max, all sensors" -a max -p frame -b 86400
+run "per-pixel max, all sensors" -a max
+run "hourly p95 per pixel, one sensor" -s sensor_007 -a p95 -b 3600
+run "daily frame average, all sensors, one day" -a avg -p frame -b 86400 -f "$HOT" -t "${HOT}T23:59:59" -o ndjson
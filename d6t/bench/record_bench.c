@@ -0,0 +1,163 @@
+/*
+ * record_bench - throughput of the binary frame FIFO (recorder.h) into a
+ * recording file, vmsplice() + splice() against write() + read()/write()
+ *
+ * Usage: record_bench [FRAMES [DIR]]     (default 2000000, $TMPDIR or /tmp)
+ *
+ * The recorder pool is filled with frames of four sensors and flushed every
+ * 64 or 1024 frames, as the event loop would after that many frames per
+ * wakeup, while d6trecord (same directory as this program) moves the FIFO
+ * into a file in DIR: zero copy with splice(), or with -c. A run ends when
+ * the file holds every frame. When the reader falls behind and the pool is
+ * full the sender yields and retries instead of dropping, so every run
+ * records the same bytes. Best of 3 runs each, with the system time of
+ * both sides.
+ */
+#include <libgen.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "recorder.h"
+#include "wire.h"
+
+#define RUNS 3
+
+static char record_bin[PATH_MAX];
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Size of one FRAME message on the FIFO; the same for every sensor id here
+static int frame_bytes(void) {
+    uint8_t msg[WIRE_MAX_MSG];
+    WireFrame wf = { .sensor_id = "sensor_0" };
+    return wire_put_frame(msg, sizeof(msg), &wf);
+}
+
+static double sys_ms(const struct rusage *ru) {
+    return ru->ru_stime.tv_sec * 1e3 + ru->ru_stime.tv_usec / 1e3;
+}
+
+typedef struct {
+    double ms;
+    double sender_sys_ms;
+    double reader_sys_ms;
+    unsigned long waits;            // Frames retried because the pool was full
+} Result;
+
+static int run(const char *dir, long frames, int batch, bool zero_copy, Result *res) {
+    char fifo[PATH_MAX], out[PATH_MAX];
+    static const char *ids[] = { "sensor_0", "sensor_1", "sensor_2", "sensor_3" };
+    struct rusage self0, self1, child;
+    RecorderStats st;
+    struct stat fst;
+    StoreFrame f;
+    int status;
+
+    snprintf(fifo, sizeof(fifo), "%s/record_bench.fifo", dir);
+    snprintf(out, sizeof(out), "%s/record_bench.d6r", dir);
+    unlink(out);
+    if (recorder_open(fifo, zero_copy) != 0) {
+        fprintf(stderr, "record_bench: cannot open %s\n", fifo);
+        return -1;
+    }
+    off_t total = (off_t)frames * frame_bytes();
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stderr);
+        execl(record_bin, record_bin, "-p", fifo, "-o", out, zero_copy ? NULL : "-c", NULL);
+        _exit(127);
+    }
+
+    getrusage(RUSAGE_SELF, &self0);
+    double t0 = now();
+    memset(&f, 0, sizeof(f));
+    for (long i = 0; i < frames; i++) {
+        f.t_ms = 1790000000000LL + i * 25 / 4;
+        f.ptat = 250;
+        for (int p = 0; p < STORE_N_PIXEL; p++) {
+            f.pix[p] = (int16_t)(200 + (i + p) % 50);
+        }
+        while (recorder_send(ids[i % 4], false, &f) != 0) {
+            recorder_flush();
+            sched_yield();
+        }
+        if ((i + 1) % batch == 0) {
+            recorder_flush();
+        }
+    }
+    // Hand over the rest, then wait for the reader to write it all
+    for (recorder_get_stats(&st); (off_t)st.bytes < total; recorder_get_stats(&st)) {
+        recorder_flush();
+        sched_yield();
+    }
+    while (stat(out, &fst) != 0 || fst.st_size < total) {
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            fprintf(stderr, "record_bench: %s exited early\n", record_bin);
+            recorder_close();
+            return -1;
+        }
+        sched_yield();
+    }
+    double t1 = now();
+    getrusage(RUSAGE_SELF, &self1);
+
+    recorder_close();
+    kill(pid, SIGTERM);
+    wait4(pid, &status, 0, &child);
+    unlink(fifo);
+    unlink(out);
+    if (fst.st_size != total) {
+        fprintf(stderr, "record_bench: recorded %lld of %lld bytes\n",
+                (long long)fst.st_size, (long long)total);
+        return -1;
+    }
+    res->ms = (t1 - t0) * 1e3;
+    res->sender_sys_ms = sys_ms(&self1) - sys_ms(&self0);
+    res->reader_sys_ms = sys_ms(&child);
+    res->waits = st.dropped;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long frames = argc > 1 ? atol(argv[1]) : 2000000;
+    const char *dir = argc > 2 ? argv[2] : getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    static const int batches[] = { 64, 1024 };
+    char self[PATH_MAX];
+
+    snprintf(self, sizeof(self), "%s", argv[0]);
+    snprintf(record_bin, sizeof(record_bin), "%s/d6trecord", dirname(self));
+    if (frames < 1 || access(record_bin, X_OK) != 0) {
+        fprintf(stderr, "Usage: %s [FRAMES [DIR]], with d6trecord next to it\n", argv[0]);
+        return 2;
+    }
+
+    printf("record_bench: %ld frames of %d bytes to %s, best of %d runs\n",
+           frames, frame_bytes(), dir, RUNS);
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        for (int zc = 1; zc >= 0; zc--) {
+            Result best = { .ms = 1e12 }, r;
+            for (int k = 0; k < RUNS; k++) {
+                if (run(dir, frames, batches[b], zc, &r) != 0) return 1;
+                if (r.ms < best.ms) best = r;
+            }
+            printf("record_bench: flush every %4d frames, %-17s %5.0f ms, "
+                   "system time sender %3.0f ms, reader %3.0f ms, %lu full-pool retries\n",
+                   batches[b], zc ? "vmsplice+splice" : "writev+read/write", best.ms,
+                   best.sender_sys_ms, best.reader_sys_ms, best.waits);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * rule_bench - cost of compiling and evaluating alert rules (rule.h) at
+ * thousands of rules: 256 sensors with 16 rules each, against parsing the
+ * rule text again on every frame
+ *
+ * The rules are five shapes that cover values, arithmetic, logic and the
+ * three kinds of duration, cycled over the sensors.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rule.h"
+
+#define SENSORS 256
+#define RULES   RULE_MAX_RULES      // Per sensor
+#define FRAMES  10000               // Per sensor
+
+static const char *const shapes[] = {
+    "max > 60 for 3 frames and ptat < 40",
+    "(p5 - avg > 8 or rise > 20) for 2 s",
+    "min < 5 or max - min > 30",
+    "not (avg >= 18 and avg <= 28) for 500 ms",
+    "p0 + p1 + p2 + p3 > 4 * p15 + 12",
+};
+#define N_SHAPES (int)(sizeof(shapes) / sizeof(shapes[0]))
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void input(RuleInput *in, int n, int s) {
+    in->t_ms = (int64_t)n * 300;
+    in->v[RULE_VAR_MAX] = 26.0f + (float)((n + s) % 7);
+    in->v[RULE_VAR_MIN] = 22.0f;
+    in->v[RULE_VAR_AVG] = 24.0f + (float)((n * 3 + s) % 5) * 0.5f;
+    in->v[RULE_VAR_PTAT] = 30.0f;
+    in->v[RULE_VAR_RISE] = (float)((n + s) % 30);
+    in->v[RULE_VAR_MEAN_RISE] = 0.5f;
+    for (int p = 0; p < 16; p++) {
+        in->v[RULE_VAR_PIXEL0 + p] = 22.0f + (float)((p * 7 + n + s) % 9);
+    }
+}
+
+int main(void) {
+    static RuleSet sets[SENSORS], scratch;
+    static RuleState states[SENSORS];
+    static RuleInput in;
+    char err[128];
+    long fired = 0;
+
+    double t0 = now();
+    for (int s = 0; s < SENSORS; s++) {
+        rule_set_clear(&sets[s]);
+        for (int r = 0; r < RULES; r++) {
+            if (rule_add(&sets[s], shapes[(s + r) % N_SHAPES], NULL, NULL, 0, err, sizeof(err)) != 0) {
+                fprintf(stderr, "rule_bench: %s\n", err);
+                return 1;
+            }
+        }
+    }
+    double t1 = now();
+    int code = 0;
+    for (int s = 0; s < SENSORS; s++) {
+        code += sets[s].n_code;
+    }
+    printf("rules: %d sensors x %d rules, %.1f instructions per rule, compile %.2f us per rule\n",
+           SENSORS, RULES, (double)code / (SENSORS * RULES),
+           (t1 - t0) / (SENSORS * RULES) * 1e6);
+
+    t0 = now();
+    for (int n = 0; n < FRAMES; n++) {
+        for (int s = 0; s < SENSORS; s++) {
+            input(&in, n, s);
+            fired += rule_eval(&sets[s], &states[s], &in) >= 0;
+        }
+    }
+    t1 = now();
+    double eval = (t1 - t0) / ((double)FRAMES * SENSORS * RULES) * 1e9;
+    printf("rules: evaluate %.1f ns per rule, %.3f ms per frame of all sensors (%ld alerts)\n",
+           eval, eval * SENSORS * RULES / 1e6, fired);
+
+    // Parsing the text every frame instead: compile each rule into a
+    // scratch set and evaluate it once
+    t0 = now();
+    for (int n = 0; n < FRAMES / 20; n++) {
+        for (int s = 0; s < SENSORS; s++) {
+            input(&in, n, s);
+            rule_set_clear(&scratch);
+            for (int r = 0; r < RULES; r++) {
+                rule_add(&scratch, shapes[(s + r) % N_SHAPES], NULL, NULL, 0, err, sizeof(err));
+            }
+            fired += rule_eval(&scratch, &states[s], &in) >= 0;
+        }
+    }
+    t1 = now();
+    printf("rules: parsing on every frame %.1f ns per rule\n",
+           (t1 - t0) / ((double)FRAMES / 20 * SENSORS * RULES) * 1e9);
+    printf("rules: RuleSet %.1f KB, RuleState %zu B per sensor\n",
+           sizeof(RuleSet) / 1024.0, sizeof(RuleState));
+    return 0;
+}
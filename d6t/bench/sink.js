@@ -0,0 +1,51 @@
+// HTTP sink for the benchmarks: accepts every POST with 200.
+//
+// Usage: node sink.js PORT [STATS_FILE]
+//
+// Without STATS_FILE the body is discarded (alloc.sh). With it, bodies are
+// taken as JSON arrays of records, gzip or not (d6taggregate batches,
+// aggregate.sh), and STATS_FILE is rewritten after each one with the
+// number of batches and records and how many of those were duplicates by
+// sensor id, date and time.
+const fs = require('fs');
+const http = require('http');
+const zlib = require('zlib');
+
+const port = parseInt(process.argv[2], 10);
+const statsFile = process.argv[3];
+const stats = { batches: 0, records: 0, unique: 0, duplicates: 0 };
+const seen = new Set();
+
+function count(body) {
+    const records = JSON.parse(body);
+    stats.batches++;
+    stats.records += records.length;
+    for (const r of records) {
+        const key = `${r.sensor_id}|${r.date}|${r.time}`;
+        if (seen.has(key)) {
+            stats.duplicates++;
+        } else {
+            seen.add(key);
+            stats.unique++;
+        }
+    }
+    fs.writeFileSync(statsFile, JSON.stringify(stats));
+}
+
+http.createServer((req, res) => {
+    const chunks = [];
+    req.on('data', (chunk) => {
+        if (statsFile) chunks.push(chunk);
+    });
+    req.on('end', () => {
+        if (statsFile) {
+            let body = Buffer.concat(chunks);
+            if (req.headers['content-encoding'] === 'gzip') {
+                body = zlib.gunzipSync(body);
+            }
+            count(body.toString());
+        }
+        res.writeHead(200, { 'Content-Length': 0 });
+        res.end();
+    });
+}).listen(port, '127.0.0.1');
@@ -0,0 +1,71 @@
+/*
+ * store_gen - fill a frame store (store.h) with synthetic frames for
+ * query.sh
+ *
+ * Usage: store_gen DIR [SENSORS [DAYS [HZ]]]     (default 100 30 3)
+ *
+ * Sensors sensor_000.. read a room that swings 4 degC over each day, with a
+ * little noise, from 2025-10-01 00:00 UTC at HZ frames per second and
+ * 300 s chunks. sensor_007 has one 65 degC hot spot on pixel 5 for one
+ * minute at 09:00 UTC on day DAYS * 2 / 5 (counting from 0), the only
+ * pixel above 60 degC in the store.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "store.h"
+
+#define START_MS 1759276800000LL   // 2025-10-01T00:00:00Z
+
+static uint32_t rng = 7;
+
+static int noise(void) {
+    rng = rng * 1664525u + 1013904223u;
+    return (int)(rng >> 16) % 5 - 2;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s DIR [SENSORS [DAYS [HZ]]]\n", argv[0]);
+        return 2;
+    }
+    int sensors = argc > 2 ? atoi(argv[2]) : 100;
+    int days = argc > 3 ? atoi(argv[3]) : 30;
+    int hz = argc > 4 ? atoi(argv[4]) : 3;
+    int64_t per_day = 86400LL * hz, frames = per_day * days;
+    int64_t hot = per_day * (days * 2 / 5) + 9 * 3600LL * hz;
+    char id[32];
+    struct timespec t0, t1;
+
+    if (sensors < 1 || days < 1 || hz < 1 || store_open(argv[1], 300) != 0) {
+        fprintf(stderr, "store_gen: cannot write %s\n", argv[1]);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int64_t i = 0; i < frames; i++) {
+        double swing = 40 * sin(2 * M_PI * (i % per_day) / per_day);
+        for (int s = 0; s < sensors; s++) {
+            StoreFrame f;
+            snprintf(id, sizeof(id), "sensor_%03d", s);
+            f.t_ms = START_MS + i * 1000 / hz + noise();
+            f.ptat = (int16_t)(240 + s % 20 + (i / 20000) % 10);
+            for (int p = 0; p < STORE_N_PIXEL; p++) {
+                f.pix[p] = (int16_t)(240 + s % 30 + swing + p + noise());
+            }
+            if (s == 7 && i >= hot && i < hot + 60 * hz) {
+                f.pix[5] = 650;
+            }
+            if (store_append(id, &f) != 0) {
+                fprintf(stderr, "store_gen: cannot append to %s\n", argv[1]);
+                return 1;
+            }
+        }
+    }
+    store_close();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("store_gen: %lld frames of %d sensors over %d days written in %.1f s\n",
+           (long long)frames * sensors, sensors, days,
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * store_roundtrip - write synthetic frames to a frame store (store.h) and
+ * read them back
+ *
+ * Usage: store_roundtrip [DAYS [HZ]]     (default 3 3)
+ *
+ * One sensor, DAYS days at HZ frames per second with timestamp jitter, a
+ * 7 s gap every 50000 frames and a full-scale spike once an hour, so that
+ * every timestamp code and the widest column deltas occur. Every frame must
+ * decode bit-exact with the checksums verified, and the index rebuilt from
+ * the chunk headers after deleting each .d6i must match the one written.
+ * Chunks lie at arbitrary byte offsets in the segments; the number that
+ * are not 8-byte aligned is reported. Also prints the store size against
+ * the same frames as SensorDataApp text lines.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "store.h"
+
+#define START_MS 1759276800000LL   // 2025-10-01T00:00:00Z
+#define SENSOR   "sensor_000"
+
+static int hz;
+
+static uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    return x ^ (x >> 16);
+}
+
+// Frame i, the same every time it is asked for
+static void make_frame(int64_t i, StoreFrame *f) {
+    f->t_ms = START_MS + 1000 + i * 1000 / hz + (i / 50000) * 7000 + hash((uint32_t)i) % 5;
+    f->ptat = (int16_t)(250 + (i / (600 * hz)) % 7);
+    for (int p = 0; p < STORE_N_PIXEL; p++) {
+        f->pix[p] = (int16_t)(220 + p + (i / (60 * hz)) % 40 +
+                              hash((uint32_t)(i * STORE_N_PIXEL + p)) % 5);
+    }
+    if (i % (3600 * hz) == 1800) {
+        f->pix[3] = INT16_MIN;
+        f->pix[4] = INT16_MAX;
+    }
+}
+
+// Size of the frame as a text line on the FIFO (stage_log in sensor.c)
+static int text_bytes(const StoreFrame *f) {
+    char line[512], date[16];
+    time_t secs = (time_t)(f->t_ms / 1000);
+    struct tm tm;
+    int len;
+
+    gmtime_r(&secs, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d", &tm);
+    len = snprintf(line, sizeof(line), "id: %s, date: %s, time: %02d:%02d:%02d:%03d, "
+                   "PTAT: %4.1f [degC], Temperature: ", SENSOR, date, tm.tm_hour,
+                   tm.tm_min, tm.tm_sec, (int)(f->t_ms % 1000), f->ptat / 10.0);
+    for (int p = 0; p < STORE_N_PIXEL; p++) {
+        len += snprintf(line + len, sizeof(line) - len, "%4.1f%s", f->pix[p] / 10.0,
+                        p < STORE_N_PIXEL - 1 ? ", " : " [degC]\n");
+    }
+    return len;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int days = argc > 1 ? atoi(argv[1]) : 3;
+    hz = argc > 2 ? atoi(argv[2]) : 3;
+    int64_t frames = 86400LL * hz * days;
+    char dir[] = "/tmp/store_roundtrip.XXXXXX";
+    char path[512], ipath[512];
+    static StoreChunk chunk;
+    StoreFrame f;
+    long long store_bytes = 0, text = 0;
+    int chunks = 0, unaligned = 0, bad = 0;
+
+    if (days < 1 || hz < 1 || !mkdtemp(dir) || store_open(dir, 300) != 0) {
+        fprintf(stderr, "Usage: %s [DAYS [HZ]]\n", argv[0]);
+        return 2;
+    }
+    double t0 = now();
+    for (int64_t i = 0; i < frames; i++) {
+        make_frame(i, &f);
+        text += text_bytes(&f);
+        if (store_append(SENSOR, &f) != 0) {
+            fprintf(stderr, "store_roundtrip: cannot append frame %lld\n", (long long)i);
+            return 1;
+        }
+    }
+    store_close();
+    double t1 = now();
+
+    // Read back in order, segment by segment
+    int64_t i = 0, last_day = (START_MS + 1000 + frames * 1000 / hz + frames / 50000 * 7000) /
+                              STORE_DAY_MS;
+    for (int64_t day = START_MS / STORE_DAY_MS; day <= last_day; day++) {
+        StoreSegment seg;
+        store_segment_path(path, sizeof(path), dir, SENSOR, day);
+        if (store_segment_open(path, &seg) != 0) continue;
+        store_bytes += (long long)seg.data_len + seg.n_chunks * (long long)sizeof(StoreIndexEntry);
+
+        for (int c = 0; c < seg.n_chunks; c++, chunks++) {
+            if (seg.index[c].offset % 8 != 0) unaligned++;
+            if (store_chunk_decode(&seg, c, STORE_COLS_ALL | STORE_DECODE_VERIFY, &chunk) != 0) {
+                fprintf(stderr, "store_roundtrip: %s: chunk %d does not decode\n", path, c);
+                return 1;
+            }
+            for (int k = 0; k < chunk.n; k++, i++) {
+                make_frame(i, &f);
+                bool same = chunk.t[k] == f.t_ms && chunk.col[STORE_COL_PTAT][k] == f.ptat;
+                for (int p = 0; p < STORE_N_PIXEL; p++) {
+                    same = same && chunk.col[STORE_COL_PIXEL(p)][k] == f.pix[p];
+                }
+                if (!same && bad++ < 5) {
+                    fprintf(stderr, "store_roundtrip: frame %lld differs\n", (long long)i);
+                }
+            }
+        }
+
+        // The same index again, from the chunk headers alone
+        StoreIndexEntry *written = malloc(seg.n_chunks * sizeof(*written));
+        int n = seg.n_chunks;
+        memcpy(written, seg.index, n * sizeof(*written));
+        store_segment_close(&seg);
+        store_index_path(ipath, sizeof(ipath), path);
+        unlink(ipath);
+        if (store_segment_open(path, &seg) != 0 || seg.n_chunks != n ||
+            memcmp(seg.index, written, n * sizeof(*written)) != 0) {
+            fprintf(stderr, "store_roundtrip: %s: rebuilt index differs\n", path);
+            return 1;
+        }
+        store_segment_close(&seg);
+        free(written);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, SENSOR);
+    rmdir(path);
+    rmdir(dir);
+    double t2 = now();
+
+    printf("store_roundtrip: %lld frames written in %.2f s, read back and checked in %.2f s\n",
+           (long long)frames, t1 - t0, t2 - t1);
+    printf("store_roundtrip: %d chunks, %d of them not 8-byte aligned; rebuilt indexes match\n",
+           chunks, unaligned);
+    printf("store_roundtrip: store %.1f MB (%.1f B/frame), text lines %.1f MB (%.1f%%)\n",
+           store_bytes / 1e6, (double)store_bytes / frames, text / 1e6, 100.0 * store_bytes / text);
+    if (i != frames || bad > 0) {
+        printf("store_roundtrip: FAILED: %lld of %lld frames read back, %d differ\n",
+               (long long)i, (long long)frames, bad);
+        return 1;
+    }
+    printf("store_roundtrip: every frame bit-exact\n");
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * trend_bench - per-frame cost of the incremental rate-of-rise fit
+ * (trend.h) against refitting the window on every frame, at increasing
+ * sensor counts, and how closely and how quickly it tracks a real rise
+ *
+ * Frames arrive every 300 ms with the default 10 s window and limits
+ * (config.c). Each sensor reads a flat room with a little noise, so the
+ * timing runs raise no alerts.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "trend.h"
+
+#define INTERVAL_MS 300
+#define PUSHES      1000000     // Frames per timing run, across all sensors
+
+// The window refitted from scratch on every frame
+typedef struct {
+    int64_t t_ms[TREND_MAX_FRAMES];
+    float y[TREND_MAX_FRAMES][TREND_CHANNELS];
+    int head, count;
+} Refit;
+
+static AppConfig cfg;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void frame(uint32_t *rng, double base, double *pix) {
+    for (int p = 0; p < TREND_N_PIXEL; p++) {
+        *rng = *rng * 1664525u + 1013904223u;
+        pix[p] = base + p * 0.1 + (double)(*rng >> 8) / (1u << 24) * 0.05;
+    }
+}
+
+static void refit_push(Refit *r, int64_t t_ms, const double *pix, int window_ms) {
+    while (r->count > 0 && (r->count == TREND_MAX_FRAMES ||
+           t_ms - r->t_ms[(r->head - r->count + TREND_MAX_FRAMES) % TREND_MAX_FRAMES] > window_ms)) {
+        r->count--;
+    }
+    double sum = 0.0;
+    for (int p = 0; p < TREND_N_PIXEL; p++) {
+        r->y[r->head][p] = (float)pix[p];
+        sum += pix[p];
+    }
+    r->y[r->head][TREND_CH_MEAN] = (float)(sum / TREND_N_PIXEL);
+    r->t_ms[r->head] = t_ms;
+    r->head = (r->head + 1) % TREND_MAX_FRAMES;
+    r->count++;
+}
+
+// Least-squares slope of every channel in degC per minute; REAL is double
+// for the timing and long double for the reference of the accuracy check
+#define REFIT_SLOPES(name, REAL)                                                        \
+static void name(const Refit *r, double *slope) {                                       \
+    REAL n = r->count, st = 0, stt = 0, sy[TREND_CHANNELS] = {0}, sty[TREND_CHANNELS] = {0}; \
+    int first = (r->head - r->count + TREND_MAX_FRAMES) % TREND_MAX_FRAMES;             \
+                                                                                        \
+    for (int k = 0, i = first; k < r->count; k++, i = (i + 1) % TREND_MAX_FRAMES) {     \
+        REAL t = (r->t_ms[i] - r->t_ms[first]) / (REAL)1000;                            \
+        st += t;                                                                        \
+        stt += t * t;                                                                   \
+        for (int ch = 0; ch < TREND_CHANNELS; ch++) {                                   \
+            sy[ch] += r->y[i][ch];                                                      \
+            sty[ch] += t * r->y[i][ch];                                                 \
+        }                                                                               \
+    }                                                                                   \
+    REAL den = n * stt - st * st;                                                       \
+    for (int ch = 0; ch < TREND_CHANNELS; ch++) {                                       \
+        slope[ch] = r->count < 2 || den <= 0 ? 0.0 : (double)((n * sty[ch] - st * sy[ch]) / den * 60); \
+    }                                                                                   \
+}
+
+REFIT_SLOPES(refit_slopes, double)
+REFIT_SLOPES(exact_slopes, long double)
+
+static int refit_check(const Refit *r) {
+    double slope[TREND_CHANNELS];
+    int rising = 0;
+
+    refit_slopes(r, slope);
+    for (int ch = 0; ch < TREND_CHANNELS; ch++) {
+        rising |= slope[ch] >= (ch == TREND_CH_MEAN ? cfg.trend_sensor_rise : cfg.trend_pixel_rise);
+    }
+    return rising;
+}
+
+static void timing(int sensors) {
+    TrendState *ts = calloc(sensors, sizeof(*ts));
+    Refit *rf = calloc(sensors, sizeof(*rf));
+    int cycles = PUSHES / sensors, window_ms = cfg.trend_window_s * 1000, hits = 0;
+    uint32_t rng = 1;
+    double pix[TREND_N_PIXEL];
+
+    double t0 = now();
+    for (int c = 0; c < cycles; c++) {
+        for (int s = 0; s < sensors; s++) {
+            frame(&rng, 25.0, pix);
+            trend_push(&ts[s], (int64_t)c * INTERVAL_MS, pix, window_ms);
+            hits += trend_check(&ts[s], &cfg) != NULL;
+        }
+    }
+    double t1 = now();
+    for (int c = 0; c < cycles; c++) {
+        for (int s = 0; s < sensors; s++) {
+            frame(&rng, 25.0, pix);
+            refit_push(&rf[s], (int64_t)c * INTERVAL_MS, pix, window_ms);
+            hits += refit_check(&rf[s]);
+        }
+    }
+    double t2 = now();
+    double inc = (t1 - t0) / ((double)cycles * sensors) * 1e9;
+    double ref = (t2 - t1) / ((double)cycles * sensors) * 1e9;
+    printf("trend: %4d sensors: incremental %6.0f ns/frame, refit %6.0f ns/frame, "
+           "%.2f vs %.2f ms per %d ms cycle%s\n", sensors, inc, ref,
+           inc * sensors / 1e6, ref * sensors / 1e6, INTERVAL_MS, hits ? " (alerts!)" : "");
+    free(ts);
+    free(rf);
+}
+
+// Largest difference from the exact refit over a long noisy run with drift
+static void accuracy(void) {
+    static TrendState ts;
+    static Refit rf;
+    int window_ms = cfg.trend_window_s * 1000;
+    uint32_t rng = 7;
+    double pix[TREND_N_PIXEL], ref[TREND_CHANNELS], worst = 0.0;
+
+    for (int n = 0; n < 100000; n++) {
+        // Jittered frame times and a slow swing of a few degrees
+        int64_t t_ms = (int64_t)n * INTERVAL_MS + (n * 37) % 11;
+        frame(&rng, 25.0 + 3.0 * sin(n / 500.0), pix);
+        trend_push(&ts, t_ms, pix, window_ms);
+        refit_push(&rf, t_ms, pix, window_ms);
+        exact_slopes(&rf, ref);
+        for (int ch = 0; ch < TREND_CHANNELS; ch++) {
+            double d = fabs(trend_slope(&ts, ch) - ref[ch]);
+            if (d > worst) worst = d;
+        }
+    }
+    printf("trend: 100000 frames, largest difference from an exact refit %.1e degC/min\n", worst);
+}
+
+// Seconds from the start of a ramp to the first alert
+static void latency(double rate) {
+    static TrendState ts;
+    int window_ms = cfg.trend_window_s * 1000;
+    uint32_t rng = 3;
+    double pix[TREND_N_PIXEL];
+
+    trend_reset(&ts);
+    for (int n = 0; n < 1000; n++) {
+        int ramp = n - 100;     // 30 s flat first
+        frame(&rng, 25.0 + (ramp > 0 ? rate * ramp * INTERVAL_MS / 60000.0 : 0.0), pix);
+        trend_push(&ts, (int64_t)n * INTERVAL_MS, pix, window_ms);
+        if (trend_check(&ts, &cfg)) {
+            printf("trend: ramp of %g degC/min alerts after %.1f s (limit %g)\n",
+                   rate, ramp * INTERVAL_MS / 1000.0, cfg.trend_pixel_rise);
+            return;
+        }
+    }
+    printf("trend: ramp of %g degC/min never alerts\n", rate);
+}
+
+int main(void) {
+    static const int counts[] = {16, 256, 4096};
+
+    config_defaults(&cfg);
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        timing(counts[i]);
+    }
+    printf("trend: state %.1f KB per sensor\n", sizeof(TrendState) / 1024.0);
+    accuracy();
+    latency(12.0);
+    latency(20.0);
+    latency(60.0);
+    return 0;
+}
@@ -0,0 +1,936 @@
+/*
+ * d6taggregate - multi-gateway aggregation node
+ *
+ * Accepts frame streams (wire.h) from the SensorDataApp forwarders of many
+ * gateways on aggregator.port, drops frames already seen by (sensor id,
+ * session, sequence), and posts the rest upstream as JSON arrays of
+ * temperature records to server.endpoints.backfill, gzip-compressed, over
+ * aggregator.concurrency keep-alive connections.
+ *
+ * A gateway's frames are acknowledged once every batch holding them has
+ * been accepted by the server, so frames lost in a crash here are resent by
+ * the gateways. When more than aggregator.queue batches wait for the
+ * server, reading from gateways stops until half of them have been sent,
+ * so a slow server backs up into the gateways' resend windows rather than
+ * into memory here.
+ */
+#define _GNU_SOURCE             // accept4
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+#include "config.h"
+#include "logger.h"
+#include "json.h"
+#include "alert.h"
+#include "evloop.h"
+#include "http.h"
+#include "store.h"
+#include "wire.h"
+#include "timestamp.h"
+
+#define AGG_MAX_CONNS       32
+#define AGG_RBUF_SIZE       4096
+#define AGG_RECORD_MAX      512
+#define AGG_STREAM_SLOTS    8192            // Power of two, at most half used
+#define AGG_STREAM_IDLE_MS  (60 * 60 * 1000)
+#define AGG_SWEEP_MS        60000
+#define AGG_DRAIN_MS        10000           // Time given to queued batches at shutdown
+#define AGG_BACKOFF_MIN     200
+#define AGG_BACKOFF_MAX     30000
+#define AGG_GATEWAY_MARKS   8
+
+// One connected gateway
+typedef struct Gateway {
+    struct Gateway *prev;
+    struct Gateway *next;
+    int fd;
+    char peer[INET_ADDRSTRLEN + 8];
+    char name[WIRE_MAX_NAME];
+    uint32_t session;
+    bool hello;
+    uint64_t frames;                // FRAME messages read on this connection
+    uint64_t acked;                 // Last count sent back
+
+    // Frame count reached in each batch this gateway added to, oldest
+    // first. When the list is full the newest entry is moved forward, which
+    // only delays acknowledgements.
+    struct {
+        uint64_t batch;
+        uint64_t frames;
+    } marks[AGG_GATEWAY_MARKS];
+    int n_marks;
+    uint8_t rbuf[AGG_RBUF_SIZE];
+    int rlen;
+    uint8_t abuf[16];               // ACK the socket has not taken in full
+    int alen;
+    int apos;
+    bool want_out;                  // EPOLLOUT requested for the rest of it
+} Gateway;
+
+// Highest sequence seen per sensor and gateway session
+typedef struct {
+    bool used;
+    uint32_t session;
+    uint32_t next_seq;
+    int64_t last_ms;
+    char sensor_id[32];
+} Stream;
+
+typedef struct Batch {
+    struct Batch *next;             // Send queue
+    struct Batch *next_built;       // Build order, until committed
+    uint64_t seq;
+    bool done;                      // Accepted or permanently rejected
+    char *req;                      // Complete HTTP request
+    int len;
+    int records;
+} Batch;
+
+typedef enum {
+    CONN_IDLE,
+    CONN_CONNECTING,
+    CONN_OPEN
+} ConnState;
+
+typedef struct {
+    int fd;
+    ConnState state;
+    Batch *batch;                   // In flight on this connection
+    int wpos;
+    char rbuf[AGG_RBUF_SIZE];
+    int rlen;
+    HttpResponse resp;
+    int timer_fd;                   // Backoff wakeups
+    bool waiting;
+    int backoff_ms;
+} Conn;
+
+static AppConfig config;
+static struct sockaddr_in server;
+static int listen_fd = -1;
+static Gateway *gateways;
+static int n_gateways;
+static bool paused;
+static bool stopping;
+
+static Stream *streams;
+static int n_streams;
+
+static Batch *queue_head;           // Built, waiting for a connection
+static Batch *queue_tail;
+static int queued;
+static Batch *built_head;           // Not yet committed, in build order
+static Batch *built_tail;
+static uint64_t open_seq;           // Sequence of the batch being filled
+static uint64_t committed_seq;      // All batches below this are done
+static Conn conns[AGG_MAX_CONNS];
+static int n_conns;
+
+static char *json_buf;              // Records of the open batch
+static size_t json_used;
+static int json_records;
+
+static struct {
+    uint64_t frames;
+    uint64_t duplicates;
+    uint64_t gaps;                  // Frames missing from a stream (dropped by a gateway)
+    uint64_t batches;
+    uint64_t failed;                // Batches rejected by the server
+    uint64_t retries;
+    uint64_t raw_bytes;
+    uint64_t sent_bytes;
+    uint64_t accepted;              // Gateway connections
+} stats;
+
+static void pump(void);
+static void conn_event(int fd, uint32_t events, void *arg);
+static void gateway_event(int fd, uint32_t events, void *arg);
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Deduplication */
+
+static uint32_t stream_hash(const char *id, uint32_t session) {
+    uint32_t h = 2166136261u ^ session;
+    for (const char *p = id; *p; p++) {
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    }
+    return h;
+}
+
+static Stream *stream_find(const char *id, uint32_t session) {
+    uint32_t i = stream_hash(id, session) & (AGG_STREAM_SLOTS - 1);
+    while (streams[i].used) {
+        if (streams[i].session == session && strcmp(streams[i].sensor_id, id) == 0) {
+            return &streams[i];
+        }
+        i = (i + 1) & (AGG_STREAM_SLOTS - 1);
+    }
+    if (n_streams >= AGG_STREAM_SLOTS / 2) return NULL;
+    streams[i].used = true;
+    streams[i].session = session;
+    streams[i].next_seq = 0;
+    snprintf(streams[i].sensor_id, sizeof(streams[i].sensor_id), "%s", id);
+    n_streams++;
+    return &streams[i];
+}
+
+// Forget streams not seen for AGG_STREAM_IDLE_MS (gateways restarted with a
+// new session) by rehashing the rest
+static void stream_sweep(void) {
+    static Stream old[AGG_STREAM_SLOTS];
+    int64_t cutoff = now_ms() - AGG_STREAM_IDLE_MS;
+
+    memcpy(old, streams, sizeof(old));
+    memset(streams, 0, sizeof(old));
+    n_streams = 0;
+    for (int i = 0; i < AGG_STREAM_SLOTS; i++) {
+        if (!old[i].used || old[i].last_ms < cutoff) continue;
+        Stream *s = stream_find(old[i].sensor_id, old[i].session);
+        *s = old[i];
+    }
+}
+
+/* Batches */
+
+// The same record the live uploader and the Node.js controller send; the
+// status is the one the gateway determined with its own thresholds
+static int format_record(const WireFrame *f, char *out, size_t size) {
+    char id[48];
+    TsText stamp;
+    double sum = 0.0;
+    int len;
+
+    ts_format(f->frame.t_ms * 1000000, &stamp);
+    json_write_string(id, sizeof(id), f->sensor_id);
+    len = snprintf(out, size, "{\"sensor_id\":%s,\"date\":\"%s\",\"time\":\"%s\",\"temperature_data\":[",
+                   id, stamp.date, stamp.time);
+    for (int i = 0; i < STORE_N_PIXEL; i++) {
+        len += snprintf(out + len, size - len, "%s%.1f", i ? "," : "", f->frame.pix[i] / 10.0);
+        sum += f->frame.pix[i] / 10.0;
+    }
+    len += snprintf(out + len, size - len, "],\"average_temp\":%.2f,\"status\":\"%s\"}",
+                    sum / STORE_N_PIXEL,
+                    (f->flags & WIRE_FLAG_ABNORMAL) ? STATUS_ABNORMAL : STATUS_NORMAL);
+    return len;
+}
+
+// Reading stops while paused; writing is only waited for with an ACK
+// pending
+static uint32_t gateway_events(const Gateway *g) {
+    return (paused ? 0 : EPOLLIN) | (g->want_out ? EPOLLOUT : 0);
+}
+
+static void pause_gateways(bool pause) {
+    paused = pause;
+    for (Gateway *g = gateways; g; g = g->next) {
+        evloop_mod(g->fd, gateway_events(g));
+    }
+    if (listen_fd >= 0) evloop_mod(listen_fd, pause ? 0 : EPOLLIN);
+}
+
+static void gateway_mark(Gateway *g) {
+    if (g->n_marks > 0 && g->marks[g->n_marks - 1].batch == open_seq) {
+        g->marks[g->n_marks - 1].frames = g->frames;
+        return;
+    }
+    if (g->n_marks == AGG_GATEWAY_MARKS) g->n_marks--;
+    g->marks[g->n_marks].batch = open_seq;
+    g->marks[g->n_marks].frames = g->frames;
+    g->n_marks++;
+}
+
+// Send what the socket takes of the pending ACK, and wait for EPOLLOUT
+// while some is left. Returns -1 if the connection failed.
+static int gateway_send_ack(Gateway *g) {
+    while (g->apos < g->alen) {
+        ssize_t n = send(g->fd, g->abuf + g->apos, g->alen - g->apos, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        g->apos += (int)n;
+    }
+    if (g->want_out != (g->apos < g->alen)) {
+        g->want_out = !g->want_out;
+        evloop_mod(g->fd, gateway_events(g));
+    }
+    return 0;
+}
+
+// Acknowledge the frames whose batches are all done. The count is
+// cumulative, so while an ACK is still going out, newer counts wait and
+// are sent as one when it is done. A connection that failed is closed by
+// the next read.
+static void gateway_ack(Gateway *g) {
+    uint64_t frames = g->acked;
+    int k = 0;
+
+    while (k < g->n_marks && g->marks[k].batch < committed_seq) {
+        frames = g->marks[k++].frames;
+    }
+    if (frames == g->acked || g->apos < g->alen) return;
+
+    g->alen = wire_put_ack(g->abuf, sizeof(g->abuf), frames);
+    g->apos = 0;
+    g->acked = frames;
+    memmove(g->marks, g->marks + k, (g->n_marks - k) * sizeof(g->marks[0]));
+    g->n_marks -= k;
+    gateway_send_ack(g);
+}
+
+static void batch_free(Batch *b) {
+    free(b->req);
+    free(b);
+}
+
+// Release batches that are done in build order and acknowledge what they
+// held
+static void commit_batches(void) {
+    while (built_head && built_head->done) {
+        Batch *b = built_head;
+        built_head = b->next_built;
+        if (!built_head) built_tail = NULL;
+        batch_free(b);
+    }
+    uint64_t upto = built_head ? built_head->seq : open_seq;
+    if (upto == committed_seq) return;
+    committed_seq = upto;
+    for (Gateway *g = gateways; g; g = g->next) {
+        gateway_ack(g);
+    }
+}
+
+// Compress the open batch into a request and queue it. On failure the
+// records stay in the open batch, and its sequence with them, so that no
+// gateway is acknowledged for frames that were not sent; the next flush
+// tries again. Returns 0 or -1.
+static int close_batch(void) {
+    if (json_records == 0) {
+        // Only duplicates, if anything: nothing to wait for
+        open_seq++;
+        commit_batches();
+        return 0;
+    }
+    json_buf[json_used++] = ']';
+
+    // Header, then the body compressed straight into the request buffer
+    char hdr[512];
+    uLong body_max = config.aggregator_gzip ? compressBound(json_used) + 32 : json_used;
+    Batch *b = calloc(1, sizeof(Batch));
+    char *req = malloc(sizeof(hdr) + body_max);
+    if (!b || !req) {
+        logger_log(LOG_ERROR, "Aggregator: out of memory, %d records kept for the next flush", json_records);
+        free(b);
+        free(req);
+        json_used--;
+        return -1;
+    }
+
+    const int hdr_room = (int)sizeof(hdr);
+    char *body = req + hdr_room;
+    size_t body_len = json_used;
+    if (config.aggregator_gzip) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        zs.next_in = (Bytef *)json_buf;
+        zs.avail_in = (uInt)json_used;
+        zs.next_out = (Bytef *)body;
+        zs.avail_out = (uInt)body_max;
+        int rc = deflate(&zs, Z_FINISH);
+        body_len = zs.total_out;
+        deflateEnd(&zs);
+        if (rc != Z_STREAM_END) {
+            logger_log(LOG_ERROR, "Aggregator: compression failed, %d records kept for the next flush",
+                       json_records);
+            free(b);
+            free(req);
+            json_used--;
+            return -1;
+        }
+    } else {
+        memcpy(body, json_buf, json_used);
+    }
+
+    int hlen = snprintf(hdr, sizeof(hdr),
+                        "POST %s HTTP/1.1\r\n"
+                        "Host: %s:%d\r\n"
+                        "Content-Type: application/json\r\n"
+                        "%s"
+                        "Content-Length: %zu\r\n"
+                        "Connection: keep-alive\r\n"
+                        "\r\n",
+                        config.endpoint_backfill, config.server_ip, config.server_port,
+                        config.aggregator_gzip ? "Content-Encoding: gzip\r\n" : "", body_len);
+    // Slide the header in front of the body
+    memcpy(body - hlen, hdr, hlen);
+    memmove(req, body - hlen, hlen + body_len);
+    b->req = req;
+    b->len = hlen + (int)body_len;
+    b->records = json_records;
+    b->seq = open_seq++;
+    if (built_tail) {
+        built_tail->next_built = b;
+    } else {
+        built_head = b;
+    }
+    built_tail = b;
+
+    if (queue_tail) {
+        queue_tail->next = b;
+    } else {
+        queue_head = b;
+    }
+    queue_tail = b;
+    queued++;
+    stats.batches++;
+    stats.raw_bytes += json_used;
+    json_used = 0;
+    json_records = 0;
+
+    if (!paused && !stopping && queued >= config.aggregator_queue) {
+        logger_log(LOG_WARN, "Aggregator: %d batches waiting for the server, pausing gateways", queued);
+        pause_gateways(true);
+    }
+    pump();
+    return 0;
+}
+
+// Returns -1 if the frame cannot be taken: the open batch is full and
+// still cannot be closed. The frame is then left uncounted and unseen, so
+// the gateway resends it.
+static int add_frame(Gateway *g, const WireFrame *f) {
+    if (json_records >= config.aggregator_batch && close_batch() != 0) {
+        return -1;
+    }
+
+    Stream *s = stream_find(f->sensor_id, g->session);
+
+    g->frames++;
+    gateway_mark(g);
+    if (s) {
+        if (f->seq < s->next_seq) {
+            stats.duplicates++;
+            return 0;
+        }
+        // A stream first seen mid-session (this process restarted) has no gap
+        if (s->last_ms != 0) stats.gaps += f->seq - s->next_seq;
+        s->next_seq = f->seq + 1;
+        s->last_ms = now_ms();
+    } else {
+        logger_log(LOG_ERROR, "Aggregator: stream table full, %s not deduplicated", f->sensor_id);
+    }
+
+    if (json_records == 0) json_buf[json_used++] = '[';
+    else json_buf[json_used++] = ',';
+    json_used += (size_t)format_record(f, json_buf + json_used, AGG_RECORD_MAX);
+    json_records++;
+    stats.frames++;
+    if (json_records >= config.aggregator_batch) {
+        close_batch();
+    }
+    return 0;
+}
+
+static void queue_push_front(Batch *b) {
+    b->next = queue_head;
+    queue_head = b;
+    if (!queue_tail) queue_tail = b;
+    queued++;
+}
+
+static Batch *queue_pop(void) {
+    Batch *b = queue_head;
+    if (!b) return NULL;
+    queue_head = b->next;
+    if (!queue_head) queue_tail = NULL;
+    b->next = NULL;
+    queued--;
+    if (paused && !stopping && queued <= config.aggregator_queue / 2) {
+        logger_log(LOG_INFO, "Aggregator: %d batches waiting, resuming gateways", queued);
+        pause_gateways(false);
+    }
+    return b;
+}
+
+/* Gateways */
+
+static void gateway_close(Gateway *g, const char *why) {
+    logger_log(LOG_INFO, "Aggregator: gateway %s (%s) disconnected: %s, %llu frames",
+               g->hello ? g->name : "?", g->peer, why, (unsigned long long)g->frames);
+    evloop_del(g->fd);
+    close(g->fd);
+    if (g->prev) g->prev->next = g->next;
+    else gateways = g->next;
+    if (g->next) g->next->prev = g->prev;
+    n_gateways--;
+    free(g);
+}
+
+static void gateway_event(int fd, uint32_t events, void *arg) {
+    Gateway *g = arg;
+    WireMsg msg;
+    int used, off = 0;
+    (void)fd;
+
+    if (events & EPOLLOUT) {
+        if (gateway_send_ack(g) != 0) {
+            gateway_close(g, strerror(errno));
+            return;
+        }
+        gateway_ack(g);
+        if (!(events & (EPOLLIN | EPOLLERR | EPOLLHUP))) return;
+    }
+
+    // One read per event keeps hundreds of gateways served in turn
+    ssize_t n = read(g->fd, g->rbuf + g->rlen, AGG_RBUF_SIZE - g->rlen);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        gateway_close(g, n == 0 ? "closed" : strerror(errno));
+        return;
+    }
+    if (n < 0) return;
+    g->rlen += (int)n;
+
+    while ((used = wire_get(g->rbuf + off, g->rlen - off, &msg)) > 0) {
+        off += used;
+        if (msg.type == WIRE_HELLO && !g->hello) {
+            g->hello = true;
+            g->session = msg.hello.session;
+            snprintf(g->name, sizeof(g->name), "%s", msg.hello.gateway);
+            logger_log(LOG_INFO, "Aggregator: gateway %s connected from %s (session %08x)",
+                       g->name, g->peer, g->session);
+        } else if (msg.type == WIRE_FRAME && g->hello) {
+            if (add_frame(g, &msg.frame) != 0) {
+                // Unacknowledged frames come back when the gateway reconnects
+                gateway_close(g, "batch cannot be sent");
+                return;
+            }
+        } else {
+            used = -1;
+            break;
+        }
+    }
+    if (used < 0) {
+        gateway_close(g, "protocol error");
+        return;
+    }
+    memmove(g->rbuf, g->rbuf + off, g->rlen - off);
+    g->rlen -= off;
+}
+
+static void listen_event(int fd, uint32_t events, void *arg) {
+    (void)events; (void)arg;
+
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t len = sizeof(peer);
+        int cfd = accept4(fd, (struct sockaddr *)&peer, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                logger_perror("Aggregator: accept");
+            }
+            return;
+        }
+
+        Gateway *g = calloc(1, sizeof(Gateway));
+        if (!g || evloop_add(cfd, EPOLLIN, gateway_event, g) != 0) {
+            logger_log(LOG_ERROR, "Aggregator: cannot take more gateways (%d connected)", n_gateways);
+            free(g);
+            close(cfd);
+            continue;
+        }
+        g->fd = cfd;
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+        snprintf(g->peer, sizeof(g->peer), "%s:%d", ip, ntohs(peer.sin_port));
+        g->next = gateways;
+        if (gateways) gateways->prev = g;
+        gateways = g;
+        n_gateways++;
+        stats.accepted++;
+    }
+}
+
+/* Upstream connections */
+
+static void conn_close(Conn *c) {
+    if (c->fd >= 0) {
+        evloop_del(c->fd);
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->state = CONN_IDLE;
+    c->rlen = 0;
+    http_response_reset(&c->resp);
+}
+
+// Put the batch back at the front of the queue and back off this connection
+static void conn_fail(Conn *c, const char *what) {
+    logger_log(LOG_WARN, "Aggregator: %s, retrying in %d ms", what, c->backoff_ms);
+    if (c->batch) {
+        queue_push_front(c->batch);
+        c->batch = NULL;
+        stats.retries++;
+    }
+    conn_close(c);
+    c->waiting = true;
+    evloop_timer_set(c->timer_fd, c->backoff_ms, 0);
+    c->backoff_ms *= 2;
+    if (c->backoff_ms > AGG_BACKOFF_MAX) c->backoff_ms = AGG_BACKOFF_MAX;
+}
+
+static int conn_start(Conn *c) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if ((connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0 && errno != EINPROGRESS) ||
+        evloop_add(fd, EPOLLOUT, conn_event, c) != 0) {
+        close(fd);
+        return -1;
+    }
+    c->fd = fd;
+    c->state = CONN_CONNECTING;
+    return 0;
+}
+
+static void handle_writable(Conn *c) {
+    Batch *b = c->batch;
+    while (c->wpos < b->len) {
+        ssize_t n = send(c->fd, b->req + c->wpos, b->len - c->wpos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                evloop_mod(c->fd, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            if (errno == EINTR) continue;
+            conn_fail(c, strerror(errno));
+            return;
+        }
+        c->wpos += (int)n;
+    }
+    evloop_mod(c->fd, EPOLLIN);
+}
+
+static void response_complete(Conn *c) {
+    Batch *b = c->batch;
+    int status = c->resp.status;
+
+    if (!b) {
+        conn_fail(c, "unexpected response");
+        return;
+    }
+    if (status == 408 || status == 429 || status >= 500 || status < 200) {
+        char what[64];
+        snprintf(what, sizeof(what), "HTTP %d", status);
+        conn_fail(c, what);
+        return;
+    }
+    if (status >= 300) {
+        // Rejected as invalid: retrying would never succeed
+        logger_log(LOG_ERROR, "Aggregator: batch of %d records rejected: HTTP %d", b->records, status);
+        stats.failed++;
+    }
+    b->done = true;
+    c->batch = NULL;
+    c->backoff_ms = AGG_BACKOFF_MIN;
+    commit_batches();
+    if (c->resp.close_after) conn_close(c);
+}
+
+static void handle_readable(Conn *c) {
+    for (;;) {
+        ssize_t n = read(c->fd, c->rbuf + c->rlen, AGG_RBUF_SIZE - 1 - c->rlen);
+        if (n > 0) {
+            c->rlen += (int)n;
+            int rc;
+            while ((rc = http_response_parse(&c->resp, c->rbuf, &c->rlen, AGG_RBUF_SIZE)) == 1) {
+                response_complete(c);
+                if (c->state != CONN_OPEN) break;
+            }
+            if (rc < 0) {
+                conn_fail(c, "malformed HTTP response");
+                return;
+            }
+            if (c->state != CONN_OPEN) return;
+            continue;
+        }
+        if (n == 0) {
+            if (c->resp.state == HTTP_RESP_BODY_UNTIL_CLOSE) {
+                response_complete(c);
+                conn_close(c);
+            } else if (c->batch) {
+                conn_fail(c, "connection closed by server");
+            } else {
+                conn_close(c);
+            }
+            return;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        if (errno == EINTR) continue;
+        conn_fail(c, strerror(errno));
+        return;
+    }
+}
+
+static void conn_event(int fd, uint32_t events, void *arg) {
+    Conn *c = arg;
+    (void)fd;
+
+    if (c->state == CONN_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            conn_fail(c, strerror(err));
+            return;
+        }
+        c->state = CONN_OPEN;
+        evloop_mod(c->fd, EPOLLIN);
+        if (c->batch) {
+            handle_writable(c);
+            return;
+        }
+    } else {
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            handle_readable(c);
+        }
+        if (c->state == CONN_OPEN && c->batch && (events & EPOLLOUT)) {
+            handle_writable(c);
+        }
+    }
+    pump();
+}
+
+static void conn_timer(int fd, uint32_t events, void *arg) {
+    Conn *c = arg;
+    (void)fd; (void)events;
+    c->waiting = false;
+    pump();
+}
+
+// Give every idle connection the oldest queued batch
+static void pump(void) {
+    int busy = 0;
+
+    for (int i = 0; i < n_conns; i++) {
+        Conn *c = &conns[i];
+        if (c->batch || c->waiting) {
+            busy += c->batch != NULL;
+            continue;
+        }
+        Batch *b = queue_pop();
+        if (!b) break;
+
+        c->batch = b;
+        c->wpos = 0;
+        stats.sent_bytes += (uint64_t)b->len;
+        busy++;
+        if (c->state == CONN_IDLE && conn_start(c) != 0) {
+            conn_fail(c, strerror(errno));
+            continue;
+        }
+        if (c->state == CONN_OPEN) handle_writable(c);
+    }
+
+    if (stopping && busy == 0 && !queue_head) {
+        evloop_stop();
+    }
+}
+
+/* Main */
+
+static void log_stats(void) {
+    logger_log(LOG_INFO, "Aggregator: %d gateways (%llu connections), %llu records in %llu batches, "
+               "%llu duplicates, %llu missing, %llu rejected, %llu retries, %d queued; "
+               "%llu KiB JSON sent as %llu KiB",
+               n_gateways, (unsigned long long)stats.accepted, (unsigned long long)stats.frames,
+               (unsigned long long)stats.batches, (unsigned long long)stats.duplicates,
+               (unsigned long long)stats.gaps, (unsigned long long)stats.failed,
+               (unsigned long long)stats.retries, queued,
+               (unsigned long long)(stats.raw_bytes >> 10), (unsigned long long)(stats.sent_bytes >> 10));
+}
+
+static void flush_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    close_batch();
+}
+
+static void sweep_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    stream_sweep();
+    log_stats();
+}
+
+static void drain_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    logger_log(LOG_WARN, "Aggregator: server did not take the remaining %d batches in time", queued);
+    evloop_stop();
+}
+
+// Stop reading and give the server a moment for what is queued, so the
+// gateways get their acknowledgements instead of resending to the next run
+static void signal_event(int fd, uint32_t events, void *arg) {
+    struct signalfd_siginfo si;
+    (void)events; (void)arg;
+
+    while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+        if (stopping) continue;
+        logger_log(LOG_INFO, "Aggregator: signal %d, sending queued batches", (int)si.ssi_signo);
+        if (listen_fd >= 0) {
+            evloop_del(listen_fd);
+            close(listen_fd);
+            listen_fd = -1;
+        }
+        pause_gateways(true);
+        stopping = true;
+        close_batch();
+        if (evloop_timer_add(AGG_DRAIN_MS, drain_timer, NULL) < 0) evloop_stop();
+        pump();
+    }
+}
+
+static int open_listener(void) {
+    struct sockaddr_in addr;
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)config.aggregator_port);
+    if (inet_pton(AF_INET, config.aggregator_listen, &addr.sin_addr) != 1) {
+        logger_log(LOG_ERROR, "Aggregator: invalid listen address %s", config.aggregator_listen);
+        return -1;
+    }
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        logger_perror("Aggregator: socket");
+        return -1;
+    }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        logger_log(LOG_ERROR, "Aggregator: cannot listen on %s:%d: %s",
+                   config.aggregator_listen, config.aggregator_port, strerror(errno));
+        return -1;
+    }
+    return evloop_add(listen_fd, EPOLLIN, listen_event, NULL);
+}
+
+int main(int argc, char *argv[]) {
+    const char *config_path = DEFAULT_CONFIG_PATH;
+    int opt_c;
+
+    while ((opt_c = getopt(argc, argv, "c:h")) != -1) {
+        switch (opt_c) {
+        case 'c':
+            config_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c config.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (logger_init(DEFAULT_LOG_DIR, "d6taggregate") != 0) {
+        fprintf(stderr, "Failed to initialize logger\n");
+        return 1;
+    }
+    config_defaults(&config);
+    if (config_load(config_path, &config) != 0) {
+        logger_close();
+        return 1;
+    }
+    if (strcmp(config.log_dir, DEFAULT_LOG_DIR) != 0) {
+        logger_close();
+        if (logger_init(config.log_dir, "d6taggregate") != 0) {
+            fprintf(stderr, "Failed to initialize logger\n");
+            return 1;
+        }
+    }
+    n_conns = config.aggregator_concurrency < AGG_MAX_CONNS ? config.aggregator_concurrency : AGG_MAX_CONNS;
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons((uint16_t)config.server_port);
+    if (inet_pton(AF_INET, config.server_ip, &server.sin_addr) != 1) {
+        logger_log(LOG_ERROR, "Aggregator: invalid server address %s", config.server_ip);
+        logger_close();
+        return 1;
+    }
+
+    json_buf = malloc((size_t)config.aggregator_batch * AGG_RECORD_MAX + 2);
+    streams = calloc(AGG_STREAM_SLOTS, sizeof(Stream));
+    if (!json_buf || !streams || evloop_init() != 0 || open_listener() != 0) {
+        logger_log(LOG_ERROR, "Aggregator: initialization failed");
+        logger_close();
+        return 1;
+    }
+    for (int i = 0; i < n_conns; i++) {
+        conns[i].fd = -1;
+        conns[i].backoff_ms = AGG_BACKOFF_MIN;
+        http_response_reset(&conns[i].resp);
+        conns[i].timer_fd = evloop_timer_add(0, conn_timer, &conns[i]);
+        if (conns[i].timer_fd < 0) {
+            logger_close();
+            return 1;
+        }
+    }
+    int flush_tfd = evloop_timer_add(config.aggregator_flush_ms > 0 ? config.aggregator_flush_ms : 1000,
+                                     flush_timer, NULL);
+    int sweep_tfd = evloop_timer_add(AGG_SWEEP_MS, sweep_timer, NULL);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (flush_tfd < 0 || sweep_tfd < 0 || sig_fd < 0 ||
+        evloop_add(sig_fd, EPOLLIN, signal_event, NULL) != 0) {
+        logger_perror("Aggregator: setup");
+        logger_close();
+        return 1;
+    }
+
+    logger_log(LOG_INFO, "Aggregator: listening on %s:%d, posting to http://%s:%d%s "
+               "(batch %d, flush %d ms, %d in flight, queue %d%s)",
+               config.aggregator_listen, config.aggregator_port, config.server_ip, config.server_port,
+               config.endpoint_backfill, config.aggregator_batch, config.aggregator_flush_ms, n_conns,
+               config.aggregator_queue, config.aggregator_gzip ? ", gzip" : "");
+    evloop_run();
+
+    log_stats();
+    while (gateways) gateway_close(gateways, "shutting down");
+    for (int i = 0; i < n_conns; i++) {
+        conn_close(&conns[i]);
+    }
+    while (built_head) {
+        Batch *b = built_head;
+        built_head = b->next_built;
+        batch_free(b);
+    }
+    free(streams);
+    free(json_buf);
+    evloop_close();
+    logger_close();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "alert.h"
+#include "logger.h"
+
+#define ALERT_MAX_SENSORS 64
+
+static bool sensorAlertState[ALERT_MAX_SENSORS];
+
+void alert_analyze(const AppConfig *cfg, const double *pix, int n, TempAnalysis *out) {
+    double sum = 0.0;
+    int i;
+
+    out->min_temp = pix[0];
+    out->max_temp = pix[0];
+    for (i = 0; i < n; i++) {
+        if (pix[i] < out->min_temp) out->min_temp = pix[i];
+        if (pix[i] > out->max_temp) out->max_temp = pix[i];
+        sum += pix[i];
+    }
+    out->avg_temp = sum / n;
+    out->is_abnormal = false;
+    out->alert_reason[0] = '\0';
+
+    // Same reason strings as temperatureController.js (%g matches JS number output)
+    if (out->max_temp > cfg->threshold_max) {
+        out->is_abnormal = true;
+        snprintf(out->alert_reason, sizeof(out->alert_reason),
+                 "温度が %g°C超えました", cfg->threshold_max);
+        logger_log(LOG_WARN, "Abnormal temperature detected: %.1f°C exceeds maximum threshold of %g°C",
+                   out->max_temp, cfg->threshold_max);
+    } else if (out->min_temp < cfg->threshold_min) {
+        out->is_abnormal = true;
+        snprintf(out->alert_reason, sizeof(out->alert_reason),
+                 "温度が %g°C未満になりました", cfg->threshold_min);
+        logger_log(LOG_WARN, "Abnormal temperature detected: %.1f°C below minimum threshold of %g°C",
+                   out->min_temp, cfg->threshold_min);
+    }
+}
+
+bool alert_check_transition(int sensor, bool is_abnormal) {
+    if (sensor < 0 || sensor >= ALERT_MAX_SENSORS) return false;
+    if (sensorAlertState[sensor] == is_abnormal) return false;
+    sensorAlertState[sensor] = is_abnormal;
+    return true;
+}
+
+void alert_reset(int sensor) {
+    if (sensor < 0 || sensor >= ALERT_MAX_SENSORS) return;
+    sensorAlertState[sensor] = false;
+}
+
+bool alert_get_state(int sensor) {
+    return sensor >= 0 && sensor < ALERT_MAX_SENSORS && sensorAlertState[sensor];
+}
+
+void alert_set_state(int sensor, bool is_abnormal) {
+    if (sensor < 0 || sensor >= ALERT_MAX_SENSORS) return;
+    sensorAlertState[sensor] = is_abnormal;
+}
+
+static int base64_encode(const uint8_t *in, int len, char *out, size_t size) {
+    static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t n = 0;
+
+    if ((size_t)(len + 2) / 3 * 4 + 1 > size) return -1;
+    for (int i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[n++] = tbl[(v >> 18) & 63];
+        out[n++] = tbl[(v >> 12) & 63];
+        out[n++] = i + 1 < len ? tbl[(v >> 6) & 63] : '=';
+        out[n++] = i + 2 < len ? tbl[v & 63] : '=';
+    }
+    out[n] = '\0';
+    return (int)n;
+}
+
+int alert_encode_history(const StoreFrame *frames, int n, char *out, size_t size) {
+    static int64_t t[STORE_MAX_CHUNK_FRAMES];
+    static int16_t cols[STORE_N_COLS][STORE_MAX_CHUNK_FRAMES];
+    static uint8_t chunk[16384];
+
+    if (n > STORE_MAX_CHUNK_FRAMES) {
+        frames += n - STORE_MAX_CHUNK_FRAMES;
+        n = STORE_MAX_CHUNK_FRAMES;
+    }
+    // Halve the window, keeping the newest frames, until it fits
+    for (; n > 0; frames += n - n / 2, n /= 2) {
+        for (int i = 0; i < n; i++) {
+            t[i] = frames[i].t_ms;
+            cols[STORE_COL_PTAT][i] = frames[i].ptat;
+            for (int p = 0; p < STORE_N_PIXEL; p++) {
+                cols[STORE_COL_PIXEL(p)][i] = frames[i].pix[p];
+            }
+        }
+        int len = store_chunk_encode(t, cols, n, chunk, sizeof(chunk));
+        if (len > 0 && base64_encode(chunk, len, out, size) >= 0) {
+            return n;
+        }
+    }
+    return -1;
+}
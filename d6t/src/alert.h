@@ -0,0 +1,48 @@
+#ifndef ALERT_H
+#define ALERT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
+#include "store.h"
+
+// Threshold analysis and alert transitions, mirroring the Node.js
+// temperatureController/alertController so that single-hop mode produces
+// the same records.
+
+#define STATUS_NORMAL   "0 ：正常"
+#define STATUS_ABNORMAL "１：異常"
+#define ALERT_RECOVERY_REASON "温度が正常範囲に戻りました"
+
+#define ALERT_HISTORY_MAX_FRAMES 128    // Recent frames kept per sensor
+#define ALERT_HISTORY_MAX_B64    3072   // Encoded history limit, keeps an alert line within PIPE_BUF
+
+typedef struct {
+    bool is_abnormal;
+    double min_temp;
+    double max_temp;
+    double avg_temp;
+    char alert_reason[128];
+} TempAnalysis;
+
+// Check one frame against config thresholds
+void alert_analyze(const AppConfig *cfg, const double *pix, int n, TempAnalysis *out);
+
+// Record the current state of a sensor. Returns true when it differs from
+// the previous state, i.e. when an alert or recovery record must be sent.
+bool alert_check_transition(int sensor, bool is_abnormal);
+
+// Forget the state of a sensor slot (sensor removed or replaced)
+void alert_reset(int sensor);
+
+// Last state reported for a sensor slot, and setting it on a warm restart
+bool alert_get_state(int sensor);
+void alert_set_state(int sensor, bool is_abnormal);
+
+// Encode frames (oldest first) as one store chunk (see store.h), base64,
+// for the history attached to an alert. The oldest frames are left out
+// until the result fits in size. Returns the number of frames encoded, or
+// -1 if none fit.
+int alert_encode_history(const StoreFrame *frames, int n, char *out, size_t size);
+
+#endif // ALERT_H
@@ -0,0 +1,1025 @@
+/*
+ * d6tbackfill - upload historical frames to the API server
+ *
+ * Frames are read from the frame store (default) or from capture files
+ * (SensorDataApp logs or saved pipe output, -l) and posted as JSON arrays of
+ * temperature records to server.endpoints.backfill, gzip-compressed, over
+ * up to backfill.concurrency keep-alive connections.
+ *
+ * Progress is checkpointed per sensor (store) or per file (captures), so an
+ * interrupted run resumes where the server last acknowledged. Uploads are
+ * rate-limited and marked low priority so live traffic keeps the link.
+ */
+#define _GNU_SOURCE             // strptime, timegm
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <ctype.h>
+#include <signal.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+#include "config.h"
+#include "logger.h"
+#include "json.h"
+#include "alert.h"
+#include "evloop.h"
+#include "http.h"
+#include "store.h"
+#include "timestamp.h"
+
+#define BACKFILL_MAX_KEYS    1024
+#define BACKFILL_MAX_CONNS   32
+#define BACKFILL_RECORD_MAX  512
+#define BACKFILL_RBUF_SIZE   4096
+#define BACKFILL_BACKOFF_MIN 200
+#define BACKFILL_BACKOFF_MAX 30000
+#define CHECKPOINT_MS        5000
+#define IPTOS_LOW_EFFORT     0x20   // DSCP CS1, below best effort
+
+typedef struct {
+    int key;                        // Checkpoint key (sensor or capture file)
+    int64_t pos;                    // Checkpoint position after this frame
+    char sensor_id[32];
+    char date[16];
+    char time[16];
+    double pix[STORE_N_PIXEL];
+} Frame;
+
+// Checkpoint entry: last acknowledged frame time (store) or file offset
+typedef struct {
+    char name[256];
+    int64_t pos;
+} CheckpointKey;
+
+typedef enum {
+    BATCH_FREE,
+    BATCH_QUEUED,                   // Built, waiting for a connection
+    BATCH_SENDING,
+    BATCH_DONE                      // Acknowledged or permanently rejected
+} BatchState;
+
+typedef struct {
+    BatchState state;
+    uint64_t seq;                   // Build order, for the checkpoint watermark
+    int key;
+    int64_t pos;                    // Checkpoint position after the last record
+    int records;
+    char *req;                      // Complete HTTP request
+    int len;
+    int attempts;
+} Batch;
+
+typedef enum {
+    CONN_IDLE,
+    CONN_CONNECTING,
+    CONN_OPEN
+} ConnState;
+
+typedef struct {
+    int fd;
+    ConnState state;
+    Batch *batch;                   // In flight on this connection
+    int wpos;
+    char rbuf[BACKFILL_RBUF_SIZE];
+    int rlen;
+    HttpResponse resp;
+    int timer_fd;                   // Backoff and rate-limit wakeups
+    bool waiting;
+    int backoff_ms;
+} Conn;
+
+static AppConfig config;
+static struct sockaddr_in server;
+
+static struct {
+    bool captures;                  // Reading capture files instead of the store
+    char **inputs;                  // Sensors or capture files, in order
+    int n_inputs;
+    int64_t from;
+    int64_t to;
+    bool reset;
+} opt = { .from = INT64_MIN, .to = INT64_MAX };
+
+static CheckpointKey keys[BACKFILL_MAX_KEYS];
+static int n_keys;
+static bool checkpoint_dirty;
+
+static Batch *batches;              // One per connection
+static Conn conns[BACKFILL_MAX_CONNS];
+static int n_conns;
+static uint64_t next_seq;
+static uint64_t committed_seq;      // All batches below this are acknowledged
+static bool source_done;
+static bool build_failed;           // A batch could not be built: send no more
+static bool stopping;
+
+static char *json_buf;              // Uncompressed batch body
+static size_t json_cap;
+
+static struct {
+    uint64_t frames;
+    uint64_t skipped;               // Unparsable capture lines
+    uint64_t batches;
+    uint64_t failed;                // Batches rejected by the server
+    uint64_t retries;
+    uint64_t raw_bytes;
+    uint64_t sent_bytes;
+    int64_t started_ms;
+} stats;
+
+static void pump(void);
+static void conn_event(int fd, uint32_t events, void *arg);
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Checkpoints */
+
+static int key_find(const char *name) {
+    for (int k = 0; k < n_keys; k++) {
+        if (strcmp(keys[k].name, name) == 0) return k;
+    }
+    if (n_keys == BACKFILL_MAX_KEYS) return -1;
+    snprintf(keys[n_keys].name, sizeof(keys[n_keys].name), "%s", name);
+    keys[n_keys].pos = opt.captures ? 0 : INT64_MIN;
+    return n_keys++;
+}
+
+static void checkpoint_load(void) {
+    char line[320], name[256];
+    long long pos;
+    FILE *fp = fopen(config.backfill_checkpoint, "r");
+
+    if (!fp) return;
+    while (fgets(line, sizeof(line), fp)) {
+        // Lines are "<store|capture> <pos> <name>"
+        char kind[16];
+        if (sscanf(line, "%15s %lld %255[^\n]", kind, &pos, name) != 3) continue;
+        if (strcmp(kind, opt.captures ? "capture" : "store") != 0) continue;
+        int k = key_find(name);
+        if (k >= 0) keys[k].pos = pos;
+    }
+    fclose(fp);
+    logger_log(LOG_INFO, "Backfill: resuming from %s (%d entries)", config.backfill_checkpoint, n_keys);
+}
+
+// Rewrite the checkpoint file atomically. Entries of the other source kind
+// are kept as they were.
+static void checkpoint_save(void) {
+    char tmp[300], line[320], kind[16];
+    const char *mine = opt.captures ? "capture" : "store";
+
+    if (!checkpoint_dirty) return;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", config.backfill_checkpoint);
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        logger_log(LOG_ERROR, "Backfill: cannot write %s: %s", tmp, strerror(errno));
+        return;
+    }
+    FILE *in = fopen(config.backfill_checkpoint, "r");
+    if (in) {
+        while (fgets(line, sizeof(line), in)) {
+            if (sscanf(line, "%15s", kind) == 1 && strcmp(kind, mine) != 0) fputs(line, out);
+        }
+        fclose(in);
+    }
+    for (int k = 0; k < n_keys; k++) {
+        if (keys[k].pos != INT64_MIN) {
+            fprintf(out, "%s %lld %s\n", mine, (long long)keys[k].pos, keys[k].name);
+        }
+    }
+    if (fflush(out) != 0 || fdatasync(fileno(out)) != 0) {
+        logger_log(LOG_ERROR, "Backfill: cannot write %s: %s", tmp, strerror(errno));
+        fclose(out);
+        return;
+    }
+    fclose(out);
+    if (rename(tmp, config.backfill_checkpoint) != 0) {
+        logger_log(LOG_ERROR, "Backfill: cannot replace %s: %s", config.backfill_checkpoint, strerror(errno));
+        return;
+    }
+    checkpoint_dirty = false;
+}
+
+// Advance the checkpoint over batches acknowledged in build order. A batch
+// slot is only reused after every earlier batch has been acknowledged, so a
+// resumed run never skips records that were not delivered.
+static void commit_batches(void) {
+    bool found = true;
+    while (found) {
+        found = false;
+        for (int i = 0; i < n_conns; i++) {
+            Batch *b = &batches[i];
+            if (b->state == BATCH_DONE && b->seq == committed_seq) {
+                keys[b->key].pos = b->pos;
+                checkpoint_dirty = true;
+                b->state = BATCH_FREE;
+                committed_seq++;
+                found = true;
+            }
+        }
+    }
+}
+
+/* Sources */
+
+static int parse_time(const char *s, int64_t *out) {
+    struct tm tm;
+    const char *end;
+    bool digits = *s != '\0';
+
+    for (const char *p = s; *p; p++) {
+        if (!isdigit((unsigned char)*p)) digits = false;
+    }
+    if (digits) {
+        *out = strtoll(s, NULL, 10);    // Epoch milliseconds
+        return 0;
+    }
+    memset(&tm, 0, sizeof(tm));
+    if ((end = strptime(s, "%Y-%m-%dT%H:%M:%S", &tm)) == NULL &&
+        (end = strptime(s, "%Y-%m-%d %H:%M:%S", &tm)) == NULL &&
+        (end = strptime(s, "%Y-%m-%d", &tm)) == NULL) {
+        return -1;
+    }
+    if (*end != '\0') return -1;
+    tm.tm_isdst = -1;
+    *out = (int64_t)mktime(&tm) * 1000;
+    return 0;
+}
+
+// Store: sensors in order, then days, chunks and frames
+static struct {
+    int input;
+    int key;
+    int64_t days[4096];
+    int n_days;
+    int day;
+    StoreSegment seg;
+    bool seg_open;
+    int chunk;
+    int frame;
+    StoreChunk data;
+} st = { .input = -1 };
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void store_list_days(const char *sensor) {
+    char path[512];
+    struct dirent *de;
+
+    st.n_days = 0;
+    snprintf(path, sizeof(path), "%s/%s", config.store_dir, sensor);
+    DIR *d = opendir(path);
+    if (!d) return;
+    while ((de = readdir(d)) && st.n_days < 4096) {
+        int y, m, dd;
+        char ext[8];
+        if (sscanf(de->d_name, "%4d%2d%2d.%3s", &y, &m, &dd, ext) != 4 || strcmp(ext, "d6s") != 0) {
+            continue;   // Rollups are not backfilled
+        }
+        struct tm tm = { .tm_year = y - 1900, .tm_mon = m - 1, .tm_mday = dd };
+        int64_t day = (int64_t)timegm(&tm) / 86400;
+        if ((opt.from == INT64_MIN || day >= opt.from / STORE_DAY_MS - 1) &&
+            (opt.to == INT64_MAX || day <= opt.to / STORE_DAY_MS + 1)) {
+            st.days[st.n_days++] = day;
+        }
+    }
+    closedir(d);
+    qsort(st.days, st.n_days, sizeof(st.days[0]), cmp_i64);
+}
+
+static void format_local(int64_t t_ms, char *date, char *time_str) {
+    TsText stamp;
+    ts_format(t_ms * 1000000, &stamp);
+    memcpy(date, stamp.date, sizeof(stamp.date));
+    memcpy(time_str, stamp.time, sizeof(stamp.time));
+}
+
+static int store_next(Frame *f) {
+    for (;;) {
+        if (st.seg_open && st.chunk < st.seg.n_chunks) {
+            if (st.frame == 0) {
+                const StoreIndexEntry *e = &st.seg.index[st.chunk];
+                if (e->t_last <= keys[st.key].pos || e->t_last < opt.from || e->t_first > opt.to ||
+                    store_chunk_decode(&st.seg, st.chunk, STORE_COLS_ALL, &st.data) != 0) {
+                    st.chunk++;
+                    continue;
+                }
+            }
+            if (st.frame >= st.data.n) {
+                st.chunk++;
+                st.frame = 0;
+                continue;
+            }
+            int i = st.frame++;
+            int64_t t = st.data.t[i];
+            if (t <= keys[st.key].pos || t < opt.from || t > opt.to) continue;
+
+            f->key = st.key;
+            f->pos = t;
+            snprintf(f->sensor_id, sizeof(f->sensor_id), "%s", opt.inputs[st.input]);
+            format_local(t, f->date, f->time);
+            for (int p = 0; p < STORE_N_PIXEL; p++) {
+                f->pix[p] = st.data.col[STORE_COL_PIXEL(p)][i] / 10.0;
+            }
+            return 1;
+        }
+        if (st.seg_open) {
+            store_segment_close(&st.seg);
+            st.seg_open = false;
+        }
+        if (st.input >= 0 && st.day < st.n_days) {
+            char path[512];
+            store_segment_path(path, sizeof(path), config.store_dir, opt.inputs[st.input], st.days[st.day++]);
+            if (store_segment_open(path, &st.seg) == 0) {
+                st.seg_open = true;
+                st.chunk = st.frame = 0;
+            }
+            continue;
+        }
+        if (++st.input >= opt.n_inputs) return 0;
+        st.key = key_find(opt.inputs[st.input]);
+        if (st.key < 0) return 0;
+        store_list_days(opt.inputs[st.input]);
+        st.day = 0;
+    }
+}
+
+// Captures: "id: <id>, date: <date>, time: <time>, PTAT: <t> [degC],
+// Temperature: <16 values> [degC]" lines, possibly behind a log prefix
+static struct {
+    int input;
+    int key;
+    FILE *fp;
+} cap = { .input = -1 };
+
+#define CAPTURE_MIN_TEMP  (INT16_MIN / 10.0)
+#define CAPTURE_MAX_TEMP  (INT16_MAX / 10.0)
+
+static bool parse_capture(const char *line, Frame *f) {
+    const char *p = strstr(line, "id: ");
+    double ptat;
+    int n;
+
+    if (!p || sscanf(p, "id: %31[^,], date: %15[^,], time: %15[^,], PTAT: %lf [degC], Temperature: %n",
+                     f->sensor_id, f->date, f->time, &ptat, &n) != 4) {
+        return false;
+    }
+    p += n;
+    for (int i = 0; i < STORE_N_PIXEL; i++) {
+        char *end;
+        f->pix[i] = strtod(p, &end);
+        // The sensor reports int16 0.1 degC: anything else (including
+        // NaN) is not one of our lines and would not fit a record
+        if (end == p || !(f->pix[i] >= CAPTURE_MIN_TEMP && f->pix[i] <= CAPTURE_MAX_TEMP)) {
+            return false;
+        }
+        p = end;
+        while (*p == ',' || *p == ' ') p++;
+    }
+
+    // Lines written before the millisecond fix may carry a garbage time
+    int hh, mm, ss, ms;
+    if (sscanf(f->time, "%2d:%2d:%2d:%3d", &hh, &mm, &ss, &ms) != 4) return false;
+    if (opt.from != INT64_MIN || opt.to != INT64_MAX) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (!strptime(f->date, "%Y-%m-%d", &tm)) return false;
+        tm.tm_hour = hh;
+        tm.tm_min = mm;
+        tm.tm_sec = ss;
+        tm.tm_isdst = -1;
+        int64_t t = (int64_t)mktime(&tm) * 1000 + ms;
+        if (t < opt.from || t > opt.to) return false;
+    }
+    return true;
+}
+
+static int capture_next(Frame *f) {
+    char line[1024];
+
+    for (;;) {
+        if (cap.fp) {
+            off_t start = ftello(cap.fp);
+            if (fgets(line, sizeof(line), cap.fp)) {
+                if (!strchr(line, '\n') && feof(cap.fp)) {
+                    // A line still being written; the next run picks it up
+                    fseeko(cap.fp, start, SEEK_SET);
+                    fclose(cap.fp);
+                    cap.fp = NULL;
+                    continue;
+                }
+                if (!parse_capture(line, f)) {
+                    if (strstr(line, "id: ")) stats.skipped++;
+                    continue;
+                }
+                f->key = cap.key;
+                f->pos = (int64_t)ftello(cap.fp);
+                return 1;
+            }
+            fclose(cap.fp);
+            cap.fp = NULL;
+        }
+        if (++cap.input >= opt.n_inputs) return 0;
+        cap.key = key_find(opt.inputs[cap.input]);
+        if (cap.key < 0) return 0;
+        cap.fp = fopen(opt.inputs[cap.input], "r");
+        if (!cap.fp) {
+            logger_log(LOG_ERROR, "Backfill: cannot open %s: %s", opt.inputs[cap.input], strerror(errno));
+            continue;
+        }
+        if (keys[cap.key].pos > 0 && fseeko(cap.fp, keys[cap.key].pos, SEEK_SET) != 0) {
+            logger_log(LOG_ERROR, "Backfill: cannot resume %s", opt.inputs[cap.input]);
+        }
+    }
+}
+
+static Frame pending;               // Read ahead across a batch boundary
+static bool have_pending;
+
+static int next_frame(Frame *f) {
+    if (have_pending) {
+        *f = pending;
+        have_pending = false;
+        return 1;
+    }
+    return opt.captures ? capture_next(f) : store_next(f);
+}
+
+/* Batches */
+
+// The same record the live uploader and the Node.js controller send.
+// Returns its length, or -1 if it does not fit in size.
+static int format_record(const Frame *f, char *out, size_t size) {
+    TempAnalysis analysis;
+    char id[6 * sizeof(f->sensor_id) + 3];  // Every byte escaped as \u00XX
+    int len;
+
+    alert_analyze(&config, f->pix, STORE_N_PIXEL, &analysis);
+    if (json_write_string(id, sizeof(id), f->sensor_id) < 0) {
+        return -1;
+    }
+    len = snprintf(out, size, "{\"sensor_id\":%s,\"date\":\"%s\",\"time\":\"%s\",\"temperature_data\":[",
+                   id, f->date, f->time);
+    for (int i = 0; i < STORE_N_PIXEL && (size_t)len < size; i++) {
+        len += snprintf(out + len, size - len, "%s%.1f", i ? "," : "", f->pix[i]);
+    }
+    if ((size_t)len < size) {
+        len += snprintf(out + len, size - len, "],\"average_temp\":%.2f,\"status\":\"%s\"}",
+                        analysis.avg_temp, analysis.is_abnormal ? STATUS_ABNORMAL : STATUS_NORMAL);
+    }
+    return (size_t)len < size ? len : -1;
+}
+
+// Fill b with up to backfill_batch records of one checkpoint key. Returns
+// 0, 1 when the source is exhausted, or -1 if the batch cannot be built.
+// The frames read for a batch that was not built are not checkpointed, so
+// a later run sends them.
+static int batch_build(Batch *b) {
+    Frame f;
+    size_t used = 0;
+    int n = 0;
+
+    json_buf[used++] = '[';
+    while (n < config.backfill_batch && next_frame(&f) == 1) {
+        if (n > 0 && f.key != b->key) {
+            pending = f;            // Batches never span two keys
+            have_pending = true;
+            break;
+        }
+        size_t sep = n > 0;
+        int len = format_record(&f, json_buf + used + sep, BACKFILL_RECORD_MAX - sep);
+        if (len < 0) {
+            // Acknowledged with the batch like any other frame, never sent
+            logger_log(LOG_WARN, "Backfill: %s %s %s: record too long, skipped",
+                       f.sensor_id, f.date, f.time);
+            stats.skipped++;
+        } else {
+            if (sep) json_buf[used] = ',';
+            used += sep + (size_t)len;
+            n++;
+        }
+        b->key = f.key;
+        b->pos = f.pos;
+    }
+    if (n == 0) return 1;
+    json_buf[used++] = ']';
+
+    // Header, then the body compressed straight into the request buffer
+    char hdr[512];
+    uLong body_max = config.backfill_gzip ? compressBound(used) + 32 : used;
+    size_t cap = sizeof(hdr) + body_max;
+    char *req = realloc(b->req, cap);
+    if (!req) {
+        logger_log(LOG_ERROR, "Backfill: out of memory");
+        return -1;
+    }
+    b->req = req;
+
+    const int hdr_room = (int)sizeof(hdr);
+    char *body = req + hdr_room;
+    size_t body_len = used;
+    if (config.backfill_gzip) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            logger_log(LOG_ERROR, "Backfill: cannot start compression");
+            return -1;
+        }
+        zs.next_in = (Bytef *)json_buf;
+        zs.avail_in = (uInt)used;
+        zs.next_out = (Bytef *)body;
+        zs.avail_out = (uInt)body_max;
+        int rc = deflate(&zs, Z_FINISH);
+        body_len = zs.total_out;
+        deflateEnd(&zs);
+        if (rc != Z_STREAM_END) {
+            logger_log(LOG_ERROR, "Backfill: compression failed");
+            return -1;
+        }
+    } else {
+        memcpy(body, json_buf, used);
+    }
+
+    int hlen = snprintf(hdr, sizeof(hdr),
+                        "POST %s HTTP/1.1\r\n"
+                        "Host: %s:%d\r\n"
+                        "Content-Type: application/json\r\n"
+                        "%s"
+                        "Content-Length: %zu\r\n"
+                        "Connection: keep-alive\r\n"
+                        "\r\n",
+                        config.endpoint_backfill, config.server_ip, config.server_port,
+                        config.backfill_gzip ? "Content-Encoding: gzip\r\n" : "", body_len);
+    // Slide the header in front of the body
+    memcpy(body - hlen, hdr, hlen);
+    memmove(req, body - hlen, hlen + body_len);
+    b->len = hlen + (int)body_len;
+    b->records = n;
+    b->attempts = 0;
+    b->seq = next_seq++;
+    b->state = BATCH_QUEUED;
+
+    stats.frames += n;
+    stats.batches++;
+    stats.raw_bytes += used;
+    return 0;
+}
+
+/* Connections */
+
+static void conn_close(Conn *c) {
+    if (c->fd >= 0) {
+        evloop_del(c->fd);
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->state = CONN_IDLE;
+    c->rlen = 0;
+    http_response_reset(&c->resp);
+}
+
+static void conn_wait(Conn *c, int ms) {
+    c->waiting = true;
+    evloop_timer_set(c->timer_fd, ms > 0 ? ms : 1, 0);
+}
+
+// Put the batch back in the queue and back off this connection
+static void conn_fail(Conn *c, const char *what) {
+    logger_log(LOG_WARN, "Backfill: %s, retrying in %d ms", what, c->backoff_ms);
+    if (c->batch) {
+        c->batch->state = BATCH_QUEUED;
+        c->batch = NULL;
+        stats.retries++;
+    }
+    conn_close(c);
+    conn_wait(c, c->backoff_ms);
+    c->backoff_ms *= 2;
+    if (c->backoff_ms > BACKFILL_BACKOFF_MAX) c->backoff_ms = BACKFILL_BACKOFF_MAX;
+}
+
+static int conn_start(Conn *c) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int one = 1, tos = IPTOS_LOW_EFFORT;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+    if ((connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0 && errno != EINPROGRESS) ||
+        evloop_add(fd, EPOLLOUT, conn_event, c) != 0) {
+        close(fd);
+        return -1;
+    }
+    c->fd = fd;
+    c->state = CONN_CONNECTING;
+    return 0;
+}
+
+static void handle_writable(Conn *c) {
+    Batch *b = c->batch;
+    while (c->wpos < b->len) {
+        ssize_t n = send(c->fd, b->req + c->wpos, b->len - c->wpos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                evloop_mod(c->fd, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            if (errno == EINTR) continue;
+            conn_fail(c, strerror(errno));
+            return;
+        }
+        c->wpos += (int)n;
+    }
+    evloop_mod(c->fd, EPOLLIN);
+}
+
+static void response_complete(Conn *c) {
+    Batch *b = c->batch;
+    int status = c->resp.status;
+
+    if (!b) {
+        conn_fail(c, "unexpected response");
+        return;
+    }
+    if (status == 408 || status == 429 || status >= 500 || status < 200) {
+        char what[64];
+        snprintf(what, sizeof(what), "HTTP %d", status);
+        conn_fail(c, what);
+        return;
+    }
+    if (status >= 300) {
+        // Rejected as invalid: retrying would never succeed
+        logger_log(LOG_ERROR, "Backfill: batch of %d records for %s rejected: HTTP %d",
+                   b->records, keys[b->key].name, status);
+        stats.failed++;
+    }
+    b->state = BATCH_DONE;
+    c->batch = NULL;
+    c->backoff_ms = BACKFILL_BACKOFF_MIN;
+    commit_batches();
+    if (c->resp.close_after) conn_close(c);
+}
+
+static void handle_readable(Conn *c) {
+    for (;;) {
+        ssize_t n = read(c->fd, c->rbuf + c->rlen, BACKFILL_RBUF_SIZE - 1 - c->rlen);
+        if (n > 0) {
+            c->rlen += (int)n;
+            int rc;
+            while ((rc = http_response_parse(&c->resp, c->rbuf, &c->rlen, BACKFILL_RBUF_SIZE)) == 1) {
+                response_complete(c);
+                if (c->state != CONN_OPEN) break;
+            }
+            if (rc < 0) {
+                conn_fail(c, "malformed HTTP response");
+                return;
+            }
+            if (c->state != CONN_OPEN) return;
+            continue;
+        }
+        if (n == 0) {
+            if (c->resp.state == HTTP_RESP_BODY_UNTIL_CLOSE) {
+                response_complete(c);
+                conn_close(c);
+            } else if (c->batch) {
+                conn_fail(c, "connection closed by server");
+            } else {
+                conn_close(c);
+            }
+            return;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        if (errno == EINTR) continue;
+        conn_fail(c, strerror(errno));
+        return;
+    }
+}
+
+static void conn_event(int fd, uint32_t events, void *arg) {
+    Conn *c = arg;
+    (void)fd;
+
+    if (c->state == CONN_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            conn_fail(c, strerror(err));
+            return;
+        }
+        c->state = CONN_OPEN;
+        evloop_mod(c->fd, EPOLLIN);
+        if (c->batch) {
+            handle_writable(c);
+            return;
+        }
+    } else {
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            handle_readable(c);
+        }
+        if (c->state == CONN_OPEN && c->batch && (events & EPOLLOUT)) {
+            handle_writable(c);
+        }
+    }
+    pump();
+}
+
+static void conn_timer(int fd, uint32_t events, void *arg) {
+    Conn *c = arg;
+    (void)fd; (void)events;
+    c->waiting = false;
+    pump();
+}
+
+// Delay before the next send that keeps the upload under backfill_rate_kb
+static int rate_delay(void) {
+    if (config.backfill_rate_kb <= 0) return 0;
+    int64_t due = stats.started_ms +
+                  (int64_t)(stats.sent_bytes * 1000 / ((uint64_t)config.backfill_rate_kb * 1024));
+    int64_t wait = due - now_ms();
+    return wait > 0 ? (int)wait : 0;
+}
+
+static Batch *queued_batch(void) {
+    Batch *best = NULL;
+    for (int i = 0; i < n_conns; i++) {
+        if (batches[i].state == BATCH_QUEUED && (!best || batches[i].seq < best->seq)) {
+            best = &batches[i];
+        }
+    }
+    return best;
+}
+
+static Batch *free_batch(void) {
+    for (int i = 0; i < n_conns; i++) {
+        if (batches[i].state == BATCH_FREE) return &batches[i];
+    }
+    return NULL;
+}
+
+// Give every idle connection a batch, building new ones as slots free up
+static void pump(void) {
+    if (stopping) return;
+
+    for (int i = 0; i < n_conns; i++) {
+        Conn *c = &conns[i];
+        if (c->batch || c->waiting) continue;
+
+        Batch *b = queued_batch();
+        Batch *slot = !b && !source_done && !build_failed ? free_batch() : NULL;
+        if (slot) {
+            int rc = batch_build(slot);
+            if (rc == 0) {
+                b = slot;
+            } else if (rc > 0) {
+                source_done = true;
+            } else {
+                build_failed = true;
+                logger_log(LOG_ERROR, "Backfill: stopping after the batches in flight; "
+                           "run again to resume from the checkpoint");
+            }
+        }
+        if (!b) break;
+
+        int wait = rate_delay();
+        if (wait > 0) {
+            conn_wait(c, wait);
+            continue;
+        }
+        b->state = BATCH_SENDING;
+        b->attempts++;
+        c->batch = b;
+        c->wpos = 0;
+        stats.sent_bytes += (uint64_t)b->len;
+
+        if (c->state == CONN_IDLE && conn_start(c) != 0) {
+            conn_fail(c, strerror(errno));
+            continue;
+        }
+        if (c->state == CONN_OPEN) handle_writable(c);
+    }
+
+    if ((source_done || build_failed) && committed_seq == next_seq) {
+        evloop_stop();
+    }
+}
+
+/* Main */
+
+static void checkpoint_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    checkpoint_save();
+}
+
+static void signal_event(int fd, uint32_t events, void *arg) {
+    struct signalfd_siginfo si;
+    (void)events; (void)arg;
+
+    while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+        logger_log(LOG_INFO, "Backfill: signal %d, saving progress", (int)si.ssi_signo);
+        stopping = true;
+        evloop_stop();
+    }
+}
+
+static int list_sensors(void) {
+    DIR *d = opendir(config.store_dir);
+    struct dirent *de;
+    static char *names[BACKFILL_MAX_KEYS];
+    int n = 0;
+
+    if (!d) {
+        logger_log(LOG_ERROR, "Backfill: cannot open %s: %s", config.store_dir, strerror(errno));
+        return -1;
+    }
+    while ((de = readdir(d)) && n < BACKFILL_MAX_KEYS) {
+        char path[512];
+        struct stat sb;
+        if (de->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", config.store_dir, de->d_name);
+        if (stat(path, &sb) == 0 && S_ISDIR(sb.st_mode)) names[n++] = strdup(de->d_name);
+    }
+    closedir(d);
+    qsort(names, n, sizeof(names[0]), cmp_str);
+    opt.inputs = names;
+    opt.n_inputs = n;
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-c config.json] [options]\n"
+        "  -s sensor_id   sensor to upload from the store (repeatable, default: all)\n"
+        "  -l file        upload frames from a capture file instead (repeatable)\n"
+        "  -f time        start, inclusive (epoch ms, YYYY-MM-DD[THH:MM:SS] local)\n"
+        "  -t time        end, inclusive\n"
+        "  -j n           requests in flight (default: backfill.concurrency)\n"
+        "  -r             ignore the checkpoint and start over\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *config_path = DEFAULT_CONFIG_PATH;
+    static char *sensors[BACKFILL_MAX_KEYS];
+    static char *files[BACKFILL_MAX_KEYS];
+    int n_sensors = 0, n_files = 0, jobs = 0, opt_c;
+
+    while ((opt_c = getopt(argc, argv, "c:s:l:f:t:j:rh")) != -1) {
+        switch (opt_c) {
+        case 'c':
+            config_path = optarg;
+            break;
+        case 's':
+            if (n_sensors < BACKFILL_MAX_KEYS) sensors[n_sensors++] = optarg;
+            break;
+        case 'l':
+            if (n_files < BACKFILL_MAX_KEYS) files[n_files++] = optarg;
+            break;
+        case 'f':
+        case 't':
+            if (parse_time(optarg, opt_c == 'f' ? &opt.from : &opt.to) != 0) {
+                fprintf(stderr, "d6tbackfill: invalid time \"%s\"\n", optarg);
+                return 1;
+            }
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'r':
+            opt.reset = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (logger_init(DEFAULT_LOG_DIR, "d6tbackfill") != 0) {
+        fprintf(stderr, "Failed to initialize logger\n");
+        return 1;
+    }
+    config_defaults(&config);
+    if (config_load(config_path, &config) != 0) {
+        logger_close();
+        return 1;
+    }
+    if (strcmp(config.log_dir, DEFAULT_LOG_DIR) != 0) {
+        logger_close();
+        if (logger_init(config.log_dir, "d6tbackfill") != 0) {
+            fprintf(stderr, "Failed to initialize logger\n");
+            return 1;
+        }
+    }
+    if (jobs > 0) config.backfill_concurrency = jobs;
+    if (config.backfill_concurrency > BACKFILL_MAX_CONNS) config.backfill_concurrency = BACKFILL_MAX_CONNS;
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons((uint16_t)config.server_port);
+    if (inet_pton(AF_INET, config.server_ip, &server.sin_addr) != 1) {
+        logger_log(LOG_ERROR, "Backfill: invalid server address %s", config.server_ip);
+        logger_close();
+        return 1;
+    }
+
+    if (n_files > 0) {
+        opt.captures = true;
+        opt.inputs = files;
+        opt.n_inputs = n_files;
+    } else if (n_sensors > 0) {
+        opt.inputs = sensors;
+        opt.n_inputs = n_sensors;
+    } else if (list_sensors() != 0) {
+        logger_close();
+        return 1;
+    }
+    if (!opt.reset) checkpoint_load();
+
+    // Background work: yield CPU to the sampler and uploader
+    setpriority(PRIO_PROCESS, 0, 10);
+
+    n_conns = config.backfill_concurrency;
+    json_cap = (size_t)config.backfill_batch * BACKFILL_RECORD_MAX + 2;
+    json_buf = malloc(json_cap);
+    batches = calloc(n_conns, sizeof(Batch));
+    if (!json_buf || !batches || evloop_init() != 0) {
+        logger_log(LOG_ERROR, "Backfill: initialization failed");
+        logger_close();
+        return 1;
+    }
+    for (int i = 0; i < n_conns; i++) {
+        conns[i].fd = -1;
+        conns[i].backoff_ms = BACKFILL_BACKOFF_MIN;
+        http_response_reset(&conns[i].resp);
+        conns[i].timer_fd = evloop_timer_add(0, conn_timer, &conns[i]);
+        if (conns[i].timer_fd < 0) {
+            logger_close();
+            return 1;
+        }
+    }
+    int ckpt_tfd = evloop_timer_add(CHECKPOINT_MS, checkpoint_timer, NULL);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (ckpt_tfd < 0 || sig_fd < 0 || evloop_add(sig_fd, EPOLLIN, signal_event, NULL) != 0) {
+        logger_perror("Backfill: setup");
+        logger_close();
+        return 1;
+    }
+
+    logger_log(LOG_INFO, "Backfill: %d %s to http://%s:%d%s (batch %d, %d in flight, %d KiB/s%s)",
+               opt.n_inputs, opt.captures ? "capture files" : "sensors", config.server_ip,
+               config.server_port, config.endpoint_backfill, config.backfill_batch, n_conns,
+               config.backfill_rate_kb, config.backfill_gzip ? ", gzip" : "");
+    stats.started_ms = now_ms();
+    pump();
+    if (!(source_done || build_failed) || committed_seq != next_seq) {
+        evloop_run();
+    }
+
+    commit_batches();
+    checkpoint_save();
+    int64_t elapsed = now_ms() - stats.started_ms;
+    logger_log(LOG_INFO, "Backfill: %s after %lld ms: %llu records in %llu batches, %llu rejected, "
+               "%llu retries, %llu unparsable lines; %llu KiB JSON sent as %llu KiB",
+               stopping ? "stopped" : build_failed ? "failed" : "done", (long long)elapsed,
+               (unsigned long long)stats.frames, (unsigned long long)stats.batches,
+               (unsigned long long)stats.failed, (unsigned long long)stats.retries,
+               (unsigned long long)stats.skipped, (unsigned long long)(stats.raw_bytes >> 10),
+               (unsigned long long)(stats.sent_bytes >> 10));
+
+    for (int i = 0; i < n_conns; i++) {
+        conn_close(&conns[i]);
+        free(batches[i].req);
+    }
+    free(batches);
+    free(json_buf);
+    evloop_close();
+    logger_close();
+    return build_failed ? 1 : stats.failed > 0 ? 2 : 0;
+}
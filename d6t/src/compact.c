@@ -0,0 +1,509 @@
+/*
+ * d6tcompact - compaction and retention for the frame store (store.c)
+ *
+ * One pass over every sensor in store.dir, meant to run periodically at idle
+ * priority (SensorDataApp-compact.timer):
+ *
+ *   - closed days whose chunks were split by restarts or reloads are
+ *     rewritten with one chunk per time bucket
+ *   - raw days older than raw_days are replaced with min/max/avg rollups
+ *   - days older than retention_days are deleted
+ *   - the oldest days are deleted while a sensor is over quota_mb
+ *
+ * The current UTC day is never touched, since SensorDataApp appends to it.
+ * -t runs the pass as of another day, for stores written in virtual time
+ * (SensorDataApp -t).
+ * All reads and writes go through a rate limit and the process runs in the
+ * idle I/O class, so sampling and uploads are not delayed.
+ */
+#define _GNU_SOURCE             // syscall, posix_fadvise
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include "config.h"
+#include "logger.h"
+#include "store.h"
+#include "timestamp.h"
+
+#define COMPACT_MAX_DAYS   4096
+#define ROLLUP_CHUNK_MS    3600000LL    // One rollup chunk per hour
+
+// ioprio_set(2) has no glibc wrapper
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE  3
+#define IOPRIO_CLASS_SHIFT 13
+
+static const char *rollup_kinds[3] = { "min", "max", "avg" };
+
+typedef struct {
+    int64_t day;
+    bool raw;
+    bool rollup;
+    uint64_t bytes;                 // All files of the day
+} DayFiles;
+
+// Frames buffered for one output chunk
+typedef struct {
+    int n;
+    int64_t key;                    // Bucket of the buffered frames
+    int64_t t[STORE_MAX_CHUNK_FRAMES];
+    int16_t cols[STORE_N_COLS][STORE_MAX_CHUNK_FRAMES];
+} ChunkBuffer;
+
+static AppConfig config;
+static int64_t today;
+static StoreChunk chunk;
+static ChunkBuffer out[3];          // Merge uses out[0]; rollups use one per kind
+
+static struct {
+    int merged;
+    int rolled_up;
+    int expired;
+    int evicted;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    int64_t throttled_ms;
+} stats;
+
+/* Throttling */
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Sleep as needed to keep reads plus writes under store_compact_rate_kb
+static void throttle(uint64_t bytes) {
+    static int64_t start = -1;
+    static uint64_t total;
+
+    if (config.store_compact_rate_kb <= 0) return;
+    if (start < 0) start = now_ms();
+    total += bytes;
+
+    int64_t due = start + (int64_t)(total * 1000 / ((uint64_t)config.store_compact_rate_kb * 1024));
+    int64_t wait = due - now_ms();
+    if (wait > 0) {
+        struct timespec ts = { wait / 1000, (wait % 1000) * 1000000 };
+        nanosleep(&ts, NULL);
+        stats.throttled_ms += wait;
+    }
+}
+
+static void lower_priority(void) {
+    if (setpriority(PRIO_PROCESS, 0, 19) != 0) {
+        logger_perror("setpriority");
+    }
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+        logger_log(LOG_WARN, "Compact: ioprio_set failed (%s), relying on the rate limit",
+                   strerror(errno));
+    }
+}
+
+// Keep segments the compactor read or wrote from evicting hot pages
+static void drop_cache(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+/* Day files */
+
+static DayFiles *day_entry(DayFiles *days, int *n, int64_t day) {
+    for (int k = 0; k < *n; k++) {
+        if (days[k].day == day) return &days[k];
+    }
+    if (*n == COMPACT_MAX_DAYS) return NULL;
+    memset(&days[*n], 0, sizeof(days[0]));
+    days[*n].day = day;
+    return &days[(*n)++];
+}
+
+static int cmp_day(const void *a, const void *b) {
+    int64_t x = ((const DayFiles *)a)->day, y = ((const DayFiles *)b)->day;
+    return (x > y) - (x < y);
+}
+
+// Collect the days stored for a sensor, oldest first. Temporary files left
+// by an interrupted rewrite are removed.
+static int list_days(const char *sensor_dir, DayFiles *days) {
+    DIR *d = opendir(sensor_dir);
+    struct dirent *de;
+    int n = 0;
+
+    if (!d) return 0;
+    while ((de = readdir(d))) {
+        char path[768], kind[8], ext[8];
+        struct stat st;
+        int y, m, dd, len;
+
+        snprintf(path, sizeof(path), "%s/%s", sensor_dir, de->d_name);
+        len = (int)strlen(de->d_name);
+        if (len > 4 && strcmp(de->d_name + len - 4, ".tmp") == 0) {
+            unlink(path);
+            continue;
+        }
+        if (sscanf(de->d_name, "%4d%2d%2d.%7[^.].%7s", &y, &m, &dd, kind, ext) == 5) {
+            if (strcmp(ext, "d6s") != 0 && strcmp(ext, "d6i") != 0) continue;
+        } else if (sscanf(de->d_name, "%4d%2d%2d.%7s", &y, &m, &dd, ext) == 4 &&
+                   (strcmp(ext, "d6s") == 0 || strcmp(ext, "d6i") == 0)) {
+            kind[0] = '\0';
+        } else {
+            continue;
+        }
+        if (stat(path, &st) != 0) continue;
+
+        struct tm tm = { .tm_year = y - 1900, .tm_mon = m - 1, .tm_mday = dd };
+        DayFiles *e = day_entry(days, &n, (int64_t)timegm(&tm) / 86400);
+        if (!e) break;
+        e->bytes += (uint64_t)st.st_size;
+        if (strcmp(ext, "d6s") == 0) {
+            if (kind[0]) e->rollup = true;
+            else e->raw = true;
+        }
+    }
+    closedir(d);
+    qsort(days, n, sizeof(days[0]), cmp_day);
+    return n;
+}
+
+static void unlink_segment(const char *path) {
+    char ipath[512];
+    store_index_path(ipath, sizeof(ipath), path);
+    if (unlink(path) != 0 && errno != ENOENT) {
+        logger_log(LOG_ERROR, "Compact: cannot remove %s: %s", path, strerror(errno));
+    }
+    unlink(ipath);
+}
+
+static void remove_day(const char *sensor, int64_t day) {
+    char path[512];
+    store_segment_path(path, sizeof(path), config.store_dir, sensor, day);
+    unlink_segment(path);
+    for (int k = 0; k < 3; k++) {
+        store_rollup_path(path, sizeof(path), config.store_dir, sensor, day, rollup_kinds[k]);
+        unlink_segment(path);
+    }
+}
+
+/* Chunk output */
+
+static int buffer_flush(StoreBuilder *b, ChunkBuffer *cb) {
+    if (cb->n == 0) return 0;
+    int len = store_builder_add(b, cb->t, cb->cols, cb->n);
+    cb->n = 0;
+    if (len < 0) return -1;
+    stats.bytes_written += (uint64_t)len;
+    throttle((uint64_t)len);
+    return 0;
+}
+
+// Decode chunk i with its checksum verified, counting it against the rate
+static int read_chunk(const StoreSegment *seg, int i, const char *path) {
+    throttle(seg->index[i].chunk_bytes);
+    stats.bytes_read += seg->index[i].chunk_bytes;
+    if (store_chunk_decode(seg, i, STORE_COLS_ALL | STORE_DECODE_VERIFY, &chunk) != 0) {
+        logger_log(LOG_WARN, "Compact: %s: dropping corrupt chunk %d", path, i);
+        return -1;
+    }
+    return 0;
+}
+
+/* Merge */
+
+// Chunks that continue the previous chunk's time bucket are fragments left
+// by a flush on restart or reload
+static bool fragmented(const StoreSegment *seg, int64_t bucket_ms) {
+    for (int i = 1; i < seg->n_chunks; i++) {
+        const StoreIndexEntry *a = &seg->index[i - 1], *b = &seg->index[i];
+        if (a->t_last / bucket_ms == b->t_first / bucket_ms && b->t_first >= a->t_last &&
+            a->n_frames + b->n_frames <= STORE_MAX_CHUNK_FRAMES) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int merge_segment(const char *path) {
+    int64_t bucket_ms = (config.store_chunk_seconds > 0 ? config.store_chunk_seconds : 300) * 1000LL;
+    StoreSegment seg;
+    StoreBuilder b;
+    ChunkBuffer *cb = &out[0];
+    int before;
+
+    if (store_segment_open(path, &seg) != 0) return -1;
+    if (!fragmented(&seg, bucket_ms)) {
+        store_segment_close(&seg);
+        return 0;
+    }
+    if (store_builder_open(&b, path) != 0) {
+        store_segment_close(&seg);
+        return -1;
+    }
+
+    // Same chunking rules as the writer
+    cb->n = 0;
+    before = seg.n_chunks;
+    for (int i = 0; i < seg.n_chunks; i++) {
+        if (read_chunk(&seg, i, path) != 0) continue;
+        for (int j = 0; j < chunk.n; j++) {
+            int64_t key = chunk.t[j] / bucket_ms;
+            if (cb->n > 0 && (key != cb->key || cb->n == STORE_MAX_CHUNK_FRAMES ||
+                              chunk.t[j] < cb->t[cb->n - 1])) {
+                if (buffer_flush(&b, cb) != 0) goto fail;
+            }
+            if (cb->n == 0) cb->key = key;
+            cb->t[cb->n] = chunk.t[j];
+            for (int c = 0; c < STORE_N_COLS; c++) cb->cols[c][cb->n] = chunk.col[c][j];
+            cb->n++;
+        }
+    }
+    if (buffer_flush(&b, cb) != 0) goto fail;
+    store_segment_close(&seg);
+
+    if (b.n_chunks == 0) {
+        store_builder_abort(&b);
+        unlink_segment(path);
+        return 0;
+    }
+    if (store_builder_commit(&b) != 0) return -1;
+    drop_cache(path);
+    logger_log(LOG_INFO, "Compact: %s merged %d chunks into %d", path, before, b.n_chunks);
+    stats.merged++;
+    return 0;
+
+fail:
+    store_builder_abort(&b);
+    store_segment_close(&seg);
+    return -1;
+}
+
+/* Rollup */
+
+typedef struct {
+    int64_t key;
+    int n;
+    int16_t min[STORE_N_COLS];
+    int16_t max[STORE_N_COLS];
+    int64_t sum[STORE_N_COLS];
+} RollupAcc;
+
+static int rollup_emit(StoreBuilder *b, RollupAcc *acc, int64_t rollup_ms) {
+    if (acc->n == 0) return 0;
+    int64_t t = acc->key * rollup_ms;
+
+    for (int k = 0; k < 3; k++) {
+        ChunkBuffer *cb = &out[k];
+        int64_t key = t / ROLLUP_CHUNK_MS;
+        if (cb->n > 0 && (key != cb->key || cb->n == STORE_MAX_CHUNK_FRAMES)) {
+            if (buffer_flush(&b[k], cb) != 0) return -1;
+        }
+        if (cb->n == 0) cb->key = key;
+        cb->t[cb->n] = t;
+        for (int c = 0; c < STORE_N_COLS; c++) {
+            int64_t s = acc->sum[c];
+            cb->cols[c][cb->n] = k == 0 ? acc->min[c] : k == 1 ? acc->max[c]
+                               : (int16_t)((s >= 0 ? s + acc->n / 2 : s - acc->n / 2) / acc->n);
+        }
+        cb->n++;
+    }
+    acc->n = 0;
+    return 0;
+}
+
+static int rollup_segment(const char *sensor, int64_t day) {
+    int64_t rollup_ms = config.store_rollup_seconds * 1000LL;
+    char path[512], rpath[3][512];
+    StoreSegment seg;
+    StoreBuilder b[3];
+    RollupAcc acc = { .n = 0 };
+    int k, opened = 0;
+    uint64_t frames = 0;
+
+    store_segment_path(path, sizeof(path), config.store_dir, sensor, day);
+    if (store_segment_open(path, &seg) != 0) return -1;
+
+    for (k = 0; k < 3; k++) {
+        store_rollup_path(rpath[k], sizeof(rpath[k]), config.store_dir, sensor, day, rollup_kinds[k]);
+        if (store_builder_open(&b[k], rpath[k]) != 0) goto fail;
+        out[k].n = 0;
+        opened++;
+    }
+
+    for (int i = 0; i < seg.n_chunks; i++) {
+        if (read_chunk(&seg, i, path) != 0) continue;
+        for (int j = 0; j < chunk.n; j++) {
+            int64_t key = chunk.t[j] / rollup_ms;
+            if (acc.n > 0 && key != acc.key && rollup_emit(b, &acc, rollup_ms) != 0) goto fail;
+            if (acc.n == 0) {
+                acc.key = key;
+                for (int c = 0; c < STORE_N_COLS; c++) {
+                    acc.min[c] = INT16_MAX;
+                    acc.max[c] = INT16_MIN;
+                    acc.sum[c] = 0;
+                }
+            }
+            for (int c = 0; c < STORE_N_COLS; c++) {
+                int16_t v = chunk.col[c][j];
+                if (v < acc.min[c]) acc.min[c] = v;
+                if (v > acc.max[c]) acc.max[c] = v;
+                acc.sum[c] += v;
+            }
+            acc.n++;
+            frames++;
+        }
+    }
+    if (rollup_emit(b, &acc, rollup_ms) != 0) goto fail;
+    for (k = 0; k < 3; k++) {
+        if (buffer_flush(&b[k], &out[k]) != 0) goto fail;
+    }
+    store_segment_close(&seg);
+
+    // Rollups are complete before the raw segment goes away
+    for (k = 0; k < 3; k++) {
+        if (b[k].n_chunks == 0) {
+            store_builder_abort(&b[k]);
+        } else if (store_builder_commit(&b[k]) != 0) {
+            while (++k < 3) store_builder_abort(&b[k]);
+            return -1;
+        } else {
+            drop_cache(rpath[k]);
+        }
+    }
+    drop_cache(path);
+    unlink_segment(path);
+    logger_log(LOG_INFO, "Compact: %s rolled up %llu frames at %d s", path,
+               (unsigned long long)frames, config.store_rollup_seconds);
+    stats.rolled_up++;
+    return 0;
+
+fail:
+    for (k = 0; k < opened; k++) store_builder_abort(&b[k]);
+    store_segment_close(&seg);
+    return -1;
+}
+
+/* Retention */
+
+static void compact_sensor(const char *sensor) {
+    static DayFiles days[COMPACT_MAX_DAYS];
+    char dir[512], path[512];
+    int n;
+
+    snprintf(dir, sizeof(dir), "%s/%s", config.store_dir, sensor);
+    n = list_days(dir, days);
+
+    for (int k = 0; k < n; k++) {
+        int64_t age = today - days[k].day;
+        if (age <= 0) continue;
+
+        if (config.store_retention_days > 0 && age > config.store_retention_days) {
+            remove_day(sensor, days[k].day);
+            stats.expired++;
+        } else if (days[k].raw && config.store_raw_days > 0 && age > config.store_raw_days) {
+            rollup_segment(sensor, days[k].day);
+        } else if (days[k].raw && age >= 2) {
+            // Yesterday may still receive late frames
+            store_segment_path(path, sizeof(path), config.store_dir, sensor, days[k].day);
+            merge_segment(path);
+        }
+    }
+
+    if (config.store_quota_mb <= 0) return;
+    uint64_t quota = (uint64_t)config.store_quota_mb * 1024 * 1024, total = 0;
+    n = list_days(dir, days);
+    for (int k = 0; k < n; k++) total += days[k].bytes;
+    for (int k = 0; k < n && total > quota && days[k].day < today; k++) {
+        time_t secs = (time_t)(days[k].day * 86400);
+        struct tm tm;
+        gmtime_r(&secs, &tm);
+        logger_log(LOG_WARN, "Compact: %s over quota (%llu MiB), removing %04d-%02d-%02d", sensor,
+                   (unsigned long long)(total >> 20), tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+        remove_day(sensor, days[k].day);
+        total -= days[k].bytes;
+        stats.evicted++;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *config_path = DEFAULT_CONFIG_PATH;
+    struct dirent *de;
+    int64_t as_of = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:t:")) != -1) {
+        switch (opt) {
+        case 'c':
+            config_path = optarg;
+            break;
+        case 't':
+            if (ts_parse(optarg, &as_of) != 0) {
+                fprintf(stderr, "Bad date: %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c config.json] [-t date]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (logger_init(DEFAULT_LOG_DIR, "d6tcompact") != 0) {
+        fprintf(stderr, "Failed to initialize logger\n");
+        return 1;
+    }
+    config_defaults(&config);
+    if (config_load(config_path, &config) != 0) {
+        logger_close();
+        return 1;
+    }
+    if (strcmp(config.log_dir, DEFAULT_LOG_DIR) != 0) {
+        logger_close();
+        if (logger_init(config.log_dir, "d6tcompact") != 0) {
+            fprintf(stderr, "Failed to initialize logger\n");
+            return 1;
+        }
+    }
+
+    lower_priority();
+    today = (as_of >= 0 ? as_of / 1000000000 : (int64_t)time(NULL)) / 86400;
+    int64_t started = now_ms();
+
+    DIR *d = opendir(config.store_dir);
+    if (!d) {
+        logger_log(LOG_INFO, "Compact: %s does not exist, nothing to do", config.store_dir);
+        logger_close();
+        return 0;
+    }
+    while ((de = readdir(d))) {
+        char path[512];
+        struct stat st;
+        if (de->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", config.store_dir, de->d_name);
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            compact_sensor(de->d_name);
+        }
+    }
+    closedir(d);
+
+    logger_log(LOG_INFO, "Compact: done in %lld ms: %d merged, %d rolled up, %d expired, "
+               "%d evicted; %llu KiB read, %llu KiB written, %lld ms throttled",
+               (long long)(now_ms() - started), stats.merged, stats.rolled_up, stats.expired,
+               stats.evicted, (unsigned long long)(stats.bytes_read >> 10),
+               (unsigned long long)(stats.bytes_written >> 10), (long long)stats.throttled_ms);
+    logger_close();
+    return 0;
+}
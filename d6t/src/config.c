@@ -0,0 +1,421 @@
+#include "config.h"
+#include "json.h"
+#include "logger.h"
+#include "rule.h"
+
+#include <ctype.h>
+
+#define CONFIG_MAX_SIZE   (64 * 1024)
+#define CONFIG_MAX_TOKENS 2048
+
+static void sensor_defaults(SensorConfig *s, int index, int interval_ms) {
+    memset(s, 0, sizeof(*s));
+    snprintf(s->id, sizeof(s->id), "sensor_%d", index + 1);
+    snprintf(s->device, sizeof(s->device), "%s", "/dev/i2c-0");
+    s->address = 0x0A;
+    s->interval_ms = interval_ms;
+    s->filter = FILTER_NONE;
+    s->filter_alpha = 0.5;
+    s->upload_mode = POLICY_FULL;
+    s->summary_ms = 60000;
+    s->pre_trigger = 20;
+    s->post_trigger_ms = 30000;
+    s->power_off_ms = 500;
+}
+
+void config_defaults(AppConfig *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    snprintf(cfg->log_dir, sizeof(cfg->log_dir), "%s", DEFAULT_LOG_DIR);
+    cfg->interval_ms = 300;
+    cfg->threshold_min = 10.0;
+    cfg->threshold_max = 70.0;
+    cfg->alert_history_seconds = 10;
+    cfg->trend_enabled = false;
+    cfg->trend_window_s = 10;
+    cfg->trend_min_frames = 5;
+    cfg->trend_pixel_rise = 10.0;
+    cfg->trend_sensor_rise = 5.0;
+    cfg->i2c_timeout_ms = 100;
+    cfg->i2c_retries = -1;
+    cfg->i2c_recover_after = 3;
+    cfg->snapshot_enabled = false;
+    snprintf(cfg->snapshot_dir, sizeof(cfg->snapshot_dir), "%s", "/opt2/sees/aibc_demo/state");
+    cfg->snapshot_interval_s = 30;
+    cfg->snapshot_max_age_s = 600;
+    cfg->low_power = false;
+    cfg->low_power_align_ms = 100;
+    cfg->sensor_count = 1;
+    sensor_defaults(&cfg->sensors[0], 0, cfg->interval_ms);
+    cfg->pipe_enabled = true;
+    snprintf(cfg->pipe_name, sizeof(cfg->pipe_name), "%s", "/tmp/sensor_data_pipe");
+    snprintf(cfg->pipe_alert_name, sizeof(cfg->pipe_alert_name), "%s", "/tmp/sensor_alert_pipe");
+    cfg->pipe_record_name[0] = '\0';
+    cfg->pipe_record_zero_copy = true;
+    snprintf(cfg->server_ip, sizeof(cfg->server_ip), "%s", "127.0.0.1");
+    cfg->server_port = 3000;
+    snprintf(cfg->endpoint_temperature, sizeof(cfg->endpoint_temperature), "%s", "/api/data");
+    snprintf(cfg->endpoint_alerts, sizeof(cfg->endpoint_alerts), "%s", "/api/alerts");
+    snprintf(cfg->endpoint_summary, sizeof(cfg->endpoint_summary), "%s", "/api/summary");
+    snprintf(cfg->endpoint_backfill, sizeof(cfg->endpoint_backfill), "%s", "/api/data/batch");
+    cfg->store_enabled = false;
+    snprintf(cfg->store_dir, sizeof(cfg->store_dir), "%s", "/opt2/sees/aibc_demo/store");
+    cfg->store_chunk_seconds = 300;
+    cfg->store_flush_seconds = 60;
+    cfg->store_raw_days = 30;
+    cfg->store_rollup_seconds = 60;
+    cfg->store_retention_days = 365;
+    cfg->store_quota_mb = 0;
+    cfg->store_compact_rate_kb = 4096;
+    cfg->uploader_enabled = false;
+    cfg->uploader_batch = 8;
+    cfg->uploader_flush_ms = 1000;
+    cfg->uploader_queue = 256;
+    cfg->uploader_alert_queue = 64;
+    cfg->backfill_batch = 1000;
+    cfg->backfill_concurrency = 4;
+    cfg->backfill_rate_kb = 512;
+    cfg->backfill_gzip = true;
+    snprintf(cfg->backfill_checkpoint, sizeof(cfg->backfill_checkpoint), "%s",
+             "/opt2/sees/aibc_demo/store/backfill.ckpt");
+    cfg->forward_window = 1024;
+    cfg->aggregator_port = 7600;
+    snprintf(cfg->aggregator_listen, sizeof(cfg->aggregator_listen), "%s", "0.0.0.0");
+    cfg->aggregator_batch = 500;
+    cfg->aggregator_flush_ms = 1000;
+    cfg->aggregator_concurrency = 2;
+    cfg->aggregator_queue = 64;
+    cfg->aggregator_gzip = true;
+}
+
+// I2C addresses may be written as numbers or as "0x0A" strings
+static void get_address(const char *js, const JsonToken *t, int i, int *out) {
+    char buf[16];
+    if (json_get_string(js, t, i, buf, sizeof(buf)) == 0) {
+        *out = (int)strtol(buf, NULL, 0);
+    } else {
+        json_get_int(js, t, i, out);
+    }
+}
+
+// Read a list of {"when": ..., "reason": ...} rules. They are compiled by
+// check_rules() once the zones they may refer to are known.
+static int parse_rules(const char *js, const JsonToken *t, int arr, RuleConfig *rules,
+                       int *count, const char *owner) {
+    if (arr < 0) {
+        return 0;
+    }
+    if (t[arr].type != JSON_ARRAY || t[arr].size > CONFIG_MAX_RULES) {
+        logger_log(LOG_ERROR, "%s: rules must list up to %d entries", owner, CONFIG_MAX_RULES);
+        return -1;
+    }
+    *count = t[arr].size;
+    for (int k = 0; k < *count; k++) {
+        int item = json_array_item(t, arr, k);
+        RuleConfig *r = &rules[k];
+        r->reason[0] = '\0';
+        json_get_string(js, t, json_find(js, t, item, "reason"), r->reason, sizeof(r->reason));
+        if (json_get_string(js, t, json_find(js, t, item, "when"), r->when, sizeof(r->when)) != 0) {
+            logger_log(LOG_ERROR, "%s: rule %d has no \"when\"", owner, k + 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Compile alert.rules and the sensor's own rules against its zones, to
+// reject bad rules at load time rather than on the first frame
+static int check_rules(const AppConfig *cfg, const SensorConfig *s) {
+    static RuleSet scratch;
+    char err[128];
+
+    rule_set_clear(&scratch);
+    for (int k = 0; k < cfg->rule_count + s->rule_count; k++) {
+        const RuleConfig *r = k < cfg->rule_count ? &cfg->rules[k] : &s->rules[k - cfg->rule_count];
+        if (rule_add(&scratch, r->when, r->reason, s->zones, s->zone_count, err, sizeof(err)) != 0) {
+            logger_log(LOG_ERROR, "Sensor %s: rule \"%s\": %s", s->id, r->when, err);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Read a list of {"name": ..., "pixels": [...]} zones
+static int parse_zones(const char *js, const JsonToken *t, int arr, SensorConfig *s) {
+    if (arr < 0) {
+        return 0;
+    }
+    if (t[arr].type != JSON_ARRAY || t[arr].size > CONFIG_MAX_ZONES) {
+        logger_log(LOG_ERROR, "Sensor %s: zones must list up to %d entries", s->id, CONFIG_MAX_ZONES);
+        return -1;
+    }
+    s->zone_count = t[arr].size;
+    for (int k = 0; k < s->zone_count; k++) {
+        int item = json_array_item(t, arr, k);
+        int pixels = json_find(js, t, item, "pixels");
+        ZoneConfig *z = &s->zones[k];
+        bool ok = json_get_string(js, t, json_find(js, t, item, "name"), z->name, sizeof(z->name)) == 0 &&
+                  (isalpha((unsigned char)z->name[0]) || z->name[0] == '_') &&
+                  pixels >= 0 && t[pixels].type == JSON_ARRAY && t[pixels].size > 0;
+
+        z->mask = 0;
+        for (const char *c = z->name; ok && *c; c++) {
+            ok = isalnum((unsigned char)*c) || *c == '_';
+        }
+        for (int j = 0; ok && j < k; j++) {
+            ok = strcmp(s->zones[j].name, z->name) != 0;
+        }
+        for (int i = 0; ok && i < t[pixels].size; i++) {
+            int p = -1;
+            json_get_int(js, t, json_array_item(t, pixels, i), &p);
+            ok = p >= 0 && p < 16;
+            z->mask |= ok ? (uint16_t)(1u << p) : 0;
+        }
+        if (!ok) {
+            logger_log(LOG_ERROR, "Sensor %s: zone %d needs a unique name (letters, digits, _) "
+                       "and pixels 0..15", s->id, k + 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int parse_sensor(const char *js, const JsonToken *t, int obj,
+                        SensorConfig *s, int index, int interval_ms) {
+    char filter[16];
+    char mode[16];
+    char owner[48];
+    int seconds;
+
+    sensor_defaults(s, index, interval_ms);
+    json_get_string(js, t, json_find(js, t, obj, "id"), s->id, sizeof(s->id));
+    json_get_string(js, t, json_find(js, t, obj, "device"), s->device, sizeof(s->device));
+    get_address(js, t, json_find(js, t, obj, "address"), &s->address);
+    json_get_int(js, t, json_find(js, t, obj, "interval"), &s->interval_ms);
+
+    if (json_get_string(js, t, json_path(js, t, obj, "filter.type"), filter, sizeof(filter)) == 0) {
+        if (strcmp(filter, "ema") == 0) {
+            s->filter = FILTER_EMA;
+        } else if (strcmp(filter, "median3") == 0) {
+            s->filter = FILTER_MEDIAN3;
+        } else if (strcmp(filter, "none") != 0) {
+            logger_log(LOG_ERROR, "Sensor %s: unknown filter \"%s\"", s->id, filter);
+            return -1;
+        }
+    }
+    json_get_double(js, t, json_path(js, t, obj, "filter.alpha"), &s->filter_alpha);
+
+    if (json_get_string(js, t, json_path(js, t, obj, "upload.mode"), mode, sizeof(mode)) == 0) {
+        if (strcmp(mode, "summary") == 0) {
+            s->upload_mode = POLICY_SUMMARY;
+        } else if (strcmp(mode, "full") != 0) {
+            logger_log(LOG_ERROR, "Sensor %s: unknown upload mode \"%s\"", s->id, mode);
+            return -1;
+        }
+    }
+    if (json_get_int(js, t, json_path(js, t, obj, "upload.summary_seconds"), &seconds) == 0) {
+        s->summary_ms = seconds * 1000;
+    }
+    json_get_int(js, t, json_path(js, t, obj, "upload.pre_trigger"), &s->pre_trigger);
+    if (json_get_int(js, t, json_path(js, t, obj, "upload.post_trigger_seconds"), &seconds) == 0) {
+        s->post_trigger_ms = seconds * 1000;
+    }
+    json_get_string(js, t, json_path(js, t, obj, "power.chip"), s->power_chip, sizeof(s->power_chip));
+    json_get_int(js, t, json_path(js, t, obj, "power.line"), &s->power_line);
+    json_get_bool(js, t, json_path(js, t, obj, "power.active_low"), &s->power_active_low);
+    json_get_int(js, t, json_path(js, t, obj, "power.off_ms"), &s->power_off_ms);
+    snprintf(owner, sizeof(owner), "Sensor %s", s->id);
+    if (parse_rules(js, t, json_find(js, t, obj, "rules"), s->rules, &s->rule_count, owner) != 0 ||
+        parse_zones(js, t, json_find(js, t, obj, "zones"), s) != 0) {
+        return -1;
+    }
+
+    if (s->interval_ms <= 0 || s->address <= 0 || s->address > 0x7F ||
+        s->filter_alpha <= 0.0 || s->filter_alpha > 1.0) {
+        logger_log(LOG_ERROR, "Sensor %s: invalid interval, address or filter.alpha", s->id);
+        return -1;
+    }
+    if (s->summary_ms <= 0 || s->post_trigger_ms < 0 ||
+        s->pre_trigger < 0 || s->pre_trigger > CONFIG_MAX_PRE_TRIGGER) {
+        logger_log(LOG_ERROR, "Sensor %s: invalid upload policy (pre_trigger is 0..%d)",
+                   s->id, CONFIG_MAX_PRE_TRIGGER);
+        return -1;
+    }
+    if (s->power_chip[0] != '\0' && (s->power_line < 0 || s->power_off_ms <= 0)) {
+        logger_log(LOG_ERROR, "Sensor %s: invalid power.line or power.off_ms", s->id);
+        return -1;
+    }
+    return 0;
+}
+
+int config_load(const char *path, AppConfig *cfg) {
+    static char text[CONFIG_MAX_SIZE];
+    static JsonToken tok[CONFIG_MAX_TOKENS];
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        logger_log(LOG_ERROR, "Failed to open config %s: %s", path, strerror(errno));
+        return -1;
+    }
+    size_t len = fread(text, 1, sizeof(text) - 1, fp);
+    fclose(fp);
+    text[len] = '\0';
+
+    int n = json_parse(text, len, tok, CONFIG_MAX_TOKENS);
+    if (n <= 0 || tok[0].type != JSON_OBJECT) {
+        logger_log(LOG_ERROR, "Invalid JSON in config %s", path);
+        return -1;
+    }
+
+    // Missing keys keep their defaults
+    json_get_string(text, tok, json_path(text, tok, 0, "log.dir"),
+                    cfg->log_dir, sizeof(cfg->log_dir));
+    json_get_bool(text, tok, json_path(text, tok, 0, "output.io_uring"), &cfg->output_uring);
+    json_get_int(text, tok, json_find(text, tok, 0, "interval"), &cfg->interval_ms);
+    json_get_double(text, tok, json_path(text, tok, 0, "threshold.min"), &cfg->threshold_min);
+    json_get_double(text, tok, json_path(text, tok, 0, "threshold.max"), &cfg->threshold_max);
+    json_get_int(text, tok, json_path(text, tok, 0, "alert.history_seconds"), &cfg->alert_history_seconds);
+    if (parse_rules(text, tok, json_path(text, tok, 0, "alert.rules"), cfg->rules,
+                    &cfg->rule_count, "Config: alert") != 0) {
+        return -1;
+    }
+    json_get_bool(text, tok, json_path(text, tok, 0, "trend.enabled"), &cfg->trend_enabled);
+    json_get_int(text, tok, json_path(text, tok, 0, "trend.window_s"), &cfg->trend_window_s);
+    json_get_int(text, tok, json_path(text, tok, 0, "trend.min_frames"), &cfg->trend_min_frames);
+    json_get_double(text, tok, json_path(text, tok, 0, "trend.pixel_rise"), &cfg->trend_pixel_rise);
+    json_get_double(text, tok, json_path(text, tok, 0, "trend.sensor_rise"), &cfg->trend_sensor_rise);
+    json_get_int(text, tok, json_path(text, tok, 0, "i2c.timeout_ms"), &cfg->i2c_timeout_ms);
+    json_get_int(text, tok, json_path(text, tok, 0, "i2c.retries"), &cfg->i2c_retries);
+    json_get_int(text, tok, json_path(text, tok, 0, "i2c.recover_after"), &cfg->i2c_recover_after);
+    json_get_bool(text, tok, json_path(text, tok, 0, "snapshot.enabled"), &cfg->snapshot_enabled);
+    json_get_string(text, tok, json_path(text, tok, 0, "snapshot.dir"), cfg->snapshot_dir,
+                    sizeof(cfg->snapshot_dir));
+    json_get_int(text, tok, json_path(text, tok, 0, "snapshot.interval_s"), &cfg->snapshot_interval_s);
+    json_get_int(text, tok, json_path(text, tok, 0, "snapshot.max_age_s"), &cfg->snapshot_max_age_s);
+    json_get_bool(text, tok, json_path(text, tok, 0, "low_power.enabled"), &cfg->low_power);
+    json_get_int(text, tok, json_path(text, tok, 0, "low_power.align_ms"), &cfg->low_power_align_ms);
+    json_get_bool(text, tok, json_path(text, tok, 0, "pipe.enabled"), &cfg->pipe_enabled);
+    json_get_string(text, tok, json_path(text, tok, 0, "pipe.name"),
+                    cfg->pipe_name, sizeof(cfg->pipe_name));
+    json_get_string(text, tok, json_path(text, tok, 0, "pipe.alert_name"),
+                    cfg->pipe_alert_name, sizeof(cfg->pipe_alert_name));
+    json_get_string(text, tok, json_path(text, tok, 0, "pipe.record_name"),
+                    cfg->pipe_record_name, sizeof(cfg->pipe_record_name));
+    json_get_bool(text, tok, json_path(text, tok, 0, "pipe.record_zero_copy"),
+                  &cfg->pipe_record_zero_copy);
+
+    json_get_string(text, tok, json_path(text, tok, 0, "server.ip"),
+                    cfg->server_ip, sizeof(cfg->server_ip));
+    json_get_int(text, tok, json_path(text, tok, 0, "server.port"), &cfg->server_port);
+    json_get_string(text, tok, json_path(text, tok, 0, "server.endpoints.temperature"),
+                    cfg->endpoint_temperature, sizeof(cfg->endpoint_temperature));
+    json_get_string(text, tok, json_path(text, tok, 0, "server.endpoints.alerts"),
+                    cfg->endpoint_alerts, sizeof(cfg->endpoint_alerts));
+    json_get_string(text, tok, json_path(text, tok, 0, "server.endpoints.summary"),
+                    cfg->endpoint_summary, sizeof(cfg->endpoint_summary));
+    json_get_string(text, tok, json_path(text, tok, 0, "server.endpoints.backfill"),
+                    cfg->endpoint_backfill, sizeof(cfg->endpoint_backfill));
+
+    json_get_bool(text, tok, json_path(text, tok, 0, "store.enabled"), &cfg->store_enabled);
+    json_get_string(text, tok, json_path(text, tok, 0, "store.dir"),
+                    cfg->store_dir, sizeof(cfg->store_dir));
+    json_get_int(text, tok, json_path(text, tok, 0, "store.chunk_seconds"), &cfg->store_chunk_seconds);
+    json_get_int(text, tok, json_path(text, tok, 0, "store.flush_seconds"), &cfg->store_flush_seconds);
+    json_get_int(text, tok, json_path(text, tok, 0, "store.compaction.raw_days"), &cfg->store_raw_days);
+    json_get_int(text, tok, json_path(text, tok, 0, "store.compaction.rollup_seconds"),
+                 &cfg->store_rollup_seconds);
+    json_get_int(text, tok, json_path(text, tok, 0, "store.compaction.retention_days"),
+                 &cfg->store_retention_days);
+    json_get_int(text, tok, json_path(text, tok, 0, "store.compaction.quota_mb"), &cfg->store_quota_mb);
+    json_get_int(text, tok, json_path(text, tok, 0, "store.compaction.rate_kb"),
+                 &cfg->store_compact_rate_kb);
+
+    json_get_bool(text, tok, json_path(text, tok, 0, "uploader.enabled"), &cfg->uploader_enabled);
+    json_get_int(text, tok, json_path(text, tok, 0, "uploader.batch"), &cfg->uploader_batch);
+    json_get_int(text, tok, json_path(text, tok, 0, "uploader.flush_ms"), &cfg->uploader_flush_ms);
+    json_get_int(text, tok, json_path(text, tok, 0, "uploader.queue"), &cfg->uploader_queue);
+    json_get_int(text, tok, json_path(text, tok, 0, "uploader.alert_queue"), &cfg->uploader_alert_queue);
+
+    json_get_int(text, tok, json_path(text, tok, 0, "backfill.batch"), &cfg->backfill_batch);
+    json_get_int(text, tok, json_path(text, tok, 0, "backfill.concurrency"), &cfg->backfill_concurrency);
+    json_get_int(text, tok, json_path(text, tok, 0, "backfill.rate_kb"), &cfg->backfill_rate_kb);
+    json_get_bool(text, tok, json_path(text, tok, 0, "backfill.gzip"), &cfg->backfill_gzip);
+    json_get_string(text, tok, json_path(text, tok, 0, "backfill.checkpoint"),
+                    cfg->backfill_checkpoint, sizeof(cfg->backfill_checkpoint));
+
+    json_get_string(text, tok, json_path(text, tok, 0, "aggregator.host"),
+                    cfg->forward_host, sizeof(cfg->forward_host));
+    json_get_string(text, tok, json_path(text, tok, 0, "aggregator.gateway"),
+                    cfg->forward_gateway, sizeof(cfg->forward_gateway));
+    json_get_int(text, tok, json_path(text, tok, 0, "aggregator.window"), &cfg->forward_window);
+    json_get_int(text, tok, json_path(text, tok, 0, "aggregator.port"), &cfg->aggregator_port);
+    json_get_string(text, tok, json_path(text, tok, 0, "aggregator.listen"),
+                    cfg->aggregator_listen, sizeof(cfg->aggregator_listen));
+    json_get_int(text, tok, json_path(text, tok, 0, "aggregator.batch"), &cfg->aggregator_batch);
+    json_get_int(text, tok, json_path(text, tok, 0, "aggregator.flush_ms"), &cfg->aggregator_flush_ms);
+    json_get_int(text, tok, json_path(text, tok, 0, "aggregator.concurrency"),
+                 &cfg->aggregator_concurrency);
+    json_get_int(text, tok, json_path(text, tok, 0, "aggregator.queue"), &cfg->aggregator_queue);
+    json_get_bool(text, tok, json_path(text, tok, 0, "aggregator.gzip"), &cfg->aggregator_gzip);
+
+    if (cfg->interval_ms <= 0) cfg->interval_ms = 300;
+    if (cfg->store_rollup_seconds <= 0) cfg->store_rollup_seconds = 60;
+    if (cfg->store_flush_seconds <= 0) cfg->store_flush_seconds = 60;
+    if (cfg->trend_window_s <= 0) cfg->trend_window_s = 10;
+    if (cfg->trend_min_frames < 2) cfg->trend_min_frames = 2;
+    if (cfg->i2c_timeout_ms < 0) cfg->i2c_timeout_ms = 0;
+    if (cfg->i2c_recover_after < 0) cfg->i2c_recover_after = 0;
+    if (cfg->snapshot_interval_s <= 0) cfg->snapshot_interval_s = 30;
+    if (cfg->snapshot_max_age_s < 0) cfg->snapshot_max_age_s = 0;
+    if (cfg->low_power_align_ms <= 0) cfg->low_power_align_ms = 100;
+    if (cfg->uploader_batch <= 0) cfg->uploader_batch = 1;
+    if (cfg->uploader_queue < cfg->uploader_batch) cfg->uploader_queue = cfg->uploader_batch;
+    if (cfg->uploader_alert_queue <= 0) cfg->uploader_alert_queue = 1;
+    if (cfg->backfill_batch <= 0) cfg->backfill_batch = 1;
+    if (cfg->backfill_concurrency <= 0) cfg->backfill_concurrency = 1;
+    if (cfg->forward_window <= 0) cfg->forward_window = 1;
+    if (cfg->aggregator_batch <= 0) cfg->aggregator_batch = 1;
+    if (cfg->aggregator_concurrency <= 0) cfg->aggregator_concurrency = 1;
+    if (cfg->aggregator_queue <= 0) cfg->aggregator_queue = 1;
+
+    // Without a sensor list the single built-in sensor follows "interval"
+    int list = json_find(text, tok, 0, "sensors");
+    if (list >= 0 && tok[list].type == JSON_ARRAY) {
+        if (tok[list].size == 0 || tok[list].size > CONFIG_MAX_SENSORS) {
+            logger_log(LOG_ERROR, "Config: sensors must list 1..%d entries", CONFIG_MAX_SENSORS);
+            return -1;
+        }
+        cfg->sensor_count = tok[list].size;
+        for (int k = 0; k < cfg->sensor_count; k++) {
+            if (parse_sensor(text, tok, json_array_item(tok, list, k),
+                             &cfg->sensors[k], k, cfg->interval_ms) != 0) {
+                return -1;
+            }
+            for (int j = 0; j < k; j++) {
+                if (strcmp(cfg->sensors[j].id, cfg->sensors[k].id) == 0) {
+                    logger_log(LOG_ERROR, "Config: duplicate sensor id %s", cfg->sensors[k].id);
+                    return -1;
+                }
+            }
+        }
+    } else {
+        cfg->sensors[0].interval_ms = cfg->interval_ms;
+    }
+    for (int k = 0; k < cfg->sensor_count; k++) {
+        if (check_rules(cfg, &cfg->sensors[k]) != 0) {
+            return -1;
+        }
+    }
+
+    logger_log(LOG_INFO, "Configuration loaded from %s (%d sensor%s)",
+               path, cfg->sensor_count, cfg->sensor_count == 1 ? "" : "s");
+    return 0;
+}
+
+const SensorConfig *config_find_sensor(const AppConfig *cfg, const char *id) {
+    for (int k = 0; k < cfg->sensor_count; k++) {
+        if (strcmp(cfg->sensors[k].id, id) == 0) {
+            return &cfg->sensors[k];
+        }
+    }
+    return NULL;
+}
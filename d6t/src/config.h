@@ -0,0 +1,162 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DEFAULT_CONFIG_PATH "/opt2/sees/aibc_demo/config/config.json"
+#define DEFAULT_LOG_DIR     "/opt2/sees/aibc_demo/logs"
+#define CONFIG_MAX_SENSORS  16
+#define CONFIG_MAX_PRE_TRIGGER 64
+#define CONFIG_MAX_RULES    8
+#define CONFIG_MAX_ZONES    8
+
+// Per-sensor smoothing applied before the frame is published
+typedef enum {
+    FILTER_NONE,
+    FILTER_EMA,         // Exponential moving average, weight filter_alpha
+    FILTER_MEDIAN3      // Per-pixel median of the last three frames
+} FilterType;
+
+// Which temperature records are uploaded (policy.c)
+typedef enum {
+    POLICY_FULL,        // Every frame
+    POLICY_SUMMARY      // Periodic summaries, full frames around anomalies
+} PolicyMode;
+
+// An alert rule (rule.h): when the condition holds the sensor is abnormal
+typedef struct {
+    char when[160];
+    char reason[96];                // "" = the rule text
+} RuleConfig;
+
+// A named group of pixels of one sensor (zone.h)
+typedef struct {
+    char name[16];
+    uint16_t mask;                  // Bit p set: pixel p is in the zone
+} ZoneConfig;
+
+typedef struct {
+    char id[32];                    // sensor_id reported upstream
+    char device[64];                // I2C bus device
+    int address;                    // 7-bit I2C address
+    int interval_ms;                // Sampling interval for this sensor
+    FilterType filter;
+    double filter_alpha;
+    PolicyMode upload_mode;
+    int summary_ms;                 // Summary period
+    int pre_trigger;                // Frames sent from before an anomaly
+    int post_trigger_ms;            // Full frames continue this long after one
+    char power_chip[64];            // GPIO chip of the power switch ("" = none)
+    int power_line;                 // Line offset on power_chip
+    bool power_active_low;
+    int power_off_ms;               // Off time of a power cycle
+    RuleConfig rules[CONFIG_MAX_RULES];     // In addition to alert.rules
+    int rule_count;
+    ZoneConfig zones[CONFIG_MAX_ZONES];
+    int zone_count;
+} SensorConfig;
+
+// Settings read from the shared config/config.json
+typedef struct {
+    char log_dir[256];
+    bool output_uring;              // Log and FIFO writes through io_uring (output.c)
+    int interval_ms;                // Default sampling interval
+    double threshold_min;           // Normal range, same as the Node side
+    double threshold_max;
+    int alert_history_seconds;      // Frame history attached to alerts (0 = none)
+    RuleConfig rules[CONFIG_MAX_RULES];     // alert.rules, for every sensor
+    int rule_count;
+
+    // Rate-of-rise alerts (trend.c), in degC per minute (0 = rule off)
+    bool trend_enabled;
+    int trend_window_s;             // Frames the slope is fitted over
+    int trend_min_frames;           // No trend alert from fewer frames
+    double trend_pixel_rise;        // Any pixel rising faster than this
+    double trend_sensor_rise;       // The frame mean rising faster than this
+
+    // I2C transactions (i2cbus.c)
+    int i2c_timeout_ms;             // Deadline of one sensor read (0 = none)
+    int i2c_retries;                // Adapter retries (-1 = leave as is)
+    int i2c_recover_after;          // Failed reads before each recovery step (0 = never)
+
+    // Warm-restart snapshots of per-sensor state (snapshot.c)
+    bool snapshot_enabled;
+    char snapshot_dir[256];
+    int snapshot_interval_s;        // Between periodic snapshots
+    int snapshot_max_age_s;         // Older analytics state is not restored
+
+    // Low-power mode: shared wakeups and combined I2C transfers
+    bool low_power;
+    int low_power_align_ms;         // Timers expire on multiples of this
+
+    int sensor_count;
+    SensorConfig sensors[CONFIG_MAX_SENSORS];
+
+    // Named pipe transport (read by the Node.js pipeReader)
+    bool pipe_enabled;
+    char pipe_name[256];
+    char pipe_alert_name[256];      // Alert lines, kept apart from frames ("" = off)
+    char pipe_record_name[256];     // Binary frames for d6trecord ("" = off)
+    bool pipe_record_zero_copy;     // vmsplice() instead of write() (recorder.c)
+
+    char server_ip[64];
+    int server_port;
+    char endpoint_temperature[128];
+    char endpoint_alerts[128];
+    char endpoint_summary[128];     // Summaries in summary upload mode
+    char endpoint_backfill[128];    // Batched records (d6tbackfill, d6taggregate)
+
+    // Compressed columnar frame store (store.c)
+    bool store_enabled;
+    char store_dir[256];
+    int store_chunk_seconds;        // Time bucket per chunk
+    int store_flush_seconds;        // Partial chunks are written this often
+
+    // Compaction and retention (d6tcompact); 0 disables each limit
+    int store_raw_days;             // Days of raw frames before rollup
+    int store_rollup_seconds;       // Rollup interval
+    int store_retention_days;       // Days before data is deleted
+    int store_quota_mb;             // Per-sensor disk quota
+    int store_compact_rate_kb;      // Compactor I/O limit, KiB/s
+
+    // Direct HTTP uploader (single-hop mode, replaces the pipe + Node hop)
+    bool uploader_enabled;
+    int uploader_batch;             // Max requests pipelined per write
+    int uploader_flush_ms;          // Max time a record waits for a batch
+    int uploader_queue;             // Queued records before the oldest is dropped
+    int uploader_alert_queue;       // Same, for the alert lane
+
+    // Historical backfill (d6tbackfill)
+    int backfill_batch;             // Records per request
+    int backfill_concurrency;       // Requests in flight
+    int backfill_rate_kb;           // Upload limit, KiB/s (0 = unlimited)
+    bool backfill_gzip;             // Send bodies with Content-Encoding: gzip
+    char backfill_checkpoint[256];  // Progress file for resuming
+
+    // Multi-gateway aggregation: gateways stream frames (forwarder.c) to
+    // d6taggregate, which batches them upstream
+    char forward_host[64];          // Aggregator address ("" = off)
+    char forward_gateway[64];       // Name given to the aggregator ("" = host name)
+    int forward_window;             // Unacknowledged frames kept for resending
+    int aggregator_port;
+    char aggregator_listen[64];     // Address d6taggregate binds
+    int aggregator_batch;           // Records per upstream request
+    int aggregator_flush_ms;        // Max time a record waits for a batch
+    int aggregator_concurrency;     // Upstream requests in flight
+    int aggregator_queue;           // Batches queued before gateways are paused
+    bool aggregator_gzip;           // Send bodies with Content-Encoding: gzip
+} AppConfig;
+
+// Fill cfg with built-in defaults
+void config_defaults(AppConfig *cfg);
+
+// Load the config file on top of the defaults. Returns 0 on success; on
+// failure cfg may be partially updated, so load into a scratch copy when
+// the current settings must survive a bad file.
+int config_load(const char *path, AppConfig *cfg);
+
+// Find a sensor by id, or NULL
+const SensorConfig *config_find_sensor(const AppConfig *cfg, const char *id);
+
+#endif // CONFIG_H
@@ -0,0 +1,199 @@
+#include "evloop.h"
+#include "logger.h"
+#include "timestamp.h"
+
+#include <sys/timerfd.h>
+
+#define NS_PER_MS 1000000LL
+
+typedef struct {
+    EvCallback cb;
+    void *arg;
+    int is_timer;
+    int64_t due_ns;                 // Virtual time: next expiry (0 = disarmed)
+    int64_t interval_ns;
+} EvHandler;
+
+static int epfd = -1;
+static int max_fd = -1;
+static int64_t align_ns;
+static volatile int running = 0;
+static EvHandler handlers[EVLOOP_MAX_FDS];
+static void (*prepare)(void);
+
+int evloop_init(void) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        logger_perror("epoll_create1");
+        return -1;
+    }
+    return 0;
+}
+
+int evloop_add(int fd, uint32_t events, EvCallback cb, void *arg) {
+    if (fd < 0 || fd >= EVLOOP_MAX_FDS) {
+        logger_log(LOG_ERROR, "evloop: fd %d out of range", fd);
+        return -1;
+    }
+    struct epoll_event ev = { .events = events, .data.fd = fd };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        logger_perror("epoll_ctl(ADD)");
+        return -1;
+    }
+    handlers[fd].cb = cb;
+    handlers[fd].arg = arg;
+    handlers[fd].is_timer = 0;
+    if (fd > max_fd) max_fd = fd;
+    return 0;
+}
+
+int evloop_mod(int fd, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.fd = fd };
+    if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        logger_perror("epoll_ctl(MOD)");
+        return -1;
+    }
+    return 0;
+}
+
+int evloop_del(int fd) {
+    if (fd < 0 || fd >= EVLOOP_MAX_FDS) return -1;
+    handlers[fd].cb = NULL;
+    handlers[fd].arg = NULL;
+    handlers[fd].due_ns = 0;
+    return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+void evloop_set_align(int align_ms) {
+    align_ns = align_ms * NS_PER_MS;
+}
+
+int evloop_timer_set(int tfd, int initial_ms, int interval_ms) {
+    int64_t due = initial_ms > 0 ? ts_mono_ns() + initial_ms * NS_PER_MS : 0;
+    int64_t interval = interval_ms * NS_PER_MS;
+
+    if (align_ns > 0 && due != 0) {
+        due = (due + align_ns - 1) / align_ns * align_ns;
+        if (interval > 0) {
+            interval = (interval + align_ns / 2) / align_ns * align_ns;
+            if (interval == 0) interval = align_ns;
+        }
+    }
+    if (ts_virtual()) {
+        // The timerfd stays disarmed; evloop_run() fires the timer
+        handlers[tfd].due_ns = due;
+        handlers[tfd].interval_ns = interval;
+        return 0;
+    }
+    // Absolute, so that aligned timers expire together
+    struct itimerspec its = {
+        .it_value = { due / 1000000000, due % 1000000000 },
+        .it_interval = { interval / 1000000000, interval % 1000000000 },
+    };
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        logger_perror("timerfd_settime");
+        return -1;
+    }
+    return 0;
+}
+
+int evloop_timer_add(int interval_ms, EvCallback cb, void *arg) {
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) {
+        logger_perror("timerfd_create");
+        return -1;
+    }
+    if (evloop_add(tfd, EPOLLIN, cb, arg) != 0) {
+        close(tfd);
+        return -1;
+    }
+    if (evloop_timer_set(tfd, interval_ms, interval_ms) != 0) {
+        evloop_del(tfd);
+        close(tfd);
+        return -1;
+    }
+    handlers[tfd].is_timer = 1;
+    return tfd;
+}
+
+// Virtual time: move the clock to the earliest armed timer and run it.
+// Ties go to the lower descriptor, so runs repeat exactly. Returns false
+// if no timer is armed.
+static bool run_virtual_timer(void) {
+    int next = -1;
+
+    for (int fd = 0; fd <= max_fd; fd++) {
+        EvHandler *h = &handlers[fd];
+        if (h->cb && h->is_timer && h->due_ns != 0 &&
+            (next < 0 || h->due_ns < handlers[next].due_ns)) {
+            next = fd;
+        }
+    }
+    if (next < 0) {
+        return false;
+    }
+    EvHandler *h = &handlers[next];
+    ts_advance_to(h->due_ns);
+    if (h->interval_ns > 0) {
+        // Expirations missed while a callback advanced the clock are one
+        // batch, as with a timerfd
+        int64_t now = ts_mono_ns();
+        do {
+            h->due_ns += h->interval_ns;
+        } while (h->due_ns <= now);
+    } else {
+        h->due_ns = 0;
+    }
+    h->cb(next, EPOLLIN, h->arg);
+    return true;
+}
+
+void evloop_set_prepare(void (*fn)(void)) {
+    prepare = fn;
+}
+
+int evloop_run(void) {
+    struct epoll_event events[64];
+
+    running = 1;
+    while (running) {
+        if (prepare) prepare();
+        // In virtual time pending I/O is handled first, then the next timer
+        // runs at once instead of being waited for
+        bool virt = ts_virtual();
+        int n = epoll_wait(epfd, events, 64, virt ? 0 : -1);
+        if (n == 0 && virt && run_virtual_timer()) {
+            continue;
+        }
+        if (n == 0 && virt) {
+            n = epoll_wait(epfd, events, 64, -1);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            logger_perror("epoll_wait");
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            EvHandler *h = &handlers[fd];
+            if (!h->cb) continue;   // Removed by an earlier callback
+            if (h->is_timer) {
+                uint64_t expirations;
+                if (read(fd, &expirations, sizeof(expirations)) < 0) continue;
+            }
+            h->cb(fd, events[i].events, h->arg);
+        }
+    }
+    return 0;
+}
+
+void evloop_stop(void) {
+    running = 0;
+}
+
+void evloop_close(void) {
+    if (epfd >= 0) {
+        close(epfd);
+        epfd = -1;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+// Single-threaded epoll event loop shared by the sampler and transports.
+// Handlers are kept in a table indexed by file descriptor. In virtual time
+// (timestamp.h) timers do not wait: when no I/O is pending the clock jumps
+// to the earliest expiry and that timer runs.
+
+#define EVLOOP_MAX_FDS 1024
+
+typedef void (*EvCallback)(int fd, uint32_t events, void *arg);
+
+// Create the epoll instance
+int evloop_init(void);
+
+// Register, modify or remove interest in a file descriptor
+int evloop_add(int fd, uint32_t events, EvCallback cb, void *arg);
+int evloop_mod(int fd, uint32_t events);
+int evloop_del(int fd);
+
+// Create a timerfd firing every interval_ms (0 = disarmed) and register it.
+// The callback runs once per expiration batch; the counter is drained here.
+int evloop_timer_add(int interval_ms, EvCallback cb, void *arg);
+
+// Re-arm a timer: first expiry after initial_ms, then every interval_ms
+// (interval_ms = 0 makes it one-shot, initial_ms = 0 disarms it)
+int evloop_timer_set(int tfd, int initial_ms, int interval_ms);
+
+// Make timers expire on multiples of align_ms of CLOCK_MONOTONIC, so timers
+// of all kinds share wakeups (0 = off). Intervals are rounded to the
+// nearest multiple. Applies to timers armed afterwards.
+void evloop_set_align(int align_ms);
+
+// Call fn before every wait, once the handlers of the last wakeup have run
+void evloop_set_prepare(void (*fn)(void));
+
+// Dispatch events until evloop_stop() is called
+int evloop_run(void);
+void evloop_stop(void);
+
+// Close the epoll instance
+void evloop_close(void);
+
+#endif // EVLOOP_H
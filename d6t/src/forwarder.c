@@ -0,0 +1,390 @@
+#include "forwarder.h"
+#include "evloop.h"
+#include "logger.h"
+#include "wire.h"
+
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define FORWARDER_WBUF_SIZE   16384
+#define FORWARDER_RBUF_SIZE   256
+#define FORWARDER_BACKOFF_MIN 200
+#define FORWARDER_BACKOFF_MAX 10000
+#define FORWARDER_MAX_IDS     (CONFIG_MAX_SENSORS * 4)  // Sensor ids seen since start
+
+typedef enum {
+    CONN_IDLE,
+    CONN_CONNECTING,
+    CONN_OPEN
+} ConnState;
+
+typedef struct {
+    uint8_t len;
+    uint8_t data[WIRE_MAX_MSG];
+} FwdSlot;
+
+// Sequence numbers are kept by sensor id rather than by sensor slot, so a
+// sensor removed and added again by config reloads does not restart them
+// within the session.
+typedef struct {
+    char id[32];
+    uint32_t next_seq;
+} FwdSeq;
+
+// Frames are numbered from the start of the process. The window holds
+// [acked, tail); [acked, sent) have been written on the current connection,
+// which started at conn_base, so the aggregator's per-connection count n
+// acknowledges everything below conn_base + n.
+static struct {
+    struct sockaddr_in addr;
+    char host[64];
+    char gateway[WIRE_MAX_NAME];
+    uint32_t session;
+    FwdSeq seqs[FORWARDER_MAX_IDS];
+    int n_seqs;
+
+    FwdSlot *slots;
+    int cap;
+    uint64_t acked;
+    uint64_t sent;
+    uint64_t tail;
+    uint64_t conn_base;
+    uint64_t resend_end;            // Frames below this were sent before
+    bool overflowing;
+
+    int fd;
+    ConnState state;
+    uint8_t wbuf[FORWARDER_WBUF_SIZE];
+    int wlen;
+    int wpos;
+    uint8_t rbuf[FORWARDER_RBUF_SIZE];
+    int rlen;
+
+    int retry_tfd;
+    bool retry_pending;
+    int backoff_ms;
+
+    ForwarderStats stats;
+} fw = { .fd = -1, .retry_tfd = -1 };
+
+static void conn_event(int fd, uint32_t events, void *arg);
+static void try_send(void);
+
+static void conn_close(void) {
+    if (fw.fd >= 0) {
+        evloop_del(fw.fd);
+        close(fw.fd);
+        fw.fd = -1;
+    }
+    fw.state = CONN_IDLE;
+    fw.wlen = fw.wpos = 0;
+    fw.rlen = 0;
+    if (fw.sent > fw.resend_end) fw.resend_end = fw.sent;
+    fw.sent = fw.acked;
+}
+
+static void conn_fail(const char *what) {
+    logger_log(LOG_ERROR, "Forwarder: %s (%s:%d), retrying in %d ms",
+               what, fw.host, ntohs(fw.addr.sin_port), fw.backoff_ms);
+    conn_close();
+    fw.retry_pending = true;
+    evloop_timer_set(fw.retry_tfd, fw.backoff_ms, 0);
+    fw.backoff_ms *= 2;
+    if (fw.backoff_ms > FORWARDER_BACKOFF_MAX) fw.backoff_ms = FORWARDER_BACKOFF_MAX;
+}
+
+static void conn_start(void) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        conn_fail(strerror(errno));
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&fw.addr, sizeof(fw.addr)) < 0 &&
+        errno != EINPROGRESS) {
+        close(fd);
+        conn_fail(strerror(errno));
+        return;
+    }
+    if (evloop_add(fd, EPOLLOUT, conn_event, NULL) != 0) {
+        close(fd);
+        conn_fail("cannot watch socket");
+        return;
+    }
+    fw.fd = fd;
+    fw.state = CONN_CONNECTING;
+}
+
+static void handle_ack(uint64_t count) {
+    uint64_t upto = fw.conn_base + count;
+    if (upto > fw.sent) {
+        conn_fail("acknowledgement beyond what was sent");
+        return;
+    }
+    if (upto > fw.acked) {
+        fw.stats.acked += upto - fw.acked;
+        fw.acked = upto;
+    }
+}
+
+static void handle_readable(void) {
+    for (;;) {
+        ssize_t n = read(fw.fd, fw.rbuf + fw.rlen, FORWARDER_RBUF_SIZE - fw.rlen);
+        if (n > 0) {
+            WireMsg msg;
+            int used, off = 0;
+            fw.rlen += (int)n;
+            while ((used = wire_get(fw.rbuf + off, fw.rlen - off, &msg)) > 0) {
+                if (msg.type != WIRE_ACK) {
+                    conn_fail("unexpected message from aggregator");
+                    return;
+                }
+                handle_ack(msg.ack);
+                if (fw.state != CONN_OPEN) return;
+                off += used;
+            }
+            if (used < 0) {
+                conn_fail("malformed message from aggregator");
+                return;
+            }
+            memmove(fw.rbuf, fw.rbuf + off, fw.rlen - off);
+            fw.rlen -= off;
+            continue;
+        }
+        if (n == 0) {
+            conn_fail("connection closed by aggregator");
+            return;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        if (errno == EINTR) continue;
+        conn_fail(strerror(errno));
+        return;
+    }
+}
+
+// Copy unsent frames into the write buffer and write as much as the socket
+// takes. Returns with EPOLLOUT armed if anything is left over.
+static void handle_writable(void) {
+    for (;;) {
+        if (fw.wpos == fw.wlen) {
+            fw.wlen = fw.wpos = 0;
+            while (fw.sent < fw.tail) {
+                const FwdSlot *s = &fw.slots[fw.sent % fw.cap];
+                if (fw.wlen + s->len > FORWARDER_WBUF_SIZE) break;
+                memcpy(fw.wbuf + fw.wlen, s->data, s->len);
+                fw.wlen += s->len;
+                if (fw.sent < fw.resend_end) fw.stats.resent++;
+                fw.sent++;
+            }
+            if (fw.wlen == 0) {
+                evloop_mod(fw.fd, EPOLLIN);
+                return;
+            }
+        }
+        ssize_t n = send(fw.fd, fw.wbuf + fw.wpos, fw.wlen - fw.wpos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                evloop_mod(fw.fd, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            if (errno == EINTR) continue;
+            conn_fail(strerror(errno));
+            return;
+        }
+        fw.wpos += (int)n;
+    }
+}
+
+static void conn_event(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)arg;
+
+    if (fw.state == CONN_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fw.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            conn_fail(strerror(err));
+            return;
+        }
+        fw.state = CONN_OPEN;
+        fw.stats.connects++;
+        fw.backoff_ms = FORWARDER_BACKOFF_MIN;
+        logger_log(LOG_INFO, "Forwarder: connected to %s:%d as %s, %llu frames to resend",
+                   fw.host, ntohs(fw.addr.sin_port), fw.gateway,
+                   (unsigned long long)(fw.tail - fw.acked));
+
+        // Everything not acknowledged goes out again after the hello
+        fw.conn_base = fw.sent = fw.acked;
+        fw.wlen = wire_put_hello(fw.wbuf, sizeof(fw.wbuf), fw.session, fw.gateway);
+        fw.wpos = 0;
+        handle_writable();
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        handle_readable();
+        if (fw.state != CONN_OPEN) return;
+    }
+    if (events & EPOLLOUT) {
+        handle_writable();
+    }
+}
+
+static void try_send(void) {
+    if (fw.state == CONN_IDLE) {
+        if (!fw.retry_pending) conn_start();
+        return;
+    }
+    // A pending write finishes on EPOLLOUT and picks up new frames then
+    if (fw.state == CONN_OPEN && fw.wpos == fw.wlen) {
+        handle_writable();
+    }
+}
+
+static void retry_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    fw.retry_pending = false;
+    try_send();
+}
+
+static int set_target(const AppConfig *cfg) {
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)cfg->aggregator_port);
+    if (inet_pton(AF_INET, cfg->forward_host, &addr.sin_addr) != 1) {
+        logger_log(LOG_ERROR, "Forwarder: invalid aggregator address %s", cfg->forward_host);
+        return -1;
+    }
+    fw.addr = addr;
+    snprintf(fw.host, sizeof(fw.host), "%s", cfg->forward_host);
+    if (cfg->forward_gateway[0] != '\0') {
+        snprintf(fw.gateway, sizeof(fw.gateway), "%s", cfg->forward_gateway);
+    } else if (gethostname(fw.gateway, sizeof(fw.gateway)) != 0) {
+        snprintf(fw.gateway, sizeof(fw.gateway), "%s", "gateway");
+    }
+    fw.gateway[sizeof(fw.gateway) - 1] = '\0';
+    return 0;
+}
+
+int forwarder_init(const AppConfig *cfg) {
+    if (set_target(cfg) != 0) return -1;
+
+    // A new session per process start: sequence numbers restart with it
+    if (getrandom(&fw.session, sizeof(fw.session), 0) != sizeof(fw.session)) {
+        fw.session = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    }
+    fw.cap = cfg->forward_window;
+    fw.slots = calloc(fw.cap, sizeof(FwdSlot));
+    if (!fw.slots) {
+        logger_log(LOG_ERROR, "Forwarder: out of memory");
+        return -1;
+    }
+    fw.acked = fw.sent = fw.tail = fw.conn_base = fw.resend_end = 0;
+    fw.n_seqs = 0;
+    fw.backoff_ms = FORWARDER_BACKOFF_MIN;
+    fw.retry_tfd = evloop_timer_add(0, retry_timer, NULL);
+    if (fw.retry_tfd < 0) {
+        forwarder_close();
+        return -1;
+    }
+
+    logger_log(LOG_INFO, "Forwarder: streaming frames to %s:%d (window %d, session %08x)",
+               fw.host, cfg->aggregator_port, fw.cap, fw.session);
+    try_send();
+    return 0;
+}
+
+int forwarder_reconfigure(const AppConfig *cfg) {
+    struct sockaddr_in old = fw.addr;
+    char gateway[WIRE_MAX_NAME];
+
+    snprintf(gateway, sizeof(gateway), "%s", fw.gateway);
+    if (set_target(cfg) != 0) return -1;
+    if (cfg->forward_window != fw.cap) {
+        logger_log(LOG_WARN, "Forwarder: window size change takes effect after restart");
+    }
+    if (old.sin_port != fw.addr.sin_port || old.sin_addr.s_addr != fw.addr.sin_addr.s_addr ||
+        strcmp(gateway, fw.gateway) != 0) {
+        logger_log(LOG_INFO, "Forwarder: reconnecting to %s:%d", fw.host, cfg->aggregator_port);
+        conn_close();
+        fw.retry_pending = false;
+        fw.backoff_ms = FORWARDER_BACKOFF_MIN;
+        evloop_timer_set(fw.retry_tfd, 0, 0);
+        try_send();
+    }
+    return 0;
+}
+
+static FwdSeq *find_seq(const char *sensor_id) {
+    for (int k = 0; k < fw.n_seqs; k++) {
+        if (strcmp(fw.seqs[k].id, sensor_id) == 0) return &fw.seqs[k];
+    }
+    if (fw.n_seqs == FORWARDER_MAX_IDS) return NULL;
+    FwdSeq *q = &fw.seqs[fw.n_seqs++];
+    snprintf(q->id, sizeof(q->id), "%s", sensor_id);
+    q->next_seq = 0;
+    return q;
+}
+
+int forwarder_send(const char *sensor_id, bool abnormal, const StoreFrame *f) {
+    WireFrame wf;
+    FwdSeq *q = find_seq(sensor_id);
+
+    if (!q) {
+        logger_log(LOG_ERROR, "Forwarder: more than %d sensor ids since start, frame of %s dropped",
+                   FORWARDER_MAX_IDS, sensor_id);
+        fw.stats.dropped++;
+        return -1;
+    }
+
+    if (fw.tail - fw.acked == (uint64_t)fw.cap) {
+        fw.stats.dropped++;
+        if (!fw.overflowing) {
+            logger_log(LOG_WARN, "Forwarder: %d frames unacknowledged, dropping new frames", fw.cap);
+            fw.overflowing = true;
+        }
+        return -1;
+    }
+    if (fw.overflowing) {
+        logger_log(LOG_INFO, "Forwarder: window has room again, %lu frames dropped so far",
+                   fw.stats.dropped);
+        fw.overflowing = false;
+    }
+
+    wf.seq = q->next_seq++;
+    wf.flags = abnormal ? WIRE_FLAG_ABNORMAL : 0;
+    snprintf(wf.sensor_id, sizeof(wf.sensor_id), "%s", sensor_id);
+    wf.frame = *f;
+    FwdSlot *s = &fw.slots[fw.tail % fw.cap];
+    s->len = (uint8_t)wire_put_frame(s->data, sizeof(s->data), &wf);
+    fw.tail++;
+    fw.stats.queued++;
+    try_send();
+    return 0;
+}
+
+void forwarder_get_stats(ForwarderStats *st) {
+    *st = fw.stats;
+}
+
+void forwarder_close(void) {
+    if (fw.tail > fw.acked) {
+        logger_log(LOG_WARN, "Forwarder: %llu frames not acknowledged at shutdown",
+                   (unsigned long long)(fw.tail - fw.acked));
+    }
+    conn_close();
+    if (fw.retry_tfd >= 0) {
+        evloop_del(fw.retry_tfd);
+        close(fw.retry_tfd);
+        fw.retry_tfd = -1;
+    }
+    free(fw.slots);
+    fw.slots = NULL;
+    fw.retry_pending = false;
+}
@@ -0,0 +1,41 @@
+#ifndef FORWARDER_H
+#define FORWARDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "store.h"
+
+// Gateway side of multi-gateway aggregation: frames are streamed to
+// d6taggregate over one TCP connection in the wire.h format instead of
+// each gateway posting to the API server itself.
+//
+// Frames stay in a window until the aggregator acknowledges them and are
+// sent again after a reconnect; the aggregator discards the duplicates.
+// When the window is full, new frames are dropped until acknowledgements
+// make room, so what was already sent is never lost to the resend.
+
+typedef struct {
+    unsigned long queued;       // Frames accepted by forwarder_send()
+    unsigned long acked;        // Frames acknowledged by the aggregator
+    unsigned long dropped;      // Frames discarded because the window was full
+    unsigned long resent;       // Frames sent again after a reconnect
+    unsigned long connects;     // TCP connections established
+} ForwarderStats;
+
+// Set up the window and connect. Requires evloop_init().
+int forwarder_init(const AppConfig *cfg);
+
+// Apply a changed aggregator address or gateway name from a reloaded
+// config. Unacknowledged frames are kept and sent on the new connection.
+int forwarder_reconfigure(const AppConfig *cfg);
+
+// Queue a frame of a sensor. Returns 0, or -1 if it was dropped.
+int forwarder_send(const char *sensor_id, bool abnormal, const StoreFrame *f);
+
+void forwarder_get_stats(ForwarderStats *st);
+
+// Close the connection and release the window
+void forwarder_close(void);
+
+#endif // FORWARDER_H
@@ -0,0 +1,87 @@
+#include "frame.h"
+#include "logger.h"
+
+#include <stdlib.h>
+
+typedef struct Slab {
+    struct Slab *next;
+    SensorFrame frames[FRAME_SLAB_FRAMES];
+} Slab;
+
+static struct {
+    Slab *slabs;
+    SensorFrame *free_list;
+    int capacity;
+    FramePoolStats stats;
+} pool;
+
+static int pool_grow(void) {
+    if (pool.capacity >= FRAME_POOL_MAX) {
+        return -1;
+    }
+    Slab *slab = malloc(sizeof(Slab));
+    if (!slab) {
+        logger_perror("Failed to allocate frame slab");
+        return -1;
+    }
+    slab->next = pool.slabs;
+    pool.slabs = slab;
+    for (int k = FRAME_SLAB_FRAMES - 1; k >= 0; k--) {
+        slab->frames[k].next_free = pool.free_list;
+        pool.free_list = &slab->frames[k];
+    }
+    pool.capacity += FRAME_SLAB_FRAMES;
+    pool.stats.slabs++;
+    logger_log(LOG_DEBUG, "Frame pool grown to %d frames", pool.capacity);
+    return 0;
+}
+
+SensorFrame *frame_alloc(void) {
+    if (!pool.free_list && pool_grow() != 0) {
+        if (pool.stats.failed++ == 0) {
+            logger_log(LOG_ERROR, "Frame pool exhausted at %d frames", pool.capacity);
+        }
+        return NULL;
+    }
+    SensorFrame *f = pool.free_list;
+    pool.free_list = f->next_free;
+    f->refs = 1;
+    f->next_free = NULL;
+    pool.stats.allocs++;
+    if (++pool.stats.in_use > pool.stats.peak) {
+        pool.stats.peak = pool.stats.in_use;
+    }
+    return f;
+}
+
+SensorFrame *frame_ref(SensorFrame *f) {
+    f->refs++;
+    return f;
+}
+
+void frame_unref(SensorFrame *f) {
+    if (!f || --f->refs > 0) {
+        return;
+    }
+    f->next_free = pool.free_list;
+    pool.free_list = f;
+    pool.stats.in_use--;
+}
+
+void frame_get_stats(FramePoolStats *st) {
+    *st = pool.stats;
+}
+
+void frame_pool_close(void) {
+    logger_log(LOG_INFO, "Frame pool: %lu slabs, peak %d frames in use, %lu frames handed out",
+               pool.stats.slabs, pool.stats.peak, pool.stats.allocs);
+    if (pool.stats.in_use != 0) {
+        logger_log(LOG_WARN, "Frame pool closed with %d frames in use", pool.stats.in_use);
+    }
+    while (pool.slabs) {
+        Slab *next = pool.slabs->next;
+        free(pool.slabs);
+        pool.slabs = next;
+    }
+    memset(&pool, 0, sizeof(pool));
+}
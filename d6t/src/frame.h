@@ -0,0 +1,65 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "alert.h"
+#include "config.h"
+#include "store.h"
+#include "timestamp.h"
+#include "zone.h"
+
+// Pool of per-frame objects for the sampling path.
+//
+// Each sample is built once in a SensorFrame taken from the pool. Sinks
+// that keep a frame after sample() returns (the alert history ring, the
+// pre-trigger ring of the upload policy) take a reference rather than a
+// copy, and the frame goes back on the free list when the last reference
+// is dropped.
+//
+// Frames are carved from slabs of FRAME_SLAB_FRAMES, allocated only when
+// the free list is empty. The number of frames alive at once is bounded by
+// the rings, so after warm-up sampling never calls malloc; the pool never
+// grows past FRAME_POOL_MAX frames (rounded up to a whole slab).
+
+#define FRAME_N_PIXEL     16
+#define FRAME_SLAB_FRAMES 64
+#define FRAME_POOL_MAX    (CONFIG_MAX_SENSORS * (ALERT_HISTORY_MAX_FRAMES + CONFIG_MAX_PRE_TRIGGER + 2))
+
+typedef struct SensorFrame SensorFrame;
+
+struct SensorFrame {
+    int refs;
+    SensorFrame *next_free;
+    int64_t t_ms;                   // Wall-clock time, ms since the epoch
+    TsText stamp;                   // Local date and time of t_ms
+    double pix[FRAME_N_PIXEL];      // degC, after filtering
+    double avg_temp;
+    bool is_abnormal;
+    ZoneStats zones;                // Per-zone min, max and mean (n = 0: none)
+    StoreFrame store;               // The same frame in sensor units
+};
+
+typedef struct {
+    unsigned long slabs;            // Slabs allocated
+    unsigned long allocs;           // Frames handed out by frame_alloc()
+    unsigned long failed;           // frame_alloc() calls refused at FRAME_POOL_MAX
+    int in_use;                     // Frames alive now
+    int peak;                       // Most frames alive at once
+} FramePoolStats;
+
+// A frame with one reference, or NULL if the pool is at its limit
+SensorFrame *frame_alloc(void);
+
+// Take another reference
+SensorFrame *frame_ref(SensorFrame *f);
+
+// Drop a reference; NULL is ignored
+void frame_unref(SensorFrame *f);
+
+void frame_get_stats(FramePoolStats *st);
+
+// Release the slabs. No frame may be in use.
+void frame_pool_close(void);
+
+#endif // FRAME_H
@@ -0,0 +1,37 @@
+#include "history.h"
+
+void history_reset(FrameHistory *h) {
+    h->head = 0;
+    h->count = 0;
+}
+
+void history_push(FrameHistory *h, int64_t t_ms, const double *pix) {
+    int lo = h->head, hi = h->head + HISTORY_FRAMES;
+
+    for (int p = 0; p < HISTORY_N_PIXEL; p++) {
+        h->v[p][lo] = h->v[p][hi] = (float)pix[p];
+    }
+    h->t_ms[lo] = h->t_ms[hi] = t_ms;
+    h->head = (h->head + 1) % HISTORY_FRAMES;
+    if (h->count < HISTORY_FRAMES) {
+        h->count++;
+    }
+}
+
+// First slot of the latest n frames; slot head + HISTORY_FRAMES - 1 holds
+// the newest, and the mirror keeps everything before it in range
+static int window(const FrameHistory *h, int *n) {
+    if (*n > h->count) *n = h->count;
+    if (*n < 0) *n = 0;
+    return h->head + HISTORY_FRAMES - *n;
+}
+
+int history_pixel(const FrameHistory *h, int p, int n, const float **v) {
+    *v = &h->v[p][window(h, &n)];
+    return n;
+}
+
+int history_times(const FrameHistory *h, int n, const int64_t **t) {
+    *t = &h->t_ms[window(h, &n)];
+    return n;
+}
@@ -0,0 +1,38 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+// Recent frames of one sensor, laid out for per-pixel temporal kernels.
+//
+// Values are stored pixel-major: each pixel has its own time-contiguous
+// block of floats, 64-byte aligned, so a kernel over one pixel's history
+// reads a single linear run of memory. Every value is written twice, at
+// slot i and slot i + HISTORY_FRAMES, which keeps the latest n values of a
+// pixel contiguous even where the ring wraps: windows are handed out as
+// pointers into the ring, never copied.
+
+#define HISTORY_N_PIXEL 16
+#define HISTORY_FRAMES  128             // Frames kept, a multiple of 16
+
+typedef struct {
+    float v[HISTORY_N_PIXEL][2 * HISTORY_FRAMES] __attribute__((aligned(64)));
+    int64_t t_ms[2 * HISTORY_FRAMES] __attribute__((aligned(64)));
+    int head;                           // Next slot written, 0 .. HISTORY_FRAMES-1
+    int count;                          // Frames held, up to HISTORY_FRAMES
+} FrameHistory;
+
+// Forget all frames
+void history_reset(FrameHistory *h);
+
+// Append a frame, dropping the oldest once full
+void history_push(FrameHistory *h, int64_t t_ms, const double *pix);
+
+// The latest n values of pixel p, oldest first. *v stays valid until the
+// next push. Returns the number of values, fewer than n if fewer are held.
+int history_pixel(const FrameHistory *h, int p, int n, const float **v);
+
+// The times of the same frames, ms since the epoch
+int history_times(const FrameHistory *h, int n, const int64_t **t);
+
+#endif // HISTORY_H
@@ -0,0 +1,115 @@
+#include "http.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+void http_response_reset(HttpResponse *r) {
+    r->state = HTTP_RESP_HEADERS;
+    r->body_left = 0;
+    r->status = 0;
+    r->close_after = false;
+}
+
+static void parse_headers(HttpResponse *r, const char *hdr, int len) {
+    const char *line = strstr(hdr, "\r\n");
+    const char *end = hdr + len;
+    bool chunked = false;
+    long content_length = -1;
+
+    if (sscanf(hdr, "HTTP/%*d.%*d %d", &r->status) != 1) {
+        r->status = 0;
+    }
+    while (line && line + 2 < end) {
+        line += 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtol(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            chunked = strstr(line, "chunked") != NULL;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            r->close_after = strncasecmp(line + 11, " close", 6) == 0;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    if (chunked) {
+        r->state = HTTP_RESP_CHUNK_SIZE;
+    } else if (content_length >= 0) {
+        r->body_left = content_length;
+        r->state = HTTP_RESP_BODY;
+    } else if (r->status == 204 || r->status == 304 || r->status / 100 == 1) {
+        r->body_left = 0;
+        r->state = HTTP_RESP_BODY;
+    } else {
+        r->close_after = true;
+        r->state = HTTP_RESP_BODY_UNTIL_CLOSE;
+    }
+}
+
+static void consume(char *buf, int *len, int n) {
+    memmove(buf, buf + n, *len - n);
+    *len -= n;
+}
+
+int http_response_parse(HttpResponse *r, char *buf, int *len, int cap) {
+    if (r->state == HTTP_RESP_DONE) {
+        http_response_reset(r);
+    }
+    for (;;) {
+        switch (r->state) {
+        case HTTP_RESP_HEADERS: {
+            buf[*len] = '\0';
+            char *eoh = strstr(buf, "\r\n\r\n");
+            if (!eoh) {
+                return *len >= cap - 1 ? -1 : 0;
+            }
+            int hlen = (int)(eoh - buf) + 4;
+            parse_headers(r, buf, hlen);
+            consume(buf, len, hlen);
+            break;
+        }
+        case HTTP_RESP_BODY:
+        case HTTP_RESP_CHUNK_DATA: {
+            int n = r->body_left < *len ? (int)r->body_left : *len;
+            consume(buf, len, n);
+            r->body_left -= n;
+            if (r->body_left > 0) return 0;
+            if (r->state == HTTP_RESP_CHUNK_DATA) {
+                r->state = HTTP_RESP_CHUNK_SIZE;
+            } else {
+                r->state = HTTP_RESP_DONE;
+                return 1;
+            }
+            break;
+        }
+        case HTTP_RESP_BODY_UNTIL_CLOSE:
+            *len = 0;       // Completed by EOF
+            return 0;
+        case HTTP_RESP_CHUNK_SIZE:
+        case HTTP_RESP_CHUNK_TRAILER: {
+            buf[*len] = '\0';
+            char *eol = strstr(buf, "\r\n");
+            if (!eol) {
+                return *len >= cap - 1 ? -1 : 0;
+            }
+            int llen = (int)(eol - buf) + 2;
+            if (r->state == HTTP_RESP_CHUNK_SIZE) {
+                long size = strtol(buf, NULL, 16);
+                r->state = size > 0 ? HTTP_RESP_CHUNK_DATA : HTTP_RESP_CHUNK_TRAILER;
+                r->body_left = size + 2;    // Chunk data plus its CRLF
+                consume(buf, len, llen);
+            } else {
+                consume(buf, len, llen);
+                if (llen == 2) {            // Empty line ends the trailer
+                    r->state = HTTP_RESP_DONE;
+                    return 1;
+                }
+            }
+            break;
+        }
+        case HTTP_RESP_DONE:
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <stdbool.h>
+
+// Incremental HTTP/1.1 response parser shared by the uploader and the
+// backfill tool. Bodies are discarded; only the status and connection
+// handling are kept.
+
+typedef enum {
+    HTTP_RESP_HEADERS,
+    HTTP_RESP_BODY,
+    HTTP_RESP_BODY_UNTIL_CLOSE,     // No length given: the body ends at EOF
+    HTTP_RESP_CHUNK_SIZE,
+    HTTP_RESP_CHUNK_DATA,
+    HTTP_RESP_CHUNK_TRAILER,
+    HTTP_RESP_DONE
+} HttpRespState;
+
+typedef struct {
+    HttpRespState state;
+    long body_left;
+    int status;
+    bool close_after;               // Server sent "Connection: close"
+} HttpResponse;
+
+void http_response_reset(HttpResponse *r);
+
+// Consume bytes from buf (*len bytes, cap bytes allocated). Returns 1 when a
+// complete response has been consumed (status and close_after describe it
+// until the next call), 0 when more data is needed, or -1 if the response
+// is malformed or a header does not fit in buf.
+int http_response_parse(HttpResponse *r, char *buf, int *len, int cap);
+
+#endif // HTTP_H
@@ -0,0 +1,557 @@
+#define _GNU_SOURCE             // realpath, timer_create
+#include "i2cbus.h"
+#include "logger.h"
+#include "timestamp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define NS_PER_MS        1000000LL
+#define WD_REPEAT_MS     10         // The watchdog repeats until disarmed
+
+#define IO_OK            0
+#define IO_ERROR         -1
+#define IO_TIMEOUT       -2
+
+// One interval timer for all buses: reads run one at a time
+static struct {
+    bool ready;
+    timer_t timer;
+    int64_t due_ns;                 // Virtual time: the deadline (0 = none)
+} wd;
+static volatile sig_atomic_t wd_expired;
+
+static void on_alarm(int sig) {
+    (void)sig;
+    wd_expired = 1;
+}
+
+// SIGALRM is installed without SA_RESTART, so a blocked read returns EINTR.
+// The timer keeps firing after the deadline in case the signal arrives
+// just before the read starts to block.
+static void wd_init(void) {
+    struct sigaction sa = { .sa_handler = on_alarm };
+    struct sigevent sev = { .sigev_notify = SIGEV_SIGNAL, .sigev_signo = SIGALRM };
+
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGALRM, &sa, NULL) != 0 || timer_create(CLOCK_MONOTONIC, &sev, &wd.timer) != 0) {
+        logger_perror("I2C watchdog");
+        return;
+    }
+    wd.ready = true;
+}
+
+static void wd_arm(int ms) {
+    struct itimerspec it = {
+        .it_value = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * NS_PER_MS },
+        .it_interval = { .tv_sec = 0, .tv_nsec = WD_REPEAT_MS * NS_PER_MS }
+    };
+
+    wd_expired = 0;
+    if (ts_virtual()) {
+        // Only simulated sensors wait in virtual time; wait_ns() checks this
+        wd.due_ns = ms > 0 ? ts_mono_ns() + ms * NS_PER_MS : 0;
+    } else if (wd.ready && ms > 0) {
+        timer_settime(wd.timer, 0, &it, NULL);
+    }
+}
+
+static void wd_disarm(void) {
+    struct itimerspec off = {0};
+
+    wd.due_ns = 0;
+    if (wd.ready && !ts_virtual()) {
+        timer_settime(wd.timer, 0, &off, NULL);
+    }
+}
+
+// Sleep ns, or until the deadline
+static int wait_ns(int64_t ns) {
+    struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+
+    if (ts_virtual()) {
+        int64_t until = ts_mono_ns() + ns;
+        if (wd.due_ns != 0 && until > wd.due_ns) {
+            ts_advance_to(wd.due_ns);
+            wd_expired = 1;
+            return IO_TIMEOUT;
+        }
+        ts_advance_to(until);
+        return IO_OK;
+    }
+    while (nanosleep(&ts, &ts) != 0) {
+        if (errno != EINTR || wd_expired) {
+            return IO_TIMEOUT;
+        }
+    }
+    return IO_OK;
+}
+
+static int io_result(ssize_t r, ssize_t want) {
+    if (r == want) {
+        return IO_OK;
+    }
+    if (r < 0 && errno == EINTR && wd_expired) {
+        return IO_TIMEOUT;
+    }
+    if (r >= 0) {
+        errno = EIO;
+    }
+    return IO_ERROR;
+}
+
+static uint8_t crc8(uint8_t crc, uint8_t data) {
+    crc ^= data;
+    for (int i = 0; i < 8; i++) {
+        crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+    return crc;
+}
+
+/* Simulated sensor */
+
+static double sim_rand(I2cSim *s) {
+    s->rng ^= s->rng >> 12;
+    s->rng ^= s->rng << 25;
+    s->rng ^= s->rng >> 27;
+    return (double)((s->rng * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+static void sim_parse(I2cSim *s, const char *spec, uint8_t addr) {
+    char buf[64], *save = NULL;
+
+    memset(s, 0, sizeof(*s));
+    s->hang_ms = 5000;
+    s->reset_clears = true;
+    s->clock_hz = 100000;
+    s->rng = 0x9E3779B97F4A7C15ULL ^ addr;
+    if (spec[3] != ':') {
+        return;
+    }
+    snprintf(buf, sizeof(buf), "%s", spec + 4);
+    for (char *kv = strtok_r(buf, ",", &save); kv; kv = strtok_r(NULL, ",", &save)) {
+        char *v = strchr(kv, '=');
+        if (!v) {
+            logger_log(LOG_WARN, "I2C sim: ignoring \"%s\"", kv);
+            continue;
+        }
+        *v++ = '\0';
+        if (strcmp(kv, "hang") == 0) s->hang = atof(v);
+        else if (strcmp(kv, "hang_ms") == 0) s->hang_ms = atoi(v);
+        else if (strcmp(kv, "wedge") == 0) s->wedge = atof(v);
+        else if (strcmp(kv, "error") == 0) s->error = atof(v);
+        else if (strcmp(kv, "reset") == 0) s->reset_clears = atoi(v) != 0;
+        else if (strcmp(kv, "clock") == 0) s->clock_hz = atoi(v);
+        else if (strcmp(kv, "seed") == 0) s->rng = strtoull(v, NULL, 0) | 1;
+        else logger_log(LOG_WARN, "I2C sim: unknown option \"%s\"", kv);
+    }
+}
+
+// A room at about 25 degC with a slow drift, PEC included
+static void sim_frame(I2cSim *s, uint8_t addr, uint8_t *data, int len) {
+    uint8_t crc = crc8(0, (uint8_t)((addr << 1) | 1));
+    unsigned long n = s->frames++;
+
+    for (int i = 0; i + 1 < len; i += 2) {
+        int16_t v = i == 0 ? (int16_t)(250 + (n / 200) % 10)
+                           : (int16_t)(240 + ((i / 2) * 7 + n / 20) % 30);
+        data[i] = (uint8_t)(v & 0xFF);
+        data[i + 1] = (uint8_t)((uint16_t)v >> 8);
+    }
+    for (int i = 0; i < len - 1; i++) {
+        crc = crc8(crc, data[i]);
+    }
+    data[len - 1] = crc;
+}
+
+// Time the bytes take on the wire at the simulated clock: 9 bits each, plus
+// start and stop
+static int sim_wire(const I2cSim *s, int bytes) {
+    if (s->clock_hz <= 0) {
+        return IO_OK;
+    }
+    return wait_ns((bytes * 9 + 2) * 1000000000LL / s->clock_hz);
+}
+
+// Address and register, and with a combined transfer the read too; faults
+// are injected here, where a real slave would NAK or stretch the clock
+static int sim_write(I2cBus *b, int bytes) {
+    I2cSim *s = &b->sim;
+
+    if (!s->wedged) {
+        double u = sim_rand(s);
+        if (u < s->error) {
+            errno = EREMOTEIO;
+            return IO_ERROR;
+        }
+        if (u < s->error + s->hang) {
+            if (sim_rand(s) < s->wedge) {
+                s->wedged = true;
+            } else if (wait_ns(s->hang_ms * NS_PER_MS) != IO_OK) {
+                return IO_TIMEOUT;
+            }
+        }
+    }
+    if (s->wedged) {
+        // Without a deadline the read gives up after hang_ms
+        if (wait_ns(s->hang_ms * NS_PER_MS) != IO_OK) {
+            return IO_TIMEOUT;
+        }
+        errno = ETIMEDOUT;
+        return IO_ERROR;
+    }
+    return sim_wire(s, bytes);
+}
+
+static int sim_read(I2cBus *b, uint8_t *data, int len) {
+    int rc = sim_wire(&b->sim, 1 + len);
+    if (rc == IO_OK) {
+        sim_frame(&b->sim, b->addr, data, len);
+    }
+    return rc;
+}
+
+/* Device */
+
+static int open_dev(I2cBus *b) {
+    b->fd = open(b->dev, O_RDWR | O_CLOEXEC);
+    if (b->fd < 0) {
+        return -1;
+    }
+    if (ioctl(b->fd, I2C_SLAVE, b->addr) < 0) {
+        logger_log(LOG_ERROR, "Failed to select device: %s", strerror(errno));
+        close(b->fd);
+        b->fd = -1;
+        return -1;
+    }
+    // Both apply to the whole adapter; the timeout is in units of 10 ms
+    if (b->timeout_ms > 0 && ioctl(b->fd, I2C_TIMEOUT, (unsigned long)(b->timeout_ms + 9) / 10) < 0) {
+        logger_log(LOG_DEBUG, "I2C %s: I2C_TIMEOUT: %s", b->dev, strerror(errno));
+    }
+    if (b->retries >= 0 && ioctl(b->fd, I2C_RETRIES, (unsigned long)b->retries) < 0) {
+        logger_log(LOG_DEBUG, "I2C %s: I2C_RETRIES: %s", b->dev, strerror(errno));
+    }
+    return 0;
+}
+
+static void close_dev(I2cBus *b) {
+    if (b->fd >= 0) {
+        close(b->fd);
+        b->fd = -1;
+    }
+}
+
+// Register write and data read in one I2C_RDWR call with a repeated
+// start: one syscall and no settle sleep. All of it is timed as the read.
+static int transact_combined(I2cBus *b, uint8_t reg, uint8_t *data, int len, I2cTiming *t) {
+    int64_t t0 = ts_mono_ns();
+    int rc;
+
+    if (b->is_sim) {
+        rc = sim_write(b, 2 + 1 + len);
+        if (rc == IO_OK) {
+            sim_frame(&b->sim, b->addr, data, len);
+        }
+    } else if (b->fd < 0 && open_dev(b) != 0) {
+        rc = IO_ERROR;
+    } else {
+        struct i2c_msg msgs[2] = {
+            { .addr = b->addr, .flags = 0, .len = 1, .buf = &reg },
+            { .addr = b->addr, .flags = I2C_M_RD, .len = (uint16_t)len, .buf = data },
+        };
+        struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = 2 };
+        rc = io_result(ioctl(b->fd, I2C_RDWR, &xfer), 2);
+    }
+    t->write_ns = 0;
+    t->settle_ns = 0;
+    t->read_ns = ts_mono_ns() - t0;
+    return rc;
+}
+
+// Register write, settle time, data read. Each phase is timed into t.
+static int transact(I2cBus *b, uint8_t reg, uint8_t *data, int len, I2cTiming *t) {
+    int64_t t0 = ts_mono_ns(), t1, t2;
+    int rc;
+
+    if (b->combined) {
+        return transact_combined(b, reg, data, len, t);
+    }
+    if (b->is_sim) {
+        rc = sim_write(b, 2);
+    } else if (b->fd < 0 && open_dev(b) != 0) {
+        rc = IO_ERROR;
+    } else {
+        rc = io_result(write(b->fd, &reg, 1), 1);
+    }
+    t1 = ts_mono_ns();
+    if (rc == IO_OK) {
+        rc = wait_ns(I2C_SETTLE_MS * NS_PER_MS);
+    }
+    t2 = ts_mono_ns();
+    if (rc == IO_OK) {
+        rc = b->is_sim ? sim_read(b, data, len) : io_result(read(b->fd, data, len), len);
+    }
+    t->write_ns = t1 - t0;
+    t->settle_ns = t2 - t1;
+    t->read_ns = ts_mono_ns() - t2;
+    return rc;
+}
+
+/* Recovery */
+
+static int sysfs_write(const char *dir, const char *file, const char *value) {
+    char path[PATH_MAX + 16];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t r = write(fd, value, strlen(value));
+    close(fd);
+    return r == (ssize_t)strlen(value) ? 0 : -1;
+}
+
+// Unbind and rebind the driver of the controller behind /dev/i2c-N, which
+// resets the controller and clocks a stuck slave free on most of them
+static int adapter_reset(I2cBus *b) {
+    char path[128], ctrl[PATH_MAX], drv[PATH_MAX];
+
+    if (b->is_sim) {
+        if (b->sim.reset_clears) {
+            b->sim.wedged = false;
+        }
+        return 0;
+    }
+    const char *name = strrchr(b->dev, '/');
+    snprintf(path, sizeof(path), "/sys/class/i2c-adapter/%s/..", name ? name + 1 : b->dev);
+    if (!realpath(path, ctrl)) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%.100s/driver", ctrl);
+    if (strlen(ctrl) > 100 || !realpath(path, drv)) {
+        return -1;
+    }
+    const char *ctrl_name = strrchr(ctrl, '/') + 1;
+
+    close_dev(b);
+    if (sysfs_write(drv, "unbind", ctrl_name) != 0) {
+        logger_perror("I2C adapter unbind");
+        return -1;
+    }
+    if (sysfs_write(drv, "bind", ctrl_name) != 0) {
+        logger_perror("I2C adapter bind");
+    }
+    return 0;
+}
+
+static int power_request(I2cBus *b, const SensorConfig *sc) {
+    struct gpio_v2_line_request req;
+
+    int chip = open(sc->power_chip, O_RDWR | O_CLOEXEC);
+    if (chip < 0) {
+        logger_log(LOG_ERROR, "Sensor %s: power switch %s: %s", sc->id, sc->power_chip, strerror(errno));
+        return -1;
+    }
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = (uint32_t)sc->power_line;
+    req.num_lines = 1;
+    req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT | (sc->power_active_low ? GPIO_V2_LINE_FLAG_ACTIVE_LOW : 0);
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    req.config.attrs[0].attr.values = 1;       // On
+    req.config.attrs[0].mask = 1;
+    snprintf(req.consumer, sizeof(req.consumer), "%s", sc->id);
+    int rc = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chip);
+    if (rc < 0) {
+        logger_log(LOG_ERROR, "Sensor %s: power switch %s line %d: %s",
+                   sc->id, sc->power_chip, sc->power_line, strerror(errno));
+        return -1;
+    }
+    b->power_fd = req.fd;
+    return 0;
+}
+
+static int power_set(I2cBus *b, bool on) {
+    struct gpio_v2_line_values v = { .bits = on ? 1 : 0, .mask = 1 };
+
+    if (b->is_sim) {
+        return 0;
+    }
+    if (ioctl(b->power_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &v) < 0) {
+        logger_perror("Sensor power switch");
+        return -1;
+    }
+    return 0;
+}
+
+// Switch the sensor off; i2c_bus_read() switches it back on after
+// power_off_ms and reads again once it has started up
+static int power_cycle(I2cBus *b) {
+    if (!b->is_sim && b->power_fd < 0) {
+        return -1;
+    }
+    if (power_set(b, false) != 0) {
+        return -1;
+    }
+    b->sim.wedged = false;
+    b->power_on_ns = ts_mono_ns() + b->power_off_ms * NS_PER_MS;
+    b->ready_ns = b->power_on_ns + I2C_STARTUP_MS * NS_PER_MS;
+    return 0;
+}
+
+static void recover(I2cBus *b) {
+    static const char *const names[] = {"reopening", "resetting adapter", "power-cycling"};
+
+    for (int tries = 0; tries < 3; tries++) {
+        int step = b->step;
+        b->step = (b->step + 1) % 3;
+
+        int rc = 0;
+        switch (step) {
+        case 0:
+            close_dev(b);
+            break;
+        case 1:
+            rc = adapter_reset(b);
+            break;
+        case 2:
+            rc = power_cycle(b);
+            break;
+        }
+        if (rc == 0) {
+            logger_log(LOG_WARN, "I2C %s 0x%02X: %d failed reads, %s",
+                       b->dev, b->addr, b->failures, names[step]);
+            b->stats.recoveries++;
+            return;
+        }
+    }
+}
+
+/* API */
+
+void i2c_bus_open(I2cBus *b, const SensorConfig *sc, const AppConfig *cfg) {
+    if (!wd.ready) {
+        wd_init();
+    }
+    memset(b, 0, sizeof(*b));
+    snprintf(b->dev, sizeof(b->dev), "%s", sc->device);
+    b->addr = (uint8_t)sc->address;
+    b->fd = -1;
+    b->power_fd = -1;
+    b->power_off_ms = sc->power_off_ms;
+    i2c_bus_configure(b, cfg);
+
+    b->is_sim = strncmp(sc->device, "sim", 3) == 0 && (sc->device[3] == '\0' || sc->device[3] == ':');
+    if (b->is_sim) {
+        sim_parse(&b->sim, sc->device, b->addr);
+        return;
+    }
+    if (sc->power_chip[0] != '\0') {
+        power_request(b, sc);
+    }
+    if (open_dev(b) != 0) {
+        logger_log(LOG_ERROR, "Failed to open device %s: %s", b->dev, strerror(errno));
+    }
+}
+
+void i2c_bus_configure(I2cBus *b, const AppConfig *cfg) {
+    bool changed = b->timeout_ms != cfg->i2c_timeout_ms || b->retries != cfg->i2c_retries;
+
+    b->timeout_ms = cfg->i2c_timeout_ms;
+    b->retries = cfg->i2c_retries;
+    b->recover_after = cfg->i2c_recover_after;
+    b->combined = cfg->low_power;
+    if (changed && b->fd >= 0) {
+        close_dev(b);
+        open_dev(b);
+    }
+}
+
+int i2c_bus_read(I2cBus *b, uint8_t reg, uint8_t *data, int len) {
+    I2cTiming t;
+
+    return i2c_bus_read_timed(b, reg, data, len, &t);
+}
+
+int i2c_bus_read_timed(I2cBus *b, uint8_t reg, uint8_t *data, int len, I2cTiming *t) {
+    int64_t start = ts_mono_ns();
+
+    // Power comes back on at the first read past power_on_ns, however late
+    // that is, and the start-up time counts from then
+    if (b->power_on_ns != 0 && start >= b->power_on_ns) {
+        power_set(b, true);
+        b->power_on_ns = 0;
+        b->ready_ns = start + I2C_STARTUP_MS * NS_PER_MS;
+    }
+    if (b->power_on_ns != 0 || start < b->ready_ns) {
+        memset(t, 0, sizeof(*t));
+        return 1;
+    }
+
+    b->stats.reads++;
+    wd_arm(b->timeout_ms);
+    int rc = transact(b, reg, data, len, t);
+    wd_disarm();
+    int64_t took = ts_mono_ns() - start;
+    if (took > b->stats.max_ns) {
+        b->stats.max_ns = took;
+    }
+    if (b->timeout_ms > 0 && took > (b->timeout_ms + WD_REPEAT_MS) * NS_PER_MS) {
+        logger_log(LOG_WARN, "I2C %s 0x%02X: read took %lld ms, past its %d ms deadline",
+                   b->dev, b->addr, (long long)(took / NS_PER_MS), b->timeout_ms);
+    }
+
+    if (rc == IO_OK) {
+        if (b->failures > 1) {
+            logger_log(LOG_INFO, "I2C %s 0x%02X: reading again after %d failed reads",
+                       b->dev, b->addr, b->failures);
+        }
+        b->failures = 0;
+        b->step = 0;
+        return 0;
+    }
+    if (rc == IO_TIMEOUT) {
+        b->stats.timeouts++;
+        logger_log(LOG_ERROR, "I2C %s 0x%02X: read timed out after %lld ms",
+                   b->dev, b->addr, (long long)(took / NS_PER_MS));
+    } else {
+        b->stats.errors++;
+        logger_log(LOG_ERROR, "I2C %s 0x%02X: read failed: %s", b->dev, b->addr, strerror(errno));
+    }
+    b->failures++;
+    if (b->recover_after > 0 && b->failures % b->recover_after == 0) {
+        recover(b);
+    }
+    return -1;
+}
+
+void i2c_bus_get_stats(const I2cBus *b, I2cStats *st) {
+    *st = b->stats;
+}
+
+void i2c_bus_close(I2cBus *b) {
+    if (b->stats.reads > 0) {
+        logger_log(LOG_INFO, "I2C %s 0x%02X: %lu reads, %lu errors, %lu timeouts, "
+                   "%lu recoveries, longest %.1f ms", b->dev, b->addr, b->stats.reads,
+                   b->stats.errors, b->stats.timeouts, b->stats.recoveries,
+                   (double)b->stats.max_ns / NS_PER_MS);
+    }
+    close_dev(b);
+    if (b->power_fd >= 0) {
+        close(b->power_fd);
+        b->power_fd = -1;
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+// Sensor reads with a bounded duration and hung-bus recovery.
+//
+// Every read has a deadline of i2c.timeout_ms. The adapter is given the
+// same timeout (I2C_TIMEOUT) and i2c.retries (I2C_RETRIES), and an interval
+// timer interrupts a read that is still blocked when the deadline passes,
+// so a wedged slave costs one deadline per sample instead of stopping the
+// event loop. A read that outlasts the deadline anyway (a driver waiting
+// uninterruptibly) is logged with its duration.
+//
+// After i2c.recover_after failed reads in a row the next recovery step is
+// taken, in this order, skipping steps that are not available:
+//   1. reopen the device
+//   2. reset the adapter by unbinding and rebinding its driver (sysfs)
+//   3. power-cycle the sensor through its GPIO line (sensors[].power)
+// Reads are skipped while the sensor is off and starting up again.
+//
+// In low_power mode the register write and the data read go out as one
+// I2C_RDWR transfer with a repeated start, without the settle sleep.
+//
+// A device of "sim" or "sim:key=value,..." is a simulated D6T that
+// produces valid frames and injects faults, for testing without hardware:
+//   hang=P      probability that a read hangs
+//   hang_ms=N   how long a hang lasts (default 5000)
+//   wedge=P     probability that a hang persists until an adapter reset
+//               or power cycle
+//   reset=0     an adapter reset does not clear a wedge, only power does
+//   error=P     probability that a read fails at once (NAK)
+//   clock=HZ    bus clock the wire time is simulated at (default 100000,
+//               0 = none)
+//   seed=N      random seed
+// In virtual time (timestamp.h) hangs and wire time advance the clock
+// instead of sleeping, and the deadline is checked against it.
+
+#define I2C_STARTUP_MS  620         // D6T start-up time after power-on
+#define I2C_SETTLE_MS   1           // Between the register write and the read
+
+typedef struct {
+    unsigned long reads;            // Reads attempted
+    unsigned long errors;           // Failed at once (open, NAK, short read)
+    unsigned long timeouts;         // Stopped at the deadline
+    unsigned long recoveries;       // Recovery steps taken
+    int64_t max_ns;                 // Longest read
+} I2cStats;
+
+// Where the time of one read went
+typedef struct {
+    int64_t write_ns;               // Register write: syscall and wire
+    int64_t settle_ns;              // Sleep before the read
+    int64_t read_ns;                // Data read: syscall and wire
+} I2cTiming;
+
+typedef struct {
+    double hang;
+    int hang_ms;
+    double wedge;
+    double error;
+    int clock_hz;
+    bool reset_clears;              // An adapter reset clears a wedge
+    uint64_t rng;
+    bool wedged;
+    unsigned long frames;
+} I2cSim;
+
+typedef struct {
+    char dev[64];
+    uint8_t addr;
+    int fd;                         // -1 until opened
+    int timeout_ms;
+    int retries;
+    int recover_after;
+    bool combined;                  // Write and read in one I2C_RDWR (low_power)
+
+    int power_fd;                   // GPIO line request, -1 without a switch
+    int power_off_ms;
+    int64_t power_on_ns;            // Switch the sensor back on then (0 = on)
+    int64_t ready_ns;               // No reads before then
+
+    int failures;                   // Failed reads in a row
+    int step;                       // Next recovery step
+    bool is_sim;
+    I2cSim sim;
+    I2cStats stats;
+} I2cBus;
+
+// Open the sensor's device and power switch. A device that cannot be
+// opened yet is retried by each read.
+void i2c_bus_open(I2cBus *b, const SensorConfig *sc, const AppConfig *cfg);
+
+// Apply reloaded i2c.* settings
+void i2c_bus_configure(I2cBus *b, const AppConfig *cfg);
+
+// Write reg and read len bytes. Returns 0, -1 if the read failed or timed
+// out, or 1 if it was skipped because the sensor is being power-cycled.
+int i2c_bus_read(I2cBus *b, uint8_t reg, uint8_t *data, int len);
+
+// i2c_bus_read() that also reports the time of each phase (d6ti2cprof)
+int i2c_bus_read_timed(I2cBus *b, uint8_t reg, uint8_t *data, int len, I2cTiming *t);
+
+void i2c_bus_get_stats(const I2cBus *b, I2cStats *st);
+
+// Log the statistics and release the device and the power switch
+void i2c_bus_close(I2cBus *b);
+
+#endif // I2CBUS_H
@@ -0,0 +1,346 @@
+/*
+ * d6ti2cprof - I2C timing profile and sensors-per-bus capacity report
+ *
+ * Reads the configured sensors the way SensorDataApp does (i2cbus.c) and
+ * reports, per sensor and per bus:
+ *
+ *   - the latency distribution of a frame read and of its phases (register
+ *     write, settle sleep, data read)
+ *   - a sweep of shorter reads fitted to a fixed cost plus a per-byte cost,
+ *     which gives the effective bus clock and the syscall/driver overhead
+ *   - how much of the sampling period a frame takes on the wire, asleep and
+ *     in overhead, and how many sensors one bus sustains at the target rate
+ *
+ * Run it with SensorDataApp stopped, or the two contend for the bus. -j
+ * prints the same report as JSON for capacity planning tools.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "config.h"
+#include "i2cbus.h"
+
+#define D6T_CMD          0x4C
+#define FRAME_BYTES      35         // PTAT, 16 pixels, PEC
+#define WARMUP_READS     5
+#define MAX_READS        100000
+#define BITS_PER_BYTE    9          // 8 data bits and ACK
+
+static const int sweep_len[] = {1, 4, 8, 16, 24, FRAME_BYTES};
+#define N_SWEEP ((int)(sizeof(sweep_len) / sizeof(sweep_len[0])))
+
+typedef struct {
+    double min, p50, p90, p99, max;     // ms
+} Dist;
+
+typedef struct {
+    const SensorConfig *sc;
+    int reads;
+    int failed;
+    Dist total, write, settle, read;
+    double fixed_ms;                    // Fit of read time: fixed_ms + byte_ms * length
+    double byte_ms;
+    double r2;
+    double clock_khz;                   // 0 if the fit gave no usable slope
+    double wire_ms;                     // Per frame: bytes on the wire
+    double overhead_ms;                 // Per frame: neither wire nor settle
+} SensorProfile;
+
+static AppConfig config;
+static SensorProfile prof[CONFIG_MAX_SENSORS];
+static int64_t samples[4][MAX_READS];
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void distribution(int64_t *v, int n, Dist *d) {
+    memset(d, 0, sizeof(*d));
+    if (n == 0) {
+        return;
+    }
+    qsort(v, (size_t)n, sizeof(v[0]), cmp_i64);
+    d->min = v[0] / 1e6;
+    d->p50 = v[n / 2] / 1e6;
+    d->p90 = v[(int)(n * 0.90)] / 1e6;
+    d->p99 = v[(int)(n * 0.99)] / 1e6;
+    d->max = v[n - 1] / 1e6;
+}
+
+static double median_ms(int64_t *v, int n) {
+    if (n == 0) {
+        return 0.0;
+    }
+    qsort(v, (size_t)n, sizeof(v[0]), cmp_i64);
+    return v[n / 2] / 1e6;
+}
+
+// Least squares fit of y = a + b x
+static void fit_line(const double *x, const double *y, int n, double *a, double *b, double *r2) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+
+    for (int i = 0; i < n; i++) {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+        syy += y[i] * y[i];
+    }
+    double den = n * sxx - sx * sx;
+    *b = den != 0 ? (n * sxy - sx * sy) / den : 0;
+    *a = (sy - *b * sx) / n;
+    double vy = n * syy - sy * sy;
+    *r2 = den != 0 && vy > 0 ? (n * sxy - sx * sy) * (n * sxy - sx * sy) / (den * vy) : 0;
+}
+
+static void profile_sensor(SensorProfile *p, const SensorConfig *sc, int n) {
+    uint8_t buf[FRAME_BYTES];
+    I2cTiming t;
+    I2cBus bus;
+    double x[N_SWEEP], y[N_SWEEP];
+
+    memset(p, 0, sizeof(*p));
+    p->sc = sc;
+    i2c_bus_open(&bus, sc, &config);
+    for (int i = 0; i < WARMUP_READS; i++) {
+        i2c_bus_read_timed(&bus, D6T_CMD, buf, FRAME_BYTES, &t);
+    }
+
+    int ok = 0;
+    for (int i = 0; i < n; i++) {
+        if (i2c_bus_read_timed(&bus, D6T_CMD, buf, FRAME_BYTES, &t) != 0) {
+            p->failed++;
+            continue;
+        }
+        samples[0][ok] = t.write_ns + t.settle_ns + t.read_ns;
+        samples[1][ok] = t.write_ns;
+        samples[2][ok] = t.settle_ns;
+        samples[3][ok] = t.read_ns;
+        ok++;
+    }
+    p->reads = n;
+    distribution(samples[0], ok, &p->total);
+    distribution(samples[1], ok, &p->write);
+    distribution(samples[2], ok, &p->settle);
+    distribution(samples[3], ok, &p->read);
+
+    // The read phase against its length; medians keep preemption out
+    int per_len = n / 4 > 20 ? n / 4 : 20;
+    for (int k = 0; k < N_SWEEP; k++) {
+        int m = 0;
+        for (int i = 0; i < per_len; i++) {
+            if (i2c_bus_read_timed(&bus, D6T_CMD, buf, sweep_len[k], &t) == 0) {
+                samples[3][m++] = t.read_ns;
+            }
+        }
+        x[k] = sweep_len[k];
+        y[k] = median_ms(samples[3], m);
+    }
+    i2c_bus_close(&bus);
+
+    fit_line(x, y, N_SWEEP, &p->fixed_ms, &p->byte_ms, &p->r2);
+    if (p->byte_ms > 0) {
+        p->clock_khz = BITS_PER_BYTE / p->byte_ms;
+        // Address and register out, address and the frame in
+        p->wire_ms = (2 + 1 + FRAME_BYTES) * p->byte_ms;
+    }
+    p->overhead_ms = p->total.p50 - p->settle.p50 - p->wire_ms;
+    if (p->overhead_ms < 0) {
+        p->overhead_ms = 0;
+    }
+}
+
+// Sensors one bus sustains at the target period: reads one after another
+// as SensorDataApp does them, and the bound set by wire time alone
+static int capacity(double period_ms, double util, double cost_ms) {
+    return cost_ms > 0 ? (int)(period_ms * util / cost_ms) : 0;
+}
+
+static void print_dist(const char *name, const Dist *d) {
+    printf("    %-8s %8.3f %8.3f %8.3f %8.3f %8.3f\n", name, d->min, d->p50, d->p90, d->p99, d->max);
+}
+
+static void print_text(int count, double period_ms, double util, int n) {
+    printf("I2C timing profile: %d reads per sensor, target %.2f Hz (%.0f ms), %.0f%% utilization\n",
+           n, 1000.0 / period_ms, period_ms, util * 100);
+
+    for (int i = 0; i < count; i++) {
+        const SensorProfile *p = &prof[i];
+        printf("\nSensor %s  %s 0x%02X\n", p->sc->id, p->sc->device, p->sc->address);
+        printf("  frame read (%d bytes), ms   min      p50      p90      p99      max\n", FRAME_BYTES);
+        print_dist("total", &p->total);
+        print_dist("write", &p->write);
+        print_dist("settle", &p->settle);
+        print_dist("read", &p->read);
+        printf("  failed reads          %d of %d\n", p->failed, p->reads);
+        printf("  length sweep          read = %.3f ms + %.4f ms/byte (r2 %.3f)\n",
+               p->fixed_ms, p->byte_ms, p->r2);
+        if (p->clock_khz > 0) {
+            printf("  effective bus clock   %.1f kHz\n", p->clock_khz);
+        } else {
+            printf("  effective bus clock   unknown (no per-byte cost measured)\n");
+        }
+        printf("  per frame (p50)       wire %.2f ms, settle %.2f ms, syscall/driver %.2f ms"
+               " = %.1f%% of the period\n", p->wire_ms, p->settle.p50, p->overhead_ms,
+               p->total.p50 * 100 / period_ms);
+    }
+
+    double round_ms = 0;
+    for (int i = 0; i < count; i++) {
+        bool seen = false;
+        for (int j = 0; j < i; j++) {
+            seen = seen || strcmp(prof[j].sc->device, prof[i].sc->device) == 0;
+        }
+        round_ms += prof[i].total.p99;
+        if (seen) {
+            continue;
+        }
+        double cost = 0, wire = 0;
+        int on_bus = 0;
+        for (int j = i; j < count; j++) {
+            if (strcmp(prof[j].sc->device, prof[i].sc->device) == 0) {
+                cost = prof[j].total.p99 > cost ? prof[j].total.p99 : cost;
+                wire = prof[j].wire_ms > wire ? prof[j].wire_ms : wire;
+                on_bus++;
+            }
+        }
+        printf("\nBus %s: %d sensor%s profiled\n", prof[i].sc->device, on_bus, on_bus == 1 ? "" : "s");
+        printf("  cost per sensor (p99)  %.2f ms, of which wire %.2f ms\n", cost, wire);
+        printf("  sensors per bus        %d with serial reads, %d on wire time alone\n",
+               capacity(period_ms, util, cost), capacity(period_ms, util, wire));
+    }
+    printf("\nProcess: %d sensors, %.2f ms per sampling round (p99 sum) = %.1f%% of the period\n",
+           count, round_ms, round_ms * 100 / period_ms);
+}
+
+static void print_dist_json(const char *name, const Dist *d, const char *sep) {
+    printf("\"%s\":{\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}%s",
+           name, d->min, d->p50, d->p90, d->p99, d->max, sep);
+}
+
+static void print_json(int count, double period_ms, double util, int n) {
+    double round_ms = 0;
+
+    printf("{\"reads\":%d,\"target_hz\":%.3f,\"period_ms\":%.1f,\"utilization\":%.2f,\"sensors\":[",
+           n, 1000.0 / period_ms, period_ms, util);
+    for (int i = 0; i < count; i++) {
+        const SensorProfile *p = &prof[i];
+        round_ms += p->total.p99;
+        printf("%s{\"id\":\"%s\",\"device\":\"%s\",\"address\":%d,\"failed\":%d,\"latency_ms\":{",
+               i ? "," : "", p->sc->id, p->sc->device, p->sc->address, p->failed);
+        print_dist_json("total", &p->total, ",");
+        print_dist_json("write", &p->write, ",");
+        print_dist_json("settle", &p->settle, ",");
+        print_dist_json("read", &p->read, "");
+        printf("},\"fixed_ms\":%.4f,\"byte_ms\":%.5f,\"r2\":%.4f,\"clock_khz\":%.1f,"
+               "\"wire_ms\":%.3f,\"overhead_ms\":%.3f}",
+               p->fixed_ms, p->byte_ms, p->r2, p->clock_khz, p->wire_ms, p->overhead_ms);
+    }
+    printf("],\"buses\":[");
+    int buses = 0;
+    for (int i = 0; i < count; i++) {
+        bool seen = false;
+        for (int j = 0; j < i; j++) {
+            seen = seen || strcmp(prof[j].sc->device, prof[i].sc->device) == 0;
+        }
+        if (seen) {
+            continue;
+        }
+        double cost = 0, wire = 0;
+        printf("%s{\"device\":\"%s\",\"sensors\":[", buses++ ? "," : "", prof[i].sc->device);
+        for (int j = i, k = 0; j < count; j++) {
+            if (strcmp(prof[j].sc->device, prof[i].sc->device) == 0) {
+                printf("%s\"%s\"", k++ ? "," : "", prof[j].sc->id);
+                cost = prof[j].total.p99 > cost ? prof[j].total.p99 : cost;
+                wire = prof[j].wire_ms > wire ? prof[j].wire_ms : wire;
+            }
+        }
+        printf("],\"cost_ms\":%.3f,\"wire_ms\":%.3f,\"max_sensors_serial\":%d,\"max_sensors_wire\":%d}",
+               cost, wire, capacity(period_ms, util, cost), capacity(period_ms, util, wire));
+    }
+    printf("],\"round_ms\":%.3f,\"round_share\":%.4f}\n", round_ms, round_ms / period_ms);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [-c config.json] [options]\n"
+        "  -s sensor_id     sensor to profile (repeatable, default: all)\n"
+        "  -n reads         frame reads per sensor (default 200)\n"
+        "  -r hz            target sampling rate (default: from interval)\n"
+        "  -u fraction      share of the period the bus may be busy (default 0.7)\n"
+        "  -j               JSON report\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *config_path = DEFAULT_CONFIG_PATH;
+    const char *only[CONFIG_MAX_SENSORS];
+    int n_only = 0, n = 200;
+    double rate = 0, util = 0.7;
+    bool json = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:s:n:r:u:jh")) != -1) {
+        switch (opt) {
+        case 'c':
+            config_path = optarg;
+            break;
+        case 's':
+            if (n_only < CONFIG_MAX_SENSORS) only[n_only++] = optarg;
+            break;
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'u':
+            util = atof(optarg);
+            break;
+        case 'j':
+            json = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (n <= 0 || n > MAX_READS || util <= 0 || util > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    config_defaults(&config);
+    if (config_load(config_path, &config) != 0) {
+        fprintf(stderr, "d6ti2cprof: cannot load %s\n", config_path);
+        return 1;
+    }
+    double period_ms = rate > 0 ? 1000.0 / rate : config.interval_ms;
+
+    int count = 0;
+    for (int i = 0; i < config.sensor_count; i++) {
+        const SensorConfig *sc = &config.sensors[i];
+        bool want = n_only == 0;
+        for (int k = 0; k < n_only; k++) {
+            want = want || strcmp(only[k], sc->id) == 0;
+        }
+        if (want) {
+            fprintf(stderr, "d6ti2cprof: profiling %s (%s 0x%02X)\n", sc->id, sc->device, sc->address);
+            profile_sensor(&prof[count++], sc, n);
+        }
+    }
+    if (count == 0) {
+        fprintf(stderr, "d6ti2cprof: no sensor to profile\n");
+        return 1;
+    }
+
+    if (json) {
+        print_json(count, period_ms, util, n);
+    } else {
+        print_text(count, period_ms, util, n);
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include "json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define JSON_MAX_DEPTH 32
+
+static int new_token(JsonToken *tokens, int *count, int max_tokens,
+                     JsonType type, int start, int end) {
+    if (*count >= max_tokens) {
+        return -1;
+    }
+    JsonToken *tok = &tokens[*count];
+    tok->type = type;
+    tok->start = start;
+    tok->end = end;
+    tok->size = 0;
+    return (*count)++;
+}
+
+// Tokenize the document. Nesting is tracked with a fixed stack so that the
+// parser never allocates.
+int json_parse(const char *js, size_t len, JsonToken *tokens, int max_tokens) {
+    int stack[JSON_MAX_DEPTH];
+    int depth = 0;
+    int count = 0;
+    bool expect_key = false;
+    size_t pos;
+
+    for (pos = 0; pos < len; pos++) {
+        char c = js[pos];
+        int parent = depth > 0 ? stack[depth - 1] : -1;
+
+        switch (c) {
+        case '{':
+        case '[': {
+            if (depth >= JSON_MAX_DEPTH) return -1;
+            int idx = new_token(tokens, &count, max_tokens,
+                                c == '{' ? JSON_OBJECT : JSON_ARRAY, (int)pos, -1);
+            if (idx < 0) return -1;
+            if (parent >= 0 && tokens[parent].type == JSON_ARRAY) {
+                tokens[parent].size++;
+            }
+            stack[depth++] = idx;
+            expect_key = (c == '{');
+            break;
+        }
+        case '}':
+        case ']': {
+            if (depth == 0) return -1;
+            int idx = stack[--depth];
+            if (tokens[idx].type != (c == '}' ? JSON_OBJECT : JSON_ARRAY)) return -1;
+            tokens[idx].end = (int)pos + 1;
+            expect_key = false;
+            break;
+        }
+        case '"': {
+            size_t start = ++pos;
+            for (; pos < len && js[pos] != '"'; pos++) {
+                if (js[pos] == '\\' && pos + 1 < len) pos++;
+            }
+            if (pos >= len) return -1;
+            int idx = new_token(tokens, &count, max_tokens, JSON_STRING,
+                                (int)start, (int)pos);
+            if (idx < 0) return -1;
+            // Object keys count as children of the object; values hang off
+            // the key token that precedes them.
+            if (parent >= 0) {
+                if (tokens[parent].type == JSON_OBJECT && expect_key) {
+                    tokens[parent].size++;
+                } else if (tokens[parent].type == JSON_ARRAY) {
+                    tokens[parent].size++;
+                }
+            }
+            break;
+        }
+        case ':':
+            expect_key = false;
+            break;
+        case ',':
+            expect_key = parent >= 0 && tokens[parent].type == JSON_OBJECT;
+            break;
+        case ' ': case '\t': case '\r': case '\n':
+            break;
+        default: {
+            size_t start = pos;
+            while (pos < len && !strchr(" \t\r\n,]}", js[pos])) pos++;
+            int idx = new_token(tokens, &count, max_tokens, JSON_PRIMITIVE,
+                                (int)start, (int)pos);
+            if (idx < 0) return -1;
+            if (parent >= 0 && tokens[parent].type == JSON_ARRAY) {
+                tokens[parent].size++;
+            }
+            pos--;
+            break;
+        }
+        }
+    }
+
+    return depth == 0 ? count : -1;
+}
+
+int json_skip(const JsonToken *t, int i) {
+    int pending = 1;
+    while (pending > 0) {
+        if (t[i].type == JSON_OBJECT) {
+            pending += t[i].size * 2;   // key + value per member
+        } else if (t[i].type == JSON_ARRAY) {
+            pending += t[i].size;
+        }
+        pending--;
+        i++;
+    }
+    return i;
+}
+
+bool json_eq(const char *js, const JsonToken *tok, const char *s) {
+    size_t n = strlen(s);
+    return tok->type == JSON_STRING && (size_t)(tok->end - tok->start) == n &&
+           strncmp(js + tok->start, s, n) == 0;
+}
+
+int json_find(const char *js, const JsonToken *t, int obj, const char *key) {
+    if (obj < 0 || t[obj].type != JSON_OBJECT) return -1;
+    int i = obj + 1;
+    for (int k = 0; k < t[obj].size; k++) {
+        if (json_eq(js, &t[i], key)) {
+            return i + 1;
+        }
+        i = json_skip(t, i + 1);
+    }
+    return -1;
+}
+
+int json_path(const char *js, const JsonToken *t, int obj, const char *path) {
+    char key[64];
+    const char *p = path;
+    int cur = obj;
+
+    while (cur >= 0 && *p) {
+        const char *dot = strchr(p, '.');
+        size_t n = dot ? (size_t)(dot - p) : strlen(p);
+        if (n >= sizeof(key)) return -1;
+        memcpy(key, p, n);
+        key[n] = '\0';
+        cur = json_find(js, t, cur, key);
+        p += n + (dot ? 1 : 0);
+    }
+    return cur;
+}
+
+int json_array_item(const JsonToken *t, int arr, int n) {
+    if (arr < 0 || t[arr].type != JSON_ARRAY || n >= t[arr].size) return -1;
+    int i = arr + 1;
+    while (n-- > 0) {
+        i = json_skip(t, i);
+    }
+    return i;
+}
+
+int json_get_string(const char *js, const JsonToken *t, int i, char *out, size_t size) {
+    if (i < 0 || t[i].type != JSON_STRING || size == 0) return -1;
+    size_t o = 0;
+    for (int p = t[i].start; p < t[i].end && o + 1 < size; p++) {
+        char c = js[p];
+        if (c == '\\' && p + 1 < t[i].end) {
+            c = js[++p];
+            switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            default: break;     // \" \\ \/ and anything unusual kept verbatim
+            }
+        }
+        out[o++] = c;
+    }
+    out[o] = '\0';
+    return 0;
+}
+
+int json_get_double(const char *js, const JsonToken *t, int i, double *out) {
+    char buf[64];
+    if (i < 0 || t[i].type != JSON_PRIMITIVE) return -1;
+    int n = t[i].end - t[i].start;
+    if (n <= 0 || n >= (int)sizeof(buf)) return -1;
+    memcpy(buf, js + t[i].start, n);
+    buf[n] = '\0';
+    char *end;
+    errno = 0;
+    double v = strtod(buf, &end);
+    if (errno != 0 || *end != '\0') return -1;
+    *out = v;
+    return 0;
+}
+
+int json_get_int(const char *js, const JsonToken *t, int i, int *out) {
+    double v;
+    if (json_get_double(js, t, i, &v) != 0) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+int json_get_bool(const char *js, const JsonToken *t, int i, bool *out) {
+    if (i < 0 || t[i].type != JSON_PRIMITIVE) return -1;
+    if (strncmp(js + t[i].start, "true", 4) == 0) {
+        *out = true;
+    } else if (strncmp(js + t[i].start, "false", 5) == 0) {
+        *out = false;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int json_write_string(char *out, size_t size, const char *s) {
+    size_t o = 0;
+    if (size < 3) return -1;
+    out[o++] = '"';
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (o + 7 >= size) return -1;
+        if (c == '"' || c == '\\') {
+            out[o++] = '\\';
+            out[o++] = (char)c;
+        } else if (c < 0x20) {
+            o += snprintf(out + o, size - o, "\\u%04x", c);
+        } else {
+            out[o++] = (char)c;
+        }
+    }
+    out[o++] = '"';
+    out[o] = '\0';
+    return (int)o;
+}
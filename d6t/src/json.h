@@ -0,0 +1,54 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Minimal allocation-free JSON tokenizer. The caller provides the token
+// array; tokens reference the source text by offset and are never copied.
+
+typedef enum {
+    JSON_UNDEF,
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE
+} JsonType;
+
+typedef struct {
+    JsonType type;
+    int start;      // Offset of the first character (inside quotes for strings)
+    int end;        // Offset one past the last character
+    int size;       // Number of direct children (object keys or array items)
+} JsonToken;
+
+// Tokenize js[0..len). Returns the number of tokens or -1 on error.
+int json_parse(const char *js, size_t len, JsonToken *tokens, int max_tokens);
+
+// Index of the token following the subtree rooted at i
+int json_skip(const JsonToken *t, int i);
+
+// Index of the value stored under key in object obj, or -1
+int json_find(const char *js, const JsonToken *t, int obj, const char *key);
+
+// Resolve a dotted path ("server.endpoints.alerts") from object obj, or -1
+int json_path(const char *js, const JsonToken *t, int obj, const char *path);
+
+// Index of the n-th item of array arr, or -1
+int json_array_item(const JsonToken *t, int arr, int n);
+
+// Compare a token with a literal string
+bool json_eq(const char *js, const JsonToken *tok, const char *s);
+
+// Value accessors. All return 0 on success and -1 if the token is missing
+// (i < 0) or has the wrong type; out is left untouched on failure.
+int json_get_string(const char *js, const JsonToken *t, int i, char *out, size_t size);
+int json_get_double(const char *js, const JsonToken *t, int i, double *out);
+int json_get_int(const char *js, const JsonToken *t, int i, int *out);
+int json_get_bool(const char *js, const JsonToken *t, int i, bool *out);
+
+// Append s to out as a quoted, escaped JSON string. Returns bytes written
+// (excluding the terminator) or -1 if it does not fit.
+int json_write_string(char *out, size_t size, const char *s);
+
+#endif // JSON_H
@@ -1,8 +1,10 @@
 #include "logger.h"
+#include "output.h"
 
 static FILE *logFile = NULL;
 static LogLevel currentLogLevel = LOG_INFO;
 static char logFilePath[512] = {0};
+static int64_t (*clockFn)(void);
 
 // Helper function to create directory recursively
 static int mkpath(const char *path, mode_t mode) {
@@ -41,22 +43,24 @@ static int mkpath(const char *path, mode_t mode) {
     return 0;
 }
 
-// Returns the current date/time as a string
+// Returns the current date/time as a string. localtime() re-reads TZ, and
+// allocates, on every call, so it is avoided on the per-frame path.
 static void get_time_string(char *buffer, size_t size, int include_date) {
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
+    time_t now = clockFn ? (time_t)(clockFn() / 1000000000) : time(NULL);
+    struct tm tm_info;
     
-    if (include_date) {
-        strftime(buffer, size, "%Y-%m-%d %H:%M:%S", tm_info);
+    localtime_r(&now, &tm_info);
+    if (include_date || clockFn) {
+        strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &tm_info);
     } else {
-        strftime(buffer, size, "%H:%M:%S", tm_info);
+        strftime(buffer, size, "%H:%M:%S", &tm_info);
     }
 }
 
 // Initialize the logger
 int logger_init(const char *logDir, const char *fileName) {
     char dateStr[20];
-    time_t now = time(NULL);
+    time_t now = clockFn ? (time_t)(clockFn() / 1000000000) : time(NULL);
     struct tm *tm_info = localtime(&now);
     
     strftime(dateStr, sizeof(dateStr), "%Y%m%d", tm_info);
@@ -84,10 +88,15 @@ int logger_init(const char *logDir, const char *fileName) {
     get_time_string(timeStr, sizeof(timeStr), 1);
     fprintf(logFile, "[%s] [INFO] Logging initialized\n", timeStr);
     fflush(logFile);
+    output_register(fileno(logFile));
     
     return 0;
 }
 
+void logger_set_clock(int64_t (*now_ns)(void)) {
+    clockFn = now_ns;
+}
+
 // Get string representation of log level
 static const char* get_level_string(LogLevel level) {
     switch (level) {
@@ -107,19 +116,24 @@ void logger_log(LogLevel level, const char *format, ...) {
     
     va_list args;
     char timeStr[25];
+    char line[LOGGER_LINE_MAX];
+    size_t len;
     
     get_time_string(timeStr, sizeof(timeStr), 0);
-    fprintf(logFile, "[%s] [%s] ", timeStr, get_level_string(level));
+    len = snprintf(line, sizeof(line), "[%s] [%s] ", timeStr, get_level_string(level));
     
     va_start(args, format);
-    vfprintf(logFile, format, args);
+    len += vsnprintf(line + len, sizeof(line) - len, format, args);
     va_end(args);
     
-    if (format[strlen(format) - 1] != '\n') {
-        fprintf(logFile, "\n");
+    // One write per line, through output.c (possibly io_uring)
+    if (len > sizeof(line) - 2) {
+        len = sizeof(line) - 2;
+        line[len++] = '\n';
+    } else if (format[strlen(format) - 1] != '\n') {
+        line[len++] = '\n';
     }
-    
-    fflush(logFile);
+    output_write(fileno(logFile), line, len, NULL, NULL);
     
     // Also print to console for ERROR and FATAL
     if (level >= LOG_ERROR) {
@@ -142,9 +156,14 @@ void logger_perror(const char *s) {
     fprintf(stderr, "%s: %s\n", s, strerror(errno));
 }
 
+int logger_fd(void) {
+    return logFile ? fileno(logFile) : -1;
+}
+
 // Close the logger
 void logger_close() {
     if (logFile) {
+        output_forget(fileno(logFile));
         char timeStr[25];
         get_time_string(timeStr, sizeof(timeStr), 1);
         fprintf(logFile, "[%s] [INFO] Logging terminated\n", timeStr);
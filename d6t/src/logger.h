@@ -1,6 +1,7 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
@@ -21,12 +22,21 @@ typedef enum {
     LOG_FATAL
 } LogLevel;
 
+#define LOGGER_LINE_MAX 16384          // Longer messages are cut
+
 // Initialize the logger with the base directory
 int logger_init(const char *logDir, const char *fileName);
 
+// Take the time from now_ns (ns since the epoch) instead of time(). Lines
+// then carry the date too, for runs in virtual time (timestamp.h).
+void logger_set_clock(int64_t (*now_ns)(void));
+
 // Log a message with the specified level
 void logger_log(LogLevel level, const char *format, ...);
 
+// Descriptor of the log file, -1 if closed
+int logger_fd(void);
+
 // Close the logger
 void logger_close();
 
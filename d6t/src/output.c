@@ -0,0 +1,352 @@
+#include "output.h"
+#include "logger.h"
+
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+typedef struct {
+    int fd;
+    OutputDone done;
+    void *arg;
+} OutputSlot;
+
+static struct {
+    bool active;
+    int ring_fd;
+
+    // Submission queue
+    void *sq_map;
+    size_t sq_map_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned tail;                  // Local tail, published on flush
+    unsigned queued;                // Written since the last submit
+    unsigned batch_start;           // Tail at the start of this batch
+
+    // Completion queue
+    void *cq_map;
+    size_t cq_map_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    char *arena;                    // OUTPUT_SLOTS buffers of OUTPUT_SLOT_SIZE
+    bool fixed_bufs;
+    OutputSlot slots[OUTPUT_SLOTS];
+    int free_slots[OUTPUT_SLOTS];
+    int n_free;
+    unsigned inflight;
+
+    bool fixed_files;
+    int files[OUTPUT_MAX_FILES];
+
+    OutputStats stats;
+} out = { .ring_fd = -1 };
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, out.ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, out.ring_fd, opcode, arg, nr_args);
+}
+
+static void plain_done(int fd, ssize_t res, OutputDone done, void *arg) {
+    if (res < 0) {
+        out.stats.failed++;
+    }
+    if (done) {
+        done(fd, res, arg);
+    }
+}
+
+static ssize_t plain_write(int fd, const void *buf, size_t len, OutputDone done, void *arg) {
+    ssize_t res = write(fd, buf, len);
+
+    out.stats.sync_writes++;
+    plain_done(fd, res < 0 ? -errno : res, done, arg);
+    return res;
+}
+
+// Hand finished writes back. Callbacks run after the ring and the slots are
+// updated, so they may queue new writes.
+static void reap(void) {
+    struct { OutputSlot slot; ssize_t res; } done[OUTPUT_SLOTS];
+    unsigned head = *out.cq_head;
+    unsigned tail = __atomic_load_n(out.cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &out.cqes[head & out.cq_mask];
+        int slot = (int)cqe->user_data;
+        done[n].slot = out.slots[slot];
+        done[n].res = cqe->res;
+        n++;
+        out.free_slots[out.n_free++] = slot;
+        out.inflight--;
+        head++;
+    }
+    __atomic_store_n(out.cq_head, head, __ATOMIC_RELEASE);
+
+    for (int k = 0; k < n; k++) {
+        plain_done(done[k].slot.fd, done[k].res, done[k].slot.done, done[k].slot.arg);
+    }
+}
+
+static int submit(void) {
+    if (out.queued == 0) {
+        return 0;
+    }
+    // Writes are hard-linked so they run one after another without a
+    // failure cancelling the rest; a batch queued behind writes still in
+    // flight waits for them.
+    out.sqes[(out.tail - 1) & out.sq_mask].flags &= ~IOSQE_IO_HARDLINK;
+    if (out.inflight > out.queued) {
+        out.sqes[out.batch_start & out.sq_mask].flags |= IOSQE_IO_DRAIN;
+    }
+    __atomic_store_n(out.sq_tail, out.tail, __ATOMIC_RELEASE);
+
+    int n = uring_enter(out.queued, 0, 0);
+    out.stats.submits++;
+    if (n < 0) {
+        logger_perror("io_uring_enter");
+        return -1;
+    }
+    out.queued -= (unsigned)n;
+    out.batch_start = out.tail - out.queued;
+    return 0;
+}
+
+static void wait_all(void) {
+    if (submit() != 0) {
+        return;
+    }
+    while (out.inflight > 0) {
+        if (out.queued == 0 && uring_enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            logger_perror("io_uring_enter");
+            return;
+        }
+        reap();
+        if (submit() != 0) {
+            return;
+        }
+    }
+}
+
+static void unmap(void) {
+    if (out.sqes && out.sqes != MAP_FAILED) munmap(out.sqes, out.sqes_size);
+    if (out.cq_map && out.cq_map != MAP_FAILED && out.cq_map != out.sq_map) munmap(out.cq_map, out.cq_map_size);
+    if (out.sq_map && out.sq_map != MAP_FAILED) munmap(out.sq_map, out.sq_map_size);
+    if (out.arena) munmap(out.arena, (size_t)OUTPUT_SLOTS * OUTPUT_SLOT_SIZE);
+    if (out.ring_fd >= 0) close(out.ring_fd);
+    out.sqes = NULL;
+    out.sq_map = out.cq_map = NULL;
+    out.arena = NULL;
+    out.ring_fd = -1;
+}
+
+static int ring_open(void) {
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    out.ring_fd = uring_setup(OUTPUT_SLOTS, &p);
+    if (out.ring_fd < 0) {
+        return -1;
+    }
+
+    out.sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    out.cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (out.cq_map_size > out.sq_map_size) out.sq_map_size = out.cq_map_size;
+        out.cq_map_size = out.sq_map_size;
+    }
+    out.sq_map = mmap(NULL, out.sq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, out.ring_fd, IORING_OFF_SQ_RING);
+    if (out.sq_map == MAP_FAILED) {
+        return -1;
+    }
+    out.cq_map = (p.features & IORING_FEAT_SINGLE_MMAP) ? out.sq_map :
+                 mmap(NULL, out.cq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, out.ring_fd, IORING_OFF_CQ_RING);
+    out.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    out.sqes = mmap(NULL, out.sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, out.ring_fd, IORING_OFF_SQES);
+    if (out.cq_map == MAP_FAILED || out.sqes == MAP_FAILED) {
+        return -1;
+    }
+
+    char *sq = out.sq_map, *cq = out.cq_map;
+    out.sq_head = (unsigned *)(sq + p.sq_off.head);
+    out.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    out.sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    unsigned *array = (unsigned *)(sq + p.sq_off.array);
+    for (unsigned k = 0; k < p.sq_entries; k++) {
+        array[k] = k;
+    }
+    out.tail = out.batch_start = *out.sq_tail;
+    out.cq_head = (unsigned *)(cq + p.cq_off.head);
+    out.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    out.cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    out.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // One registered buffer covering all slots; writes fall back to
+    // unregistered buffers if the memlock limit does not allow it
+    out.arena = mmap(NULL, (size_t)OUTPUT_SLOTS * OUTPUT_SLOT_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (out.arena == MAP_FAILED) {
+        out.arena = NULL;
+        return -1;
+    }
+    struct iovec iov = { out.arena, (size_t)OUTPUT_SLOTS * OUTPUT_SLOT_SIZE };
+    out.fixed_bufs = uring_register(IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+
+    for (int k = 0; k < OUTPUT_MAX_FILES; k++) {
+        out.files[k] = -1;
+    }
+    out.fixed_files = uring_register(IORING_REGISTER_FILES, out.files, OUTPUT_MAX_FILES) == 0;
+
+    out.n_free = 0;
+    for (int k = OUTPUT_SLOTS - 1; k >= 0; k--) {
+        out.free_slots[out.n_free++] = k;
+    }
+    return 0;
+}
+
+int output_init(bool uring) {
+    if (!uring || out.active) {
+        return 0;
+    }
+    if (ring_open() != 0) {
+        logger_log(LOG_WARN, "io_uring unavailable (%s), writing synchronously", strerror(errno));
+        unmap();
+        return 0;
+    }
+    out.active = true;
+    logger_log(LOG_INFO, "Output: io_uring, %d slots%s%s", OUTPUT_SLOTS,
+               out.fixed_bufs ? ", registered buffers" : "",
+               out.fixed_files ? ", registered files" : "");
+    return 0;
+}
+
+static int file_index(int fd) {
+    for (int k = 0; k < OUTPUT_MAX_FILES; k++) {
+        if (out.files[k] == fd) return k;
+    }
+    return -1;
+}
+
+static void files_update(int index, int fd) {
+    struct io_uring_files_update up = { .offset = (unsigned)index, .fds = (uint64_t)(uintptr_t)&fd };
+
+    if (uring_register(IORING_REGISTER_FILES_UPDATE, &up, 1) == 1) {
+        out.files[index] = fd;
+    }
+}
+
+void output_register(int fd) {
+    if (!out.active || !out.fixed_files || fd < 0 || file_index(fd) >= 0) {
+        return;
+    }
+    int k = file_index(-1);
+    if (k >= 0) {
+        files_update(k, fd);
+    }
+}
+
+void output_forget(int fd) {
+    if (!out.active) {
+        return;
+    }
+    wait_all();
+    int k = file_index(fd);
+    if (k >= 0 && fd >= 0) {
+        files_update(k, -1);
+        out.files[k] = -1;
+    }
+}
+
+ssize_t output_write(int fd, const void *buf, size_t len, OutputDone done, void *arg) {
+    out.stats.writes++;
+    if (!out.active) {
+        return plain_write(fd, buf, len, done, arg);
+    }
+    if (len > OUTPUT_SLOT_SIZE) {
+        wait_all();
+        return plain_write(fd, buf, len, done, arg);
+    }
+    if (out.n_free == 0) {
+        reap();
+    }
+    if (out.n_free == 0) {
+        wait_all();
+    }
+
+    int slot = out.free_slots[--out.n_free];
+    char *data = out.arena + (size_t)slot * OUTPUT_SLOT_SIZE;
+    memcpy(data, buf, len);
+    out.slots[slot] = (OutputSlot){ fd, done, arg };
+
+    struct io_uring_sqe *sqe = &out.sqes[out.tail & out.sq_mask];
+    int index = file_index(fd);
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = out.fixed_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    if (index >= 0) {
+        sqe->fd = index;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = fd;
+    }
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = (uint32_t)len;
+    sqe->off = (uint64_t)-1;        // Current file position (or append)
+    sqe->buf_index = 0;
+    sqe->user_data = (uint64_t)slot;
+    out.tail++;
+    out.queued++;
+    out.inflight++;
+    return (ssize_t)len;
+}
+
+void output_flush(void) {
+    if (!out.active) {
+        return;
+    }
+    reap();
+    submit();
+    reap();
+}
+
+void output_drain(void) {
+    if (out.active) {
+        wait_all();
+    }
+}
+
+bool output_uring_active(void) {
+    return out.active;
+}
+
+void output_get_stats(OutputStats *st) {
+    *st = out.stats;
+}
+
+void output_close(void) {
+    if (!out.active) {
+        return;
+    }
+    wait_all();
+    out.active = false;
+    unmap();
+}
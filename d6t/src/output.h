@@ -0,0 +1,60 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Write path for the log file and the FIFOs.
+//
+// By default output_write() is a plain write(). With output_init(true) the
+// data is copied into a buffer registered with an io_uring instance and the
+// write is queued; output_flush(), run by the event loop before it waits,
+// submits everything queued since the last flush with one io_uring_enter().
+// Writes complete in the order they were queued. When io_uring is not
+// available (old kernel, seccomp filter, kernel.io_uring_disabled) the
+// plain path is used.
+//
+// The result of a write is passed to its OutputDone callback: immediately
+// on the plain path, when the completion is reaped on the io_uring path.
+
+#define OUTPUT_SLOTS      64            // Writes in flight at once
+#define OUTPUT_SLOT_SIZE  4096          // Larger writes go out synchronously
+#define OUTPUT_MAX_FILES  8             // Descriptors registered with the ring
+
+// res is the number of bytes written or -errno
+typedef void (*OutputDone)(int fd, ssize_t res, void *arg);
+
+typedef struct {
+    unsigned long writes;           // output_write() calls
+    unsigned long sync_writes;      // Of which were written with write()
+    unsigned long submits;          // io_uring_enter() calls
+    unsigned long failed;           // Writes that returned an error
+} OutputStats;
+
+// Select the backend. Returns 0; if io_uring was asked for but cannot be
+// set up, the plain path is used and a warning logged.
+int output_init(bool uring);
+
+// Register a long-lived descriptor with the ring, so writes to it skip the
+// per-call fd lookup. output_forget() must be called before closing it.
+void output_register(int fd);
+void output_forget(int fd);
+
+// Write len bytes to fd; done may be NULL. Returns the bytes written or -1
+// on the plain path, len once queued.
+ssize_t output_write(int fd, const void *buf, size_t len, OutputDone done, void *arg);
+
+// Submit queued writes and reap finished ones
+void output_flush(void);
+
+// Submit queued writes and wait until all have finished
+void output_drain(void);
+
+bool output_uring_active(void);
+void output_get_stats(OutputStats *st);
+
+// Finish pending writes and tear the ring down
+void output_close(void);
+
+#endif // OUTPUT_H
@@ -0,0 +1,36 @@
+#include "pipeline.h"
+#include "logger.h"
+
+void pipeline_clear(Pipeline *p) {
+    p->n = 0;
+}
+
+int pipeline_add(Pipeline *p, const PipelineStage *stage) {
+    if (p->n == PIPELINE_MAX_STAGES) {
+        logger_log(LOG_ERROR, "Pipeline full, stage %s not added", stage->name);
+        return -1;
+    }
+    p->fn[p->n] = stage->fn;
+    p->names[p->n] = stage->name;
+    p->n++;
+    return 0;
+}
+
+void pipeline_run(const Pipeline *p, PipelineCtx *ctx) {
+    for (int k = 0; k < p->n; k++) {
+        p->fn[k](ctx);
+    }
+}
+
+void pipeline_describe(const Pipeline *p, char *buf, size_t size) {
+    size_t len = 0;
+
+    buf[0] = '\0';
+    for (int k = 0; k < p->n && len < size; k++) {
+        len += snprintf(buf + len, size - len, "%s%s", k ? " > " : "", p->names[k]);
+    }
+}
+
+bool pipeline_equal(const Pipeline *a, const Pipeline *b) {
+    return a->n == b->n && memcmp(a->fn, b->fn, a->n * sizeof(a->fn[0])) == 0;
+}
@@ -0,0 +1,46 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Per-sensor chain of frame processing stages.
+//
+// Which stages a frame goes through (filter, analysis, sinks) depends only
+// on the configuration, so the chain is resolved once, when a sensor starts
+// or the config is reloaded, into a flat array of stage functions. The
+// sampling loop walks that array without checking per frame what is
+// enabled. The PipelineCtx passed along is defined by the caller and
+// carries the frame being processed.
+
+#define PIPELINE_MAX_STAGES 16
+
+typedef struct PipelineCtx PipelineCtx;
+typedef void (*PipelineStageFn)(PipelineCtx *ctx);
+
+typedef struct {
+    const char *name;
+    PipelineStageFn fn;
+} PipelineStage;
+
+typedef struct {
+    PipelineStageFn fn[PIPELINE_MAX_STAGES];
+    int n;
+    const char *names[PIPELINE_MAX_STAGES];
+} Pipeline;
+
+void pipeline_clear(Pipeline *p);
+
+// Append a stage. Returns 0, or -1 if the chain is full.
+int pipeline_add(Pipeline *p, const PipelineStage *stage);
+
+// Run the stages in order
+void pipeline_run(const Pipeline *p, PipelineCtx *ctx);
+
+// Stage names joined by " > ", for the log
+void pipeline_describe(const Pipeline *p, char *buf, size_t size);
+
+// True if both chains run the same stages
+bool pipeline_equal(const Pipeline *a, const Pipeline *b);
+
+#endif // PIPELINE_H
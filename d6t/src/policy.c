@@ -0,0 +1,133 @@
+#include "policy.h"
+#include "logger.h"
+
+typedef struct {
+    // Recent frames while not triggered, for the pre-trigger history
+    SensorFrame *ring[CONFIG_MAX_PRE_TRIGGER];
+    int head;
+    int count;
+
+    // History handed out by the last call, released on the next one
+    SensorFrame *sent[CONFIG_MAX_PRE_TRIGGER];
+    int n_sent;
+
+    bool triggered;
+    int64_t window_end_ms;          // Full frames are sent until this time
+
+    int64_t period_start_ms;
+    PolicySummary sum;
+} PolicyState;
+
+static PolicyState states[CONFIG_MAX_SENSORS];
+
+static void release_sent(PolicyState *st) {
+    for (int k = 0; k < st->n_sent; k++) {
+        frame_unref(st->sent[k]);
+    }
+    st->n_sent = 0;
+}
+
+static void summary_add(PolicyState *st, const SensorFrame *f) {
+    PolicySummary *sum = &st->sum;
+
+    if (sum->frames == 0) {
+        st->period_start_ms = f->t_ms;
+        sum->min_temp = sum->max_temp = f->pix[0];
+        sum->hotspot = 0;
+        sum->avg_temp = 0.0;
+        sum->any_abnormal = false;
+    }
+    for (int i = 0; i < FRAME_N_PIXEL; i++) {
+        if (f->pix[i] < sum->min_temp) sum->min_temp = f->pix[i];
+        if (f->pix[i] > sum->max_temp) {
+            sum->max_temp = f->pix[i];
+            sum->hotspot = i;
+        }
+    }
+    // Running sum until the period closes
+    sum->avg_temp += f->avg_temp;
+    sum->any_abnormal |= f->is_abnormal;
+    sum->frames++;
+    snprintf(sum->date, sizeof(sum->date), "%s", f->stamp.date);
+    snprintf(sum->time, sizeof(sum->time), "%s", f->stamp.time);
+}
+
+void policy_frame(int sensor, const SensorConfig *cfg, SensorFrame *f, PolicyOutput *out) {
+    PolicyState *st = &states[sensor];
+
+    release_sent(st);
+    out->n_frames = 0;
+    out->have_summary = false;
+    if (cfg->upload_mode == POLICY_FULL) {
+        out->frames[out->n_frames++] = f;
+        return;
+    }
+
+    summary_add(st, f);
+
+    if (f->is_abnormal) {
+        if (!st->triggered) {
+            // Send the history leading up to the anomaly first
+            for (int k = 0; k < st->count; k++) {
+                st->sent[st->n_sent++] = st->ring[(st->head + k) % CONFIG_MAX_PRE_TRIGGER];
+                out->frames[out->n_frames++] = st->sent[k];
+            }
+            st->head = st->count = 0;
+            st->triggered = true;
+            logger_log(LOG_INFO, "Sensor %s: full frames from %d frames before the anomaly",
+                       cfg->id, out->n_frames);
+        }
+        st->window_end_ms = f->t_ms + cfg->post_trigger_ms;
+    } else if (st->triggered && f->t_ms > st->window_end_ms) {
+        st->triggered = false;
+        logger_log(LOG_INFO, "Sensor %s: back to summaries", cfg->id);
+    }
+
+    if (st->triggered) {
+        out->frames[out->n_frames++] = f;
+    } else if (cfg->pre_trigger > 0) {
+        while (st->count >= cfg->pre_trigger) {
+            frame_unref(st->ring[st->head]);
+            st->head = (st->head + 1) % CONFIG_MAX_PRE_TRIGGER;
+            st->count--;
+        }
+        st->ring[(st->head + st->count) % CONFIG_MAX_PRE_TRIGGER] = frame_ref(f);
+        st->count++;
+    }
+
+    if (f->t_ms - st->period_start_ms >= cfg->summary_ms) {
+        out->summary = st->sum;
+        out->summary.avg_temp /= st->sum.frames;
+        out->have_summary = true;
+        st->sum.frames = 0;
+    }
+}
+
+void policy_reset(int sensor) {
+    PolicyState *st = &states[sensor];
+
+    release_sent(st);
+    for (int k = 0; k < st->count; k++) {
+        frame_unref(st->ring[(st->head + k) % CONFIG_MAX_PRE_TRIGGER]);
+    }
+    memset(&states[sensor], 0, sizeof(states[sensor]));
+}
+
+void policy_save(int sensor, PolicySnapshot *out) {
+    const PolicyState *st = &states[sensor];
+
+    memset(out, 0, sizeof(*out));
+    out->triggered = st->triggered;
+    out->window_end_ms = st->window_end_ms;
+    out->period_start_ms = st->period_start_ms;
+    out->sum = st->sum;
+}
+
+void policy_restore(int sensor, const PolicySnapshot *in) {
+    PolicyState *st = &states[sensor];
+
+    st->triggered = in->triggered;
+    st->window_end_ms = in->window_end_ms;
+    st->period_start_ms = in->period_start_ms;
+    st->sum = in->sum;
+}
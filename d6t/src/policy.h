@@ -0,0 +1,53 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "frame.h"
+
+// Upload policy for temperature records, mirroring the Node.js
+// policyController so that single-hop mode uploads the same records. In
+// summary mode a sensor sends one summary per period; full frames are sent
+// from pre_trigger frames before an abnormal frame until post_trigger_ms
+// after the last one. Frames held for the pre-trigger history are
+// references into the frame pool, not copies.
+
+typedef struct {
+    int frames;                     // Frames in the period
+    char date[32];                  // Last frame of the period
+    char time[32];
+    double min_temp;
+    double max_temp;
+    double avg_temp;                // Mean of the frame averages
+    int hotspot;                    // Pixel that reached max_temp
+    bool any_abnormal;
+} PolicySummary;
+
+typedef struct {
+    // Frames to send in full, oldest first. Valid until the next call.
+    const SensorFrame *frames[CONFIG_MAX_PRE_TRIGGER + 1];
+    int n_frames;
+    bool have_summary;
+    PolicySummary summary;
+} PolicyOutput;
+
+// Trigger window and open summary of a sensor, kept across restarts
+// (snapshot.h). Held frames are not: the pre-trigger history refills.
+typedef struct {
+    bool triggered;
+    int64_t window_end_ms;
+    int64_t period_start_ms;
+    PolicySummary sum;
+} PolicySnapshot;
+
+// Feed one frame of a sensor slot and get the records to upload for it
+void policy_frame(int sensor, const SensorConfig *cfg, SensorFrame *f, PolicyOutput *out);
+
+// Forget the history and open summary of a sensor slot, releasing its frames
+void policy_reset(int sensor);
+
+void policy_save(int sensor, PolicySnapshot *out);
+void policy_restore(int sensor, const PolicySnapshot *in);
+
+#endif // POLICY_H
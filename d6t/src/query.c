@@ -0,0 +1,633 @@
+/*
+ * d6tquery - time-range queries and export on the frame store (store.c)
+ *
+ * Reads segments through mmap, skips chunks using the index time ranges and
+ * zone maps, and streams results with memory bounded by one decoded chunk
+ * (plus per-column histograms when a percentile is requested).
+ */
+#define _GNU_SOURCE             // strptime, timegm
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <ctype.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "json.h"
+#include "store.h"
+
+#define QUERY_MAX_SENSORS 1024
+#define QUERY_MAX_DAYS    4096
+#define HIST_SIZE         65536     // One counter per int16 value
+
+typedef enum {
+    OUT_CSV,
+    OUT_NDJSON,
+    OUT_BIN
+} OutFormat;
+
+typedef enum {
+    AGG_NONE,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_AVG,
+    AGG_PCT
+} AggType;
+
+// Fixed-size record of the binary output (frames and per-pixel aggregates)
+typedef struct {
+    char sensor_id[32];
+    int64_t t_ms;                   // Frame time, or bucket start
+    uint32_t count;                 // Frames aggregated (1 for raw frames)
+    int16_t ptat;
+    int16_t pix[STORE_N_PIXEL];
+    int16_t reserved;
+} QueryRecord;
+
+typedef struct {
+    int64_t key;                    // Bucket start (ms)
+    int64_t count;                  // Frames (per-pixel) or values (per-frame)
+    int16_t min[STORE_N_COLS];
+    int16_t max[STORE_N_COLS];
+    int64_t sum[STORE_N_COLS];
+    uint32_t *hist;                 // [ncols][HIST_SIZE], percentile only
+} Accumulator;
+
+static struct {
+    const char *dir;
+    char *sensors[QUERY_MAX_SENSORS];
+    int n_sensors;
+    int64_t from;
+    int64_t to;
+    AggType agg;
+    double pct;
+    bool per_frame;
+    int64_t bucket_ms;
+    bool have_above;
+    bool have_below;
+    int16_t above;
+    int16_t below;
+    OutFormat out;
+} q = { .from = INT64_MIN, .to = INT64_MAX };
+
+static struct {
+    uint64_t chunks_total;
+    uint64_t chunks_skipped;        // Excluded by time range or zone map
+    uint64_t chunks_zonemap_only;   // Answered from the header without decoding
+    uint64_t chunks_decoded;
+    uint64_t frames_scanned;
+    uint64_t rows;
+    uint64_t rollup_segments;       // Days answered from rollups
+} stats;
+
+static StoreChunk chunk;
+static Accumulator acc;
+static const char *cur_sensor;
+static char cur_sensor_json[6 * NAME_MAX + 3];  // Quoted and escaped for NDJSON
+
+static const char *agg_name(void) {
+    switch (q.agg) {
+    case AGG_MIN: return "min";
+    case AGG_MAX: return "max";
+    case AGG_AVG: return "avg";
+    case AGG_PCT: return "percentile";
+    default:      return "none";
+    }
+}
+
+/* Time parsing and formatting */
+
+static int parse_time(const char *s, int64_t *out) {
+    struct tm tm;
+    const char *end;
+    bool digits = *s != '\0';
+
+    for (const char *p = s; *p; p++) {
+        if (!isdigit((unsigned char)*p)) digits = false;
+    }
+    if (digits) {
+        *out = strtoll(s, NULL, 10);    // Epoch milliseconds
+        return 0;
+    }
+
+    memset(&tm, 0, sizeof(tm));
+    if ((end = strptime(s, "%Y-%m-%dT%H:%M:%S", &tm)) == NULL &&
+        (end = strptime(s, "%Y-%m-%d %H:%M:%S", &tm)) == NULL &&
+        (end = strptime(s, "%Y-%m-%d", &tm)) == NULL) {
+        return -1;
+    }
+    if (*end != '\0') return -1;
+    tm.tm_isdst = -1;
+    *out = (int64_t)mktime(&tm) * 1000;
+    return 0;
+}
+
+// Local time as "YYYY-MM-DD" and "HH:MM:SS:mmm", the pipeline's format. The
+// broken-down time is cached per second.
+static void format_time(int64_t t_ms, char *date, char *time_str) {
+    static int64_t cached_sec = INT64_MIN;
+    static struct tm tm;
+    int64_t sec = t_ms >= 0 ? t_ms / 1000 : (t_ms - 999) / 1000;
+    int ms = (int)(t_ms - sec * 1000);
+
+    if (sec != cached_sec) {
+        time_t tt = (time_t)sec;
+        localtime_r(&tt, &tm);
+        cached_sec = sec;
+    }
+    sprintf(date, "%04d-%02d-%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+    sprintf(time_str, "%02d:%02d:%02d:%03d", tm.tm_hour, tm.tm_min, tm.tm_sec, ms);
+}
+
+/* Output */
+
+static void print_header(void) {
+    if (q.out != OUT_CSV) return;
+    if (q.agg == AGG_NONE) {
+        printf("sensor_id,date,time,ptat");
+    } else if (q.per_frame) {
+        printf("sensor_id,date,time,count,%s\n", agg_name());
+        return;
+    } else {
+        printf("sensor_id,date,time,count,ptat");
+    }
+    for (int p = 0; p < STORE_N_PIXEL; p++) printf(",p%d", p);
+    printf("\n");
+}
+
+static void emit_record(int64_t t, uint32_t count, const double *v) {
+    QueryRecord r;
+    memset(&r, 0, sizeof(r));
+    snprintf(r.sensor_id, sizeof(r.sensor_id), "%s", cur_sensor);
+    r.t_ms = t;
+    r.count = count;
+    r.ptat = (int16_t)(v[0] + (v[0] >= 0 ? 0.5 : -0.5));
+    for (int p = 0; p < STORE_N_PIXEL; p++) {
+        double x = v[STORE_COL_PIXEL(p)];
+        r.pix[p] = (int16_t)(x + (x >= 0 ? 0.5 : -0.5));
+    }
+    fwrite(&r, sizeof(r), 1, stdout);
+}
+
+// One row of STORE_N_COLS values in sensor units (0.1 degC)
+static void emit_row(int64_t t, int64_t count, const double *v, bool fractional) {
+    char date[16], time_str[16];
+    const char *fmt = fractional ? "%.2f" : "%.1f";
+
+    stats.rows++;
+    if (q.out == OUT_BIN) {
+        emit_record(t, (uint32_t)count, v);
+        return;
+    }
+    format_time(t, date, time_str);
+    if (q.out == OUT_CSV) {
+        printf("%s,%s,%s", cur_sensor, date, time_str);
+        if (q.agg != AGG_NONE) printf(",%lld", (long long)count);
+        for (int c = 0; c < STORE_N_COLS; c++) {
+            putchar(',');
+            printf(fmt, v[c] / 10.0);
+        }
+        putchar('\n');
+        return;
+    }
+
+    // NDJSON uses the same field names as the API temperature records
+    printf("{\"sensor_id\":%s,\"date\":\"%s\",\"time\":\"%s\"", cur_sensor_json, date, time_str);
+    if (q.agg != AGG_NONE) printf(",\"aggregate\":\"%s\",\"count\":%lld", agg_name(), (long long)count);
+    printf(",\"ptat\":");
+    printf(fmt, v[0] / 10.0);
+    printf(",\"temperature_data\":[");
+    for (int p = 0; p < STORE_N_PIXEL; p++) {
+        if (p) putchar(',');
+        printf(fmt, v[STORE_COL_PIXEL(p)] / 10.0);
+    }
+    printf("]}\n");
+}
+
+static void emit_value(int64_t t, int64_t count, double v, bool fractional) {
+    char date[16], time_str[16];
+
+    stats.rows++;
+    format_time(t, date, time_str);
+    if (q.out == OUT_CSV) {
+        printf(fractional ? "%s,%s,%s,%lld,%.2f\n" : "%s,%s,%s,%lld,%.1f\n",
+               cur_sensor, date, time_str, (long long)count, v / 10.0);
+    } else {
+        printf(fractional
+               ? "{\"sensor_id\":%s,\"date\":\"%s\",\"time\":\"%s\",\"aggregate\":\"%s\",\"count\":%lld,\"value\":%.2f}\n"
+               : "{\"sensor_id\":%s,\"date\":\"%s\",\"time\":\"%s\",\"aggregate\":\"%s\",\"count\":%lld,\"value\":%.1f}\n",
+               cur_sensor_json, date, time_str, agg_name(), (long long)count, v / 10.0);
+    }
+}
+
+/* Aggregation */
+
+static int acc_cols(void) {
+    return q.per_frame ? 1 : STORE_N_COLS;
+}
+
+static void acc_reset(int64_t key) {
+    acc.key = key;
+    acc.count = 0;
+    for (int c = 0; c < STORE_N_COLS; c++) {
+        acc.min[c] = INT16_MAX;
+        acc.max[c] = INT16_MIN;
+        acc.sum[c] = 0;
+    }
+    if (acc.hist) {
+        memset(acc.hist, 0, (size_t)acc_cols() * HIST_SIZE * sizeof(uint32_t));
+    }
+}
+
+static inline void acc_add(int c, int16_t v) {
+    if (v < acc.min[c]) acc.min[c] = v;
+    if (v > acc.max[c]) acc.max[c] = v;
+    acc.sum[c] += v;
+    if (acc.hist) acc.hist[(size_t)c * HIST_SIZE + (uint16_t)(v + 32768)]++;
+}
+
+static double hist_percentile(int c, int64_t count) {
+    const uint32_t *h = acc.hist + (size_t)c * HIST_SIZE;
+    int64_t rank = (int64_t)(q.pct / 100.0 * count + 0.999999);
+    int64_t seen = 0;
+    if (rank < 1) rank = 1;
+    for (int i = 0; i < HIST_SIZE; i++) {
+        seen += h[i];
+        if (seen >= rank) return (double)(i - 32768);
+    }
+    return 0.0;
+}
+
+static double acc_value(int c, int64_t count) {
+    switch (q.agg) {
+    case AGG_MIN: return acc.min[c];
+    case AGG_MAX: return acc.max[c];
+    case AGG_AVG: return (double)acc.sum[c] / count;
+    default:      return hist_percentile(c, count);
+    }
+}
+
+static void acc_emit(void) {
+    if (acc.count == 0) return;
+    if (q.per_frame) {
+        emit_value(acc.key, acc.count, acc_value(0, acc.count), q.agg == AGG_AVG);
+    } else {
+        double v[STORE_N_COLS];
+        for (int c = 0; c < STORE_N_COLS; c++) v[c] = acc_value(c, acc.count);
+        emit_row(acc.key, acc.count, v, q.agg == AGG_AVG);
+    }
+    acc.count = 0;
+}
+
+static int64_t bucket_of(int64_t t) {
+    if (q.bucket_ms <= 0) return acc.count ? acc.key : t;
+    int64_t b = t / q.bucket_ms;
+    if (t < 0 && t % q.bucket_ms) b--;
+    return b * q.bucket_ms;
+}
+
+// Move to the bucket of t, emitting the previous one
+static void acc_advance(int64_t t) {
+    int64_t key = bucket_of(t);
+    if (acc.count && key != acc.key) acc_emit();
+    if (acc.count == 0) acc_reset(key);
+}
+
+// Value of one frame across its 16 pixels
+static double frame_value(int i) {
+    int16_t v[STORE_N_PIXEL];
+    int p, j;
+    int64_t sum = 0;
+
+    for (p = 0; p < STORE_N_PIXEL; p++) {
+        v[p] = chunk.col[STORE_COL_PIXEL(p)][i];
+        sum += v[p];
+    }
+    switch (q.agg) {
+    case AGG_MIN:
+        for (j = 1; j < STORE_N_PIXEL; j++) if (v[j] < v[0]) v[0] = v[j];
+        return v[0];
+    case AGG_MAX:
+        for (j = 1; j < STORE_N_PIXEL; j++) if (v[j] > v[0]) v[0] = v[j];
+        return v[0];
+    case AGG_AVG:
+        return (double)sum / STORE_N_PIXEL;
+    default:
+        for (p = 1; p < STORE_N_PIXEL; p++) {      // Insertion sort of 16
+            int16_t x = v[p];
+            for (j = p - 1; j >= 0 && v[j] > x; j--) v[j + 1] = v[j];
+            v[j + 1] = x;
+        }
+        int rank = (int)(q.pct / 100.0 * STORE_N_PIXEL + 0.999999);
+        if (rank < 1) rank = 1;
+        return v[rank - 1];
+    }
+}
+
+/* Scanning */
+
+static bool threshold_match(int i) {
+    if (!q.have_above && !q.have_below) return true;
+    for (int p = 0; p < STORE_N_PIXEL; p++) {
+        int16_t v = chunk.col[STORE_COL_PIXEL(p)][i];
+        if ((q.have_above && v > q.above) || (q.have_below && v < q.below)) return true;
+    }
+    return false;
+}
+
+// min/max without thresholds can be answered from zone maps: per pixel from
+// the chunk headers, across the frame from the index alone
+static bool zonemap_aggregate(void) {
+    return (q.agg == AGG_MIN || q.agg == AGG_MAX) && !q.have_above && !q.have_below &&
+           (!q.per_frame || q.bucket_ms > 0);
+}
+
+// Whether the zone map rules out every frame of the chunk
+static bool zonemap_excludes(const StoreIndexEntry *e) {
+    if (!q.have_above && !q.have_below) return false;
+    bool may_above = q.have_above && e->pix_max > q.above;
+    bool may_below = q.have_below && e->pix_min < q.below;
+    return !may_above && !may_below;
+}
+
+static void scan_chunk(const StoreSegment *seg, int ci) {
+    const StoreIndexEntry *e = &seg->index[ci];
+    stats.chunks_total++;
+
+    if (e->t_last < q.from || e->t_first > q.to || zonemap_excludes(e)) {
+        stats.chunks_skipped++;
+        return;
+    }
+
+    // A chunk that lies wholly inside the range and one bucket needs no decoding
+    bool inside = e->t_first >= q.from && e->t_last <= q.to;
+    if (inside && zonemap_aggregate() && bucket_of(e->t_first) == bucket_of(e->t_last)) {
+        StoreChunkHeader h;
+        if (q.per_frame) {
+            acc_advance(e->t_first);
+            if (e->pix_min < acc.min[0]) acc.min[0] = e->pix_min;
+            if (e->pix_max > acc.max[0]) acc.max[0] = e->pix_max;
+            acc.count += (int64_t)e->n_frames * STORE_N_PIXEL;
+            stats.chunks_zonemap_only++;
+            return;
+        }
+        if (store_chunk_header(seg, ci, &h) == 0) {
+            acc_advance(e->t_first);
+            for (int c = 0; c < STORE_N_COLS; c++) {
+                if (h.col_min[c] < acc.min[c]) acc.min[c] = h.col_min[c];
+                if (h.col_max[c] > acc.max[c]) acc.max[c] = h.col_max[c];
+            }
+            acc.count += h.n_frames;
+            stats.chunks_zonemap_only++;
+            return;
+        }
+    }
+
+    // Checksummed as well as bounds-checked: a torn or corrupt chunk is
+    // skipped rather than decoded into garbage
+    uint32_t cols = q.agg != AGG_NONE && q.per_frame
+                    ? STORE_COLS_ALL & ~(1u << STORE_COL_PTAT) : STORE_COLS_ALL;
+    if (store_chunk_decode(seg, ci, cols | STORE_DECODE_VERIFY, &chunk) != 0) {
+        fprintf(stderr, "d6tquery: %s: corrupt chunk %d skipped\n", cur_sensor, ci);
+        return;
+    }
+    stats.chunks_decoded++;
+
+    for (int i = 0; i < chunk.n; i++) {
+        int64_t t = chunk.t[i];
+        if (t < q.from || t > q.to || !threshold_match(i)) continue;
+        stats.frames_scanned++;
+
+        if (q.agg == AGG_NONE) {
+            double v[STORE_N_COLS];
+            for (int c = 0; c < STORE_N_COLS; c++) v[c] = chunk.col[c][i];
+            emit_row(t, 1, v, false);
+        } else if (q.per_frame && q.bucket_ms <= 0) {
+            emit_value(t, 1, frame_value(i), q.agg == AGG_AVG);
+        } else if (q.per_frame) {
+            acc_advance(t);
+            for (int p = 0; p < STORE_N_PIXEL; p++) {
+                acc_add(0, chunk.col[STORE_COL_PIXEL(p)][i]);
+            }
+            acc.count += STORE_N_PIXEL;
+        } else {
+            acc_advance(t);
+            for (int c = 0; c < STORE_N_COLS; c++) acc_add(c, chunk.col[c][i]);
+            acc.count++;
+        }
+    }
+}
+
+// Days the compactor has rolled up are read from the rollup that best
+// answers the query; frames and other aggregates use the averages
+static const char *rollup_kind(void) {
+    if (q.agg == AGG_MAX || (q.agg == AGG_NONE && q.have_above)) return "max";
+    if (q.agg == AGG_MIN || (q.agg == AGG_NONE && q.have_below)) return "min";
+    return "avg";
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void scan_sensor(const char *sensor) {
+    static int64_t days[QUERY_MAX_DAYS];
+    char path[512];
+    int n_days = 0;
+    int64_t first_day = q.from == INT64_MIN ? INT64_MIN : q.from / STORE_DAY_MS - 1;
+    int64_t last_day = q.to == INT64_MAX ? INT64_MAX : q.to / STORE_DAY_MS + 1;
+
+    snprintf(path, sizeof(path), "%s/%s", q.dir, sensor);
+    DIR *d = opendir(path);
+    if (!d) {
+        fprintf(stderr, "d6tquery: no data for sensor %s\n", sensor);
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) && n_days < QUERY_MAX_DAYS) {
+        int y, m, dd;
+        char ext[8];
+        // Raw segments and rollups (<YYYYMMDD>.<kind>.d6s) both name a day
+        if (sscanf(de->d_name, "%4d%2d%2d.%3s", &y, &m, &dd, ext) != 4 ||
+            (strcmp(ext, "d6s") != 0 && strcmp(ext, "min") != 0 &&
+             strcmp(ext, "max") != 0 && strcmp(ext, "avg") != 0)) {
+            continue;
+        }
+        struct tm tm = { .tm_year = y - 1900, .tm_mon = m - 1, .tm_mday = dd };
+        int64_t day = (int64_t)timegm(&tm) / 86400;
+        if (day >= first_day && day <= last_day) days[n_days++] = day;
+    }
+    closedir(d);
+    qsort(days, n_days, sizeof(days[0]), cmp_i64);
+
+    cur_sensor = sensor;
+    json_write_string(cur_sensor_json, sizeof(cur_sensor_json), sensor);
+    acc.count = 0;
+    for (int k = 0; k < n_days; k++) {
+        StoreSegment seg;
+        if (k > 0 && days[k] == days[k - 1]) continue;
+        store_segment_path(path, sizeof(path), q.dir, sensor, days[k]);
+        if (store_segment_open(path, &seg) != 0) {
+            store_rollup_path(path, sizeof(path), q.dir, sensor, days[k], rollup_kind());
+            if (store_segment_open(path, &seg) != 0) continue;
+            stats.rollup_segments++;
+        }
+        // Header lookups touch one page per chunk; without this, readahead
+        // pulls in the payloads as well
+        if ((zonemap_aggregate() && !q.per_frame) || q.have_above || q.have_below) {
+            madvise((void *)seg.data, seg.data_len, MADV_RANDOM);
+        }
+        for (int ci = 0; ci < seg.n_chunks; ci++) {
+            scan_chunk(&seg, ci);
+        }
+        store_segment_close(&seg);
+    }
+    acc_emit();
+}
+
+static int list_sensors(void) {
+    DIR *d = opendir(q.dir);
+    struct dirent *de;
+    if (!d) {
+        fprintf(stderr, "d6tquery: cannot open %s: %s\n", q.dir, strerror(errno));
+        return -1;
+    }
+    while ((de = readdir(d)) && q.n_sensors < QUERY_MAX_SENSORS) {
+        char path[512];
+        struct stat st;
+        if (de->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", q.dir, de->d_name);
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            q.sensors[q.n_sensors++] = strdup(de->d_name);
+        }
+    }
+    closedir(d);
+    qsort(q.sensors, q.n_sensors, sizeof(q.sensors[0]), cmp_str);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s -d store_dir [options]\n"
+        "  -s sensor_id     sensor to read (repeatable, default: all)\n"
+        "  -f time          start, inclusive (epoch ms, YYYY-MM-DD[THH:MM:SS] local)\n"
+        "  -t time          end, inclusive\n"
+        "  -a agg           min | max | avg | pNN (percentile, e.g. p95)\n"
+        "  -p pixel|frame   aggregate each pixel (default) or across the frame\n"
+        "  -b seconds       aggregate per time bucket instead of the whole range\n"
+        "  -A degC          only frames with a pixel above degC\n"
+        "  -B degC          only frames with a pixel below degC\n"
+        "  -o csv|ndjson|bin  output format (default csv)\n"
+        "  -v               print scan statistics to stderr\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:s:f:t:a:p:b:A:B:o:vh")) != -1) {
+        switch (opt) {
+        case 'd':
+            q.dir = optarg;
+            break;
+        case 's':
+            if (q.n_sensors < QUERY_MAX_SENSORS) q.sensors[q.n_sensors++] = optarg;
+            break;
+        case 'f':
+        case 't':
+            if (parse_time(optarg, opt == 'f' ? &q.from : &q.to) != 0) {
+                fprintf(stderr, "d6tquery: invalid time \"%s\"\n", optarg);
+                return 1;
+            }
+            break;
+        case 'a':
+            if (strcmp(optarg, "min") == 0) q.agg = AGG_MIN;
+            else if (strcmp(optarg, "max") == 0) q.agg = AGG_MAX;
+            else if (strcmp(optarg, "avg") == 0) q.agg = AGG_AVG;
+            else if (optarg[0] == 'p' && (q.pct = atof(optarg + 1)) > 0 && q.pct <= 100) q.agg = AGG_PCT;
+            else {
+                fprintf(stderr, "d6tquery: invalid aggregate \"%s\"\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            q.per_frame = strcmp(optarg, "frame") == 0;
+            break;
+        case 'b':
+            q.bucket_ms = (int64_t)(atof(optarg) * 1000);
+            break;
+        case 'A':
+            q.have_above = true;
+            q.above = (int16_t)(atof(optarg) * 10.0);
+            break;
+        case 'B':
+            q.have_below = true;
+            q.below = (int16_t)(atof(optarg) * 10.0);
+            break;
+        case 'o':
+            if (strcmp(optarg, "csv") == 0) q.out = OUT_CSV;
+            else if (strcmp(optarg, "ndjson") == 0) q.out = OUT_NDJSON;
+            else if (strcmp(optarg, "bin") == 0) q.out = OUT_BIN;
+            else {
+                fprintf(stderr, "d6tquery: invalid output format \"%s\"\n", optarg);
+                return 1;
+            }
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!q.dir) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (q.out == OUT_BIN && q.per_frame && q.agg != AGG_NONE) {
+        fprintf(stderr, "d6tquery: binary output supports frames and per-pixel aggregates only\n");
+        return 1;
+    }
+    if (q.agg == AGG_PCT) {
+        acc.hist = calloc((size_t)acc_cols() * HIST_SIZE, sizeof(uint32_t));
+        if (!acc.hist) {
+            fprintf(stderr, "d6tquery: out of memory\n");
+            return 1;
+        }
+    }
+    if (q.n_sensors == 0 && list_sensors() != 0) {
+        return 1;
+    }
+
+    static char outbuf[1 << 16];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+    print_header();
+    for (int s = 0; s < q.n_sensors; s++) {
+        scan_sensor(q.sensors[s]);
+    }
+    fflush(stdout);
+
+    if (verbose) {
+        fprintf(stderr, "chunks: %llu total, %llu skipped, %llu from zone maps, %llu decoded; "
+                "frames scanned: %llu; rows: %llu; rollup days: %llu\n",
+                (unsigned long long)stats.chunks_total, (unsigned long long)stats.chunks_skipped,
+                (unsigned long long)stats.chunks_zonemap_only, (unsigned long long)stats.chunks_decoded,
+                (unsigned long long)stats.frames_scanned, (unsigned long long)stats.rows,
+                (unsigned long long)stats.rollup_segments);
+    }
+    free(acc.hist);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * d6trecord - bulk recording of the binary frame FIFO (recorder.c)
+ *
+ * Record mode moves everything SensorDataApp writes to pipe.record_name into
+ * a file with splice(), so the frames go from the daemon's pool pages to the
+ * page cache without passing through userspace. The recording is the raw
+ * wire.h message stream and is appended to, so runs can be chained. When the
+ * daemon closes the FIFO (restart, reload) the reader waits for it to come
+ * back.
+ *
+ * Import mode decodes a recording and appends its frames to the frame store
+ * (store.c), e.g. on a machine that keeps the long-term archive.
+ */
+#define _GNU_SOURCE             // splice
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "store.h"
+#include "wire.h"
+
+#define RECORD_CHUNK (1 << 20)      // Bytes moved per splice()/read()
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+// read() + write(), for comparison with splice()
+static ssize_t copy_chunk(int in, int out, char *buf) {
+    ssize_t n = read(in, buf, RECORD_CHUNK);
+    for (ssize_t off = 0; off < n; ) {
+        ssize_t w = write(out, buf + off, (size_t)(n - off));
+        if (w < 0) {
+            return -1;
+        }
+        off += w;
+    }
+    return n;
+}
+
+static int record(const char *fifo, const char *path, bool copy) {
+    unsigned long long total = 0;
+    unsigned long calls = 0;
+    char *buf = NULL;
+    int ret = 0;
+
+    // splice() does not write to O_APPEND files; seek to the end instead
+    int out = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (out < 0 || lseek(out, 0, SEEK_END) < 0) {
+        fprintf(stderr, "d6trecord: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (copy && !(buf = malloc(RECORD_CHUNK))) {
+        fprintf(stderr, "d6trecord: out of memory\n");
+        close(out);
+        return 1;
+    }
+
+    while (!stop) {
+        // Blocks until SensorDataApp has the FIFO open
+        int in = open(fifo, O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "d6trecord: %s: %s\n", fifo, strerror(errno));
+            ret = 1;
+            break;
+        }
+        while (!stop) {
+            ssize_t n = copy ? copy_chunk(in, out, buf)
+                             : splice(in, NULL, out, NULL, RECORD_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n > 0) {
+                total += (unsigned long long)n;
+                calls++;
+            } else if (n == 0) {
+                break;              // Writer gone, wait for the next one
+            } else if (errno != EINTR) {
+                fprintf(stderr, "d6trecord: %s: %s\n", copy ? "copy" : "splice", strerror(errno));
+                stop = 1;
+                ret = 1;
+            }
+        }
+        close(in);
+    }
+
+    free(buf);
+    if (close(out) != 0) {
+        fprintf(stderr, "d6trecord: %s: %s\n", path, strerror(errno));
+        ret = 1;
+    }
+    fprintf(stderr, "d6trecord: %llu bytes recorded in %lu calls\n", total, calls);
+    return ret;
+}
+
+static int import(const char *path, const char *dir, int chunk_seconds) {
+    struct stat st;
+    WireMsg msg;
+    unsigned long frames = 0;
+    size_t off = 0;
+    int n = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "d6trecord: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    const uint8_t *data = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "d6trecord: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (store_open(dir, chunk_seconds) != 0) {
+        fprintf(stderr, "d6trecord: cannot open store %s\n", dir);
+        return 1;
+    }
+
+    while (off < size && (n = wire_get(data + off, size - off, &msg)) > 0) {
+        if (msg.type == WIRE_FRAME && store_append(msg.frame.sensor_id, &msg.frame.frame) == 0) {
+            frames++;
+        }
+        off += (size_t)n;
+    }
+    store_close();
+    if (data) {
+        munmap((void *)data, size);
+    }
+
+    fprintf(stderr, "d6trecord: %lu frames imported\n", frames);
+    if (off < size) {
+        fprintf(stderr, "d6trecord: %s at byte %zu, %zu bytes not imported\n",
+                n == 0 ? "truncated message" : "invalid data", off, size - off);
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s -p fifo -o file [-c]       record the frame FIFO to file\n"
+        "       %s -i file -d store_dir [-b seconds]  import a recording\n"
+        "  -c               copy with read()/write() instead of splice()\n"
+        "  -b seconds       store chunk length (default 300)\n", prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *fifo = NULL, *out = NULL, *in = NULL, *dir = NULL;
+    int chunk_seconds = 300;
+    bool copy = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:o:ci:d:b:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            fifo = optarg;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'c':
+            copy = true;
+            break;
+        case 'i':
+            in = optarg;
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'b':
+            chunk_seconds = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (in && dir) {
+        return import(in, dir, chunk_seconds);
+    }
+    if (!fifo || !out) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // No SA_RESTART: a blocked open() or splice() returns so we can stop
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    return record(fifo, out, copy);
+}
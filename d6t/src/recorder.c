@@ -0,0 +1,245 @@
+#define _GNU_SOURCE             // vmsplice, F_SETPIPE_SZ
+#include "recorder.h"
+#include "logger.h"
+#include "wire.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+typedef struct {
+    size_t fill;                    // Bytes encoded
+    size_t sent;                    // Of which handed to the pipe
+    uint64_t end;                   // Stream offset just past its last sent byte
+} RecPage;
+
+// Pages are numbered from the start and page n lives in slot
+// n % RECORDER_PAGES. Pages [tail, head] are in use, pages [send, head]
+// have bytes not yet in the pipe, and head is being filled.
+static struct {
+    int fd;
+    bool zero_copy;
+    bool dropping;                  // Frames are being dropped
+    uint8_t *pool;
+    size_t page_size;
+    RecPage pages[RECORDER_PAGES];
+    uint64_t tail;
+    uint64_t send;
+    uint64_t head;
+    uint64_t written;               // Bytes handed to the pipe
+    uint32_t next_seq;
+    unsigned long dropped_run;      // Frames dropped since dropping started
+    RecorderStats stats;
+} rec = { .fd = -1 };
+
+static RecPage *page(uint64_t n) {
+    return &rec.pages[n % RECORDER_PAGES];
+}
+
+static uint8_t *page_data(uint64_t n) {
+    return rec.pool + (n % RECORDER_PAGES) * rec.page_size;
+}
+
+// Release pages the reader has taken out of the pipe. The pipe holds the
+// last FIONREAD bytes written, so everything before that has been read.
+static void reclaim(void) {
+    uint64_t consumed = rec.written;
+
+    if (rec.zero_copy) {
+        int queued;
+        if (ioctl(rec.fd, FIONREAD, &queued) != 0) {
+            return;
+        }
+        consumed -= (uint64_t)queued;
+    }
+    while (rec.tail < rec.send && page(rec.tail)->end <= consumed) {
+        rec.tail++;
+    }
+}
+
+static bool next_page(void) {
+    if (rec.head + 1 - rec.tail >= RECORDER_PAGES) {
+        reclaim();
+        if (rec.head + 1 - rec.tail >= RECORDER_PAGES) {
+            return false;
+        }
+    }
+    rec.head++;
+    memset(page(rec.head), 0, sizeof(RecPage));
+    return true;
+}
+
+static ssize_t put(const struct iovec *iov, int n) {
+    if (rec.zero_copy) {
+        // The pipe references the pages; they are not written again until
+        // reclaim() sees them read
+        ssize_t r = vmsplice(rec.fd, iov, (unsigned long)n, SPLICE_F_NONBLOCK | SPLICE_F_GIFT);
+        if (r >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+            return r;
+        }
+        logger_perror("vmsplice on record pipe, falling back to write");
+        rec.zero_copy = false;
+    }
+    return writev(rec.fd, iov, n);
+}
+
+int recorder_open(const char *path, bool zero_copy) {
+    struct stat st;
+
+    if (access(path, F_OK) == -1) {
+        logger_log(LOG_INFO, "Creating named pipe at %s", path);
+        if (mkfifo(path, 0666) == -1) {
+            logger_perror("Error creating record pipe");
+            return -1;
+        }
+    }
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        logger_perror("Failed to open record pipe");
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        logger_log(LOG_ERROR, "Record pipe %s is not a FIFO", path);
+        close(fd);
+        return -1;
+    }
+    // More room lets the reader fall further behind; the default 64 KiB
+    // pipe holds only 16 vmsplice()d pieces
+    if (fcntl(fd, F_SETPIPE_SZ, RECORDER_PIPE_SIZE) < 0) {
+        logger_log(LOG_DEBUG, "Record pipe: cannot grow to %d bytes: %s",
+                   RECORDER_PIPE_SIZE, strerror(errno));
+    }
+
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    void *pool = mmap(NULL, RECORDER_PAGES * page_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pool == MAP_FAILED) {
+        logger_perror("Record pool");
+        close(fd);
+        return -1;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.fd = fd;
+    rec.zero_copy = zero_copy;
+    rec.pool = pool;
+    rec.page_size = page_size;
+    logger_log(LOG_INFO, "Recording frames to %s (%s)", path, zero_copy ? "vmsplice" : "write");
+    return 0;
+}
+
+int recorder_send(const char *sensor_id, bool abnormal, const StoreFrame *f) {
+    WireFrame wf;
+
+    if (rec.fd < 0) {
+        return -1;
+    }
+    wf.seq = rec.next_seq++;
+    wf.flags = abnormal ? WIRE_FLAG_ABNORMAL : 0;
+    snprintf(wf.sensor_id, sizeof(wf.sensor_id), "%s", sensor_id);
+    wf.frame = *f;
+
+    // Encode straight into the pool page
+    RecPage *p = page(rec.head);
+    int len = wire_put_frame(page_data(rec.head) + p->fill, rec.page_size - p->fill, &wf);
+    if (len < 0) {
+        if (!next_page()) {
+            if (!rec.dropping) {
+                logger_log(LOG_WARN, "Record pipe full, dropping frames");
+                rec.dropping = true;
+            }
+            rec.dropped_run++;
+            rec.stats.dropped++;
+            return -1;
+        }
+        p = page(rec.head);
+        len = wire_put_frame(page_data(rec.head), rec.page_size, &wf);
+    }
+    if (rec.dropping) {
+        logger_log(LOG_INFO, "Record pipe drained, %lu frames dropped", rec.dropped_run);
+        rec.dropping = false;
+        rec.dropped_run = 0;
+    }
+    p->fill += (size_t)len;
+    rec.stats.frames++;
+    return 0;
+}
+
+void recorder_flush(void) {
+    struct iovec iov[RECORDER_PAGES];
+    int n = 0;
+
+    if (rec.fd < 0) {
+        return;
+    }
+    // Everything not yet in the pipe, one piece per page, in one call
+    for (uint64_t i = rec.send; i <= rec.head; i++) {
+        RecPage *p = page(i);
+        if (p->sent < p->fill) {
+            iov[n].iov_base = page_data(i) + p->sent;
+            iov[n].iov_len = p->fill - p->sent;
+            n++;
+        }
+    }
+    ssize_t r = 0;
+    if (n > 0) {
+        r = put(iov, n);
+        if (r < 0) {
+            if (errno != EAGAIN) {
+                logger_perror("Failed to write record pipe");
+            }
+            return;
+        }
+        rec.stats.calls++;
+        rec.stats.bytes += (unsigned long long)r;
+    }
+
+    // The pipe may have taken only the first pages
+    for (;;) {
+        RecPage *p = page(rec.send);
+        size_t k = p->fill - p->sent;
+        if (k > (size_t)r) {
+            k = (size_t)r;
+        }
+        if (k > 0) {
+            p->sent += k;
+            rec.written += k;
+            p->end = rec.written;
+            r -= (ssize_t)k;
+        }
+        if (p->sent < p->fill || rec.send == rec.head) {
+            return;
+        }
+        rec.send++;
+    }
+}
+
+bool recorder_active(void) {
+    return rec.fd >= 0;
+}
+
+void recorder_get_stats(RecorderStats *st) {
+    *st = rec.stats;
+}
+
+void recorder_close(void) {
+    if (rec.fd < 0) {
+        return;
+    }
+    recorder_flush();
+    logger_log(LOG_INFO, "Recorder: %lu frames, %lu dropped, %llu bytes in %lu %s calls",
+               rec.stats.frames, rec.stats.dropped, rec.stats.bytes, rec.stats.calls,
+               rec.zero_copy ? "vmsplice" : "write");
+    // Pages still in the pipe keep their own references and stay readable
+    munmap(rec.pool, RECORDER_PAGES * rec.page_size);
+    close(rec.fd);
+    rec.fd = -1;
+    rec.pool = NULL;
+}
@@ -0,0 +1,51 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdbool.h>
+#include "store.h"
+
+// Binary frame recording FIFO (pipe.record_name), read by d6trecord.
+//
+// Frames are encoded as wire.h FRAME messages into a pool of page-aligned
+// pages and, in zero-copy mode, handed to the pipe with vmsplice(): the
+// pipe references the pool pages instead of copying them, and d6trecord
+// splice()s them on into a file, so the frame bytes are never copied
+// through userspace on either side. A page is reused only once the pipe no
+// longer holds any of it. Without zero copy the same pages go out with
+// write().
+//
+// A page counts as read once the pipe holds fewer bytes than were written
+// after it (FIONREAD). That holds for readers that copy or splice into a
+// file; a reader that splices the FIFO into another pipe (tee, a shell
+// pipeline of splicing tools) would keep references the daemon cannot see.
+// When the reader falls behind and every page is still in the pipe, new
+// frames are dropped.
+
+#define RECORDER_PAGES      64              // Pool size, in pages
+#define RECORDER_PIPE_SIZE  (1 << 20)       // Requested pipe capacity
+
+typedef struct {
+    unsigned long frames;           // Frames accepted by recorder_send()
+    unsigned long dropped;          // Frames dropped, all pages in the pipe
+    unsigned long calls;            // vmsplice() or write() calls
+    unsigned long long bytes;       // Bytes handed to the pipe
+} RecorderStats;
+
+// Create the FIFO if needed and open it read-write, so the daemon never
+// waits for d6trecord and frames queue while it restarts.
+int recorder_open(const char *path, bool zero_copy);
+
+// Encode a frame into the pool. Returns 0, or -1 if it was dropped.
+int recorder_send(const char *sensor_id, bool abnormal, const StoreFrame *f);
+
+// Hand the frames encoded since the last call to the pipe. Run by the
+// event loop before it waits.
+void recorder_flush(void);
+
+bool recorder_active(void);
+void recorder_get_stats(RecorderStats *st);
+
+// Flush what the pipe takes and release the pool
+void recorder_close(void);
+
+#endif // RECORDER_H
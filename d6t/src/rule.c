@@ -0,0 +1,406 @@
+#include "rule.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    OP_PUSH,            // k
+    OP_LOAD,            // v[var]
+    OP_NEG,
+    OP_NOT,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE,
+    OP_AND,
+    OP_OR,
+    OP_FOR_FRAMES,      // Held for k frames, counter in slot
+    OP_FOR_MS           // Held for k ms, start time in slot
+};
+
+enum { TOK_END, TOK_NUM, TOK_IDENT, TOK_OP };
+
+static const struct {
+    const char *name;
+    int var;
+} var_names[] = {
+    {"max", RULE_VAR_MAX}, {"min", RULE_VAR_MIN}, {"avg", RULE_VAR_AVG},
+    {"ptat", RULE_VAR_PTAT}, {"rise", RULE_VAR_RISE}, {"mean_rise", RULE_VAR_MEAN_RISE},
+};
+
+typedef struct {
+    const char *src;
+    const char *p;
+    RuleSet *rs;
+    const ZoneConfig *zones;
+    int n_zones;
+    int depth;
+    char *err;
+    size_t size;
+    bool failed;
+
+    // Current token
+    int tok;
+    const char *at;
+    double num;
+    char text[32];
+} Parser;
+
+static void fail(Parser *P, const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    if (P->failed) {
+        return;
+    }
+    P->failed = true;
+    n = snprintf(P->err, P->size, "column %d: ", (int)(P->at - P->src) + 1);
+    if (n >= 0 && (size_t)n < P->size) {
+        va_start(ap, fmt);
+        vsnprintf(P->err + n, P->size - n, fmt, ap);
+        va_end(ap);
+    }
+}
+
+static void next(Parser *P) {
+    const char *p = P->p;
+
+    while (isspace((unsigned char)*p)) p++;
+    P->at = p;
+    P->text[0] = '\0';
+    if (*p == '\0') {
+        P->tok = TOK_END;
+    } else if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
+        char *end;
+        P->tok = TOK_NUM;
+        P->num = strtod(p, &end);
+        p = end;
+    } else if (isalpha((unsigned char)*p) || *p == '_') {
+        size_t n = 0;
+        P->tok = TOK_IDENT;
+        while (isalnum((unsigned char)*p) || *p == '_') {
+            if (n < sizeof(P->text) - 1) P->text[n++] = *p;
+            p++;
+        }
+        P->text[n] = '\0';
+    } else {
+        static const char *ops[] = {"<=", ">=", "==", "!=", "<", ">", "+", "-", "*", "/", "(", ")"};
+        P->tok = TOK_OP;
+        for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k++) {
+            size_t n = strlen(ops[k]);
+            if (strncmp(p, ops[k], n) == 0) {
+                memcpy(P->text, ops[k], n + 1);
+                p += n;
+                break;
+            }
+        }
+        if (P->text[0] == '\0') {
+            fail(P, "unexpected '%c'", *p);
+            P->tok = TOK_END;
+        }
+    }
+    P->p = p;
+}
+
+static bool is(const Parser *P, const char *text) {
+    return (P->tok == TOK_OP || P->tok == TOK_IDENT) && strcmp(P->text, text) == 0;
+}
+
+static bool accept(Parser *P, const char *text) {
+    if (is(P, text)) {
+        next(P);
+        return true;
+    }
+    return false;
+}
+
+// Append an instruction; pops and pushes track the stack depth
+static void emit(Parser *P, int op, int pops, int pushes, int var, int slot, double k) {
+    RuleSet *rs = P->rs;
+
+    if (P->failed) {
+        return;
+    }
+    if (rs->n_code == RULE_MAX_CODE) {
+        fail(P, "rules too long");
+        return;
+    }
+    P->depth += pushes - pops;
+    if (P->depth > RULE_STACK) {
+        fail(P, "expression nested too deeply");
+        return;
+    }
+    rs->code[rs->n_code++] = (RuleInsn){(uint8_t)op, (uint8_t)var, (uint16_t)slot, (float)k};
+}
+
+static void parse_or(Parser *P);
+
+static void parse_primary(Parser *P) {
+    if (P->tok == TOK_NUM) {
+        emit(P, OP_PUSH, 0, 1, 0, 0, P->num);
+        next(P);
+    } else if (accept(P, "(")) {
+        parse_or(P);
+        if (!accept(P, ")")) {
+            fail(P, "expected ')'");
+        }
+    } else if (P->tok == TOK_IDENT) {
+        static const char *zone_fn[] = {"min", "max", "avg"};
+        int var = -1;
+
+        // max(zone) and the like: look ahead for the parenthesis
+        const char *q = P->p;
+        while (isspace((unsigned char)*q)) q++;
+        for (int k = 0; k < 3 && *q == '('; k++) {
+            if (strcmp(P->text, zone_fn[k]) != 0) {
+                continue;
+            }
+            next(P);
+            next(P);
+            for (int z = 0; P->tok == TOK_IDENT && z < P->n_zones; z++) {
+                if (strcmp(P->text, P->zones[z].name) == 0) {
+                    var = RULE_ZONE_VAR(z, k);
+                }
+            }
+            if (var < 0) {
+                fail(P, P->tok == TOK_IDENT ? "unknown zone \"%s\"" : "expected a zone", P->text);
+                return;
+            }
+            next(P);
+            if (!is(P, ")")) {
+                fail(P, "expected ')'");
+                return;
+            }
+            break;
+        }
+        for (size_t k = 0; var < 0 && k < sizeof(var_names) / sizeof(var_names[0]); k++) {
+            if (strcmp(P->text, var_names[k].name) == 0) {
+                var = var_names[k].var;
+            }
+        }
+        if (var < 0 && P->text[0] == 'p' && isdigit((unsigned char)P->text[1])) {
+            char *end;
+            long n = strtol(P->text + 1, &end, 10);
+            if (*end == '\0' && n >= 0 && n < 16) {
+                var = RULE_VAR_PIXEL0 + (int)n;
+            }
+        }
+        if (var < 0) {
+            fail(P, "unknown value \"%s\"", P->text);
+            return;
+        }
+        P->rs->vars |= 1ull << var;
+        emit(P, OP_LOAD, 0, 1, var, 0, 0.0);
+        next(P);
+    } else {
+        fail(P, P->tok == TOK_END ? "unexpected end of rule" : "expected a value");
+    }
+}
+
+static void parse_unary(Parser *P) {
+    if (accept(P, "-")) {
+        parse_unary(P);
+        emit(P, OP_NEG, 1, 1, 0, 0, 0.0);
+    } else {
+        parse_primary(P);
+    }
+}
+
+static void parse_product(Parser *P) {
+    parse_unary(P);
+    while (!P->failed && (is(P, "*") || is(P, "/"))) {
+        int op = is(P, "*") ? OP_MUL : OP_DIV;
+        next(P);
+        parse_unary(P);
+        emit(P, op, 2, 1, 0, 0, 0.0);
+    }
+}
+
+static void parse_sum(Parser *P) {
+    parse_product(P);
+    while (!P->failed && (is(P, "+") || is(P, "-"))) {
+        int op = is(P, "+") ? OP_ADD : OP_SUB;
+        next(P);
+        parse_product(P);
+        emit(P, op, 2, 1, 0, 0, 0.0);
+    }
+}
+
+static void parse_compare(Parser *P) {
+    static const struct {
+        const char *text;
+        int op;
+    } cmp[] = {
+        {"<", OP_LT}, {"<=", OP_LE}, {">", OP_GT}, {">=", OP_GE}, {"==", OP_EQ}, {"!=", OP_NE},
+    };
+
+    parse_sum(P);
+    for (size_t k = 0; !P->failed && k < sizeof(cmp) / sizeof(cmp[0]); k++) {
+        if (accept(P, cmp[k].text)) {
+            parse_sum(P);
+            emit(P, cmp[k].op, 2, 1, 0, 0, 0.0);
+            break;
+        }
+    }
+}
+
+// <compare> [for N frames|s|ms]
+static void parse_timed(Parser *P) {
+    parse_compare(P);
+    if (P->failed || !accept(P, "for")) {
+        return;
+    }
+    if (P->tok != TOK_NUM || P->num < 0) {
+        fail(P, "expected a duration after \"for\"");
+        return;
+    }
+    double n = P->num;
+    next(P);
+    if (P->rs->n_slots == RULE_MAX_SLOTS) {
+        fail(P, "too many durations");
+    } else if (accept(P, "frames") || accept(P, "frame")) {
+        emit(P, OP_FOR_FRAMES, 1, 1, 0, P->rs->n_slots++, n);
+    } else if (accept(P, "s")) {
+        emit(P, OP_FOR_MS, 1, 1, 0, P->rs->n_slots++, n * 1000.0);
+    } else if (accept(P, "ms")) {
+        emit(P, OP_FOR_MS, 1, 1, 0, P->rs->n_slots++, n);
+    } else {
+        fail(P, "expected frames, s or ms");
+    }
+}
+
+static void parse_not(Parser *P) {
+    if (accept(P, "not")) {
+        parse_not(P);
+        emit(P, OP_NOT, 1, 1, 0, 0, 0.0);
+    } else {
+        parse_timed(P);
+    }
+}
+
+static void parse_and(Parser *P) {
+    parse_not(P);
+    while (!P->failed && accept(P, "and")) {
+        parse_not(P);
+        emit(P, OP_AND, 2, 1, 0, 0, 0.0);
+    }
+}
+
+static void parse_or(Parser *P) {
+    parse_and(P);
+    while (!P->failed && accept(P, "or")) {
+        parse_and(P);
+        emit(P, OP_OR, 2, 1, 0, 0, 0.0);
+    }
+}
+
+void rule_set_clear(RuleSet *rs) {
+    rs->n_code = 0;
+    rs->n_rules = 0;
+    rs->n_slots = 0;
+    rs->vars = 0;
+}
+
+int rule_add(RuleSet *rs, const char *when, const char *reason,
+             const ZoneConfig *zones, int n_zones, char *err, size_t size) {
+    Parser P = {.src = when, .p = when, .rs = rs, .zones = zones, .n_zones = n_zones,
+                .err = err, .size = size};
+    int start = rs->n_code, slots = rs->n_slots;
+    uint64_t vars = rs->vars;
+
+    if (rs->n_rules == RULE_MAX_RULES) {
+        snprintf(err, size, "more than %d rules", RULE_MAX_RULES);
+        return -1;
+    }
+    next(&P);
+    parse_or(&P);
+    if (!P.failed && P.tok != TOK_END) {
+        fail(&P, "unexpected \"%s\"", P.text);
+    }
+    if (P.failed) {
+        rs->n_code = start;
+        rs->n_slots = slots;
+        rs->vars = vars;
+        return -1;
+    }
+
+    Rule *r = &rs->rules[rs->n_rules++];
+    r->start = (uint16_t)start;
+    r->len = (uint16_t)(rs->n_code - start);
+    snprintf(r->reason, sizeof(r->reason), "%s", reason && reason[0] ? reason : when);
+    return 0;
+}
+
+uint32_t rule_set_sum(const RuleSet *rs) {
+    const uint8_t *p[2] = {(const uint8_t *)rs->code, (const uint8_t *)rs->rules};
+    size_t n[2] = {rs->n_code * sizeof(rs->code[0]), rs->n_rules * sizeof(rs->rules[0])};
+    uint32_t h = 2166136261u;
+
+    for (int k = 0; k < 2; k++) {
+        for (size_t i = 0; i < n[k]; i++) {
+            h = (h ^ p[k][i]) * 16777619u;
+        }
+    }
+    return h;
+}
+
+int rule_eval(const RuleSet *rs, RuleState *st, const RuleInput *in) {
+    float s[RULE_STACK];
+    int fired = -1;
+
+    for (int r = 0; r < rs->n_rules; r++) {
+        const RuleInsn *ip = &rs->code[rs->rules[r].start];
+        const RuleInsn *end = ip + rs->rules[r].len;
+        int sp = 0;
+
+        for (; ip < end; ip++) {
+            switch (ip->op) {
+            case OP_PUSH: s[sp++] = ip->k; break;
+            case OP_LOAD: s[sp++] = in->v[ip->var]; break;
+            case OP_NEG:  s[sp - 1] = -s[sp - 1]; break;
+            case OP_NOT:  s[sp - 1] = s[sp - 1] == 0.0f; break;
+            case OP_ADD:  sp--; s[sp - 1] += s[sp]; break;
+            case OP_SUB:  sp--; s[sp - 1] -= s[sp]; break;
+            case OP_MUL:  sp--; s[sp - 1] *= s[sp]; break;
+            case OP_DIV:  sp--; s[sp - 1] /= s[sp]; break;
+            case OP_LT:   sp--; s[sp - 1] = s[sp - 1] < s[sp]; break;
+            case OP_LE:   sp--; s[sp - 1] = s[sp - 1] <= s[sp]; break;
+            case OP_GT:   sp--; s[sp - 1] = s[sp - 1] > s[sp]; break;
+            case OP_GE:   sp--; s[sp - 1] = s[sp - 1] >= s[sp]; break;
+            case OP_EQ:   sp--; s[sp - 1] = s[sp - 1] == s[sp]; break;
+            case OP_NE:   sp--; s[sp - 1] = s[sp - 1] != s[sp]; break;
+            case OP_AND:  sp--; s[sp - 1] = s[sp - 1] != 0.0f && s[sp] != 0.0f; break;
+            case OP_OR:   sp--; s[sp - 1] = s[sp - 1] != 0.0f || s[sp] != 0.0f; break;
+            case OP_FOR_FRAMES: {
+                uint32_t *n = &st->frames[ip->slot];
+                *n = s[sp - 1] != 0.0f ? *n + (*n != UINT32_MAX) : 0;
+                s[sp - 1] = *n >= ip->k;
+                break;
+            }
+            case OP_FOR_MS: {
+                int64_t *since = &st->since_ms[ip->slot];
+                if (s[sp - 1] != 0.0f) {
+                    if (*since == 0) *since = in->t_ms;
+                    s[sp - 1] = in->t_ms - *since >= ip->k;
+                } else {
+                    *since = 0;
+                }
+                break;
+            }
+            }
+        }
+        if (fired < 0 && s[0] != 0.0f) {
+            fired = r;
+        }
+    }
+    return fired;
+}
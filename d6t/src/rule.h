@@ -0,0 +1,96 @@
+#ifndef RULE_H
+#define RULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Alert rules: a small expression language compiled to stack bytecode.
+//
+//   max > 60 for 3 frames and ptat < 40
+//   (p5 - avg > 8 or rise > 20) for 2 s
+//
+// Values:      max, min, avg, ptat (degC); p0 .. p15 (pixels, degC);
+//              rise, mean_rise (steepest pixel and frame-mean slope in degC
+//              per minute, see trend.h; 0 unless trend.enabled);
+//              max(zone), min(zone), avg(zone) (the sensor's zones, zone.h)
+// Operators:   + - * /  < <= > >= == !=  not and or  ( )
+// Duration:    <condition> for N frames | for N s | for N ms
+//              true once the condition has held that long without a break
+//
+// A rule is parsed and compiled once, when the config is loaded. Evaluating
+// it is a loop over fixed-size instructions on a small stack of floats,
+// with no allocation and no strings. Every rule of a sensor is evaluated on
+// every frame so that duration counters never miss a frame; `and` and `or`
+// do not short-circuit for the same reason.
+
+#define RULE_MAX_RULES  (2 * CONFIG_MAX_RULES)  // alert.rules and sensors[].rules
+#define RULE_MAX_CODE   (RULE_MAX_RULES * 32)
+#define RULE_MAX_SLOTS  (RULE_MAX_RULES * 4)    // Duration counters
+#define RULE_STACK      16
+
+enum {
+    RULE_VAR_MAX,
+    RULE_VAR_MIN,
+    RULE_VAR_AVG,
+    RULE_VAR_PTAT,
+    RULE_VAR_RISE,
+    RULE_VAR_MEAN_RISE,
+    RULE_VAR_PIXEL0,
+    RULE_VAR_ZONE0 = RULE_VAR_PIXEL0 + 16,  // min, max, avg of each zone
+    RULE_N_VARS = RULE_VAR_ZONE0 + 3 * CONFIG_MAX_ZONES
+};
+#define RULE_TREND_VARS ((1ull << RULE_VAR_RISE) | (1ull << RULE_VAR_MEAN_RISE))
+#define RULE_ZONE_VAR(z, k) (RULE_VAR_ZONE0 + 3 * (z) + (k))  // k: 0 min, 1 max, 2 avg
+
+// What the rules of one frame are evaluated against
+typedef struct {
+    int64_t t_ms;
+    float v[RULE_N_VARS];
+} RuleInput;
+
+typedef struct {
+    uint8_t op;
+    uint8_t var;
+    uint16_t slot;
+    float k;
+} RuleInsn;
+
+typedef struct {
+    uint16_t start;                 // First instruction in RuleSet.code
+    uint16_t len;
+    char reason[96];                // alert_reason when the rule fires
+} Rule;
+
+typedef struct {
+    RuleInsn code[RULE_MAX_CODE];
+    int n_code;
+    Rule rules[RULE_MAX_RULES];
+    int n_rules;
+    int n_slots;
+    uint64_t vars;                  // Values read, bit per RULE_VAR_*
+} RuleSet;
+
+// Duration counters of one sensor's rules
+typedef struct {
+    uint32_t frames[RULE_MAX_SLOTS];
+    int64_t since_ms[RULE_MAX_SLOTS];
+} RuleState;
+
+void rule_set_clear(RuleSet *rs);
+
+// Compile a rule and append it to rs. reason defaults to the rule text;
+// zone names resolve against zones. Returns 0, or -1 with a message in err.
+int rule_add(RuleSet *rs, const char *when, const char *reason,
+             const ZoneConfig *zones, int n_zones, char *err, size_t size);
+
+// Checksum of the compiled rules, to tell whether saved duration counters
+// (snapshot.h) still belong to them
+uint32_t rule_set_sum(const RuleSet *rs);
+
+// Evaluate every rule of rs for one frame. Returns the index of the first
+// rule that holds, or -1.
+int rule_eval(const RuleSet *rs, RuleState *st, const RuleInput *in);
+
+#endif // RULE_H
@@ -35,71 +35,104 @@
 #include <time.h>
 #include <linux/i2c.h> //add
 #include <sys/stat.h> // For mkfifo
-#include <sys/time.h> // For millisecond timestamps
+#include <signal.h>
+#include <libgen.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
 #include "logger.h" // For logging functionality
+#include "config.h"
+#include "evloop.h"
+#include "uploader.h"
+#include "alert.h"
+#include "json.h"
+#include "service.h"
+#include "store.h"
+#include "policy.h"
+#include "forwarder.h"
+#include "timestamp.h"
+#include "frame.h"
+#include "history.h"
+#include "trend.h"
+#include "rule.h"
+#include "zone.h"
+#include "pipeline.h"
+#include "recorder.h"
+#include "i2cbus.h"
+#include "output.h"
+#include "snapshot.h"
 
 /* defines */
-#define D6T_ADDR 0x0A  // for I2C 7bit address
 #define D6T_CMD 0x4C  // for D6T-44L-06/06H, D6T-8L-09/09H, for D6T-1A-01/02
 #define N_ROW 4
 #define N_PIXEL (4 * 4)
 #define N_READ ((N_PIXEL + 1) * 2 + 1)
-#define RASPBERRY_PI_I2C    "/dev/i2c-0"
-#define I2CDEV              RASPBERRY_PI_I2C
-#define PIPE_NAME "/tmp/sensor_data_pipe"  // Named pipe location
 
-uint8_t rbuf[N_READ];
-double ptat;
-double pix_data[N_PIXEL];
+// Runtime state of one configured sensor. Slots are matched to config
+// entries by id across reloads so that timers, filters and alert state
+// survive when a sensor is unchanged.
+typedef struct {
+    bool active;
+    SensorConfig cfg;
+    int timer_fd;
+    I2cBus bus;
+    uint8_t rbuf[N_READ];
+    double ptat;
+    double pix_data[N_PIXEL];
+    FrameHistory raw;               // Recent frames before filtering
+    TrendState trend;               // Rate of rise of the filtered frames
+    RuleSet rules;                  // alert.rules and the sensor's own, compiled
+    RuleState rule_state;
+    ZoneSet zones;                  // The sensor's zones, compiled
+    Pipeline pipeline;              // Stages a frame goes through
+    bool have_filtered;
+    SensorFrame *recent[ALERT_HISTORY_MAX_FRAMES]; // Ring for alert history
+    int recent_head;
+    int recent_count;
+} D6TSensor;
 
-void delay(int msec) {
-    struct timespec ts = {.tv_sec = msec / 1000,
-                          .tv_nsec = (msec % 1000) * 1000000};
-    nanosleep(&ts, NULL);
-}
+// Frame history attached to an alert, a base64 store chunk
+typedef struct {
+    int frames;
+    char data[ALERT_HISTORY_MAX_B64 + 1];
+} AlertHistory;
 
-/* I2C functions */
-/** <!-- i2c_read_reg8 {{{1 --> I2C read function for bytes transfer.
- */
+// The frame being processed, handed from stage to stage
+struct PipelineCtx {
+    D6TSensor *s;
+    SensorFrame *f;
+    double pix[N_PIXEL];            // Working copy, filtered in place
+    TempAnalysis analysis;
+    const char *rising;             // Rate-of-rise alert reason, if any
+    const char *rule;               // Reason of the first alert rule that holds
+    bool transition;
+    const AlertHistory *history;    // Attached to the alert, if any
+    char line[1024];                // Frame line for the log and the pipe
+};
 
-uint32_t i2c_read_reg8(uint8_t devAddr, uint8_t regAddr,
-                       uint8_t *data, int length
-) {
-    int fd = open(I2CDEV, O_RDWR);
+static AppConfig config;
+static const char *config_path = DEFAULT_CONFIG_PATH;
+static D6TSensor sensors[CONFIG_MAX_SENSORS];
+static int inotify_fd = -1;
+static int pipe_fd = -1;        // Frame FIFO, held read-write like the socket unit does
+static bool pipe_fd_passed;     // pipe_fd came from SensorDataApp.socket
+static int alert_fd = -1;       // Alert FIFO, held read-write like the socket unit does
+static bool alert_fd_passed;    // alert_fd came from SensorDataApp.socket
+static int snapshot_tfd = -1;
+static int store_tfd = -1;
+static bool snapshot_due;       // An alert transition waits to be saved
+static SnapshotSensor snap[CONFIG_MAX_SENSORS];
 
-    if (fd < 0) {
-        logger_log(LOG_ERROR, "Failed to open device: %s", strerror(errno));
-        return 21;
-    }
-    int err = 0;
-    do {
-        if (ioctl(fd, I2C_SLAVE, devAddr) < 0) {
-            logger_log(LOG_ERROR, "Failed to select device: %s", strerror(errno));
-            err = 22; break;
-        }
-        if (write(fd, &regAddr, 1) != 1) {
-            err = 23; break;
-        }
-        delay(1); //add
-        int count = read(fd, data, length);
-        if (count < 0) {
-            err = 24; break;
-        } else if (count != length) {
-            logger_log(LOG_ERROR, "Short read from device, expected %d, got %d",
-                    length, count);
-            err = 25; break;
-        }
-    } while (false);
-    close(fd);
-    return err;
+void delay(int msec) {
+    ts_sleep_ns((int64_t)msec * 1000000);
 }
 
+/* I2C functions */
 /** <!-- i2c_write_reg8 {{{1 --> I2C read function for bytes transfer.
  */
-uint32_t i2c_write_reg8(uint8_t devAddr,
+uint32_t i2c_write_reg8(const char *dev, uint8_t devAddr,
                         uint8_t *data, int length
 ) {
-    int fd = open(I2CDEV, O_RDWR);
+    int fd = open(dev, O_RDWR);
     if (fd < 0) {
         logger_log(LOG_ERROR, "Failed to open device: %s", strerror(errno));
         return 21;
@@ -134,9 +167,9 @@ uint8_t calc_crc(uint8_t data) {
  * calculate the data sequence,
  * from an I2C Read client address (8bit) to thermal data end.
  */
-bool D6T_checkPEC(uint8_t buf[], int n) {
+bool D6T_checkPEC(uint8_t addr, uint8_t buf[], int n) {
     int i;
-    uint8_t crc = calc_crc((D6T_ADDR << 1) | 1);  // I2C Read address (8bit)
+    uint8_t crc = calc_crc((addr << 1) | 1);  // I2C Read address (8bit)
     for (i = 0; i < n; i++) {
         crc = calc_crc(buf[i] ^ crc);
     }
@@ -159,100 +192,1232 @@ int16_t conv8us_s16_le(uint8_t* buf, int n) {
 void initialSetting(void) {
 }
 
-/** <!-- main - Thermal sensor {{{1 -->
- * Read data
+/** <!-- post_frame {{{1 --> queue the temperature record of one frame.
+ */
+static void post_frame(const char *id, const ZoneSet *zs, const SensorFrame *f) {
+    char body[1024];
+    int len, i;
+
+    len = snprintf(body, sizeof(body),
+                   "{\"sensor_id\":%s,\"date\":\"%s\",\"time\":\"%s\","
+                   "\"temperature_data\":[", id, f->stamp.date, f->stamp.time);
+    for (i = 0; i < N_PIXEL; i++) {
+        len += snprintf(body + len, sizeof(body) - len, "%s%.1f",
+                        i ? "," : "", f->pix[i]);
+    }
+    len += snprintf(body + len, sizeof(body) - len, "],\"average_temp\":%.2f", f->avg_temp);
+    // Zones changed by a reload since this frame are left out
+    for (i = 0; i < f->zones.n && f->zones.n == zs->n; i++) {
+        len += snprintf(body + len, sizeof(body) - len,
+                        "%s\"%s\":{\"min\":%.1f,\"max\":%.1f,\"avg\":%.2f}",
+                        i ? "," : ",\"zones\":{", zs->name[i],
+                        f->zones.min[i], f->zones.max[i], f->zones.avg[i]);
+    }
+    len += snprintf(body + len, sizeof(body) - len, "%s,\"status\":\"%s\"}",
+                    i ? "}" : "", f->is_abnormal ? STATUS_ABNORMAL : STATUS_NORMAL);
+    uploader_post(UPLOAD_TELEMETRY, config.endpoint_temperature, body, len);
+}
+
+/** <!-- post_summary {{{1 --> queue a summary record for a closed period.
+ */
+static void post_summary(const char *id, const PolicySummary *sum) {
+    char body[512];
+    int len;
+
+    len = snprintf(body, sizeof(body),
+                   "{\"sensor_id\":%s,\"date\":\"%s\",\"time\":\"%s\",\"frames\":%d,"
+                   "\"min_temp\":%.1f,\"max_temp\":%.1f,\"average_temp\":%.2f,"
+                   "\"hotspot\":{\"pixel\":%d,\"temp\":%.1f},\"status\":\"%s\"}",
+                   id, sum->date, sum->time, sum->frames,
+                   sum->min_temp, sum->max_temp, sum->avg_temp,
+                   sum->hotspot, sum->max_temp,
+                   sum->any_abnormal ? STATUS_ABNORMAL : STATUS_NORMAL);
+    uploader_post(UPLOAD_TELEMETRY, config.endpoint_summary, body, len);
+}
+
+/** <!-- post_records {{{1 --> single-hop mode: send the same temperature,
+ * summary and alert records the Node.js pipeReader would build from this
+ * frame. Alerts go on their own uploader lane so they never queue behind
+ * frames. When frames are forwarded to an aggregator, only alerts are
+ * posted here.
+ */
+static void post_records(D6TSensor *s, const TempAnalysis *analysis, bool transition,
+                         const AlertHistory *history, SensorFrame *f) {
+    PolicyOutput out;
+    char body[ALERT_HISTORY_MAX_B64 + 512];
+    char id[6 * sizeof(s->cfg.id) + 3];     // Every byte escaped as \u00XX
+    char reason[160];
+    int len, k;
+
+    if (json_write_string(id, sizeof(id), s->cfg.id) < 0) {
+        logger_log(LOG_ERROR, "Sensor %s: id too long to post, record dropped", s->cfg.id);
+        return;
+    }
+
+    if (transition) {
+        json_write_string(reason, sizeof(reason),
+                          analysis->is_abnormal ? analysis->alert_reason : ALERT_RECOVERY_REASON);
+        len = snprintf(body, sizeof(body),
+                       "{\"sensor_id\":%s,\"date\":\"%s\",\"time\":\"%s\","
+                       "\"alert_reason\":%s,\"status\":\"%s\"",
+                       id, f->stamp.date, f->stamp.time, reason,
+                       analysis->is_abnormal ? STATUS_ABNORMAL : STATUS_NORMAL);
+        if (history) {
+            len += snprintf(body + len, sizeof(body) - len,
+                            ",\"history\":{\"format\":\"d6tc\",\"frames\":%d,\"data\":\"%s\"}",
+                            history->frames, history->data);
+        }
+        len += snprintf(body + len, sizeof(body) - len, "}");
+        uploader_post(UPLOAD_ALERT, config.endpoint_alerts, body, len);
+    }
+    if (config.forward_host[0] != '\0') {
+        return;
+    }
+
+    policy_frame((int)(s - sensors), &s->cfg, f, &out);
+    for (k = 0; k < out.n_frames; k++) {
+        post_frame(id, &s->zones, out.frames[k]);
+    }
+    if (out.have_summary) {
+        post_summary(id, &out.summary);
+    }
+}
+
+/** <!-- alert_line_written {{{1 --> result of a write to the alert pipe.
+ */
+static void alert_line_written(int fd, ssize_t res, void *arg) {
+    const char *id = arg;
+    (void)fd;
+
+    if (res == -EAGAIN) {
+        logger_log(LOG_WARN, "Alert pipe full, no reader: alert for %s dropped", id);
+    } else if (res < 0) {
+        errno = (int)-res;
+        logger_perror("Failed to write alert pipe");
+    }
+}
+
+/** <!-- write_alert_line {{{1 --> pipe mode: hand an alert transition to
+ * pipeReader on the alert FIFO, ahead of and apart from the frame stream.
+ */
+static void write_alert_line(const D6TSensor *s, const TempAnalysis *analysis,
+                             const AlertHistory *history, const SensorFrame *f) {
+    char line[ALERT_HISTORY_MAX_B64 + 512];
+    int len;
+
+    len = snprintf(line, sizeof(line), "alert: id: %s, date: %s, time: %s, status: %d, ",
+                   s->cfg.id, f->stamp.date, f->stamp.time, analysis->is_abnormal ? 1 : 0);
+    if (history) {
+        len += snprintf(line + len, sizeof(line) - len, "history: %d:%s, ",
+                        history->frames, history->data);
+    }
+    len += snprintf(line + len, sizeof(line) - len, "reason: %s\n",
+                    analysis->is_abnormal ? analysis->alert_reason : ALERT_RECOVERY_REASON);
+    output_write(alert_fd, line, len, alert_line_written, (void *)s->cfg.id);
+}
+
+/** <!-- to_store_frame {{{1 --> the published frame in sensor units
+ * (0.1 degC), as written to the frame store and the alert history.
+ */
+static int16_t to_deci(double v) {
+    return (int16_t)(v * 10.0 + (v >= 0 ? 0.5 : -0.5));
+}
+
+static void to_store_frame(const D6TSensor *s, int64_t t_ms, StoreFrame *f) {
+    int i;
+
+    f->t_ms = t_ms;
+    f->ptat = to_deci(s->ptat);
+    for (i = 0; i < N_PIXEL; i++) {
+        f->pix[i] = to_deci(s->pix_data[i]);
+    }
+}
+
+/** <!-- remember_frame {{{1 --> keep the frame in the sensor's history ring.
+ */
+static void remember_frame(D6TSensor *s, SensorFrame *f) {
+    if (s->recent_count == ALERT_HISTORY_MAX_FRAMES) {
+        frame_unref(s->recent[s->recent_head]);
+        s->recent_head = (s->recent_head + 1) % ALERT_HISTORY_MAX_FRAMES;
+        s->recent_count--;
+    }
+    s->recent[(s->recent_head + s->recent_count) % ALERT_HISTORY_MAX_FRAMES] = frame_ref(f);
+    s->recent_count++;
+}
+
+/** <!-- forget_frames {{{1 --> empty the history ring.
+ */
+static void forget_frames(D6TSensor *s) {
+    for (int k = 0; k < s->recent_count; k++) {
+        frame_unref(s->recent[(s->recent_head + k) % ALERT_HISTORY_MAX_FRAMES]);
+    }
+    s->recent_head = s->recent_count = 0;
+}
+
+/** <!-- encode_history {{{1 --> encode the last alert.history_seconds of
+ * frames, up to and including the current one. Returns false if empty.
+ */
+static bool encode_history(const D6TSensor *s, int64_t now_ms, AlertHistory *out) {
+    StoreFrame frames[ALERT_HISTORY_MAX_FRAMES];
+    int64_t since = now_ms - (int64_t)config.alert_history_seconds * 1000;
+    int n = 0;
+
+    for (int k = 0; k < s->recent_count; k++) {
+        const SensorFrame *f = s->recent[(s->recent_head + k) % ALERT_HISTORY_MAX_FRAMES];
+        if (f->t_ms > since) {
+            frames[n++] = f->store;
+        }
+    }
+    out->frames = n > 0 ? alert_encode_history(frames, n, out->data, sizeof(out->data)) : -1;
+    if (out->frames < 0) {
+        logger_log(LOG_WARN, "Sensor %s: alert history could not be encoded", s->cfg.id);
+        return false;
+    }
+    return true;
+}
+
+/** <!-- frame_line_written {{{1 --> result of a write to the frame pipe.
+ */
+static void frame_line_written(int fd, ssize_t res, void *arg) {
+    (void)fd; (void)arg;
+
+    if (res == -EAGAIN) {
+        logger_log(LOG_WARN, "Pipe full, no reader: frame dropped");
+    } else if (res < 0) {
+        errno = (int)-res;
+        logger_perror("Failed to write pipe");
+    } else {
+        logger_log(LOG_DEBUG, "Data sent to pipe");
+    }
+}
+
+/** <!-- write_frame_line {{{1 --> pipe mode: hand a frame line to pipeReader.
+ */
+static void write_frame_line(const char *buffer) {
+    // The FIFO is held read-write, so the write never waits for a reader and
+    // frames queue in the pipe while the consumer restarts.
+    if (pipe_fd >= 0) {
+        output_write(pipe_fd, buffer, strlen(buffer), frame_line_written, NULL);
+    }
+}
+
+/* Pipeline stages {{{1 */
+/** <!-- stage_ema {{{2 --> exponential moving average filter.
+ */
+static void stage_ema(PipelineCtx *c) {
+    D6TSensor *s = c->s;
+
+    if (s->have_filtered) {
+        for (int i = 0; i < N_PIXEL; i++) {
+            c->pix[i] = s->cfg.filter_alpha * c->pix[i] +
+                        (1.0 - s->cfg.filter_alpha) * s->pix_data[i];
+        }
+    }
+    s->have_filtered = true;
+}
+
+/** <!-- stage_median3 {{{2 --> median of the last three raw frames.
+ */
+static void stage_median3(PipelineCtx *c) {
+    if (c->s->raw.count < 3) {
+        return;
+    }
+    for (int i = 0; i < N_PIXEL; i++) {
+        const float *w;
+        history_pixel(&c->s->raw, i, 3, &w);
+        double a = w[0], b = w[1], c3 = w[2];
+        c->pix[i] = a > b ? (b > c3 ? b : (a > c3 ? c3 : a))
+                          : (a > c3 ? a : (b > c3 ? c3 : b));
+    }
+}
+
+/** <!-- stage_trend {{{2 --> rate-of-rise rules over the filtered frames.
+ */
+static void stage_trend(PipelineCtx *c) {
+    trend_push(&c->s->trend, c->f->t_ms, c->pix, config.trend_window_s * 1000);
+    c->rising = trend_check(&c->s->trend, &config);
+}
+
+/** <!-- stage_zones {{{2 --> min, max and mean of every zone.
+ */
+static void stage_zones(PipelineCtx *c) {
+    zone_reduce(&c->s->zones, c->pix, &c->f->zones);
+}
+
+/** <!-- stage_rules {{{2 --> evaluate the compiled alert rules.
+ */
+static void stage_rules(PipelineCtx *c) {
+    D6TSensor *s = c->s;
+    RuleInput in;
+    double sum = 0.0;
+
+    in.t_ms = c->f->t_ms;
+    in.v[RULE_VAR_MAX] = in.v[RULE_VAR_MIN] = c->pix[0];
+    for (int i = 0; i < N_PIXEL; i++) {
+        in.v[RULE_VAR_PIXEL0 + i] = c->pix[i];
+        if (c->pix[i] > in.v[RULE_VAR_MAX]) in.v[RULE_VAR_MAX] = c->pix[i];
+        if (c->pix[i] < in.v[RULE_VAR_MIN]) in.v[RULE_VAR_MIN] = c->pix[i];
+        sum += c->pix[i];
+    }
+    in.v[RULE_VAR_AVG] = sum / N_PIXEL;
+    in.v[RULE_VAR_PTAT] = s->ptat;
+    in.v[RULE_VAR_RISE] = 0.0f;
+    in.v[RULE_VAR_MEAN_RISE] = 0.0f;
+    if (s->rules.vars & RULE_TREND_VARS) {
+        for (int i = 0; i < N_PIXEL; i++) {
+            double rate = trend_slope(&s->trend, i);
+            if (rate > in.v[RULE_VAR_RISE]) in.v[RULE_VAR_RISE] = rate;
+        }
+        in.v[RULE_VAR_MEAN_RISE] = trend_slope(&s->trend, TREND_CH_MEAN);
+    }
+    for (int z = 0; z < c->f->zones.n; z++) {
+        in.v[RULE_ZONE_VAR(z, 0)] = c->f->zones.min[z];
+        in.v[RULE_ZONE_VAR(z, 1)] = c->f->zones.max[z];
+        in.v[RULE_ZONE_VAR(z, 2)] = c->f->zones.avg[z];
+    }
+
+    int r = rule_eval(&s->rules, &s->rule_state, &in);
+    c->rule = r >= 0 ? s->rules.rules[r].reason : NULL;
+}
+
+/** <!-- stage_analyze {{{2 --> threshold check and alert transitions; fills
+ * in the published frame.
+ */
+static void stage_analyze(PipelineCtx *c) {
+    D6TSensor *s = c->s;
+    SensorFrame *f = c->f;
+
+    memcpy(s->pix_data, c->pix, sizeof(c->pix));
+    alert_analyze(&config, s->pix_data, N_PIXEL, &c->analysis);
+    // A threshold breach takes precedence over the rate of rise, and that
+    // over the configured rules
+    const char *reason = c->rising ? c->rising : c->rule;
+    if (reason && !c->analysis.is_abnormal) {
+        c->analysis.is_abnormal = true;
+        snprintf(c->analysis.alert_reason, sizeof(c->analysis.alert_reason), "%s", reason);
+    }
+    c->transition = alert_check_transition((int)(s - sensors), c->analysis.is_abnormal);
+    snapshot_due |= c->transition;
+    if (c->transition && c->analysis.is_abnormal) {
+        logger_log(LOG_WARN, "ALERT: %s for sensor %s", c->analysis.alert_reason, s->cfg.id);
+    } else if (c->transition) {
+        logger_log(LOG_INFO, "RECOVERY: Temperature returned to normal for sensor %s", s->cfg.id);
+    }
+
+    memcpy(f->pix, s->pix_data, sizeof(f->pix));
+    f->avg_temp = c->analysis.avg_temp;
+    f->is_abnormal = c->analysis.is_abnormal;
+    to_store_frame(s, f->t_ms, &f->store);
+}
+
+/** <!-- stage_log {{{2 --> format the frame line and log it.
+ */
+static void stage_log(PipelineCtx *c) {
+    D6TSensor *s = c->s;
+    char *buffer = c->line;
+    int i;
+
+    // Format output string for console and pipe
+    sprintf(buffer, "id: %s, date: %s, time: %s, PTAT: %4.1f [degC], Temperature: ", 
+            s->cfg.id, c->f->stamp.date, c->f->stamp.time, s->ptat);
+    
+    int buffer_len = strlen(buffer);
+    char *ptr = buffer + buffer_len;
+    
+    // Add temperature values
+    for (i = 0; i < N_PIXEL; i++) {
+        sprintf(ptr, "%4.1f%s", s->pix_data[i], 
+                (i < N_PIXEL - 1) ? ", " : " [degC]");
+        ptr = buffer + strlen(buffer);
+    }
+    // Zones as name=min/max/avg
+    for (i = 0; i < c->f->zones.n; i++) {
+        sprintf(ptr, "%s %s=%.1f/%.1f/%.2f", i ? "" : ", zones:", s->zones.name[i],
+                c->f->zones.min[i], c->f->zones.max[i], c->f->zones.avg[i]);
+        ptr = buffer + strlen(buffer);
+    }
+    strcpy(ptr, "\n");
+    
+    // Output to logger
+    logger_log(LOG_INFO, "%s", buffer);
+}
+
+/** <!-- stage_store {{{2 --> append to the frame store.
+ */
+static void stage_store(PipelineCtx *c) {
+    store_append(c->s->cfg.id, &c->f->store);
+}
+
+/** <!-- stage_history {{{2 --> alerts carry the frames leading up to them.
+ */
+static void stage_history(PipelineCtx *c) {
+    static AlertHistory history_buf;
+
+    remember_frame(c->s, c->f);
+    if (c->transition && encode_history(c->s, c->f->t_ms, &history_buf)) {
+        c->history = &history_buf;
+    }
+}
+
+/** <!-- stage_forward {{{2 --> aggregated mode: the aggregator uploads the
+ * frames of all gateways.
+ */
+static void stage_forward(PipelineCtx *c) {
+    forwarder_send(c->s->cfg.id, c->analysis.is_abnormal, &c->f->store);
+}
+
+/** <!-- stage_upload {{{2 --> single-hop mode: post directly.
+ */
+static void stage_upload(PipelineCtx *c) {
+    post_records(c->s, &c->analysis, c->transition, c->history, c->f);
+}
+
+/** <!-- stage_pipe {{{2 --> pipe mode: alert and frame lines to pipeReader.
+ */
+static void stage_pipe(PipelineCtx *c) {
+    if (c->transition && alert_fd >= 0) {
+        write_alert_line(c->s, &c->analysis, c->history, c->f);
+    }
+    write_frame_line(c->line);
+}
+
+/** <!-- stage_record {{{2 --> recording mode: binary frames to d6trecord.
+ */
+static void stage_record(PipelineCtx *c) {
+    recorder_send(c->s->cfg.id, c->analysis.is_abnormal, &c->f->store);
+}
+
+/** <!-- compile_rules {{{1 --> compile alert.rules and the sensor's own
+ * rules. Duration counters start over only when the rules changed. Returns
+ * the number of rules.
+ */
+static int compile_rules(D6TSensor *s, const AppConfig *cfg) {
+    static RuleSet rs;
+    char err[128];
+
+    // Both lists were compiled once already when the config was loaded.
+    // Cleared whole so that unused bytes compare equal below.
+    memset(&rs, 0, sizeof(rs));
+    for (int k = 0; k < cfg->rule_count; k++) {
+        rule_add(&rs, cfg->rules[k].when, cfg->rules[k].reason,
+                 s->cfg.zones, s->cfg.zone_count, err, sizeof(err));
+    }
+    for (int k = 0; k < s->cfg.rule_count; k++) {
+        rule_add(&rs, s->cfg.rules[k].when, s->cfg.rules[k].reason,
+                 s->cfg.zones, s->cfg.zone_count, err, sizeof(err));
+    }
+    if (rs.n_code != s->rules.n_code || rs.n_rules != s->rules.n_rules ||
+        memcmp(rs.code, s->rules.code, rs.n_code * sizeof(rs.code[0])) != 0 ||
+        memcmp(rs.rules, s->rules.rules, rs.n_rules * sizeof(rs.rules[0])) != 0) {
+        s->rules = rs;
+        memset(&s->rule_state, 0, sizeof(s->rule_state));
+    }
+    return rs.n_rules;
+}
+
+/** <!-- build_pipeline {{{1 --> resolve the stages a frame of s goes through
+ * under cfg. Called when the sensor starts and after every reload.
+ */
+static void build_pipeline(D6TSensor *s, const AppConfig *cfg) {
+    static const PipelineStage ema_stage = {"ema", stage_ema};
+    static const PipelineStage median3_stage = {"median3", stage_median3};
+    static const PipelineStage trend_stage = {"trend", stage_trend};
+    static const PipelineStage zones_stage = {"zones", stage_zones};
+    static const PipelineStage rules_stage = {"rules", stage_rules};
+    static const PipelineStage analyze_stage = {"analyze", stage_analyze};
+    static const PipelineStage log_stage = {"log", stage_log};
+    static const PipelineStage store_stage = {"store", stage_store};
+    static const PipelineStage history_stage = {"history", stage_history};
+    static const PipelineStage forward_stage = {"forward", stage_forward};
+    static const PipelineStage upload_stage = {"upload", stage_upload};
+    static const PipelineStage pipe_stage = {"pipe", stage_pipe};
+    static const PipelineStage record_stage = {"record", stage_record};
+    Pipeline p;
+    char desc[128];
+
+    pipeline_clear(&p);
+    switch (s->cfg.filter) {
+    case FILTER_EMA:
+        pipeline_add(&p, &ema_stage);
+        break;
+    case FILTER_MEDIAN3:
+        pipeline_add(&p, &median3_stage);
+        break;
+    case FILTER_NONE:
+        break;
+    }
+    if (cfg->trend_enabled) {
+        pipeline_add(&p, &trend_stage);
+    } else {
+        trend_reset(&s->trend);
+    }
+    zone_set_build(&s->zones, s->cfg.zones, s->cfg.zone_count);
+    if (s->cfg.zone_count > 0) {
+        pipeline_add(&p, &zones_stage);
+    }
+    if (compile_rules(s, cfg) > 0) {
+        pipeline_add(&p, &rules_stage);
+    }
+    pipeline_add(&p, &analyze_stage);
+    pipeline_add(&p, &log_stage);
+    if (cfg->store_enabled) {
+        pipeline_add(&p, &store_stage);
+    }
+    if (cfg->alert_history_seconds > 0) {
+        pipeline_add(&p, &history_stage);
+    } else {
+        forget_frames(s);
+    }
+    if (cfg->forward_host[0] != '\0') {
+        pipeline_add(&p, &forward_stage);
+    }
+    if (cfg->uploader_enabled) {
+        pipeline_add(&p, &upload_stage);
+    }
+    if (cfg->pipe_enabled) {
+        pipeline_add(&p, &pipe_stage);
+    }
+    if (cfg->pipe_enabled && cfg->pipe_record_name[0] != '\0') {
+        pipeline_add(&p, &record_stage);
+    }
+
+    if (!pipeline_equal(&p, &s->pipeline)) {
+        pipeline_describe(&p, desc, sizeof(desc));
+        logger_log(LOG_INFO, "Sensor %s: %s", s->cfg.id, desc);
+    }
+    s->pipeline = p;
+}
+
+/** <!-- sample {{{1 --> read one frame and run it through the sensor's
+ * pipeline.
  */
-int main() {
+static void sample(int fd, uint32_t events, void *arg) {
+    D6TSensor *s = arg;
+    PipelineCtx c;
     int i;
     int16_t itemp;
+    (void)fd; (void)events;
+
+    // Read data via I2C. A failed or timed-out read (logged by i2cbus.c)
+    // produces no frame, and none is read while the sensor is power-cycled.
+    memset(s->rbuf, 0, N_READ);
+    if (i2c_bus_read(&s->bus, D6T_CMD, s->rbuf, N_READ) != 0) {
+        return;
+    }
+    // The frame's time is when the read completed, not when it was published
+    int64_t mono_ns = ts_mono_ns();
+
+    // Every sink that keeps the frame takes its own reference
+    SensorFrame *f = frame_alloc();
+    if (!f) {
+        return;
+    }
+    c.s = s;
+    c.f = f;
+    c.rising = NULL;
+    c.rule = NULL;
+    f->zones.n = 0;
+    c.transition = false;
+    c.history = NULL;
+
+    D6T_checkPEC((uint8_t)s->cfg.address, s->rbuf, N_READ - 1);
+
+    //Convert to temperature data (degC)
+    s->ptat = (double)conv8us_s16_le(s->rbuf, 0) / 10.0;
+    for (i = 0; i < N_PIXEL; i++) {
+        itemp = conv8us_s16_le(s->rbuf, 2 + 2*i);
+        c.pix[i] = (double)itemp / 10.0;
+    }
+
+    // Wall-clock date and time with milliseconds
+    int64_t wall_ns = ts_wall_ns(mono_ns);
+    f->t_ms = wall_ns / 1000000;
+    ts_format(wall_ns, &f->stamp);
+    history_push(&s->raw, f->t_ms, c.pix);
+
+    pipeline_run(&s->pipeline, &c);
+    frame_unref(f);
+}
+
+/** <!-- make_fifo {{{1 --> create a named pipe if it doesn't exist.
+ */
+static int make_fifo(const char *name) {
+    if (access(name, F_OK) == -1) {
+        logger_log(LOG_INFO, "Creating named pipe at %s", name);
+        if (mkfifo(name, 0666) == -1) {
+            logger_perror("Error creating named pipe");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/** <!-- open_pipe {{{1 --> (re)open the frame pipe for cfg, held read-write
+ * for the same reason as the alert pipe below.
+ */
+static int open_pipe(const AppConfig *cfg) {
+    if (pipe_fd_passed) {
+        return 0;   // Created and owned by SensorDataApp.socket
+    }
+    if (pipe_fd >= 0) {
+        output_forget(pipe_fd);
+        close(pipe_fd);
+        pipe_fd = -1;
+    }
+    if (!cfg->pipe_enabled) {
+        return 0;
+    }
+    if (make_fifo(cfg->pipe_name) != 0) {
+        return -1;
+    }
+    pipe_fd = open(cfg->pipe_name, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (pipe_fd < 0) {
+        logger_perror("Failed to open pipe");
+        return -1;
+    }
+    output_register(pipe_fd);
+    return 0;
+}
+
+/** <!-- open_alert_pipe {{{1 --> (re)open the alert pipe for cfg. It is held
+ * read-write so that opening never waits for a reader and alert lines wait
+ * in the pipe while pipeReader restarts.
+ */
+static void open_alert_pipe(const AppConfig *cfg) {
+    if (alert_fd_passed) {
+        return;     // Created and owned by SensorDataApp.socket
+    }
+    if (alert_fd >= 0) {
+        output_forget(alert_fd);
+        close(alert_fd);
+        alert_fd = -1;
+    }
+    if (!cfg->pipe_enabled || cfg->pipe_alert_name[0] == '\0' ||
+        make_fifo(cfg->pipe_alert_name) != 0) {
+        return;
+    }
+    alert_fd = open(cfg->pipe_alert_name, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (alert_fd < 0) {
+        logger_perror("Failed to open alert pipe");
+    }
+    output_register(alert_fd);
+}
+
+/** <!-- sensors_apply {{{1 --> reconcile running sensors with the config.
+ * Unchanged sensors keep their timer phase and filter state, so a reload
+ * never skips a sample; changed intervals are re-armed in place.
+ */
+static int sensors_apply(const AppConfig *cfg) {
+    int k, slot;
+
+    // Wakeup alignment changed on reload: sampling timers are re-armed
+    bool realign = cfg->low_power != config.low_power ||
+                   cfg->low_power_align_ms != config.low_power_align_ms;
+    evloop_set_align(cfg->low_power ? cfg->low_power_align_ms : 0);
+
+    // Stop sensors that were removed
+    for (slot = 0; slot < CONFIG_MAX_SENSORS; slot++) {
+        D6TSensor *s = &sensors[slot];
+        if (s->active && !config_find_sensor(cfg, s->cfg.id)) {
+            logger_log(LOG_INFO, "Sensor %s removed", s->cfg.id);
+            evloop_del(s->timer_fd);
+            close(s->timer_fd);
+            i2c_bus_close(&s->bus);
+            alert_reset(slot);
+            policy_reset(slot);
+            forget_frames(s);
+            store_release(s->cfg.id);
+            memset(s, 0, sizeof(*s));
+        }
+    }
+
+    for (k = 0; k < cfg->sensor_count; k++) {
+        const SensorConfig *sc = &cfg->sensors[k];
+        D6TSensor *s = NULL;
+
+        for (slot = 0; slot < CONFIG_MAX_SENSORS; slot++) {
+            if (sensors[slot].active && strcmp(sensors[slot].cfg.id, sc->id) == 0) {
+                s = &sensors[slot];
+                break;
+            }
+        }
+
+        if (s) {
+            if (s->cfg.interval_ms != sc->interval_ms || realign) {
+                evloop_timer_set(s->timer_fd, sc->interval_ms, sc->interval_ms);
+            }
+            if (s->cfg.filter != sc->filter) {
+                s->have_filtered = false;
+                trend_reset(&s->trend);
+            }
+            if (s->cfg.upload_mode != sc->upload_mode) {
+                policy_reset(slot);
+            }
+            if (strcmp(s->cfg.device, sc->device) != 0 || s->cfg.address != sc->address ||
+                strcmp(s->cfg.power_chip, sc->power_chip) != 0 ||
+                s->cfg.power_line != sc->power_line ||
+                s->cfg.power_active_low != sc->power_active_low) {
+                i2c_bus_close(&s->bus);
+                i2c_bus_open(&s->bus, sc, cfg);
+            } else {
+                s->bus.power_off_ms = sc->power_off_ms;
+                i2c_bus_configure(&s->bus, cfg);
+            }
+            if (memcmp(&s->cfg, sc, sizeof(*sc)) != 0) {
+                logger_log(LOG_INFO, "Sensor %s updated: %s addr 0x%02X every %d ms",
+                           sc->id, sc->device, sc->address, sc->interval_ms);
+            }
+            s->cfg = *sc;
+            build_pipeline(s, cfg);
+            continue;
+        }
+
+        for (slot = 0; slot < CONFIG_MAX_SENSORS && sensors[slot].active; slot++) {
+        }
+        s = &sensors[slot];
+        memset(s, 0, sizeof(*s));
+        s->cfg = *sc;
+        s->timer_fd = evloop_timer_add(sc->interval_ms, sample, s);
+        if (s->timer_fd < 0) {
+            return -1;
+        }
+        i2c_bus_open(&s->bus, sc, cfg);
+        s->active = true;
+        alert_reset(slot);
+        policy_reset(slot);
+        build_pipeline(s, cfg);
+        logger_log(LOG_INFO, "Sensor %s started: %s addr 0x%02X every %d ms",
+                   sc->id, sc->device, sc->address, sc->interval_ms);
+    }
+    return 0;
+}
+
+/** <!-- snapshot_save {{{1 --> write the state of every running sensor
+ * to <snapshot.dir>/SensorDataApp.snap (see snapshot.h).
+ */
+static void snapshot_save(void) {
+    char path[320];
+    int n = 0;
+
+    snapshot_due = false;
+    if (!config.snapshot_enabled) {
+        return;
+    }
+    if (mkdir(config.snapshot_dir, 0755) != 0 && errno != EEXIST) {
+        logger_log(LOG_ERROR, "Snapshot: cannot create %s: %s", config.snapshot_dir, strerror(errno));
+        return;
+    }
+    for (int slot = 0; slot < CONFIG_MAX_SENSORS; slot++) {
+        D6TSensor *s = &sensors[slot];
+        SnapshotSensor *o = &snap[n];
+        const int64_t *t;
+        if (!s->active) {
+            continue;
+        }
+        snprintf(o->id, sizeof(o->id), "%s", s->cfg.id);
+        o->abnormal = alert_get_state(slot);
+        o->have_filtered = s->have_filtered;
+        memcpy(o->filtered, s->pix_data, sizeof(o->filtered));
+        policy_save(slot, &o->policy);
+        o->trend = s->trend;
+        o->rules_sum = rule_set_sum(&s->rules);
+        o->rules = s->rule_state;
+        o->n_frames = history_times(&s->raw, HISTORY_FRAMES, &t);
+        for (int p = 0; p < N_PIXEL; p++) {
+            const float *v;
+            history_pixel(&s->raw, p, o->n_frames, &v);
+            for (int i = 0; i < o->n_frames; i++) {
+                o->pix[i][p] = (int16_t)(v[i] * 10.0f + (v[i] < 0 ? -0.5f : 0.5f));
+            }
+        }
+        memcpy(o->t_ms, t, (size_t)o->n_frames * sizeof(t[0]));
+        n++;
+    }
+    snprintf(path, sizeof(path), "%s/%s", config.snapshot_dir, SNAPSHOT_FILE);
+    snapshot_write(path, snap, n, ts_now_ns() / 1000000);
+}
+
+static void snapshot_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    snapshot_save();
+}
+
+/** <!-- store_timer {{{1 --> write partially filled store chunks, so
+ * that a crash loses at most store.flush_seconds of frames rather than a
+ * whole chunk bucket.
+ */
+static void store_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    if (config.store_enabled) {
+        store_flush();
+    }
+}
+
+/** <!-- watchdog_timer {{{1 --> ping the systemd watchdog from the event
+ * loop itself rather than from sensor reads, so that long sampling
+ * intervals or no active sensor do not get us killed. A loop stuck in I2C
+ * or pipe I/O stops these pings and systemd restarts us.
+ */
+static void watchdog_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    service_watchdog();
+}
+
+/** <!-- snapshot_restore {{{1 --> warm restart: take over the state saved
+ * by the previous run. The alert state is always restored, since it is
+ * what was last reported upstream; filters, the trend window, rule
+ * duration counters, raw frames and the upload window only if the snapshot
+ * is at most snapshot.max_age_s old. Counters of rules that changed since
+ * are not restored.
+ */
+static void snapshot_restore(void) {
+    char path[320];
+    int64_t written_ms;
+    int restored = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", config.snapshot_dir, SNAPSHOT_FILE);
+    int n = snapshot_read(path, snap, CONFIG_MAX_SENSORS, &written_ms);
+    if (n < 0) {
+        return;
+    }
+    int64_t age_ms = ts_now_ns() / 1000000 - written_ms;
+    bool fresh = age_ms <= (int64_t)config.snapshot_max_age_s * 1000;
+
+    for (int k = 0; k < n; k++) {
+        const SnapshotSensor *o = &snap[k];
+        for (int slot = 0; slot < CONFIG_MAX_SENSORS; slot++) {
+            D6TSensor *s = &sensors[slot];
+            if (!s->active || strcmp(s->cfg.id, o->id) != 0) {
+                continue;
+            }
+            alert_set_state(slot, o->abnormal);
+            if (fresh) {
+                s->have_filtered = o->have_filtered;
+                memcpy(s->pix_data, o->filtered, sizeof(s->pix_data));
+                policy_restore(slot, &o->policy);
+                // Frames missed while we were down leave the trend window
+                // on the next push, as they would have anyway
+                if (config.trend_enabled) {
+                    s->trend = o->trend;
+                }
+                if (o->rules_sum == rule_set_sum(&s->rules)) {
+                    s->rule_state = o->rules;
+                }
+                history_reset(&s->raw);
+                for (int i = 0; i < o->n_frames; i++) {
+                    double pix[N_PIXEL];
+                    for (int p = 0; p < N_PIXEL; p++) {
+                        pix[p] = o->pix[i][p] / 10.0;
+                    }
+                    history_push(&s->raw, o->t_ms[i], pix);
+                }
+            }
+            restored++;
+        }
+    }
+    logger_log(LOG_INFO, "Snapshot: restored %s of %d sensors, saved %lld s ago",
+               fresh ? "all state" : "alert state only", restored, (long long)(age_ms / 1000));
+}
+
+/** <!-- flush_output {{{1 --> hand what this wakeup produced to the
+ * record pipe and the log/FIFO writer before the loop waits again. Alert
+ * transitions are saved before the loop sleeps, so a crash right after
+ * one does not report it again, but only once the output is on its way:
+ * the snapshot fsyncs and must not hold up the alert lines.
+ */
+static void flush_output(void) {
+    recorder_flush();
+    output_flush();
+    if (snapshot_due) {
+        snapshot_save();
+    }
+}
+
+/** <!-- reload_config {{{1 --> re-read config.json and apply it in place.
+ * A file that fails to parse leaves the running configuration untouched.
+ */
+static void reload_config(void) {
+    static AppConfig next;
+
+    service_notify("RELOADING=1");
+    config_defaults(&next);
+    if (config_load(config_path, &next) != 0) {
+        logger_log(LOG_ERROR, "Config reload failed, keeping current settings");
+        service_notify("READY=1\nSTATUS=Config reload failed, keeping current settings");
+        return;
+    }
+
+    if (strcmp(next.log_dir, config.log_dir) != 0) {
+        logger_log(LOG_INFO, "Switching log directory to %s", next.log_dir);
+        logger_close();
+        if (logger_init(next.log_dir, "SensorDataApp") != 0) {
+            logger_init(config.log_dir, "SensorDataApp");
+            snprintf(next.log_dir, sizeof(next.log_dir), "%s", config.log_dir);
+        }
+    }
+    if ((next.pipe_enabled != config.pipe_enabled ||
+         strcmp(next.pipe_name, config.pipe_name) != 0) && open_pipe(&next) != 0) {
+        next.pipe_enabled = false;
+    }
+    if (next.pipe_enabled != config.pipe_enabled ||
+        strcmp(next.pipe_alert_name, config.pipe_alert_name) != 0) {
+        open_alert_pipe(&next);
+    }
+    if (!next.pipe_enabled) {
+        next.pipe_record_name[0] = '\0';
+    }
+    if (strcmp(next.pipe_record_name, config.pipe_record_name) != 0 ||
+        next.pipe_record_zero_copy != config.pipe_record_zero_copy) {
+        recorder_close();
+        if (next.pipe_record_name[0] != '\0' &&
+            recorder_open(next.pipe_record_name, next.pipe_record_zero_copy) != 0) {
+            next.pipe_record_name[0] = '\0';
+        }
+    }
+    if (config.store_enabled && (!next.store_enabled ||
+                                 strcmp(next.store_dir, config.store_dir) != 0 ||
+                                 next.store_chunk_seconds != config.store_chunk_seconds)) {
+        store_close();
+        config.store_enabled = false;
+    }
+    if (next.store_enabled && !config.store_enabled && store_open(next.store_dir, next.store_chunk_seconds) != 0) {
+        next.store_enabled = false;
+    }
+    if (next.uploader_enabled && !config.uploader_enabled) {
+        if (uploader_init(&next) != 0) next.uploader_enabled = false;
+    } else if (!next.uploader_enabled && config.uploader_enabled) {
+        uploader_close();
+    } else if (next.uploader_enabled) {
+        uploader_reconfigure(&next);
+    }
+    if (next.forward_host[0] != '\0' && config.forward_host[0] == '\0') {
+        if (forwarder_init(&next) != 0) next.forward_host[0] = '\0';
+    } else if (next.forward_host[0] == '\0' && config.forward_host[0] != '\0') {
+        forwarder_close();
+    } else if (next.forward_host[0] != '\0') {
+        forwarder_reconfigure(&next);
+    }
+
+    sensors_apply(&next);
+    if (next.store_flush_seconds != config.store_flush_seconds) {
+        evloop_timer_set(store_tfd, next.store_flush_seconds * 1000, next.store_flush_seconds * 1000);
+    }
+    if (next.snapshot_enabled != config.snapshot_enabled ||
+        next.snapshot_interval_s != config.snapshot_interval_s) {
+        int ms = next.snapshot_enabled ? next.snapshot_interval_s * 1000 : 0;
+        evloop_timer_set(snapshot_tfd, ms, ms);
+    }
+    config = next;
+    logger_log(LOG_INFO, "Configuration reloaded");
+    service_notify("READY=1\nSTATUS=Configuration reloaded");
+}
+
+/** <!-- end_run {{{1 --> stop once the -d run length has passed.
+ * Runs of weeks outlast one timer interval, so the timer is re-armed
+ * for at most a day at a time.
+ */
+static int64_t run_end_ns;
+
+static void end_run(int fd, uint32_t events, void *arg) {
+    (void)events; (void)arg;
+
+    int64_t left_ms = (run_end_ns - ts_mono_ns()) / 1000000;
+    if (left_ms <= 0) {
+        logger_log(LOG_INFO, "Run length reached");
+        evloop_stop();
+        return;
+    }
+    evloop_timer_set(fd, left_ms < 86400000 ? (int)left_ms : 86400000, 0);
+}
+
+/** <!-- parse_duration {{{1 --> "90", "15m", "36h", "14d" as seconds.
+ */
+static int64_t parse_duration(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+
+    if (end == s || v <= 0) return -1;
+    switch (*end) {
+    case '\0': case 's': break;
+    case 'm': v *= 60; break;
+    case 'h': v *= 3600; break;
+    case 'd': v *= 86400; break;
+    default: return -1;
+    }
+    return (int64_t)v;
+}
+
+static void signal_event(int fd, uint32_t events, void *arg) {
+    struct signalfd_siginfo si;
+    (void)events; (void)arg;
+
+    while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+        if (si.ssi_signo == SIGHUP) {
+            logger_log(LOG_INFO, "SIGHUP received, reloading configuration");
+            reload_config();
+        } else {
+            evloop_stop();
+        }
+    }
+}
+
+// Editors replace files by rename, so the directory is watched and events
+// are filtered by file name.
+static void inotify_event(int fd, uint32_t events, void *arg) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[256];
+    const char *name;
+    bool changed = false;
+    ssize_t len;
+    (void)events; (void)arg;
+
+    snprintf(path, sizeof(path), "%s", config_path);
+    name = basename(path);
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len && strcmp(ev->name, name) == 0) {
+                changed = true;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    if (changed) {
+        logger_log(LOG_INFO, "%s changed, reloading configuration", config_path);
+        reload_config();
+    }
+}
+
+static void watch_config(void) {
+    char dir[256];
+
+    snprintf(dir, sizeof(dir), "%s", config_path);
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0 ||
+        inotify_add_watch(inotify_fd, dirname(dir), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+        evloop_add(inotify_fd, EPOLLIN, inotify_event, NULL) != 0) {
+        logger_log(LOG_WARN, "Config file watch unavailable (%s), use SIGHUP to reload",
+                   strerror(errno));
+        if (inotify_fd >= 0) close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
+
+/** <!-- main - Thermal sensor {{{1 -->
+ * Read data
+ */
+int main(int argc, char *argv[]) {
+    int64_t virtual_start = 0, run_seconds = 0;
+    bool virtual_time = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:t:d:")) != -1) {
+        switch (opt) {
+        case 'c':
+            config_path = optarg;
+            break;
+        case 't':
+            if (ts_parse(optarg, &virtual_start) != 0) {
+                fprintf(stderr, "Bad start time: %s\n", optarg);
+                return 1;
+            }
+            virtual_time = true;
+            break;
+        case 'd':
+            if ((run_seconds = parse_duration(optarg)) < 0) {
+                fprintf(stderr, "Bad run length: %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c config.json] [-t start [-d length]]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Virtual time: everything from the log file name on runs on its clock
+    struct timespec real_start;
+    clock_gettime(CLOCK_MONOTONIC, &real_start);
+    if (virtual_time) {
+        ts_virtual_start(virtual_start);
+        logger_set_clock(ts_now_ns);
+    }
     
-    // Initialize logger
-    if (logger_init("/opt2/sees/aibc_demo/logs", "SensorDataApp") != 0) {
+    // Initialize logger; reopened below if the config names another directory
+    if (logger_init(DEFAULT_LOG_DIR, "SensorDataApp") != 0) {
         fprintf(stderr, "Failed to initialize logger\n");
         return 1;
     }
     
     logger_log(LOG_INFO, "Thermal sensor application started");
 
-    // Create named pipe if it doesn't exist
-    if (access(PIPE_NAME, F_OK) == -1) {
-        logger_log(LOG_INFO, "Creating named pipe at %s", PIPE_NAME);
-        if (mkfifo(PIPE_NAME, 0666) == -1) {
-            logger_perror("Error creating named pipe");
-            logger_close();
+    config_defaults(&config);
+    if (config_load(config_path, &config) != 0) {
+        logger_log(LOG_WARN, "Using default configuration");
+        config_defaults(&config);
+    }
+    if (strcmp(config.log_dir, DEFAULT_LOG_DIR) != 0) {
+        logger_close();
+        if (logger_init(config.log_dir, "SensorDataApp") != 0) {
+            fprintf(stderr, "Failed to initialize logger\n");
             return 1;
         }
     }
 
-    delay(620);
+    if (evloop_init() != 0) {
+        logger_close();
+        return 1;
+    }
+    if (config.low_power) {
+        logger_log(LOG_INFO, "Low-power mode: wakeups aligned to %d ms", config.low_power_align_ms);
+        evloop_set_align(config.low_power_align_ms);
+    }
+    // Log and FIFO writes queued by a wakeup go out together before the
+    // loop waits again
+    output_init(config.output_uring);
+    output_register(logger_fd());
+    evloop_set_prepare(flush_output);
 
-    while(1){
-        // Read data via I2C
-        memset(rbuf, 0, N_READ);
-        uint32_t read_status = i2c_read_reg8(D6T_ADDR, D6T_CMD, rbuf, N_READ);
-        if (read_status != 0) {
-            logger_log(LOG_ERROR, "I2C read error: %u", read_status);
+    // Pick up the frame and alert FIFOs when started through
+    // SensorDataApp.socket; the alert FIFO is recognised by its path.
+    service_init();
+    int nfds = service_listen_fds();
+    struct stat alert_st;
+    bool have_alert_st = config.pipe_alert_name[0] != '\0' &&
+                         stat(config.pipe_alert_name, &alert_st) == 0;
+    for (int fd = SERVICE_LISTEN_FDS_START; fd < SERVICE_LISTEN_FDS_START + nfds; fd++) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+            continue;
         }
-        D6T_checkPEC(rbuf, N_READ - 1);
-
-        //Convert to temperature data (degC)
-        ptat = (double)conv8us_s16_le(rbuf, 0) / 10.0;
-        for (i = 0; i < N_PIXEL; i++) {
-            itemp = conv8us_s16_le(rbuf, 2 + 2*i);
-            pix_data[i] = (double)itemp / 10.0;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        if (have_alert_st && st.st_dev == alert_st.st_dev && st.st_ino == alert_st.st_ino) {
+            alert_fd = fd;
+            alert_fd_passed = true;
+            output_register(fd);
+            logger_log(LOG_INFO, "Using socket-activated alert FIFO (fd %d)", fd);
+        } else if (pipe_fd < 0) {
+            pipe_fd = fd;
+            pipe_fd_passed = true;
+            output_register(fd);
+            logger_log(LOG_INFO, "Using socket-activated FIFO (fd %d)", fd);
         }
+    }
 
-        // Get current date and time with milliseconds
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        
-        time_t t = tv.tv_sec;
-        struct tm tm = *localtime(&t);
-        
-        // Format date/time strings - increased buffer sizes to avoid overflow
-        char date_str[32];
-        char time_str[32];
-        sprintf(date_str, "%04d-%02d-%02d", 
-                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
-        
-        long raw_msec = tv.tv_usec / 1000;  // Convert microseconds to milliseconds
-
-        if (raw_msec >= 300) {  // Skip if milliseconds are less than 300
-            sprintf(time_str, "%02d:%02d:%02d:%03ld", 
-                tm.tm_hour, tm.tm_min, tm.tm_sec, raw_msec);
-            logger_log(LOG_DEBUG, "%s", time_str); // Log only if milliseconds are 300 or more
-        }
-                
-
-        // Format output string for console and pipe
-        char buffer[1024];
-        sprintf(buffer, "id: sensor_1, date: %s, time: %s, PTAT: %4.1f [degC], Temperature: ", 
-                date_str, time_str, ptat);
-        
-        int buffer_len = strlen(buffer);
-        char *ptr = buffer + buffer_len;
-        
-        // Add temperature values
-        for (i = 0; i < N_PIXEL; i++) {
-            sprintf(ptr, "%4.1f%s", pix_data[i], 
-                    (i < N_PIXEL - 1) ? ", " : " [degC]\n");
-            ptr = buffer + strlen(buffer);
+    if (config.uploader_enabled) {
+        logger_log(LOG_INFO, "Single-hop mode: uploading directly");
+        if (uploader_init(&config) != 0) {
+            logger_close();
+            return 1;
         }
-        
-        // Output to logger
-        logger_log(LOG_INFO, "%s", buffer);
-        
-        // Write to named pipe
-        logger_log(LOG_INFO, "Waiting for pipe reader...");
-        int pipe_fd = open(PIPE_NAME, O_WRONLY); // Removed O_NONBLOCK to wait for reader
-        if (pipe_fd != -1) {
-            write(pipe_fd, buffer, strlen(buffer));
-            close(pipe_fd);
-            logger_log(LOG_INFO, "Data sent to pipe");
-        } else {
-            logger_perror("Failed to open pipe");
+    }
+    if (config.forward_host[0] != '\0' && forwarder_init(&config) != 0) {
+        logger_close();
+        return 1;
+    }
+    if (open_pipe(&config) != 0) {
+        logger_close();
+        return 1;
+    }
+    open_alert_pipe(&config);
+    if (!config.pipe_enabled) {
+        config.pipe_record_name[0] = '\0';
+    }
+    if (config.pipe_record_name[0] != '\0' &&
+        recorder_open(config.pipe_record_name, config.pipe_record_zero_copy) != 0) {
+        config.pipe_record_name[0] = '\0';
+    }
+    if (config.store_enabled && store_open(config.store_dir, config.store_chunk_seconds) != 0) {
+        config.store_enabled = false;
+    }
+
+    // Signals are delivered through the event loop: SIGHUP reloads the config
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sig_fd < 0 || evloop_add(sig_fd, EPOLLIN, signal_event, NULL) != 0) {
+        logger_perror("signalfd");
+        logger_close();
+        return 1;
+    }
+    watch_config();
+
+    delay(620);
+
+    if (sensors_apply(&config) != 0) {
+        logger_close();
+        return 1;
+    }
+    if (config.snapshot_enabled) {
+        snapshot_restore();
+    }
+    int snapshot_ms = config.snapshot_enabled ? config.snapshot_interval_s * 1000 : 0;
+    snapshot_tfd = evloop_timer_add(snapshot_ms, snapshot_timer, NULL);
+    store_tfd = evloop_timer_add(config.store_flush_seconds * 1000, store_timer, NULL);
+    if (virtual_time) {
+        logger_log(LOG_INFO, "Running in virtual time");
+    }
+    if (run_seconds > 0) {
+        run_end_ns = ts_mono_ns() + run_seconds * 1000000000LL;
+        int tfd = evloop_timer_add(0, end_run, NULL);
+        if (tfd >= 0) {
+            end_run(tfd, 0, NULL);
         }
+    }
+    if (service_watchdog_enabled()) {
+        // Not aligned in low-power mode: rounding could stretch the
+        // interval past WatchdogSec
+        evloop_set_align(0);
+        evloop_timer_add(service_watchdog_interval_ms(), watchdog_timer, NULL);
+        evloop_set_align(config.low_power ? config.low_power_align_ms : 0);
+    }
+    service_notify("READY=1\nSTATUS=Sampling");
+    evloop_run();
+
+    if (virtual_time) {
+        struct timespec real_end;
+        clock_gettime(CLOCK_MONOTONIC, &real_end);
+        double real_s = (double)(real_end.tv_sec - real_start.tv_sec) +
+                        (double)(real_end.tv_nsec - real_start.tv_nsec) / 1e9;
+        double virtual_s = (double)(ts_now_ns() - virtual_start) / 1e9;
+        logger_log(LOG_INFO, "Virtual time: %.0f s run in %.1f s (%.0fx)",
+                   virtual_s, real_s, real_s > 0 ? virtual_s / real_s : 0.0);
+    }
 
-        delay(300);
+    service_notify("STOPPING=1");
+    logger_log(LOG_INFO, "Thermal sensor application stopping");
+    snapshot_save();
+    if (config.uploader_enabled) {
+        uploader_close();
+    }
+    if (config.forward_host[0] != '\0') {
+        forwarder_close();
+    }
+    if (config.store_enabled) {
+        store_close();
     }
-}
\ No newline at end of file
+    for (int slot = 0; slot < CONFIG_MAX_SENSORS; slot++) {
+        if (sensors[slot].active) {
+            i2c_bus_close(&sensors[slot].bus);
+        }
+        policy_reset(slot);
+        forget_frames(&sensors[slot]);
+    }
+    frame_pool_close();
+    recorder_close();
+    output_close();
+    if (pipe_fd >= 0) {
+        close(pipe_fd);
+    }
+    if (alert_fd >= 0) {
+        close(alert_fd);
+    }
+    evloop_close();
+    service_close();
+    logger_close();
+    return 0;
+}
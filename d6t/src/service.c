@@ -0,0 +1,112 @@
+#include "service.h"
+#include "logger.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int notify_fd = -1;
+static struct sockaddr_un notify_addr;
+static socklen_t notify_addr_len;
+static uint64_t watchdog_usec;
+static uint64_t last_ping_usec;
+
+static uint64_t now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+// Environment variables addressed to another PID (e.g. inherited by a
+// child) must be ignored.
+static bool env_pid_matches(const char *name) {
+    const char *pid = getenv(name);
+    return !pid || strtol(pid, NULL, 10) == (long)getpid();
+}
+
+int service_init(void) {
+    const char *path = getenv("NOTIFY_SOCKET");
+    const char *wd = getenv("WATCHDOG_USEC");
+
+    if (wd && env_pid_matches("WATCHDOG_PID")) {
+        watchdog_usec = strtoull(wd, NULL, 10);
+    }
+    if (!path || (path[0] != '/' && path[0] != '@') ||
+        strlen(path) >= sizeof(notify_addr.sun_path)) {
+        return 0;
+    }
+
+    memset(&notify_addr, 0, sizeof(notify_addr));
+    notify_addr.sun_family = AF_UNIX;
+    memcpy(notify_addr.sun_path, path, strlen(path));
+    if (path[0] == '@') {
+        notify_addr.sun_path[0] = '\0';     // Abstract namespace
+    }
+    notify_addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + strlen(path));
+
+    notify_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (notify_fd < 0) {
+        logger_perror("Failed to create notify socket");
+        return -1;
+    }
+    if (watchdog_usec) {
+        logger_log(LOG_INFO, "systemd watchdog enabled: %llu ms",
+                   (unsigned long long)(watchdog_usec / 1000));
+    }
+    return 0;
+}
+
+int service_notify(const char *state) {
+    if (notify_fd < 0) return 0;
+    if (sendto(notify_fd, state, strlen(state), MSG_NOSIGNAL,
+               (struct sockaddr *)&notify_addr, notify_addr_len) < 0) {
+        logger_log(LOG_WARN, "sd_notify(%s) failed: %s", state, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void service_watchdog(void) {
+    if (!watchdog_usec || notify_fd < 0) return;
+    uint64_t now = now_usec();
+    if (now - last_ping_usec >= watchdog_usec / 4) {
+        service_notify("WATCHDOG=1");
+        last_ping_usec = now;
+    }
+}
+
+bool service_watchdog_enabled(void) {
+    return watchdog_usec != 0 && notify_fd >= 0;
+}
+
+int service_watchdog_interval_ms(void) {
+    if (!service_watchdog_enabled()) return 0;
+    uint64_t ms = watchdog_usec / 2000;
+    return ms > 0 ? (int)ms : 1;
+}
+
+int service_listen_fds(void) {
+    const char *fds = getenv("LISTEN_FDS");
+    int n, fd;
+
+    if (!fds || !getenv("LISTEN_PID") || !env_pid_matches("LISTEN_PID")) {
+        return 0;
+    }
+    n = (int)strtol(fds, NULL, 10);
+    for (fd = SERVICE_LISTEN_FDS_START; fd < SERVICE_LISTEN_FDS_START + n; fd++) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return n > 0 ? n : 0;
+}
+
+void service_close(void) {
+    if (notify_fd >= 0) {
+        close(notify_fd);
+        notify_fd = -1;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <stdbool.h>
+
+// systemd integration without libsystemd: readiness/watchdog notifications
+// over $NOTIFY_SOCKET and file descriptors passed by socket activation.
+// Every call is a no-op when the process was not started by systemd.
+
+#define SERVICE_LISTEN_FDS_START 3
+
+// Read NOTIFY_SOCKET / WATCHDOG_USEC and open the notification socket
+int service_init(void);
+
+// Send a raw state string such as "READY=1" or "STATUS=..."
+int service_notify(const char *state);
+
+// Ping the watchdog; rate-limited to a quarter of WatchdogSec
+void service_watchdog(void);
+
+// Whether WatchdogSec is active for this process
+bool service_watchdog_enabled(void);
+
+// How often the event loop should ping: half of WatchdogSec, 0 if inactive
+int service_watchdog_interval_ms(void);
+
+// Number of fds passed via LISTEN_FDS, starting at SERVICE_LISTEN_FDS_START
+int service_listen_fds(void);
+
+void service_close(void);
+
+#endif // SERVICE_H
@@ -0,0 +1,179 @@
+#include "snapshot.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Header: magic, version, sensor count, time written. Trailer: FNV-1a of
+// everything before it.
+#define HEADER_BYTES  (4 + 4 + 4 + 8)
+#define SENSOR_BYTES  (32 + 1 + 1 + HISTORY_N_PIXEL * 8 + sizeof(PolicySnapshot) + \
+                       sizeof(TrendState) + 4 + sizeof(RuleState) + 4)
+#define FRAME_BYTES   (8 + HISTORY_N_PIXEL * 2)
+#define MAX_BYTES     (HEADER_BYTES + CONFIG_MAX_SENSORS * \
+                       (SENSOR_BYTES + HISTORY_FRAMES * FRAME_BYTES) + 4)
+
+static uint8_t buf[MAX_BYTES];
+
+static uint32_t fnv1a(const uint8_t *p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint8_t *put(uint8_t *p, const void *v, size_t n) {
+    memcpy(p, v, n);
+    return p + n;
+}
+
+static bool get(const uint8_t **p, const uint8_t *end, void *v, size_t n) {
+    if ((size_t)(end - *p) < n) {
+        return false;
+    }
+    memcpy(v, *p, n);
+    *p += n;
+    return true;
+}
+
+static int write_all(int fd, const uint8_t *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+int snapshot_write(const char *path, const SnapshotSensor *s, int n, int64_t now_ms) {
+    char tmp[PATH_MAX], dir[PATH_MAX];
+    uint32_t magic = SNAPSHOT_MAGIC, version = SNAPSHOT_VERSION, count = (uint32_t)n;
+    uint8_t *p = buf;
+
+    p = put(p, &magic, 4);
+    p = put(p, &version, 4);
+    p = put(p, &count, 4);
+    p = put(p, &now_ms, 8);
+    for (int k = 0; k < n; k++) {
+        uint8_t abnormal = s[k].abnormal, have_filtered = s[k].have_filtered;
+        uint32_t frames = (uint32_t)s[k].n_frames;
+        p = put(p, s[k].id, sizeof(s[k].id));
+        p = put(p, &abnormal, 1);
+        p = put(p, &have_filtered, 1);
+        p = put(p, s[k].filtered, sizeof(s[k].filtered));
+        p = put(p, &s[k].policy, sizeof(s[k].policy));
+        p = put(p, &s[k].trend, sizeof(s[k].trend));
+        p = put(p, &s[k].rules_sum, 4);
+        p = put(p, &s[k].rules, sizeof(s[k].rules));
+        p = put(p, &frames, 4);
+        for (int i = 0; i < s[k].n_frames; i++) {
+            p = put(p, &s[k].t_ms[i], 8);
+            p = put(p, s[k].pix[i], sizeof(s[k].pix[i]));
+        }
+    }
+    uint32_t sum = fnv1a(buf, (size_t)(p - buf));
+    p = put(p, &sum, 4);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        logger_log(LOG_ERROR, "Snapshot: cannot create %s: %s", tmp, strerror(errno));
+        return -1;
+    }
+    if (write_all(fd, buf, (size_t)(p - buf)) != 0 || fsync(fd) != 0) {
+        logger_log(LOG_ERROR, "Snapshot: cannot write %s: %s", tmp, strerror(errno));
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp, path) != 0) {
+        logger_log(LOG_ERROR, "Snapshot: cannot rename %s: %s", tmp, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    // Make the rename itself durable
+    snprintf(dir, sizeof(dir), "%s", path);
+    int dfd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return 0;
+}
+
+int snapshot_read(const char *path, SnapshotSensor *s, int max, int64_t *written_ms) {
+    uint32_t magic = 0, version = 0, count = 0, sum;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            logger_log(LOG_WARN, "Snapshot: cannot open %s: %s", path, strerror(errno));
+        }
+        return -1;
+    }
+    ssize_t len = read(fd, buf, sizeof(buf));
+    close(fd);
+    if (len < HEADER_BYTES + 4) {
+        logger_log(LOG_WARN, "Snapshot: %s is truncated, ignored", path);
+        return -1;
+    }
+    memcpy(&sum, buf + len - 4, 4);
+    if (fnv1a(buf, (size_t)len - 4) != sum) {
+        logger_log(LOG_WARN, "Snapshot: %s is corrupt, ignored", path);
+        return -1;
+    }
+
+    const uint8_t *p = buf, *end = buf + len - 4;
+    get(&p, end, &magic, 4);
+    get(&p, end, &version, 4);
+    get(&p, end, &count, 4);
+    get(&p, end, written_ms, 8);
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+        logger_log(LOG_WARN, "Snapshot: %s has an unknown format, ignored", path);
+        return -1;
+    }
+
+    int n = 0;
+    for (uint32_t k = 0; k < count && n < max; k++) {
+        SnapshotSensor *o = &s[n];
+        uint8_t abnormal = 0, have_filtered = 0;
+        uint32_t frames = 0;
+        bool ok = get(&p, end, o->id, sizeof(o->id)) &&
+                  get(&p, end, &abnormal, 1) &&
+                  get(&p, end, &have_filtered, 1) &&
+                  get(&p, end, o->filtered, sizeof(o->filtered)) &&
+                  get(&p, end, &o->policy, sizeof(o->policy)) &&
+                  get(&p, end, &o->trend, sizeof(o->trend)) &&
+                  get(&p, end, &o->rules_sum, 4) &&
+                  get(&p, end, &o->rules, sizeof(o->rules)) &&
+                  get(&p, end, &frames, 4) && frames <= HISTORY_FRAMES &&
+                  o->trend.head >= 0 && o->trend.head < TREND_MAX_FRAMES &&
+                  o->trend.count >= 0 && o->trend.count <= TREND_MAX_FRAMES;
+        for (uint32_t i = 0; ok && i < frames; i++) {
+            ok = get(&p, end, &o->t_ms[i], 8) && get(&p, end, o->pix[i], sizeof(o->pix[i]));
+        }
+        if (!ok) {
+            logger_log(LOG_WARN, "Snapshot: %s is malformed, ignored", path);
+            return -1;
+        }
+        o->id[sizeof(o->id) - 1] = '\0';
+        o->trend.reason[sizeof(o->trend.reason) - 1] = '\0';
+        o->abnormal = abnormal;
+        o->have_filtered = have_filtered;
+        o->n_frames = (int)frames;
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,53 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+#include "history.h"
+#include "policy.h"
+#include "rule.h"
+#include "trend.h"
+
+// Per-sensor state saved across restarts (warm restart).
+//
+// SensorDataApp writes the alert state, filter state, rate-of-rise window,
+// rule duration counters, recent raw frames and open upload-policy window
+// of every sensor to <snapshot.dir>/
+// SensorDataApp.snap every snapshot.interval_s, after each alert transition
+// and at exit. The file is written to a temporary name, synced and renamed
+// over the previous one, and ends in a checksum, so after a crash it holds
+// either the previous snapshot or the new one and never a torn mix.
+//
+// Little more than the raw frames is kept: pixel values are in sensor units
+// (0.1 degC) like the frame store, and only frames actually held are
+// written. The file is native-endian; it is only read back by the same
+// machine.
+
+#define SNAPSHOT_FILE     "SensorDataApp.snap"
+#define SNAPSHOT_MAGIC    0x50414E53u       // "SNAP"
+#define SNAPSHOT_VERSION  2
+
+typedef struct {
+    char id[32];
+    bool abnormal;                  // Last alert state reported upstream
+    bool have_filtered;             // EMA filter state below is valid
+    double filtered[HISTORY_N_PIXEL];
+    PolicySnapshot policy;
+    TrendState trend;               // Kept so that a rise alert does not
+    uint32_t rules_sum;             // recover on restart, nor a rule alert
+    RuleState rules;                // whose duration restarts from zero
+    int n_frames;                   // Raw frames, oldest first
+    int64_t t_ms[HISTORY_FRAMES];
+    int16_t pix[HISTORY_FRAMES][HISTORY_N_PIXEL];   // 0.1 degC
+} SnapshotSensor;
+
+// Write n sensors to path atomically. Returns 0 or -1.
+int snapshot_write(const char *path, const SnapshotSensor *s, int n, int64_t now_ms);
+
+// Read a snapshot into s (at most max sensors). Returns the number of
+// sensors, or -1 if the file is missing, truncated or corrupt. *written_ms
+// is the wall-clock time it was written.
+int snapshot_read(const char *path, SnapshotSensor *s, int max, int64_t *written_ms);
+
+#endif // SNAPSHOT_H
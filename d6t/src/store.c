@@ -0,0 +1,675 @@
+#include "store.h"
+#include "logger.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define STORE_MAX_WRITERS     128
+#define STORE_MAX_CHUNK_BYTES (96 * 1024)
+
+_Static_assert(sizeof(StoreIndexEntry) == 40, "index entry layout");
+_Static_assert(STORE_MAX_CHUNK_FRAMES <= UINT16_MAX, "n_frames is 16-bit");
+
+typedef struct {
+    char id[32];
+    int64_t day;                    // Day of the open segment, -1 if none
+    int64_t bucket;                 // Time bucket of the buffered chunk
+    int data_fd;
+    int index_fd;
+    int n;
+    int64_t t[STORE_MAX_CHUNK_FRAMES];
+    int16_t cols[STORE_N_COLS][STORE_MAX_CHUNK_FRAMES];
+} StoreWriter;
+
+static char store_dir[256];
+static int64_t bucket_ms = 300000;
+static StoreWriter *writers[STORE_MAX_WRITERS];
+static uint8_t chunk_buf[STORE_MAX_CHUNK_BYTES];
+
+/* Bit streams (LSB first) */
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t bit;
+} BitWriter;
+
+static int bw_put(BitWriter *w, uint64_t v, int n) {
+    if ((w->bit + n + 7) / 8 > w->size) return -1;
+    while (n > 0) {
+        uint8_t *p = &w->buf[w->bit >> 3];
+        int off = (int)(w->bit & 7);
+        int take = 8 - off < n ? 8 - off : n;
+        if (off == 0) *p = 0;
+        *p |= (uint8_t)((v & ((1u << take) - 1)) << off);
+        v >>= take;
+        n -= take;
+        w->bit += take;
+    }
+    return 0;
+}
+
+typedef struct {
+    const uint8_t *buf;
+    size_t bits;
+    size_t bit;
+} BitReader;
+
+static uint64_t br_get(BitReader *r, int n) {
+    uint64_t v = 0;
+    int got = 0;
+    while (got < n && r->bit < r->bits) {
+        int off = (int)(r->bit & 7);
+        int take = 8 - off < n - got ? 8 - off : n - got;
+        v |= (uint64_t)((r->buf[r->bit >> 3] >> off) & ((1u << take) - 1)) << got;
+        got += take;
+        r->bit += take;
+    }
+    return v;
+}
+
+static int64_t sign_extend(uint64_t v, int bits) {
+    uint64_t m = 1ULL << (bits - 1);
+    return (int64_t)((v ^ m) - m);
+}
+
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static uint32_t fnv1a(const uint8_t *p, size_t n) {
+    uint32_t h = 2166136261u;
+    while (n--) {
+        h ^= *p++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Chunk encoding */
+
+// Gorilla delta-of-delta: '0' | '10'+7 | '110'+9 | '1110'+12 | '1111'+32
+static int encode_times(BitWriter *w, const int64_t *t, int n) {
+    int64_t prev_delta = 0;
+    int rc = 0;
+    for (int i = 1; i < n; i++) {
+        int64_t delta = t[i] - t[i - 1];
+        int64_t dod = delta - prev_delta;
+        prev_delta = delta;
+        if (dod == 0) {
+            rc |= bw_put(w, 0x0, 1);
+        } else if (dod >= -64 && dod <= 63) {
+            rc |= bw_put(w, 0x1, 2);
+            rc |= bw_put(w, (uint64_t)dod & 0x7F, 7);
+        } else if (dod >= -256 && dod <= 255) {
+            rc |= bw_put(w, 0x3, 3);
+            rc |= bw_put(w, (uint64_t)dod & 0x1FF, 9);
+        } else if (dod >= -2048 && dod <= 2047) {
+            rc |= bw_put(w, 0x7, 4);
+            rc |= bw_put(w, (uint64_t)dod & 0xFFF, 12);
+        } else {
+            rc |= bw_put(w, 0xF, 4);
+            rc |= bw_put(w, (uint64_t)dod & 0xFFFFFFFFULL, 32);
+        }
+    }
+    return rc;
+}
+
+static void decode_times(const uint8_t *p, size_t len, int64_t t0, int n, int64_t *t) {
+    BitReader r = { p, len * 8, 0 };
+    int64_t delta = 0;
+    t[0] = t0;
+    for (int i = 1; i < n; i++) {
+        int64_t dod;
+        if (br_get(&r, 1) == 0) {
+            dod = 0;
+        } else if (br_get(&r, 1) == 0) {
+            dod = sign_extend(br_get(&r, 7), 7);
+        } else if (br_get(&r, 1) == 0) {
+            dod = sign_extend(br_get(&r, 9), 9);
+        } else if (br_get(&r, 1) == 0) {
+            dod = sign_extend(br_get(&r, 12), 12);
+        } else {
+            dod = sign_extend(br_get(&r, 32), 32);
+        }
+        delta += dod;
+        t[i] = t[i - 1] + delta;
+    }
+}
+
+// Column: first value (int16 LE), bit width, then n-1 zigzag deltas packed
+// at that width
+static int encode_column(uint8_t *out, size_t size, const int16_t *v, int n) {
+    uint32_t zz[STORE_MAX_CHUNK_FRAMES];
+    uint32_t all = 0;
+    int width = 0;
+
+    if (size < 3) return -1;
+    for (int i = 1; i < n; i++) {
+        zz[i] = zigzag((int32_t)v[i] - (int32_t)v[i - 1]);
+        all |= zz[i];
+    }
+    while (all >> width) width++;
+
+    out[0] = (uint8_t)((uint16_t)v[0] & 0xFF);
+    out[1] = (uint8_t)((uint16_t)v[0] >> 8);
+    out[2] = (uint8_t)width;
+    BitWriter w = { out + 3, size - 3, 0 };
+    for (int i = 1; i < n; i++) {
+        if (bw_put(&w, zz[i], width) != 0) return -1;
+    }
+    return 3 + (int)((w.bit + 7) / 8);
+}
+
+static inline uint64_t load64_le(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Fixed-width unpack: every value is an independent 64-bit load and shift,
+// so the loop has no carried state and the compiler can vectorize it. The
+// payload is padded so the final loads stay in bounds.
+static void decode_column(const uint8_t *p, int n, int16_t *v) {
+    uint32_t zz[STORE_MAX_CHUNK_FRAMES];
+    int width = p[2];
+    uint64_t mask = width ? (~0ULL >> (64 - width)) : 0;
+    const uint8_t *bits = p + 3;
+    int i;
+
+    for (i = 0; i < n - 1; i++) {
+        size_t bit = (size_t)i * width;
+        zz[i] = (uint32_t)((load64_le(bits + (bit >> 3)) >> (bit & 7)) & mask);
+    }
+    int32_t acc = (int16_t)((uint16_t)p[0] | ((uint16_t)p[1] << 8));
+    v[0] = (int16_t)acc;
+    for (i = 1; i < n; i++) {
+        acc += unzigzag(zz[i - 1]);
+        v[i] = (int16_t)acc;
+    }
+}
+
+int store_chunk_encode(const int64_t *t, int16_t (*cols)[STORE_MAX_CHUNK_FRAMES],
+                       int n, uint8_t *buf, size_t size) {
+    StoreChunkHeader h;
+    size_t hdr = sizeof(h);
+
+    if (n <= 0 || n > STORE_MAX_CHUNK_FRAMES || size < hdr + 8) return -1;
+    memset(&h, 0, hdr);
+    h.magic = STORE_MAGIC;
+    h.version = STORE_VERSION;
+    h.n_frames = (uint16_t)n;
+    h.t_first = t[0];
+    h.t_last = t[n - 1];
+
+    uint8_t *payload = buf + hdr;
+    size_t cap = size - hdr - 8;    // Keep room for the decode padding
+    BitWriter w = { payload, cap, 0 };
+    if (encode_times(&w, t, n) != 0) return -1;
+    size_t pos = (w.bit + 7) / 8;
+
+    for (int c = 0; c < STORE_N_COLS; c++) {
+        int16_t lo = cols[c][0], hi = cols[c][0];
+        for (int i = 1; i < n; i++) {
+            if (cols[c][i] < lo) lo = cols[c][i];
+            if (cols[c][i] > hi) hi = cols[c][i];
+        }
+        h.col_min[c] = lo;
+        h.col_max[c] = hi;
+        h.col_offset[c + 1] = (uint32_t)pos;
+        int len = encode_column(payload + pos, cap - pos, cols[c], n);
+        if (len < 0) return -1;
+        pos += len;
+    }
+    memset(payload + pos, 0, 8);
+    pos += 8;
+
+    h.col_offset[0] = 0;
+    h.payload_bytes = (uint32_t)pos;
+    h.checksum = fnv1a(payload, pos);
+    memcpy(buf, &h, hdr);
+    return (int)(hdr + pos);
+}
+
+/* Writer */
+
+static int mkdir_p(const char *path) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return -1;
+            *p = '/';
+        }
+    }
+    if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+int store_segment_path(char *buf, size_t size, const char *dir,
+                       const char *sensor_id, int64_t day) {
+    time_t secs = (time_t)(day * 86400);
+    struct tm tm;
+    gmtime_r(&secs, &tm);
+    int n = snprintf(buf, size, "%s/%s/%04d%02d%02d.d6s", dir, sensor_id,
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+int store_rollup_path(char *buf, size_t size, const char *dir,
+                      const char *sensor_id, int64_t day, const char *kind) {
+    time_t secs = (time_t)(day * 86400);
+    struct tm tm;
+    gmtime_r(&secs, &tm);
+    int n = snprintf(buf, size, "%s/%s/%04d%02d%02d.%s.d6s", dir, sensor_id,
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, kind);
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+void store_index_path(char *out, size_t size, const char *data_path) {
+    snprintf(out, size, "%s", data_path);
+    size_t len = strlen(out);
+    if (len > 4) out[len - 1] = 'i';    // .d6s -> .d6i
+}
+
+static void writer_close_segment(StoreWriter *w) {
+    if (w->data_fd >= 0) close(w->data_fd);
+    if (w->index_fd >= 0) close(w->index_fd);
+    w->data_fd = w->index_fd = -1;
+    w->day = -1;
+}
+
+static int writer_open_segment(StoreWriter *w, int64_t day) {
+    char path[512], ipath[512];
+    struct stat st;
+
+    writer_close_segment(w);
+    snprintf(path, sizeof(path), "%s/%s", store_dir, w->id);
+    if (mkdir_p(path) != 0 ||
+        store_segment_path(path, sizeof(path), store_dir, w->id, day) != 0) {
+        logger_log(LOG_ERROR, "Store: cannot create %s/%s: %s", store_dir, w->id, strerror(errno));
+        return -1;
+    }
+    store_index_path(ipath, sizeof(ipath), path);
+
+    w->data_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    w->index_fd = open(ipath, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (w->data_fd < 0 || w->index_fd < 0) {
+        logger_log(LOG_ERROR, "Store: cannot open %s: %s", path, strerror(errno));
+        writer_close_segment(w);
+        return -1;
+    }
+    // Drop a torn index record left by a crash
+    if (fstat(w->index_fd, &st) == 0 && st.st_size % sizeof(StoreIndexEntry) != 0) {
+        if (ftruncate(w->index_fd, st.st_size - st.st_size % sizeof(StoreIndexEntry)) != 0) {
+            logger_perror("Store: ftruncate index");
+        }
+    }
+    lseek(w->index_fd, 0, SEEK_END);
+    w->day = day;
+    return 0;
+}
+
+static void index_entry(const StoreChunkHeader *h, uint64_t offset, int len, StoreIndexEntry *e) {
+    memset(e, 0, sizeof(*e));
+    e->offset = offset;
+    e->t_first = h->t_first;
+    e->t_last = h->t_last;
+    e->n_frames = h->n_frames;
+    e->chunk_bytes = (uint32_t)len;
+    e->ptat_min = h->col_min[STORE_COL_PTAT];
+    e->ptat_max = h->col_max[STORE_COL_PTAT];
+    e->pix_min = h->col_min[STORE_COL_PIXEL(0)];
+    e->pix_max = h->col_max[STORE_COL_PIXEL(0)];
+    for (int p = 1; p < STORE_N_PIXEL; p++) {
+        if (h->col_min[STORE_COL_PIXEL(p)] < e->pix_min) e->pix_min = h->col_min[STORE_COL_PIXEL(p)];
+        if (h->col_max[STORE_COL_PIXEL(p)] > e->pix_max) e->pix_max = h->col_max[STORE_COL_PIXEL(p)];
+    }
+}
+
+static int writer_flush(StoreWriter *w) {
+    if (w->n == 0) return 0;
+
+    int64_t day = w->t[0] / STORE_DAY_MS;
+    if (w->day != day && writer_open_segment(w, day) != 0) {
+        w->n = 0;
+        return -1;
+    }
+
+    int len = store_chunk_encode(w->t, w->cols, w->n, chunk_buf, sizeof(chunk_buf));
+    if (len < 0) {
+        logger_log(LOG_ERROR, "Store: chunk encoding failed for %s", w->id);
+        w->n = 0;
+        return -1;
+    }
+
+    // Chunks are written at any byte offset, so headers are always copied
+    // out of a buffer or mapping, never cast in place
+    StoreChunkHeader h;
+    StoreIndexEntry e;
+    memcpy(&h, chunk_buf, sizeof(h));
+    index_entry(&h, (uint64_t)lseek(w->data_fd, 0, SEEK_END), len, &e);
+
+    // Data before index: a crash in between leaves an unreferenced chunk,
+    // never an index entry pointing at missing data
+    if (write(w->data_fd, chunk_buf, len) != len ||
+        write(w->index_fd, &e, sizeof(e)) != (ssize_t)sizeof(e)) {
+        logger_log(LOG_ERROR, "Store: write failed for %s: %s", w->id, strerror(errno));
+        w->n = 0;
+        return -1;
+    }
+    logger_log(LOG_DEBUG, "Store: %s chunk of %d frames, %d bytes", w->id, w->n, len);
+    w->n = 0;
+    return 0;
+}
+
+static StoreWriter *writer_get(const char *sensor_id) {
+    int free_slot = -1;
+    for (int i = 0; i < STORE_MAX_WRITERS; i++) {
+        if (writers[i] && strcmp(writers[i]->id, sensor_id) == 0) return writers[i];
+        if (!writers[i] && free_slot < 0) free_slot = i;
+    }
+    if (free_slot < 0) {
+        logger_log(LOG_ERROR, "Store: too many sensors");
+        return NULL;
+    }
+    StoreWriter *w = calloc(1, sizeof(StoreWriter));
+    if (!w) {
+        logger_log(LOG_ERROR, "Store: out of memory");
+        return NULL;
+    }
+    snprintf(w->id, sizeof(w->id), "%s", sensor_id);
+    w->day = -1;
+    w->data_fd = w->index_fd = -1;
+    writers[free_slot] = w;
+    return w;
+}
+
+int store_open(const char *dir, int chunk_seconds) {
+    snprintf(store_dir, sizeof(store_dir), "%s", dir);
+    bucket_ms = (chunk_seconds > 0 ? chunk_seconds : 300) * 1000LL;
+    if (mkdir_p(store_dir) != 0) {
+        logger_log(LOG_ERROR, "Store: cannot create %s: %s", store_dir, strerror(errno));
+        return -1;
+    }
+    logger_log(LOG_INFO, "Store: writing to %s (%d s chunks)", store_dir, (int)(bucket_ms / 1000));
+    return 0;
+}
+
+int store_append(const char *sensor_id, const StoreFrame *f) {
+    StoreWriter *w = writer_get(sensor_id);
+    if (!w) return -1;
+
+    int64_t bucket = f->t_ms / bucket_ms;
+    if (w->n > 0 && (bucket != w->bucket || w->n == STORE_MAX_CHUNK_FRAMES ||
+                     f->t_ms / STORE_DAY_MS != w->t[0] / STORE_DAY_MS ||
+                     f->t_ms < w->t[w->n - 1])) {
+        writer_flush(w);
+    }
+    if (w->n == 0) w->bucket = bucket;
+
+    w->t[w->n] = f->t_ms;
+    w->cols[STORE_COL_PTAT][w->n] = f->ptat;
+    for (int p = 0; p < STORE_N_PIXEL; p++) {
+        w->cols[STORE_COL_PIXEL(p)][w->n] = f->pix[p];
+    }
+    w->n++;
+    return 0;
+}
+
+void store_flush(void) {
+    for (int i = 0; i < STORE_MAX_WRITERS; i++) {
+        if (writers[i]) writer_flush(writers[i]);
+    }
+}
+
+void store_release(const char *sensor_id) {
+    for (int i = 0; i < STORE_MAX_WRITERS; i++) {
+        if (writers[i] && strcmp(writers[i]->id, sensor_id) == 0) {
+            writer_flush(writers[i]);
+            writer_close_segment(writers[i]);
+            free(writers[i]);
+            writers[i] = NULL;
+            return;
+        }
+    }
+}
+
+void store_close(void) {
+    for (int i = 0; i < STORE_MAX_WRITERS; i++) {
+        if (writers[i]) {
+            writer_flush(writers[i]);
+            writer_close_segment(writers[i]);
+            free(writers[i]);
+            writers[i] = NULL;
+        }
+    }
+}
+
+/* Segment rewrite */
+
+int store_builder_open(StoreBuilder *b, const char *path) {
+    memset(b, 0, sizeof(*b));
+    snprintf(b->path, sizeof(b->path), "%s", path);
+    snprintf(b->tmp, sizeof(b->tmp), "%s.tmp", path);
+    store_index_path(b->itmp, sizeof(b->itmp), path);
+    strncat(b->itmp, ".tmp", sizeof(b->itmp) - strlen(b->itmp) - 1);
+
+    b->data_fd = open(b->tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    b->index_fd = open(b->itmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (b->data_fd < 0 || b->index_fd < 0) {
+        logger_log(LOG_ERROR, "Store: cannot create %s: %s", b->tmp, strerror(errno));
+        store_builder_abort(b);
+        return -1;
+    }
+    return 0;
+}
+
+int store_builder_add(StoreBuilder *b, const int64_t *t,
+                      int16_t (*cols)[STORE_MAX_CHUNK_FRAMES], int n) {
+    int len = store_chunk_encode(t, cols, n, chunk_buf, sizeof(chunk_buf));
+    if (len < 0) {
+        logger_log(LOG_ERROR, "Store: chunk encoding failed for %s", b->path);
+        return -1;
+    }
+    StoreChunkHeader h;
+    StoreIndexEntry e;
+    memcpy(&h, chunk_buf, sizeof(h));
+    index_entry(&h, b->offset, len, &e);
+    if (write(b->data_fd, chunk_buf, len) != len ||
+        write(b->index_fd, &e, sizeof(e)) != (ssize_t)sizeof(e)) {
+        logger_log(LOG_ERROR, "Store: write failed for %s: %s", b->tmp, strerror(errno));
+        return -1;
+    }
+    b->offset += (uint64_t)len;
+    b->n_chunks++;
+    return len + (int)sizeof(e);
+}
+
+// The old index is removed before the data is replaced, so a reader that
+// opens the segment in between rebuilds the index from the new chunks
+// instead of following stale offsets
+int store_builder_commit(StoreBuilder *b) {
+    char ipath[512];
+
+    store_index_path(ipath, sizeof(ipath), b->path);
+    if (fdatasync(b->data_fd) != 0 || fdatasync(b->index_fd) != 0) {
+        logger_log(LOG_ERROR, "Store: fdatasync %s: %s", b->tmp, strerror(errno));
+        store_builder_abort(b);
+        return -1;
+    }
+    close(b->data_fd);
+    close(b->index_fd);
+    b->data_fd = b->index_fd = -1;
+
+    if ((unlink(ipath) != 0 && errno != ENOENT) ||
+        rename(b->tmp, b->path) != 0 || rename(b->itmp, ipath) != 0) {
+        logger_log(LOG_ERROR, "Store: cannot replace %s: %s", b->path, strerror(errno));
+        store_builder_abort(b);
+        return -1;
+    }
+    return 0;
+}
+
+void store_builder_abort(StoreBuilder *b) {
+    if (b->data_fd >= 0) close(b->data_fd);
+    if (b->index_fd >= 0) close(b->index_fd);
+    b->data_fd = b->index_fd = -1;
+    unlink(b->tmp);
+    unlink(b->itmp);
+}
+
+/* Reader */
+
+// Zigzag deltas of int16 values need at most 17 bits
+#define STORE_MAX_WIDTH 17
+
+// The column offsets and widths come from the file: check that every column
+// lies inside the payload, before the decode padding, and holds n-1 values
+// at its width, so that a corrupt or foreign chunk cannot make the decoder
+// read outside the mapping
+static bool chunk_layout_valid(const StoreChunkHeader *h, const uint8_t *payload) {
+    uint32_t end = h->payload_bytes;
+
+    if (end < 8 || h->col_offset[0] != 0) return false;
+    end -= 8;
+    for (int c = 0; c < STORE_N_COLS; c++) {
+        uint32_t start = h->col_offset[c + 1];
+        uint32_t next = c + 1 < STORE_N_COLS ? h->col_offset[c + 2] : end;
+        if (start < h->col_offset[c] || next < start || next > end || next - start < 3) {
+            return false;
+        }
+        int width = payload[start + 2];
+        if (width > STORE_MAX_WIDTH ||
+            3 + ((uint64_t)(h->n_frames - 1) * width + 7) / 8 > next - start) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copy out the header of the chunk at off and check it. Returns false if there is no valid chunk there.
+static bool chunk_valid(const StoreSegment *seg, uint64_t off, StoreChunkHeader *h) {
+    if (off + sizeof(*h) > seg->data_len) return false;
+    memcpy(h, seg->data + off, sizeof(*h));
+    return h->magic == STORE_MAGIC && h->version == STORE_VERSION &&
+           h->n_frames > 0 && h->n_frames <= STORE_MAX_CHUNK_FRAMES &&
+           off + sizeof(*h) + h->payload_bytes <= seg->data_len &&
+           chunk_layout_valid(h, seg->data + off + sizeof(*h));
+}
+
+// Rebuild the index by walking the chunk headers (lost or stale .d6i)
+static int rebuild_index(StoreSegment *seg) {
+    int cap = 64, n = 0;
+    StoreIndexEntry *idx = malloc(cap * sizeof(*idx));
+    uint64_t off = 0;
+    StoreChunkHeader h;
+
+    if (!idx) return -1;
+    while (chunk_valid(seg, off, &h)) {
+        if (n == cap) {
+            StoreIndexEntry *grown = realloc(idx, (cap *= 2) * sizeof(*idx));
+            if (!grown) {
+                free(idx);
+                return -1;
+            }
+            idx = grown;
+        }
+        int len = (int)(sizeof(h) + h.payload_bytes);
+        index_entry(&h, off, len, &idx[n++]);
+        off += len;
+    }
+    seg->index = idx;
+    seg->index_map = idx;
+    seg->index_map_len = 0;
+    seg->index_owned = true;
+    seg->n_chunks = n;
+    return 0;
+}
+
+int store_segment_open(const char *path, StoreSegment *seg) {
+    char ipath[512];
+    struct stat st;
+
+    memset(seg, 0, sizeof(*seg));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    seg->data = map;
+    seg->data_len = (size_t)st.st_size;
+
+    store_index_path(ipath, sizeof(ipath), path);
+    fd = open(ipath, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(StoreIndexEntry)) {
+        void *imap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (imap != MAP_FAILED) {
+            seg->index = imap;
+            seg->index_map = imap;
+            seg->index_map_len = (size_t)st.st_size;
+            seg->n_chunks = (int)(st.st_size / sizeof(StoreIndexEntry));
+            // Ignore trailing entries whose chunk is not fully on disk
+            StoreChunkHeader h;
+            while (seg->n_chunks > 0 &&
+                   !chunk_valid(seg, seg->index[seg->n_chunks - 1].offset, &h)) {
+                seg->n_chunks--;
+            }
+        }
+    }
+    if (fd >= 0) close(fd);
+
+    if (!seg->index && rebuild_index(seg) != 0) {
+        store_segment_close(seg);
+        return -1;
+    }
+    return 0;
+}
+
+void store_segment_close(StoreSegment *seg) {
+    if (seg->data) munmap((void *)seg->data, seg->data_len);
+    if (seg->index_owned) {
+        free(seg->index_map);
+    } else if (seg->index_map) {
+        munmap(seg->index_map, seg->index_map_len);
+    }
+    memset(seg, 0, sizeof(*seg));
+}
+
+int store_chunk_header(const StoreSegment *seg, int i, StoreChunkHeader *h) {
+    if (i < 0 || i >= seg->n_chunks || !chunk_valid(seg, seg->index[i].offset, h)) {
+        return -1;
+    }
+    return 0;
+}
+
+int store_chunk_decode(const StoreSegment *seg, int i, uint32_t col_mask, StoreChunk *out) {
+    StoreChunkHeader h;
+    if (store_chunk_header(seg, i, &h) != 0) return -1;
+
+    const uint8_t *payload = seg->data + seg->index[i].offset + sizeof(h);
+    if ((col_mask & STORE_DECODE_VERIFY) &&
+        fnv1a(payload, h.payload_bytes) != h.checksum) {
+        logger_log(LOG_ERROR, "Store: checksum mismatch in chunk at offset %llu",
+                   (unsigned long long)seg->index[i].offset);
+        return -1;
+    }
+
+    out->n = h.n_frames;
+    decode_times(payload, h.col_offset[1], h.t_first, out->n, out->t);
+    for (int c = 0; c < STORE_N_COLS; c++) {
+        if (col_mask & (1u << c)) {
+            decode_column(payload + h.col_offset[c + 1], out->n, out->col[c]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Column-oriented frame store for long-term retention.
+//
+// Frames are grouped per sensor into time-bucketed chunks. Each chunk is
+// appended to a per-sensor, per-day (UTC) segment file
+//
+//     <dir>/<sensor_id>/<YYYYMMDD>.d6s    chunk headers + payloads
+//     <dir>/<sensor_id>/<YYYYMMDD>.d6i    fixed-size index, one entry per chunk
+//
+// Once raw frames age out, the compactor replaces a day with min/max/avg
+// rollup segments (<YYYYMMDD>.<kind>.d6s) in the same format.
+//
+// Inside a chunk, timestamps are delta-of-delta encoded with Gorilla-style
+// prefix codes. PTAT and each pixel are stored as separate columns of
+// zigzag deltas bit-packed at a fixed width. Every chunk header carries
+// min/max zone maps per column, and the index carries them per chunk, so
+// readers can skip chunks (and columns) without decoding them. Values are
+// the raw sensor units (0.1 degC) and are stored losslessly.
+
+#define STORE_N_PIXEL          16
+#define STORE_N_COLS           (1 + STORE_N_PIXEL)  // PTAT, then pixels
+#define STORE_COL_PTAT         0
+#define STORE_COL_PIXEL(p)     (1 + (p))
+#define STORE_COLS_ALL         ((1u << STORE_N_COLS) - 1)
+#define STORE_DECODE_VERIFY    (1u << 31)           // Also check the payload checksum
+#define STORE_MAX_CHUNK_FRAMES 2048
+#define STORE_MAGIC            0x43543644u          // "D6TC"
+#define STORE_VERSION          1
+#define STORE_DAY_MS           86400000LL
+
+typedef struct {
+    int64_t t_ms;                   // Wall-clock time, ms since the epoch
+    int16_t ptat;                   // 0.1 degC
+    int16_t pix[STORE_N_PIXEL];     // 0.1 degC
+} StoreFrame;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t n_frames;
+    uint32_t payload_bytes;         // Bytes following this header
+    uint32_t checksum;              // FNV-1a of the payload
+    int64_t t_first;
+    int64_t t_last;
+    int16_t col_min[STORE_N_COLS];
+    int16_t col_max[STORE_N_COLS];
+    uint32_t col_offset[STORE_N_COLS + 1];  // [0] = timestamps, then columns
+} StoreChunkHeader;
+
+typedef struct {
+    uint64_t offset;                // Chunk header offset in the .d6s file
+    int64_t t_first;
+    int64_t t_last;
+    uint32_t n_frames;
+    uint32_t chunk_bytes;           // Header + payload
+    int16_t pix_min;                // Zone map over all pixel columns
+    int16_t pix_max;
+    int16_t ptat_min;
+    int16_t ptat_max;
+} StoreIndexEntry;
+
+// Decoded chunk. Only the columns requested are filled in.
+typedef struct {
+    int n;
+    int64_t t[STORE_MAX_CHUNK_FRAMES];
+    int16_t col[STORE_N_COLS][STORE_MAX_CHUNK_FRAMES];
+} StoreChunk;
+
+// Read-only, mmap'd view of one segment
+typedef struct {
+    const uint8_t *data;
+    size_t data_len;
+    const StoreIndexEntry *index;
+    int n_chunks;
+    void *index_map;                // mmap of the .d6i, or a heap copy
+    size_t index_map_len;
+    bool index_owned;
+} StoreSegment;
+
+/* Writer */
+
+// Open the store for appending. chunk_seconds is the time bucket size.
+int store_open(const char *dir, int chunk_seconds);
+
+// Buffer a frame; a chunk is written when its time bucket ends, when it is
+// full, or at the end of the UTC day
+int store_append(const char *sensor_id, const StoreFrame *f);
+
+// Write all partially filled chunks
+void store_flush(void);
+
+// Write a sensor's partially filled chunk and release its writer
+void store_release(const char *sensor_id);
+
+// Flush and release writer state
+void store_close(void);
+
+/* Segment rewrite (compaction) */
+
+// Builds a complete segment in temporary files next to path; commit
+// replaces the existing segment and index atomically for readers
+typedef struct {
+    char path[512];
+    char tmp[520];
+    char itmp[520];
+    int data_fd;
+    int index_fd;
+    uint64_t offset;
+    int n_chunks;
+} StoreBuilder;
+
+int store_builder_open(StoreBuilder *b, const char *path);
+
+// Append one chunk. Returns the bytes written or -1.
+int store_builder_add(StoreBuilder *b, const int64_t *t,
+                      int16_t (*cols)[STORE_MAX_CHUNK_FRAMES], int n);
+
+int store_builder_commit(StoreBuilder *b);
+void store_builder_abort(StoreBuilder *b);
+
+/* Reader */
+
+// Segment path for a sensor and day number (t_ms / STORE_DAY_MS)
+int store_segment_path(char *buf, size_t size, const char *dir,
+                       const char *sensor_id, int64_t day);
+
+// Rollup segment path, <YYYYMMDD>.<kind>.d6s, for kind "min", "max" or "avg".
+// Rollups hold one frame per rollup interval and replace raw segments that
+// have aged out (see compact.c).
+int store_rollup_path(char *buf, size_t size, const char *dir,
+                      const char *sensor_id, int64_t day, const char *kind);
+
+// Index path (.d6i) of a segment path (.d6s)
+void store_index_path(char *out, size_t size, const char *data_path);
+
+// Map a segment. The index is rebuilt by walking chunk headers if the .d6i
+// is missing. Returns 0, or -1 if the segment does not exist or is invalid.
+int store_segment_open(const char *path, StoreSegment *seg);
+void store_segment_close(StoreSegment *seg);
+
+// Copy the header of chunk i into h (chunks are not aligned in the mapping).
+// Returns 0, or -1 if the chunk is missing or invalid.
+int store_chunk_header(const StoreSegment *seg, int i, StoreChunkHeader *h);
+
+// Decode timestamps and the columns in col_mask (bit c = column c) of chunk i.
+// Add STORE_DECODE_VERIFY to check the checksum, which reads the whole payload.
+int store_chunk_decode(const StoreSegment *seg, int i, uint32_t col_mask, StoreChunk *out);
+
+// Encode n frames into buf as one chunk. Returns the chunk size or -1.
+int store_chunk_encode(const int64_t *t, int16_t (*cols)[STORE_MAX_CHUNK_FRAMES],
+                       int n, uint8_t *buf, size_t size);
+
+#endif // STORE_H
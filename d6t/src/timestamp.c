@@ -0,0 +1,206 @@
+#define _GNU_SOURCE             // strptime, timegm
+#include "timestamp.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_MS  1000000LL
+#define NS_PER_SEC 1000000000LL
+
+// Virtual time; monotonic starts at 1 s so that 0 keeps meaning "unset"
+static struct {
+    bool on;
+    int64_t mono_ns;
+    int64_t offset_ns;              // Wall minus monotonic
+} virt;
+
+static struct {
+    bool valid;
+    int64_t mono_ns;                // When the anchor was taken
+    int64_t offset_ns;              // Wall minus monotonic
+    int64_t last_wall_ns;           // Latest time handed out
+} anchor;
+
+// Local date and hour of the current hour
+static struct {
+    int64_t start;                  // Seconds since the epoch
+    int64_t end;
+    char date[TS_DATE_LEN + 1];
+    char hour[2];
+} hour_cache = { .start = INT64_MAX };
+
+static int64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+
+    if (virt.on) {
+        return id == CLOCK_REALTIME ? virt.mono_ns + virt.offset_ns : virt.mono_ns;
+    }
+    clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+int64_t ts_mono_ns(void) {
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+int64_t ts_now_ns(void) {
+    return clock_ns(CLOCK_REALTIME);
+}
+
+// Read the wall clock between two monotonic reads and keep the tightest of
+// three tries, so a preemption in between does not skew the offset
+static void anchor_refresh(void) {
+    int64_t best_width = INT64_MAX, mono = 0, wall = 0;
+
+    for (int k = 0; k < 3; k++) {
+        int64_t m0 = ts_mono_ns();
+        int64_t w = clock_ns(CLOCK_REALTIME);
+        int64_t m1 = ts_mono_ns();
+        if (m1 - m0 < best_width) {
+            best_width = m1 - m0;
+            mono = m0 + (m1 - m0) / 2;
+            wall = w;
+        }
+    }
+
+    int64_t offset = wall - mono;
+    if (anchor.valid) {
+        int64_t delta = offset - anchor.offset_ns;
+        if (delta >= TS_STEP_MS * NS_PER_MS || delta <= -TS_STEP_MS * NS_PER_MS) {
+            logger_log(LOG_WARN, "Wall clock stepped by %lld ms", (long long)(delta / NS_PER_MS));
+            anchor.last_wall_ns = INT64_MIN;
+        }
+    }
+    anchor.valid = true;
+    anchor.mono_ns = mono;
+    anchor.offset_ns = offset;
+}
+
+int64_t ts_wall_ns(int64_t mono_ns) {
+    if (!anchor.valid || mono_ns - anchor.mono_ns >= TS_ANCHOR_SECONDS * NS_PER_SEC) {
+        anchor_refresh();
+    }
+    int64_t wall = mono_ns + anchor.offset_ns;
+
+    // Hold still through a small backward correction
+    if (wall < anchor.last_wall_ns) {
+        wall = anchor.last_wall_ns;
+    }
+    anchor.last_wall_ns = wall;
+    return wall;
+}
+
+static void put2(char *p, int v) {
+    p[0] = (char)('0' + v / 10);
+    p[1] = (char)('0' + v % 10);
+}
+
+// localtime() once per local hour; UTC offsets and DST changes move on
+// hour boundaries
+static void hour_fill(int64_t sec) {
+    time_t t = (time_t)sec;
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    hour_cache.start = sec - tm.tm_min * 60 - tm.tm_sec;
+    hour_cache.end = hour_cache.start + 3600;
+    put2(hour_cache.date, (tm.tm_year + 1900) / 100);
+    put2(hour_cache.date + 2, (tm.tm_year + 1900) % 100);
+    hour_cache.date[4] = '-';
+    put2(hour_cache.date + 5, tm.tm_mon + 1);
+    hour_cache.date[7] = '-';
+    put2(hour_cache.date + 8, tm.tm_mday);
+    hour_cache.date[TS_DATE_LEN] = '\0';
+    put2(hour_cache.hour, tm.tm_hour);
+}
+
+void ts_format(int64_t wall_ns, TsText *out) {
+    int64_t ms = wall_ns / NS_PER_MS;
+    if (wall_ns < 0 && ms * NS_PER_MS != wall_ns) ms--;
+    int64_t sec = ms / 1000;
+    int msec = (int)(ms % 1000);
+    if (msec < 0) {
+        sec--;
+        msec += 1000;
+    }
+
+    if (sec < hour_cache.start || sec >= hour_cache.end) {
+        hour_fill(sec);
+    }
+    int in_hour = (int)(sec - hour_cache.start);
+
+    memcpy(out->date, hour_cache.date, sizeof(out->date));
+    char *p = out->time;
+    p[0] = hour_cache.hour[0];
+    p[1] = hour_cache.hour[1];
+    p[2] = ':';
+    put2(p + 3, in_hour / 60);
+    p[5] = ':';
+    put2(p + 6, in_hour % 60);
+    p[8] = ':';
+    p[9] = (char)('0' + msec / 100);
+    put2(p + 10, msec % 100);
+    p[TS_TIME_LEN] = '\0';
+}
+
+int ts_parse(const char *s, int64_t *wall_ns) {
+    struct tm tm;
+    char *end;
+
+    if (s[0] == '@') {
+        errno = 0;
+        long long sec = strtoll(s + 1, &end, 10);
+        if (errno != 0 || end == s + 1 || *end != '\0') {
+            return -1;
+        }
+        *wall_ns = sec * NS_PER_SEC;
+        return 0;
+    }
+
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(s, "%Y-%m-%d", &tm);
+    if (end && *end == 'T') {
+        char *rest = strptime(end + 1, "%H:%M", &tm);
+        if (rest && *rest == ':') {
+            rest = strptime(rest + 1, "%S", &tm);
+        }
+        end = rest;
+    }
+    if (!end || *end != '\0') {
+        return -1;
+    }
+    *wall_ns = (int64_t)timegm(&tm) * NS_PER_SEC;
+    return 0;
+}
+
+void ts_virtual_start(int64_t wall_ns) {
+    virt.on = true;
+    virt.mono_ns = NS_PER_SEC;
+    virt.offset_ns = wall_ns - virt.mono_ns;
+    anchor.valid = false;
+}
+
+bool ts_virtual(void) {
+    return virt.on;
+}
+
+void ts_advance_to(int64_t mono_ns) {
+    if (mono_ns > virt.mono_ns) {
+        virt.mono_ns = mono_ns;
+    }
+}
+
+void ts_sleep_ns(int64_t ns) {
+    struct timespec ts = { .tv_sec = ns / NS_PER_SEC, .tv_nsec = ns % NS_PER_SEC };
+
+    if (virt.on) {
+        ts_advance_to(virt.mono_ns + ns);
+        return;
+    }
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frame timestamps.
+//
+// A frame is stamped with CLOCK_MONOTONIC as soon as its sensor read
+// completes and mapped to wall-clock time through an anchor, a
+// CLOCK_REALTIME/CLOCK_MONOTONIC pair re-read every TS_ANCHOR_SECONDS.
+// Between refreshes wall times advance exactly with the monotonic clock.
+// Corrections smaller than TS_STEP_MS never make wall times go backwards;
+// larger ones are treated as a clock step and logged.
+//
+// Formatting keeps the local date and hour of the current hour, so most
+// frames need no localtime() call and no printf.
+//
+// In virtual time (SensorDataApp -t) both clocks stand still until the
+// event loop moves them to the next timer or a simulated sensor sleeps, so
+// a run takes no longer than its processing and repeats exactly.
+
+#define TS_ANCHOR_SECONDS 10
+#define TS_STEP_MS        1000
+#define TS_DATE_LEN       10            // YYYY-MM-DD
+#define TS_TIME_LEN       12            // HH:MM:SS:mmm, as sent upstream
+
+typedef struct {
+    char date[TS_DATE_LEN + 1];
+    char time[TS_TIME_LEN + 1];
+} TsText;
+
+// CLOCK_MONOTONIC in nanoseconds
+int64_t ts_mono_ns(void);
+
+// CLOCK_REALTIME in nanoseconds, for log lines and other wall-clock uses
+// outside the frame path
+int64_t ts_now_ns(void);
+
+// Wall-clock time (ns since the epoch) of a monotonic timestamp. Calls
+// must come in monotonic order, as they do from the sampling loop.
+int64_t ts_wall_ns(int64_t mono_ns);
+
+// Local date and time of a wall-clock time
+void ts_format(int64_t wall_ns, TsText *out);
+
+// Parse "YYYY-MM-DD", "YYYY-MM-DDTHH:MM[:SS]" (UTC) or "@seconds" into ns
+// since the epoch. Returns 0, or -1 if s is none of these.
+int ts_parse(const char *s, int64_t *wall_ns);
+
+// Switch to virtual time, with the wall clock at wall_ns. Call before any
+// other ts_ function.
+void ts_virtual_start(int64_t wall_ns);
+bool ts_virtual(void);
+
+// Move virtual time forward to mono_ns; earlier times are ignored
+void ts_advance_to(int64_t mono_ns);
+
+// Sleep, or in virtual time advance the clocks by ns
+void ts_sleep_ns(int64_t ns);
+
+#endif // TIMESTAMP_H
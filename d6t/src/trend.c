@@ -0,0 +1,143 @@
+#include "trend.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void trend_reset(TrendState *ts) {
+    memset(ts, 0, sizeof(*ts));
+}
+
+static int oldest(const TrendState *ts) {
+    return (ts->head - ts->count + TREND_MAX_FRAMES) % TREND_MAX_FRAMES;
+}
+
+// Seconds since the origin, computed the same way on entry and removal so
+// that a removal takes out exactly what the entry put in
+static double rel(const TrendState *ts, int i) {
+    return (double)(ts->t_ms[i] - ts->origin_ms) / 1000.0;
+}
+
+static void add(TrendState *ts, int i) {
+    double t = rel(ts, i);
+    ts->st += t;
+    ts->stt += t * t;
+    for (int ch = 0; ch < TREND_CHANNELS; ch++) {
+        ts->sy[ch] += ts->y[i][ch];
+        ts->sty[ch] += t * ts->y[i][ch];
+    }
+}
+
+static void drop_oldest(TrendState *ts) {
+    int i = oldest(ts);
+    double t = rel(ts, i);
+    ts->st -= t;
+    ts->stt -= t * t;
+    for (int ch = 0; ch < TREND_CHANNELS; ch++) {
+        ts->sy[ch] -= ts->y[i][ch];
+        ts->sty[ch] -= t * ts->y[i][ch];
+    }
+    ts->count--;
+}
+
+// Move the origin to the oldest frame and rebuild the sums from the ring
+static void rebase(TrendState *ts) {
+    ts->st = ts->stt = 0.0;
+    memset(ts->sy, 0, sizeof(ts->sy));
+    memset(ts->sty, 0, sizeof(ts->sty));
+    if (ts->count > 0) {
+        ts->origin_ms = ts->t_ms[oldest(ts)];
+    }
+    for (int k = 0, i = oldest(ts); k < ts->count; k++, i = (i + 1) % TREND_MAX_FRAMES) {
+        add(ts, i);
+    }
+    ts->until_rebase = TREND_MAX_FRAMES;
+}
+
+void trend_push(TrendState *ts, int64_t t_ms, const double *pix, int window_ms) {
+    // The wall clock was stepped back: the window no longer makes sense
+    if (ts->count > 0) {
+        int newest = (ts->head - 1 + TREND_MAX_FRAMES) % TREND_MAX_FRAMES;
+        if (t_ms < ts->t_ms[newest]) {
+            ts->count = 0;
+        }
+    }
+    if (ts->count == 0) {
+        ts->origin_ms = t_ms;
+        ts->until_rebase = 0;
+    }
+    while (ts->count > 0 && (ts->count == TREND_MAX_FRAMES ||
+                             t_ms - ts->t_ms[oldest(ts)] > window_ms)) {
+        drop_oldest(ts);
+    }
+
+    int i = ts->head;
+    double sum = 0.0;
+    ts->t_ms[i] = t_ms;
+    for (int p = 0; p < TREND_N_PIXEL; p++) {
+        ts->y[i][p] = (float)pix[p];
+        sum += pix[p];
+    }
+    ts->y[i][TREND_CH_MEAN] = (float)(sum / TREND_N_PIXEL);
+    ts->head = (ts->head + 1) % TREND_MAX_FRAMES;
+    ts->count++;
+
+    if (--ts->until_rebase <= 0) {
+        rebase(ts);
+    } else {
+        add(ts, i);
+    }
+}
+
+double trend_slope(const TrendState *ts, int ch) {
+    double n = ts->count;
+    double den = n * ts->stt - ts->st * ts->st;
+
+    // Less than a millisecond of spread per frame: no usable slope
+    if (ts->count < 2 || den < n * n * 1e-6) {
+        return 0.0;
+    }
+    return (n * ts->sty[ch] - ts->st * ts->sy[ch]) / den * 60.0;
+}
+
+const char *trend_check(TrendState *ts, const AppConfig *cfg) {
+    double worst = 0.0, worst_rate = 0.0, worst_limit = 0.0;
+    int worst_ch = -1;
+    bool above_half = false;
+
+    if (ts->count < cfg->trend_min_frames) {
+        ts->rising = false;
+        return NULL;
+    }
+    for (int ch = 0; ch < TREND_CHANNELS; ch++) {
+        double limit = ch == TREND_CH_MEAN ? cfg->trend_sensor_rise : cfg->trend_pixel_rise;
+        if (limit <= 0.0) {
+            continue;
+        }
+        double rate = trend_slope(ts, ch);
+        if (rate >= limit / 2) {
+            above_half = true;
+        }
+        if (rate >= limit && rate / limit > worst) {
+            worst = rate / limit;
+            worst_rate = rate;
+            worst_limit = limit;
+            worst_ch = ch;
+        }
+    }
+
+    if (worst_ch == TREND_CH_MEAN) {
+        ts->rising = true;
+        snprintf(ts->reason, sizeof(ts->reason), "平均温度の上昇率が %g°C/分を超えました", worst_limit);
+        logger_log(LOG_WARN, "Rapid temperature rise detected: mean rising %.1f°C/min exceeds %g°C/min",
+                   worst_rate, worst_limit);
+    } else if (worst_ch >= 0) {
+        ts->rising = true;
+        snprintf(ts->reason, sizeof(ts->reason), "温度の上昇率が %g°C/分を超えました", worst_limit);
+        logger_log(LOG_WARN, "Rapid temperature rise detected: pixel %d rising %.1f°C/min exceeds %g°C/min",
+                   worst_ch, worst_rate, worst_limit);
+    } else if (!above_half) {
+        ts->rising = false;
+    }
+    return ts->rising ? ts->reason : NULL;
+}
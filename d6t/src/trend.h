@@ -0,0 +1,55 @@
+#ifndef TREND_H
+#define TREND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+// Rate-of-rise (dT/dt) of each pixel and of the frame mean.
+//
+// The slope is a least-squares fit over the frames of the last
+// trend.window_s seconds. The sums behind the fit are kept up to date as
+// frames enter and leave the window, so a frame costs the same whatever the
+// window length: one add and at most a few removals per channel. Times are
+// kept relative to an origin that is moved to the oldest frame, and the
+// sums rebuilt from the ring, once per TREND_MAX_FRAMES frames; that bounds
+// both the magnitude of the time sums and the rounding left behind by
+// removals.
+//
+// A sensor is rising while a pixel climbs faster than trend.pixel_rise or
+// the frame mean faster than trend.sensor_rise (degC per minute). It stays
+// rising until every slope is back below half of its limit, so a noisy
+// slope near the limit does not flap between alert and recovery.
+
+#define TREND_N_PIXEL   16
+#define TREND_CHANNELS  (TREND_N_PIXEL + 1)     // Pixels, then the frame mean
+#define TREND_CH_MEAN   TREND_N_PIXEL
+#define TREND_MAX_FRAMES 64                     // A longer window is cut to this
+
+typedef struct {
+    int64_t t_ms[TREND_MAX_FRAMES];
+    float y[TREND_MAX_FRAMES][TREND_CHANNELS];
+    int head;                                   // Next slot written
+    int count;                                  // Frames in the window
+    int until_rebase;                           // Frames until the next rebase
+    int64_t origin_ms;                          // t of the sums, in s since this
+    double st, stt;                             // Sums of t and t*t
+    double sy[TREND_CHANNELS], sty[TREND_CHANNELS];
+    bool rising;
+    char reason[128];
+} TrendState;
+
+// Forget all frames
+void trend_reset(TrendState *ts);
+
+// Add a frame (degC) and drop frames older than window_ms
+void trend_push(TrendState *ts, int64_t t_ms, const double *pix, int window_ms);
+
+// Slope of a channel in degC per minute, 0 until two frames apart in time
+double trend_slope(const TrendState *ts, int ch);
+
+// Apply the rate-of-rise rules to the window. Returns the alert reason
+// while the sensor is rising, NULL otherwise.
+const char *trend_check(TrendState *ts, const AppConfig *cfg);
+
+#endif // TREND_H
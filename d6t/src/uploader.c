@@ -0,0 +1,492 @@
+#include "uploader.h"
+#include "evloop.h"
+#include "http.h"
+#include "logger.h"
+
+#include <limits.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define UPLOADER_SLOT_SIZE   1536
+#define UPLOADER_ALERT_SLOT_SIZE 4608   // Alerts may carry an encoded frame history
+#define UPLOADER_RBUF_SIZE   4096
+#define UPLOADER_BACKOFF_MIN 100
+#define UPLOADER_BACKOFF_MAX 5000
+#define UPLOADER_TOS_ALERT   0xB8   // DSCP EF: expedited ahead of bulk traffic
+
+typedef struct {
+    int len;
+    char data[];                // slot_size bytes
+} UploadSlot;
+
+typedef enum {
+    CONN_IDLE,
+    CONN_CONNECTING,
+    CONN_OPEN
+} ConnState;
+
+// One priority class: a queue and the connection that drains it
+typedef struct {
+    const char *name;
+    int tos;                    // IP_TOS for the socket, 0 for the default
+    int slot_size;              // Largest request, headers included
+
+    // Queue: order[] is a ring of slot pointers so that dropping the oldest
+    // unsent record only moves pointers. The first `inflight` entries from
+    // head have been written and are waiting for their responses.
+    char *slots;
+    UploadSlot **order;
+    int cap;
+    int head;
+    int count;
+    int inflight;
+
+    int fd;
+    ConnState state;
+    char *wbuf;
+    int wlen;
+    int wpos;
+
+    char rbuf[UPLOADER_RBUF_SIZE];
+    int rlen;
+    HttpResponse resp;
+
+    int retry_tfd;
+    bool retry_pending;
+    int backoff_ms;
+
+    UploaderStats stats;
+} Lane;
+
+static struct {
+    struct sockaddr_in addr;
+    char host[96];
+    int batch;
+    int flush_ms;
+    int flush_tfd;
+    Lane lanes[UPLOAD_LANES];
+} up = {
+    .flush_tfd = -1,
+    .lanes = {
+        [UPLOAD_ALERT]     = { .name = "alert", .tos = UPLOADER_TOS_ALERT,
+                               .slot_size = UPLOADER_ALERT_SLOT_SIZE, .fd = -1, .retry_tfd = -1 },
+        [UPLOAD_TELEMETRY] = { .name = "telemetry", .slot_size = UPLOADER_SLOT_SIZE,
+                               .fd = -1, .retry_tfd = -1 },
+    },
+};
+
+static Lane *const alerts = &up.lanes[UPLOAD_ALERT];
+static Lane *const telemetry = &up.lanes[UPLOAD_TELEMETRY];
+
+static void conn_event(int fd, uint32_t events, void *arg);
+static void try_send(Lane *l);
+
+static UploadSlot *slot_at(Lane *l, int k) {
+    return l->order[(l->head + k) % l->cap];
+}
+
+static void reset_response(Lane *l) {
+    l->rlen = 0;
+    http_response_reset(&l->resp);
+}
+
+static void conn_close(Lane *l) {
+    if (l->fd >= 0) {
+        evloop_del(l->fd);
+        close(l->fd);
+        l->fd = -1;
+    }
+    l->state = CONN_IDLE;
+    l->wlen = l->wpos = 0;
+    reset_response(l);
+}
+
+// Drop the connection and retry later. Requests already written stay at the
+// head of the queue and are sent again on the next connection.
+static void conn_fail(Lane *l, const char *what) {
+    logger_log(LOG_ERROR, "Uploader: %s lane: %s (%s:%d), retrying in %d ms",
+               l->name, what, up.host, ntohs(up.addr.sin_port), l->backoff_ms);
+    l->stats.retried += l->inflight;
+    l->inflight = 0;
+    conn_close(l);
+
+    l->retry_pending = true;
+    evloop_timer_set(l->retry_tfd, l->backoff_ms, 0);
+    l->backoff_ms *= 2;
+    if (l->backoff_ms > UPLOADER_BACKOFF_MAX) l->backoff_ms = UPLOADER_BACKOFF_MAX;
+}
+
+static void conn_start(Lane *l) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        conn_fail(l, strerror(errno));
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (l->tos) {
+        setsockopt(fd, IPPROTO_IP, IP_TOS, &l->tos, sizeof(l->tos));
+    }
+
+    if (connect(fd, (struct sockaddr *)&up.addr, sizeof(up.addr)) < 0 &&
+        errno != EINPROGRESS) {
+        close(fd);
+        conn_fail(l, strerror(errno));
+        return;
+    }
+    if (evloop_add(fd, EPOLLOUT, conn_event, l) != 0) {
+        close(fd);
+        conn_fail(l, "cannot watch socket");
+        return;
+    }
+    l->fd = fd;
+    l->state = CONN_CONNECTING;
+}
+
+// Pop the head request once its response has been read completely
+static void response_complete(Lane *l) {
+    if (l->inflight == 0) {
+        conn_fail(l, "unexpected response");
+        return;
+    }
+    if (l->resp.status >= 200 && l->resp.status < 300) {
+        l->stats.ok++;
+        logger_log(LOG_DEBUG, "Uploader: %s sent successfully: %d", l->name, l->resp.status);
+    } else {
+        l->stats.failed++;
+        logger_log(LOG_ERROR, "Uploader: failed to send %s: HTTP %d", l->name, l->resp.status);
+    }
+    l->head = (l->head + 1) % l->cap;
+    l->count--;
+    l->inflight--;
+
+    if (l->resp.close_after && l->inflight == 0) {
+        conn_close(l);
+    }
+}
+
+// Feed buffered bytes to the response parser. Returns -1 on a protocol error.
+static int parse_responses(Lane *l) {
+    int rc;
+    while ((rc = http_response_parse(&l->resp, l->rbuf, &l->rlen, UPLOADER_RBUF_SIZE)) == 1) {
+        response_complete(l);
+        if (l->state != CONN_OPEN) return 0;
+    }
+    return rc;
+}
+
+// Called whenever a lane may have become idle. Telemetry holds back while
+// alerts are pending, so the alert lane kicks it once it has drained.
+static void lane_idle(Lane *l) {
+    try_send(l);
+    if (l == alerts && alerts->count == 0) {
+        try_send(telemetry);
+    }
+}
+
+static void handle_readable(Lane *l) {
+    for (;;) {
+        ssize_t n = read(l->fd, l->rbuf + l->rlen, UPLOADER_RBUF_SIZE - 1 - l->rlen);
+        if (n > 0) {
+            l->rlen += (int)n;
+            if (parse_responses(l) != 0) {
+                conn_fail(l, "malformed HTTP response");
+                return;
+            }
+            if (l->state != CONN_OPEN) {
+                lane_idle(l);
+                return;
+            }
+            continue;
+        }
+        if (n == 0) {
+            if (l->resp.state == HTTP_RESP_BODY_UNTIL_CLOSE) {
+                response_complete(l);
+                conn_close(l);
+                lane_idle(l);
+            } else if (l->inflight > 0) {
+                conn_fail(l, "connection closed by server");
+            } else {
+                conn_close(l);  // Idle keep-alive connection timed out
+            }
+            return;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        if (errno == EINTR) continue;
+        conn_fail(l, strerror(errno));
+        return;
+    }
+
+    if (l->inflight == 0) {
+        lane_idle(l);
+    }
+}
+
+static void handle_writable(Lane *l) {
+    while (l->wpos < l->wlen) {
+        ssize_t n = send(l->fd, l->wbuf + l->wpos, l->wlen - l->wpos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                evloop_mod(l->fd, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            if (errno == EINTR) continue;
+            conn_fail(l, strerror(errno));
+            return;
+        }
+        l->wpos += (int)n;
+    }
+    l->wlen = l->wpos = 0;
+    evloop_mod(l->fd, EPOLLIN);
+}
+
+static void conn_event(int fd, uint32_t events, void *arg) {
+    Lane *l = arg;
+    (void)fd;
+
+    if (l->state == CONN_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(l->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            conn_fail(l, strerror(err));
+            return;
+        }
+        l->state = CONN_OPEN;
+        l->stats.connects++;
+        l->backoff_ms = UPLOADER_BACKOFF_MIN;
+        logger_log(LOG_INFO, "Uploader: %s lane connected to %s:%d",
+                   l->name, up.host, ntohs(up.addr.sin_port));
+        evloop_mod(l->fd, EPOLLIN);
+        try_send(l);
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        handle_readable(l);
+        if (l->state != CONN_OPEN) return;
+    }
+    if (events & EPOLLOUT) {
+        handle_writable(l);
+    }
+}
+
+// Write the next batch if the connection is idle. Only one batch is in
+// flight per lane; its requests are pipelined in a single write.
+static void try_send(Lane *l) {
+    if (l->count == 0 || l->inflight > 0) return;
+    if (l == telemetry && alerts->count > 0) return;
+    if (l->state == CONN_IDLE) {
+        if (!l->retry_pending) conn_start(l);
+        return;
+    }
+    if (l->state != CONN_OPEN) return;
+
+    int n = l->count < up.batch ? l->count : up.batch;
+    l->wlen = l->wpos = 0;
+    for (int k = 0; k < n; k++) {
+        UploadSlot *s = slot_at(l, k);
+        memcpy(l->wbuf + l->wlen, s->data, s->len);
+        l->wlen += s->len;
+    }
+    l->inflight = n;
+    l->stats.batches++;
+    handle_writable(l);
+}
+
+static void flush_timer(int fd, uint32_t events, void *arg) {
+    (void)fd; (void)events; (void)arg;
+    try_send(telemetry);
+}
+
+static void retry_timer(int fd, uint32_t events, void *arg) {
+    Lane *l = arg;
+    (void)fd; (void)events;
+    l->retry_pending = false;
+    try_send(l);
+}
+
+static int lane_init(Lane *l, int cap) {
+    size_t stride = sizeof(UploadSlot) + (size_t)l->slot_size;
+
+    l->cap = cap;
+    l->slots = calloc(l->cap, stride);
+    l->order = calloc(l->cap, sizeof(UploadSlot *));
+    l->wbuf = malloc((size_t)up.batch * l->slot_size);
+    if (!l->slots || !l->order || !l->wbuf) {
+        logger_log(LOG_ERROR, "Uploader: out of memory");
+        return -1;
+    }
+    for (int i = 0; i < l->cap; i++) {
+        l->order[i] = (UploadSlot *)(l->slots + (size_t)i * stride);
+    }
+    l->head = l->count = l->inflight = 0;
+    l->backoff_ms = UPLOADER_BACKOFF_MIN;
+    reset_response(l);
+
+    l->retry_tfd = evloop_timer_add(0, retry_timer, l);
+    return l->retry_tfd < 0 ? -1 : 0;
+}
+
+static void lane_close(Lane *l) {
+    conn_close(l);
+    if (l->retry_tfd >= 0) {
+        evloop_del(l->retry_tfd);
+        close(l->retry_tfd);
+        l->retry_tfd = -1;
+    }
+    free(l->slots);
+    free(l->order);
+    free(l->wbuf);
+    l->slots = NULL;
+    l->order = NULL;
+    l->wbuf = NULL;
+    l->count = l->inflight = 0;
+    l->retry_pending = false;
+}
+
+int uploader_init(const AppConfig *cfg) {
+    memset(&up.addr, 0, sizeof(up.addr));
+    up.addr.sin_family = AF_INET;
+    up.addr.sin_port = htons((uint16_t)cfg->server_port);
+    if (inet_pton(AF_INET, cfg->server_ip, &up.addr.sin_addr) != 1) {
+        logger_log(LOG_ERROR, "Uploader: invalid server address %s", cfg->server_ip);
+        return -1;
+    }
+    snprintf(up.host, sizeof(up.host), "%s", cfg->server_ip);
+
+    up.batch = cfg->uploader_batch;
+    up.flush_ms = cfg->uploader_flush_ms;
+    if (lane_init(alerts, cfg->uploader_alert_queue) != 0 ||
+        lane_init(telemetry, cfg->uploader_queue) != 0) {
+        uploader_close();
+        return -1;
+    }
+
+    up.flush_tfd = evloop_timer_add(up.flush_ms > 0 ? up.flush_ms : 0, flush_timer, NULL);
+    if (up.flush_tfd < 0) {
+        uploader_close();
+        return -1;
+    }
+
+    logger_log(LOG_INFO, "Uploader: posting to http://%s:%d (batch %d, flush %d ms, queue %d, alert queue %d)",
+               up.host, cfg->server_port, up.batch, up.flush_ms, telemetry->cap, alerts->cap);
+    return 0;
+}
+
+int uploader_reconfigure(const AppConfig *cfg) {
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)cfg->server_port);
+    if (inet_pton(AF_INET, cfg->server_ip, &addr.sin_addr) != 1) {
+        logger_log(LOG_ERROR, "Uploader: invalid server address %s", cfg->server_ip);
+        return -1;
+    }
+
+    bool server_changed = addr.sin_port != up.addr.sin_port ||
+                          addr.sin_addr.s_addr != up.addr.sin_addr.s_addr;
+    for (int k = 0; k < UPLOAD_LANES; k++) {
+        Lane *l = &up.lanes[k];
+        if (server_changed || cfg->uploader_batch != up.batch) {
+            // Anything in flight is re-sent on the new connection
+            l->inflight = 0;
+            conn_close(l);
+        }
+        if (cfg->uploader_batch != up.batch) {
+            char *wbuf = realloc(l->wbuf, (size_t)cfg->uploader_batch * l->slot_size);
+            if (!wbuf) {
+                logger_log(LOG_ERROR, "Uploader: out of memory");
+                return -1;
+            }
+            l->wbuf = wbuf;
+        }
+    }
+    up.batch = cfg->uploader_batch;
+    if (cfg->uploader_queue != telemetry->cap || cfg->uploader_alert_queue != alerts->cap) {
+        logger_log(LOG_WARN, "Uploader: queue size change takes effect after restart");
+    }
+    up.addr = addr;
+    snprintf(up.host, sizeof(up.host), "%s", cfg->server_ip);
+    if (cfg->uploader_flush_ms != up.flush_ms) {
+        up.flush_ms = cfg->uploader_flush_ms;
+        evloop_timer_set(up.flush_tfd, up.flush_ms > 0 ? up.flush_ms : 0,
+                         up.flush_ms > 0 ? up.flush_ms : 0);
+    }
+
+    logger_log(LOG_INFO, "Uploader: reconfigured for http://%s:%d (batch %d, flush %d ms)",
+               up.host, cfg->server_port, up.batch, up.flush_ms);
+    uploader_flush();
+    return 0;
+}
+
+int uploader_post(UploadLane lane, const char *path, const char *json, int len) {
+    Lane *l = &up.lanes[lane];
+
+    if (l->count == l->cap) {
+        if (l->inflight == l->count) {
+            l->stats.dropped++;
+            logger_log(LOG_WARN, "Uploader: %s queue full, record dropped", l->name);
+            return -1;
+        }
+        // Drop the oldest record that has not been written yet
+        UploadSlot *victim = slot_at(l, l->inflight);
+        for (int k = l->inflight; k > 0; k--) {
+            l->order[(l->head + k) % l->cap] = l->order[(l->head + k - 1) % l->cap];
+        }
+        l->order[l->head] = victim;
+        l->head = (l->head + 1) % l->cap;
+        l->count--;
+        l->stats.dropped++;
+        logger_log(LOG_WARN, "Uploader: %s queue full, oldest record dropped", l->name);
+    }
+
+    UploadSlot *s = l->order[(l->head + l->count) % l->cap];
+    int n = snprintf(s->data, l->slot_size,
+                     "POST %s HTTP/1.1\r\n"
+                     "Host: %s:%d\r\n"
+                     "Content-Type: application/json\r\n"
+                     "Content-Length: %d\r\n"
+                     "Connection: keep-alive\r\n"
+                     "\r\n",
+                     path, up.host, ntohs(up.addr.sin_port), len);
+    if (n < 0 || n + len > l->slot_size) {
+        logger_log(LOG_ERROR, "Uploader: record too large (%d bytes)", len);
+        l->stats.dropped++;
+        return -1;
+    }
+    memcpy(s->data + n, json, len);
+    s->len = n + len;
+    l->count++;
+    l->stats.queued++;
+
+    // Alerts are never held for a batch
+    if (l == alerts || l->count - l->inflight >= up.batch || up.flush_ms <= 0) {
+        try_send(l);
+    }
+    return 0;
+}
+
+void uploader_flush(void) {
+    try_send(alerts);
+    try_send(telemetry);
+}
+
+void uploader_get_stats(UploadLane lane, UploaderStats *st) {
+    *st = up.lanes[lane].stats;
+}
+
+void uploader_close(void) {
+    for (int k = 0; k < UPLOAD_LANES; k++) {
+        lane_close(&up.lanes[k]);
+    }
+    if (up.flush_tfd >= 0) {
+        evloop_del(up.flush_tfd);
+        close(up.flush_tfd);
+        up.flush_tfd = -1;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include "config.h"
+
+// Minimal non-blocking HTTP/1.1 client running on the event loop. Records
+// are queued as complete requests and written in pipelined batches over
+// keep-alive connections to the configured API server.
+//
+// Each priority lane has its own queue and connection, so an alert never
+// waits behind a telemetry backlog or an in-flight telemetry batch. Alerts
+// are written as soon as they are queued; telemetry is batched and does not
+// start a new batch while alerts are pending.
+
+typedef enum {
+    UPLOAD_ALERT,       // Alert and recovery records
+    UPLOAD_TELEMETRY,   // Routine temperature records
+    UPLOAD_LANES
+} UploadLane;
+
+typedef struct {
+    unsigned long queued;       // Records accepted by uploader_post()
+    unsigned long ok;           // 2xx responses
+    unsigned long failed;       // Non-2xx responses (dropped, as on the Node side)
+    unsigned long dropped;      // Records discarded because the queue was full
+    unsigned long retried;      // Requests re-sent after a connection failure
+    unsigned long connects;     // TCP connections established
+    unsigned long batches;      // Batches written
+} UploaderStats;
+
+// Set up the queues and timers. Requires evloop_init().
+int uploader_init(const AppConfig *cfg);
+
+// Apply changed server/batch/flush settings from a reloaded config. Queued
+// records are kept; a changed queue size only takes effect after a restart.
+int uploader_reconfigure(const AppConfig *cfg);
+
+// Queue a JSON body for POSTing to path on the given lane. Returns 0, or -1
+// if it was dropped.
+int uploader_post(UploadLane lane, const char *path, const char *json, int len);
+
+// Write whatever is queued now instead of waiting for the batch to fill
+void uploader_flush(void);
+
+void uploader_get_stats(UploadLane lane, UploaderStats *st);
+
+// Close the connections and release the queues
+void uploader_close(void);
+
+#endif // UPLOADER_H
@@ -0,0 +1,121 @@
+#include "wire.h"
+
+#include <string.h>
+
+#define WIRE_HEADER 5               // Length and type
+#define WIRE_FRAME_FIXED (4 + 1 + 1 + 8 + 2 * (1 + STORE_N_PIXEL))
+
+static uint8_t *put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+    return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v) {
+    p = put16(p, (uint16_t)(v >> 16));
+    return put16(p, (uint16_t)v);
+}
+
+static uint8_t *put64(uint8_t *p, uint64_t v) {
+    p = put32(p, (uint32_t)(v >> 32));
+    return put32(p, (uint32_t)v);
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)get16(p) << 16 | get16(p + 2);
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return (uint64_t)get32(p) << 32 | get32(p + 4);
+}
+
+// Fill in the length and type once the body is written
+static int finish(uint8_t *buf, WireType type, const uint8_t *end) {
+    int len = (int)(end - buf);
+    put32(buf, (uint32_t)(len - 4));
+    buf[4] = (uint8_t)type;
+    return len;
+}
+
+int wire_put_hello(uint8_t *buf, size_t size, uint32_t session, const char *gateway) {
+    size_t name_len = strnlen(gateway, WIRE_MAX_NAME - 1);
+    if (size < WIRE_HEADER + 10 + name_len) return -1;
+
+    uint8_t *p = put32(buf + WIRE_HEADER, WIRE_MAGIC);
+    p = put16(p, WIRE_VERSION);
+    p = put32(p, session);
+    memcpy(p, gateway, name_len);
+    return finish(buf, WIRE_HELLO, p + name_len);
+}
+
+int wire_put_frame(uint8_t *buf, size_t size, const WireFrame *f) {
+    size_t id_len = strnlen(f->sensor_id, sizeof(f->sensor_id) - 1);
+    if (size < WIRE_HEADER + WIRE_FRAME_FIXED + id_len) return -1;
+
+    uint8_t *p = put32(buf + WIRE_HEADER, f->seq);
+    *p++ = f->flags;
+    *p++ = (uint8_t)id_len;
+    memcpy(p, f->sensor_id, id_len);
+    p = put64(p + id_len, (uint64_t)f->frame.t_ms);
+    p = put16(p, (uint16_t)f->frame.ptat);
+    for (int i = 0; i < STORE_N_PIXEL; i++) {
+        p = put16(p, (uint16_t)f->frame.pix[i]);
+    }
+    return finish(buf, WIRE_FRAME, p);
+}
+
+int wire_put_ack(uint8_t *buf, size_t size, uint64_t count) {
+    if (size < WIRE_HEADER + 8) return -1;
+    return finish(buf, WIRE_ACK, put64(buf + WIRE_HEADER, count));
+}
+
+int wire_get(const uint8_t *buf, size_t len, WireMsg *msg) {
+    if (len < 4) return 0;
+    uint32_t body = get32(buf);
+    if (body < 1 || body > WIRE_MAX_MSG - 4) return -1;
+    if (len < 4 + body) return 0;
+
+    const uint8_t *p = buf + WIRE_HEADER;
+    size_t n = body - 1;
+    msg->type = (WireType)buf[4];
+    switch (msg->type) {
+    case WIRE_HELLO:
+        if (n < 10 || n - 10 >= WIRE_MAX_NAME ||
+            get32(p) != WIRE_MAGIC || get16(p + 4) != WIRE_VERSION) {
+            return -1;
+        }
+        msg->hello.session = get32(p + 6);
+        memcpy(msg->hello.gateway, p + 10, n - 10);
+        msg->hello.gateway[n - 10] = '\0';
+        break;
+    case WIRE_FRAME: {
+        WireFrame *f = &msg->frame;
+        size_t id_len = n >= 6 ? p[5] : 0;
+        if (n != WIRE_FRAME_FIXED + id_len || id_len == 0 || id_len >= sizeof(f->sensor_id)) {
+            return -1;
+        }
+        f->seq = get32(p);
+        f->flags = p[4];
+        memcpy(f->sensor_id, p + 6, id_len);
+        f->sensor_id[id_len] = '\0';
+        p += 6 + id_len;
+        f->frame.t_ms = (int64_t)get64(p);
+        f->frame.ptat = (int16_t)get16(p + 8);
+        for (int i = 0; i < STORE_N_PIXEL; i++) {
+            f->frame.pix[i] = (int16_t)get16(p + 10 + 2 * i);
+        }
+        break;
+    }
+    case WIRE_ACK:
+        if (n != 8) return -1;
+        msg->ack = get64(p);
+        break;
+    default:
+        return -1;
+    }
+    return (int)(4 + body);
+}
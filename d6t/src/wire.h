@@ -0,0 +1,68 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "store.h"
+
+// Binary frame stream between SensorDataApp (forwarder.c) and the
+// multi-gateway aggregator (d6taggregate).
+//
+// Every message is a 4-byte length of what follows, then a type byte and
+// the body. Integers are big-endian.
+//
+//     HELLO  gateway -> aggregator, once per connection
+//            u32 magic, u16 version, u32 session, gateway name (rest)
+//     FRAME  gateway -> aggregator
+//            u32 seq, u8 flags, u8 id_len, sensor id, i64 t_ms,
+//            i16 ptat, i16 pix[16]
+//     ACK    aggregator -> gateway
+//            u64 frames received on this connection so far
+//
+// The session is picked at random when SensorDataApp starts and seq counts
+// the frames of each sensor within it, so (sensor id, session, seq) names a
+// frame uniquely. Gateways resend unacknowledged frames after reconnecting
+// and the aggregator drops the ones it has already seen.
+
+#define WIRE_MAGIC        0x57543644u       // "D6TW"
+#define WIRE_VERSION      1
+#define WIRE_MAX_MSG      128               // Largest message, length included
+#define WIRE_MAX_NAME     64
+#define WIRE_FLAG_ABNORMAL 0x01             // Gateway classified the frame abnormal
+
+typedef enum {
+    WIRE_HELLO = 1,
+    WIRE_FRAME = 2,
+    WIRE_ACK   = 3
+} WireType;
+
+typedef struct {
+    uint32_t seq;
+    uint8_t flags;
+    char sensor_id[32];
+    StoreFrame frame;
+} WireFrame;
+
+typedef struct {
+    WireType type;
+    union {
+        struct {
+            uint32_t session;
+            char gateway[WIRE_MAX_NAME];
+        } hello;
+        WireFrame frame;
+        uint64_t ack;
+    };
+} WireMsg;
+
+// Encode one message into buf. Returns its length, or -1 if it does not fit.
+int wire_put_hello(uint8_t *buf, size_t size, uint32_t session, const char *gateway);
+int wire_put_frame(uint8_t *buf, size_t size, const WireFrame *f);
+int wire_put_ack(uint8_t *buf, size_t size, uint64_t count);
+
+// Decode the first message in buf. Returns the bytes it used, 0 if buf
+// does not hold a complete message yet, or -1 if the stream is invalid.
+int wire_get(const uint8_t *buf, size_t len, WireMsg *msg);
+
+#endif // WIRE_H
@@ -0,0 +1,90 @@
+#include "zone.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void set_lane(ZoneMask *lanes, int z, int32_t v) {
+    lanes[z / ZONE_LANES][z % ZONE_LANES] = v;
+}
+
+void zone_set_build(ZoneSet *zs, const ZoneConfig *zones, int n) {
+    union { float f; int32_t i; } pos_inf = {__builtin_inff()}, neg_inf = {-__builtin_inff()};
+
+    memset(zs, 0, sizeof(*zs));
+    zs->n = n;
+    // Unused lanes are outside every pixel and come out as +/-inf, 0
+    for (int z = 0; z < ZONE_MAX; z++) {
+        uint16_t mask = z < n ? zones[z].mask : 0;
+        for (int p = 0; p < ZONE_N_PIXEL; p++) {
+            int in = mask >> p & 1;
+            set_lane(zs->in[p], z, in ? -1 : 0);
+            set_lane(zs->lo_pad[p], z, in ? 0 : pos_inf.i);
+            set_lane(zs->hi_pad[p], z, in ? 0 : neg_inf.i);
+        }
+        if (z < n) {
+            snprintf(zs->name[z], sizeof(zs->name[z]), "%s", zones[z].name);
+            zs->mask[z] = mask;
+            zs->inv_count[z / ZONE_LANES][z % ZONE_LANES] = 1.0f / __builtin_popcount(mask);
+        }
+    }
+}
+
+// Written lane by lane so that GCC emits a single minps/maxps (fmin/fmax
+// on NEON) rather than a compare-and-select
+static inline ZoneLanes lanes_min(ZoneLanes a, ZoneLanes b) {
+    ZoneLanes r;
+    for (int l = 0; l < ZONE_LANES; l++) {
+        r[l] = a[l] < b[l] ? a[l] : b[l];
+    }
+    return r;
+}
+
+static inline ZoneLanes lanes_max(ZoneLanes a, ZoneLanes b) {
+    ZoneLanes r;
+    for (int l = 0; l < ZONE_LANES; l++) {
+        r[l] = a[l] > b[l] ? a[l] : b[l];
+    }
+    return r;
+}
+
+// vecs is a constant at each call site so that the loops over it unroll
+static inline __attribute__((always_inline))
+void reduce(const ZoneSet *zs, const double *pix, ZoneStats *out, int vecs) {
+    const float inf = __builtin_inff();
+    ZoneLanes lo[ZONE_VECS], hi[ZONE_VECS], sum[ZONE_VECS];
+
+    for (int k = 0; k < vecs; k++) {
+        lo[k] = (ZoneLanes){inf, inf, inf, inf};
+        hi[k] = -lo[k];
+        sum[k] = (ZoneLanes){0.0f, 0.0f, 0.0f, 0.0f};
+    }
+    for (int p = 0; p < ZONE_N_PIXEL; p++) {
+        float f = (float)pix[p];
+        ZoneMask v = (ZoneMask)(ZoneLanes){f, f, f, f};
+#pragma GCC unroll 4
+        for (int k = 0; k < vecs; k++) {
+            // The pixel in its zones' lanes, 0 elsewhere; the pads turn the
+            // 0 into +inf for min and -inf for max
+            ZoneMask in = v & zs->in[p][k];
+            lo[k] = lanes_min((ZoneLanes)(in | zs->lo_pad[p][k]), lo[k]);
+            hi[k] = lanes_max((ZoneLanes)(in | zs->hi_pad[p][k]), hi[k]);
+            sum[k] += (ZoneLanes)in;
+        }
+    }
+    out->n = zs->n;
+    for (int k = 0; k < vecs; k++) {
+        memcpy(&out->min[k * ZONE_LANES], &lo[k], sizeof(lo[k]));
+        memcpy(&out->max[k * ZONE_LANES], &hi[k], sizeof(hi[k]));
+        sum[k] *= zs->inv_count[k];
+        memcpy(&out->avg[k * ZONE_LANES], &sum[k], sizeof(sum[k]));
+    }
+}
+
+void zone_reduce(const ZoneSet *zs, const double *pix, ZoneStats *out) {
+    // Most sensors have a handful of zones: skip the empty upper lanes
+    if (zs->n <= ZONE_LANES) {
+        reduce(zs, pix, out, 1);
+    } else {
+        reduce(zs, pix, out, ZONE_VECS);
+    }
+}
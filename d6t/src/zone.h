@@ -0,0 +1,53 @@
+#ifndef ZONE_H
+#define ZONE_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Named zones of a sensor's field of view (a door, a machine, a bed) and
+// their minimum, maximum and mean on every frame.
+//
+// A zone is configured as a list of pixels and compiled into a bitmask, and
+// the bitmasks are expanded into per-pixel lane masks for the reduction
+// kernel: for each pixel, one lane per zone, all ones where the zone
+// contains the pixel, plus the bits that turn an empty lane into +inf or
+// -inf. All zones are then reduced in one pass over the frame with the same
+// branch-free and/or/min/max/add on every lane. The lanes are GCC vectors
+// of four floats, a native SSE or NEON register, so the accumulators of all
+// zones stay in registers whatever the number or shape of the zones.
+
+#define ZONE_MAX      CONFIG_MAX_ZONES
+#define ZONE_N_PIXEL  16
+
+#define ZONE_LANES    4
+#define ZONE_VECS     (ZONE_MAX / ZONE_LANES)
+
+// One float per zone, four zones to a vector
+typedef float ZoneLanes __attribute__((vector_size(ZONE_LANES * sizeof(float))));
+typedef int32_t ZoneMask __attribute__((vector_size(ZONE_LANES * sizeof(int32_t))));
+
+typedef struct {
+    int n;
+    char name[ZONE_MAX][16];
+    uint16_t mask[ZONE_MAX];
+    ZoneMask in[ZONE_N_PIXEL][ZONE_VECS];       // ~0 in the zone, 0 outside
+    ZoneMask lo_pad[ZONE_N_PIXEL][ZONE_VECS];   // 0 in the zone, +inf outside
+    ZoneMask hi_pad[ZONE_N_PIXEL][ZONE_VECS];   // 0 in the zone, -inf outside
+    ZoneLanes inv_count[ZONE_VECS];
+} ZoneSet;
+
+// Results of one frame, in zone order, degC
+typedef struct {
+    int n;
+    float min[ZONE_MAX];
+    float max[ZONE_MAX];
+    float avg[ZONE_MAX];
+} ZoneStats;
+
+// Compile the zones of a sensor
+void zone_set_build(ZoneSet *zs, const ZoneConfig *zones, int n);
+
+// Min, max and mean of every zone of a frame
+void zone_reduce(const ZoneSet *zs, const double *pix, ZoneStats *out);
+
+#endif // ZONE_H
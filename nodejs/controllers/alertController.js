@@ -1,7 +1,6 @@
 /**
  * Alert controller for handling alert data
  */
-const axios = require('axios');
 const { getLogger } = require('../utils/logger');
 
 const logger = getLogger('alert');
@@ -9,9 +8,10 @@ const logger = getLogger('alert');
 /**
  * Initialize the alert controller
  * @param {Object} config - Configuration object
+ * @param {Object} uploadQueue - Shared upload queue (utils/uploadQueue)
  * @returns {Object} Controller methods
  */
-function initAlertController(config) {
+function initAlertController(config, uploadQueue) {
     const alertsApiUrl = `http://${config.server.ip}:${config.server.port}${config.server.endpoints.alerts}`;
     
     logger.info(`Alert controller initialized`);
@@ -20,6 +20,9 @@ function initAlertController(config) {
     // Track alert state for each sensor to detect changes
     const sensorAlertState = {};
     
+    // Called with (sensorId, isAbnormal) after each transition
+    const stateListeners = [];
+    
     /**
      * Send alert data to API
      * @param {Object} data - Alert data to send
@@ -27,7 +30,7 @@ function initAlertController(config) {
     async function sendAlertData(data) {
         try {
             logger.debug(`Sending alert data for sensor ${data.sensor_id}`);
-            const response = await axios.post(alertsApiUrl, data);
+            const response = await uploadQueue.post('alert', alertsApiUrl, data);
             logger.info(`Alert data sent successfully: ${response.status} ${response.statusText}`);
             return true;
         } catch (error) {
@@ -40,6 +43,44 @@ function initAlertController(config) {
         }
     }
     
+    /**
+     * Send an alert or recovery record and record the new sensor state
+     * @param {String} sensorId - Sensor ID
+     * @param {Boolean} isAbnormal - New abnormal state
+     * @param {Object} sensorData - Sensor data (date and time are used)
+     * @param {String} alertReason - Reason reported for an abnormal state
+     * @param {Object} [history] - Encoded frames leading up to the alert
+     * @returns {Boolean} Whether the alert was delivered
+     */
+    async function reportAlert(sensorId, isAbnormal, sensorData, alertReason, history) {
+        // Create alert document
+        const alertRecord = {
+            sensor_id: sensorId,
+            date: sensorData.date,
+            time: sensorData.time,
+            alert_reason: isAbnormal ? alertReason : '温度が正常範囲に戻りました',
+            status: isAbnormal ? '１：異常' : '0 ：正常'
+        };
+        if (history) {
+            alertRecord.history = history;
+        }
+        
+        // Update the state first so frames arriving during the send do not
+        // report the same transition again
+        sensorAlertState[sensorId] = isAbnormal;
+        stateListeners.forEach(listener => listener(sensorId, isAbnormal));
+        
+        // Log the alert or recovery
+        if (isAbnormal) {
+            logger.warn(`⚠️ ALERT: ${alertRecord.alert_reason} for sensor ${alertRecord.sensor_id}`);
+        } else {
+            logger.info(`✅ RECOVERY: Temperature returned to normal for sensor ${alertRecord.sensor_id}`);
+        }
+        
+        // Send alert to API
+        return sendAlertData(alertRecord);
+    }
+    
     /**
      * Check for alert state transitions and send alerts if needed
      * @param {String} sensorId - Sensor ID
@@ -58,28 +99,7 @@ function initAlertController(config) {
                 return false;
             }
             
-            // Create alert document
-            const alertRecord = {
-                sensor_id: sensorId,
-                date: sensorData.date,
-                time: sensorData.time,
-                alert_reason: isAbnormal ? analysis.alertReason : '温度が正常範囲に戻りました',
-                status: isAbnormal ? '１：異常' : '0 ：正常'
-            };
-            
-            // Send alert to API
-            await sendAlertData(alertRecord);
-            
-            // Log the alert or recovery
-            if (isAbnormal) {
-                logger.warn(`⚠️ ALERT: ${alertRecord.alert_reason} for sensor ${alertRecord.sensor_id}`);
-            } else {
-                logger.info(`✅ RECOVERY: Temperature returned to normal for sensor ${alertRecord.sensor_id}`);
-            }
-            
-            // Update the sensor state
-            sensorAlertState[sensorId] = isAbnormal;
-            
+            await reportAlert(sensorId, isAbnormal, sensorData, analysis.alertReason);
             return true;
         } catch (error) {
             logger.error(`Error handling alert transition: ${error.message}`, error);
@@ -95,10 +115,29 @@ function initAlertController(config) {
         return {...sensorAlertState};
     }
     
+    /**
+     * Restore sensor alert states saved before a restart
+     * @param {Object} states - Sensor ID to abnormal state
+     */
+    function restoreSensorAlertStates(states) {
+        Object.assign(sensorAlertState, states);
+    }
+    
+    /**
+     * Register a function called after each alert state transition
+     * @param {Function} listener - Called with (sensorId, isAbnormal)
+     */
+    function onStateChange(listener) {
+        stateListeners.push(listener);
+    }
+    
     return {
         sendAlertData,
+        reportAlert,
         checkAndHandleAlertTransition,
-        getSensorAlertStates
+        getSensorAlertStates,
+        restoreSensorAlertStates,
+        onStateChange
     };
 }
 
@@ -0,0 +1,202 @@
+/**
+ * Upload policy controller
+ * Decides per sensor which temperature records go upstream. In "summary"
+ * mode a sensor sends one summary per period while it is normal, and full
+ * frames from `pre_trigger` frames before an abnormal frame until
+ * `post_trigger_seconds` after the last one. Mirrors d6t/src/policy.c.
+ */
+const { getLogger } = require('../utils/logger');
+const { parseFrameTime } = require('../utils/datetime');
+
+const logger = getLogger('policy');
+
+// Same defaults and limits as the C program
+const DEFAULT_POLICY = {
+    mode: 'full',
+    summary_seconds: 60,
+    pre_trigger: 20,
+    post_trigger_seconds: 30
+};
+const MAX_PRE_TRIGGER = 64;
+
+/**
+ * Initialize the policy controller
+ * @param {Object} config - Configuration object
+ * @param {Object} temperatureController - Sends temperature and summary records
+ * @returns {Object} Controller methods
+ */
+function initPolicyController(config, temperatureController) {
+    const policies = {};
+    for (const sensor of config.sensors || []) {
+        const policy = { ...DEFAULT_POLICY, ...(sensor.upload || {}) };
+        if (policy.pre_trigger > MAX_PRE_TRIGGER) {
+            logger.warn(`Sensor ${sensor.id}: pre_trigger limited to ${MAX_PRE_TRIGGER} frames`);
+            policy.pre_trigger = MAX_PRE_TRIGGER;
+        }
+        policies[sensor.id] = policy;
+        logger.info(`Sensor ${sensor.id}: upload mode ${policy.mode}`);
+    }
+
+    // Per-sensor history, trigger window and open summary
+    const sensorState = {};
+
+    /**
+     * Get the state of a sensor, creating it on first use
+     * @param {String} sensorId - Sensor ID
+     * @returns {Object} Sensor state
+     */
+    function getState(sensorId) {
+        if (!sensorState[sensorId]) {
+            sensorState[sensorId] = {
+                history: [],
+                triggered: false,
+                windowEnd: 0,
+                periodStart: 0,
+                summary: null
+            };
+        }
+        return sensorState[sensorId];
+    }
+
+    /**
+     * Add a frame to the open summary period
+     * @param {Object} state - Sensor state
+     * @param {Object} sensorData - Parsed sensor data
+     * @param {Object} analysis - Analysis results
+     * @param {Number} timeMs - Frame time in milliseconds
+     */
+    function addToSummary(state, sensorData, analysis, timeMs) {
+        if (!state.summary) {
+            state.periodStart = timeMs;
+            state.summary = {
+                frames: 0,
+                minTemp: sensorData.temperatureData[0],
+                maxTemp: sensorData.temperatureData[0],
+                hotspot: 0,
+                avgSum: 0,
+                anyAbnormal: false
+            };
+        }
+        const summary = state.summary;
+        sensorData.temperatureData.forEach((temp, pixel) => {
+            if (temp < summary.minTemp) {
+                summary.minTemp = temp;
+            }
+            if (temp > summary.maxTemp) {
+                summary.maxTemp = temp;
+                summary.hotspot = pixel;
+            }
+        });
+        summary.avgSum += analysis.avgTemp;
+        summary.anyAbnormal = summary.anyAbnormal || analysis.isAbnormal;
+        summary.frames++;
+        summary.date = sensorData.date;
+        summary.time = sensorData.time;
+    }
+
+    /**
+     * Build the summary record of a closed period
+     * @param {String} sensorId - Sensor ID
+     * @param {Object} summary - Accumulated summary
+     * @returns {Object} Summary record
+     */
+    function createSummaryRecord(sensorId, summary) {
+        return {
+            sensor_id: sensorId,
+            date: summary.date,
+            time: summary.time,
+            frames: summary.frames,
+            min_temp: summary.minTemp,
+            max_temp: summary.maxTemp,
+            average_temp: Number((summary.avgSum / summary.frames).toFixed(2)),
+            hotspot: { pixel: summary.hotspot, temp: summary.maxTemp },
+            status: summary.anyAbnormal ? '１：異常' : '0 ：正常'
+        };
+    }
+
+    /**
+     * Upload what the sensor's policy calls for after one frame
+     * @param {Object} sensorData - Parsed sensor data
+     * @param {Object} analysis - Analysis results
+     * @param {Object} temperatureRecord - Full temperature record of the frame
+     */
+    function handleFrame(sensorData, analysis, temperatureRecord) {
+        const policy = policies[sensorData.sensorId] || DEFAULT_POLICY;
+        if (policy.mode !== 'summary') {
+            temperatureController.sendTemperatureData(temperatureRecord);
+            return;
+        }
+
+        const state = getState(sensorData.sensorId);
+        const timeMs = parseFrameTime(sensorData.date, sensorData.time) || Date.now();
+        addToSummary(state, sensorData, analysis, timeMs);
+
+        if (analysis.isAbnormal) {
+            if (!state.triggered) {
+                // Send the history leading up to the anomaly first
+                logger.info(`Sensor ${sensorData.sensorId}: full frames from ${state.history.length} frames before the anomaly`);
+                state.history.forEach(record => temperatureController.sendTemperatureData(record));
+                state.history = [];
+                state.triggered = true;
+            }
+            state.windowEnd = timeMs + policy.post_trigger_seconds * 1000;
+        } else if (state.triggered && timeMs > state.windowEnd) {
+            state.triggered = false;
+            logger.info(`Sensor ${sensorData.sensorId}: back to summaries`);
+        }
+
+        if (state.triggered) {
+            temperatureController.sendTemperatureData(temperatureRecord);
+        } else if (policy.pre_trigger > 0) {
+            state.history.push(temperatureRecord);
+            if (state.history.length > policy.pre_trigger) {
+                state.history.shift();
+            }
+        }
+
+        if (timeMs - state.periodStart >= policy.summary_seconds * 1000) {
+            temperatureController.sendSummaryData(createSummaryRecord(sensorData.sensorId, state.summary));
+            state.summary = null;
+        }
+    }
+
+    /**
+     * Get the trigger window and open summary of every sensor, for a
+     * warm-restart snapshot. Pre-trigger history is not included.
+     * @returns {Object} Sensor ID to { triggered, windowEnd, periodStart, summary }
+     */
+    function exportState() {
+        const states = {};
+        for (const [sensorId, state] of Object.entries(sensorState)) {
+            states[sensorId] = {
+                triggered: state.triggered,
+                windowEnd: state.windowEnd,
+                periodStart: state.periodStart,
+                summary: state.summary ? { ...state.summary } : null
+            };
+        }
+        return states;
+    }
+
+    /**
+     * Restore state returned by exportState() before a restart
+     * @param {Object} states - Sensor ID to saved state
+     */
+    function importState(states) {
+        for (const [sensorId, saved] of Object.entries(states)) {
+            const state = getState(sensorId);
+            state.triggered = saved.triggered;
+            state.windowEnd = saved.windowEnd;
+            state.periodStart = saved.periodStart;
+            state.summary = saved.summary ? { ...saved.summary } : null;
+        }
+    }
+
+    return {
+        handleFrame,
+        exportState,
+        importState
+    };
+}
+
+module.exports = initPolicyController;
@@ -1,7 +1,6 @@
 /**
  * Temperature controller for processing and sending temperature data
  */
-const axios = require('axios');
 const { getLogger } = require('../utils/logger');
 
 const logger = getLogger('temperature');
@@ -9,10 +8,12 @@ const logger = getLogger('temperature');
 /**
  * Initialize the temperature controller
  * @param {Object} config - Configuration object
+ * @param {Object} uploadQueue - Shared upload queue (utils/uploadQueue)
  * @returns {Object} Controller methods
  */
-function initTemperatureController(config) {
+function initTemperatureController(config, uploadQueue) {
     const temperatureApiUrl = `http://${config.server.ip}:${config.server.port}${config.server.endpoints.temperature}`;
+    const summaryApiUrl = `http://${config.server.ip}:${config.server.port}${config.server.endpoints.summary || '/api/summary'}`;
     const minNormalTemp = config.threshold.min;
     const maxNormalTemp = config.threshold.max;
     
@@ -73,7 +74,7 @@ function initTemperatureController(config) {
     async function sendTemperatureData(data) {
         try {
             logger.debug(`Sending temperature data for sensor ${data.sensor_id}`);
-            const response = await axios.post(temperatureApiUrl, data);
+            const response = await uploadQueue.post('telemetry', temperatureApiUrl, data);
             logger.info(`Temperature data sent successfully: ${response.status} ${response.statusText}`);
             return true;
         } catch (error) {
@@ -86,6 +87,26 @@ function initTemperatureController(config) {
         }
     }
     
+    /**
+     * Send a summary record to API
+     * @param {Object} data - Summary data to send
+     */
+    async function sendSummaryData(data) {
+        try {
+            logger.debug(`Sending summary data for sensor ${data.sensor_id}`);
+            const response = await uploadQueue.post('telemetry', summaryApiUrl, data);
+            logger.info(`Summary data sent successfully: ${response.status} ${response.statusText}`);
+            return true;
+        } catch (error) {
+            if (error.response) {
+                logger.error(`Failed to send summary data: ${error.response.status} ${error.response.statusText}`);
+            } else {
+                logger.error(`Error sending summary data: ${error.message}`);
+            }
+            return false;
+        }
+    }
+    
     /**
      * Create temperature record from sensor data
      * @param {Object} sensorData - Parsed sensor data
@@ -93,19 +114,25 @@ function initTemperatureController(config) {
      * @returns {Object} Temperature record
      */
     function createTemperatureRecord(sensorData, analysis) {
-        return {
+        const record = {
             sensor_id: sensorData.sensorId,
             date: sensorData.date,
             time: sensorData.time,
             temperature_data: sensorData.temperatureData,
-            average_temp: analysis.avgTemp,
-            status: analysis.isAbnormal ? '１：異常' : '0 ：正常'
+            average_temp: analysis.avgTemp
         };
+        // Same field order as the C program's single-hop records
+        if (sensorData.zones) {
+            record.zones = sensorData.zones;
+        }
+        record.status = analysis.isAbnormal ? '１：異常' : '0 ：正常';
+        return record;
     }
     
     return {
         analyzeTemperatureData,
         sendTemperatureData,
+        sendSummaryData,
         createTemperatureRecord
     };
 }
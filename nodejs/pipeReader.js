@@ -10,6 +10,9 @@ const path = require('path');
 // Import utilities and controllers
 const { loadConfig } = require('./utils/config');
 const { getLogger } = require('./utils/logger');
+const systemd = require('./utils/systemd');
+const { createUploadQueue } = require('./utils/uploadQueue');
+const snapshot = require('./utils/snapshot');
 
 // Initialize logger
 const logger = getLogger('pipeReader');
@@ -17,22 +20,42 @@ const logger = getLogger('pipeReader');
 // Load configuration
 const config = loadConfig();
 
-// Initialize controllers
-const temperatureController = require('./controllers/temperatureController')(config);
-const alertController = require('./controllers/alertController')(config);
+// Initialize controllers; alerts and temperature records share one
+// prioritised queue so that alerts are sent ahead of the telemetry backlog
+const uploadQueue = createUploadQueue(config);
+const temperatureController = require('./controllers/temperatureController')(config, uploadQueue);
+const alertController = require('./controllers/alertController')(config, uploadQueue);
+const policyController = require('./controllers/policyController')(config, temperatureController);
 
-// Get pipe name from config
-const pipeName = config.pipe.name;
+// Frames arrive on the data pipe. When an alert pipe is configured the
+// sensor daemon detects transitions itself and writes them there, apart
+// from the frame backlog; otherwise alerts are derived from the frames.
+const frameReader = { name: config.pipe.name, onLine: processLine, fd: null, readStream: null, rl: null, retryMs: 0 };
+const alertReader = config.pipe.alert_name
+    ? { name: config.pipe.alert_name, onLine: processAlertLine, fd: null, readStream: null, rl: null, retryMs: 0 }
+    : null;
 
-// Variables for pipe reading
-let fd = null;
-let readStream = null;
-let rl = null;
+// Retries of a pipe that cannot be opened or read back off up to this
+const REOPEN_MIN_MS = 50;
+const REOPEN_MAX_MS = 5000;
+
+// Gateways that stream their frames to an aggregation node (d6taggregate)
+// leave telemetry uploads to it and only send alerts from here
+const forwarding = Boolean(config.aggregator && config.aggregator.host);
+
+// Alert states and policy windows survive restarts in this file
+const snapshotPath = config.snapshot && config.snapshot.enabled
+    ? path.join(config.snapshot.dir, 'pipeReader.snap')
+    : null;
+let snapshotPending = false;
+
+let notifiedReady = false;
 
 /**
  * Create named pipe if it doesn't exist
+ * @param {string} pipeName - Path of the pipe
  */
-function createNamedPipeIfNeeded() {
+function createNamedPipeIfNeeded(pipeName) {
     try {
         if (!fs.existsSync(pipeName)) {
             try {
@@ -52,44 +75,79 @@ function createNamedPipeIfNeeded() {
     }
 }
 
+/**
+ * Clean up the resources of one pipe reader
+ * @param {Object} reader - Pipe reader state
+ */
+function cleanupReader(reader) {
+    if (reader.rl) {
+        try {
+            reader.rl.close();
+        } catch (err) {
+            logger.debug(`Error closing readline interface: ${err.message}`);
+        }
+        reader.rl = null;
+    }
+    
+    if (reader.readStream) {
+        try {
+            reader.readStream.destroy();
+        } catch (err) {
+            logger.debug(`Error destroying read stream: ${err.message}`);
+        }
+        reader.readStream = null;
+    }
+    
+    if (reader.fd !== null) {
+        try {
+            fs.closeSync(reader.fd);
+        } catch (err) {
+            logger.debug(`Error closing file descriptor: ${err.message}`);
+        }
+        reader.fd = null;
+    }
+}
+
 /**
  * Clean up resources
  */
 function cleanupResources() {
     try {
-        if (rl) {
-            try {
-                rl.close();
-            } catch (err) {
-                logger.debug(`Error closing readline interface: ${err.message}`);
-            }
-            rl = null;
-        }
-        
-        if (readStream) {
-            try {
-                readStream.destroy();
-            } catch (err) {
-                logger.debug(`Error destroying read stream: ${err.message}`);
-            }
-            readStream = null;
-        }
-        
-        if (fd !== null) {
-            try {
-                fs.closeSync(fd);
-            } catch (err) {
-                logger.debug(`Error closing file descriptor: ${err.message}`);
-            }
-            fd = null;
+        cleanupReader(frameReader);
+        if (alertReader) {
+            cleanupReader(alertReader);
         }
-        
         logger.debug('Resources cleaned up');
     } catch (error) {
         logger.error(`Error cleaning up resources: ${error.message}`, error);
     }
 }
 
+/**
+ * Parse the zone statistics the C program appends to a frame line as
+ * ", zones: door=24.5/25.4/24.95 bed=..." (name=min/max/avg)
+ * @param {string} line - Raw data from pipe
+ * @returns {Object|null} Zone name to { min, max, avg }, or null if none
+ */
+function parseZones(line) {
+    const match = line.match(/\[degC\],\s*zones:\s*(.*)$/);
+    if (!match) {
+        return null;
+    }
+    const zones = {};
+    for (const item of match[1].trim().split(/\s+/)) {
+        const zone = item.match(/^(\w+)=([0-9.-]+)\/([0-9.-]+)\/([0-9.-]+)$/);
+        if (zone) {
+            zones[zone[1]] = {
+                min: parseFloat(zone[2]),
+                max: parseFloat(zone[3]),
+                avg: parseFloat(zone[4])
+            };
+        }
+    }
+    return zones;
+}
+
 /**
  * Process a line of data from the pipe
  * @param {string} line - Raw data from pipe
@@ -109,6 +167,7 @@ function processLine(line) {
             const time = match[3];
             const ptat = parseFloat(match[4]);
             const temperatureData = match[5].split(',').map(temp => parseFloat(temp.trim()));
+            const zones = parseZones(line);
             
             logger.info(`Parsed sensor data from sensor ${sensorId}: ${temperatureData.length} temperature readings`);
             
@@ -120,21 +179,30 @@ function processLine(line) {
                 ptat,
                 temperatureData
             };
+            if (zones) {
+                sensorData.zones = zones;
+            }
             
             // Analyze the temperature data
             const analysis = temperatureController.analyzeTemperatureData(temperatureData);
             
-            // Create and send temperature document
-            const temperatureRecord = temperatureController.createTemperatureRecord(sensorData, analysis);
-            temperatureController.sendTemperatureData(temperatureRecord);
+            // Create the temperature document; the sensor's upload policy
+            // decides whether it is sent in full or summarised
+            if (!forwarding) {
+                const temperatureRecord = temperatureController.createTemperatureRecord(sensorData, analysis);
+                policyController.handleFrame(sensorData, analysis, temperatureRecord);
+            }
             
-            // Check for alert state transitions and handle if needed
-            alertController.checkAndHandleAlertTransition(
-                sensorId, 
-                analysis.isAbnormal, 
-                sensorData, 
-                analysis
-            );
+            // Check for alert state transitions and handle if needed,
+            // unless the sensor daemon reports them on the alert pipe
+            if (!alertReader) {
+                alertController.checkAndHandleAlertTransition(
+                    sensorId, 
+                    analysis.isAbnormal, 
+                    sensorData, 
+                    analysis
+                );
+            }
         } else {
             logger.error('Unable to parse sensor data, invalid format');
         }
@@ -144,55 +212,164 @@ function processLine(line) {
 }
 
 /**
- * Function to open pipe and set up reader
+ * Process an alert transition written by the sensor daemon
+ * @param {string} line - Raw line from the alert pipe
  */
-function openPipe() {
+function processAlertLine(line) {
     try {
-        logger.info(`Opening pipe for reading: ${pipeName}`);
+        // The optional history is "<frames>:<base64 store chunk>"
+        const regex = /^alert:\s*id:\s*(\S+),\s*date:\s*(\S+),\s*time:\s*(\S+:\S+:\S+:\S+),\s*status:\s*([01]),\s*(?:history:\s*(\d+):([A-Za-z0-9+/=]+),\s*)?reason:\s*(.*)$/;
+        const match = line.match(regex);
+
+        if (match) {
+            const sensorId = match[1];
+            const sensorData = { sensorId, date: match[2], time: match[3] };
+            const history = match[5]
+                ? { format: 'd6tc', frames: parseInt(match[5], 10), data: match[6] }
+                : undefined;
+            alertController.reportAlert(sensorId, match[4] === '1', sensorData, match[7], history);
+        } else {
+            logger.error('Unable to parse alert line, invalid format');
+        }
+    } catch (error) {
+        logger.error(`Error processing alert: ${error.message}`, error);
+    }
+}
+
+/**
+ * Function to open a pipe and set up its reader
+ * @param {Object} reader - Pipe reader state
+ */
+function openPipe(reader) {
+    try {
+        logger.info(`Opening pipe for reading: ${reader.name}`);
         
         // Open pipe for reading
-        fd = fs.openSync(pipeName, 'r');
-        readStream = fs.createReadStream('', { fd });
+        reader.fd = fs.openSync(reader.name, 'r');
+        reader.readStream = fs.createReadStream('', { fd: reader.fd });
         
         // Create readline interface
-        rl = readline.createInterface({
-            input: readStream,
+        reader.rl = readline.createInterface({
+            input: reader.readStream,
             crlfDelay: Infinity,
         });
         
+        // Frames stay in the pipe while the telemetry backlog is full
+        if (reader === frameReader && uploadQueue.isSaturated()) {
+            reader.rl.pause();
+        }
+        
         // Process data line by line
-        rl.on('line', (line) => {
+        reader.rl.on('line', (line) => {
             logger.info(`Received raw data: ${line}`);
-            processLine(line);
+            reader.onLine(line);
         });
         
         // If pipe closes, try to reopen immediately
-        readStream.on('close', () => {
-            logger.warn('Pipe input ended, reconnecting immediately...');
+        reader.readStream.on('close', () => {
+            logger.warn(`Pipe ${reader.name} input ended, reconnecting immediately...`);
             
             // Clean up resources and reopen right away
-            cleanupResources();
-            openPipe();
+            cleanupReader(reader);
+            openPipe(reader);
         });
         
-        readStream.on('error', (err) => {
-            logger.error(`Error reading from pipe: ${err.message}`, err);
+        reader.readStream.on('error', (err) => {
+            logger.error(`Error reading from pipe ${reader.name}: ${err.message}`, err);
             
-            // Clean up resources and reopen right away
-            cleanupResources();
-            openPipe();
+            cleanupReader(reader);
+            reopenLater(reader);
         });
         
-        logger.info('Pipe reader ready and listening for data');
-    } catch (error) {
-        logger.error(`Error opening pipe: ${error.message}`, error);
+        reader.readStream.once('data', () => {
+            reader.retryMs = 0;
+        });
+        
+        logger.info(`Pipe reader ready and listening on ${reader.name}`);
         
-        // If pipe doesn't exist yet, check again immediately in a loop
-        // This prevents any delay in processing data
-        setImmediate(openPipe);
+        // Tell systemd we are up once the frame pipe is open for the first time
+        if (reader === frameReader && !notifiedReady) {
+            systemd.notify('READY=1');
+            notifiedReady = true;
+        }
+    } catch (error) {
+        logger.error(`Error opening pipe ${reader.name}: ${error.message}`, error);
+        reopenLater(reader);
     }
 }
 
+/**
+ * Retry a pipe that failed, backing off so that a missing or broken pipe
+ * does not keep the process spinning
+ * @param {Object} reader - Pipe reader state
+ */
+function reopenLater(reader) {
+    reader.retryMs = Math.min(reader.retryMs ? reader.retryMs * 2 : REOPEN_MIN_MS, REOPEN_MAX_MS);
+    setTimeout(() => openPipe(reader), reader.retryMs);
+}
+
+/**
+ * Save alert states and policy windows to the snapshot file
+ */
+function saveSnapshot() {
+    snapshotPending = false;
+    try {
+        const alertStates = alertController.getSensorAlertStates();
+        const policyStates = policyController.exportState();
+        const ids = new Set([...Object.keys(alertStates), ...Object.keys(policyStates)]);
+        const sensors = [...ids].map(id => ({
+            id,
+            abnormal: Boolean(alertStates[id]),
+            policy: policyStates[id]
+        }));
+        snapshot.writeSnapshot(snapshotPath, sensors);
+        logger.debug(`Snapshot of ${sensors.length} sensors written`);
+    } catch (error) {
+        logger.error(`Failed to write snapshot: ${error.message}`);
+    }
+}
+
+/**
+ * Save a snapshot once the current alert transitions have been handled
+ */
+function saveSnapshotSoon() {
+    if (!snapshotPending) {
+        snapshotPending = true;
+        setImmediate(saveSnapshot);
+    }
+}
+
+/**
+ * Restore the state saved before the last exit or crash. Alert states are
+ * always restored so that an alert is not sent twice; policy windows only
+ * from a snapshot younger than snapshot.max_age_s.
+ */
+function restoreSnapshot() {
+    let saved;
+    try {
+        saved = snapshot.readSnapshot(snapshotPath);
+    } catch (error) {
+        logger.warn(`Snapshot ignored: ${error.message}`);
+        return;
+    }
+    if (!saved) {
+        return;
+    }
+    const ageMs = Date.now() - saved.writtenMs;
+    const fresh = ageMs >= 0 && ageMs <= (config.snapshot.max_age_s || 0) * 1000;
+    const alertStates = {};
+    const policyStates = {};
+    for (const sensor of saved.sensors) {
+        alertStates[sensor.id] = sensor.abnormal;
+        policyStates[sensor.id] = sensor.policy;
+    }
+    alertController.restoreSensorAlertStates(alertStates);
+    if (fresh) {
+        policyController.importState(policyStates);
+    }
+    logger.info(`Snapshot: restored ${fresh ? 'alert and policy' : 'alert'} state of ${saved.sensors.length} sensors, saved ${Math.round(ageMs / 1000)} s ago`);
+}
+
 /**
  * Start the pipe reader
  */
@@ -200,15 +377,38 @@ function start() {
     try {
         logger.info('Starting pipe reader...');
         
-        // Create pipe if needed
-        createNamedPipeIfNeeded();
+        // Create pipes if needed
+        createNamedPipeIfNeeded(frameReader.name);
+        if (alertReader) {
+            createNamedPipeIfNeeded(alertReader.name);
+        }
         
-        // Start reading from pipe
-        openPipe();
+        // Apply backpressure to the frame pipe rather than buffer telemetry
+        uploadQueue.on('saturated', () => frameReader.rl && frameReader.rl.pause());
+        uploadQueue.on('drain', () => frameReader.rl && frameReader.rl.resume());
+        
+        // Pick up where the previous run stopped, then keep the snapshot
+        // current: periodically and after every alert transition
+        if (snapshotPath) {
+            restoreSnapshot();
+            setInterval(saveSnapshot, (config.snapshot.interval_s || 30) * 1000).unref();
+            alertController.onStateChange(saveSnapshotSoon);
+        }
+        
+        // Start reading from pipes; the alert pipe is read on its own stream
+        if (alertReader) {
+            openPipe(alertReader);
+        }
+        openPipe(frameReader);
+        systemd.startWatchdog();
         
         // Handle process termination
         process.on('SIGINT', () => {
             logger.info('Shutting down...');
+            systemd.notify('STOPPING=1');
+            if (snapshotPath) {
+                saveSnapshot();
+            }
             cleanupResources();
             process.exit(0);
         });
@@ -230,5 +430,6 @@ function start() {
 module.exports = {
     start,
     cleanupResources,
-    processLine
+    processLine,
+    processAlertLine
 };
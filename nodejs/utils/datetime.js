@@ -24,6 +24,19 @@ function getCurrentDateTime() {
     };
 }
 
+/**
+ * Convert the date and time fields of a sensor frame to milliseconds
+ * @param {string} date - Frame date, YYYY-MM-DD
+ * @param {string} time - Frame time, HH:MM:SS:mmm (local time)
+ * @returns {number} - Milliseconds since the epoch
+ */
+function parseFrameTime(date, time) {
+    const [year, month, day] = date.split('-').map(Number);
+    const [hours, minutes, seconds, milliseconds] = time.split(':').map(Number);
+    return new Date(year, month - 1, day, hours, minutes, seconds, milliseconds).getTime();
+}
+
 module.exports = {
-    getCurrentDateTime
+    getCurrentDateTime,
+    parseFrameTime
 };
@@ -0,0 +1,173 @@
+/**
+ * Warm-restart snapshots of per-sensor state (alert state, upload policy
+ * window and open summary), the Node.js side of d6t/src/snapshot.c.
+ * The file is binary, written to a temporary name, synced and renamed, and
+ * ends in an FNV-1a checksum, so a crash leaves either the old or the new
+ * snapshot and a torn file is detected and ignored.
+ */
+const fs = require('fs');
+const path = require('path');
+
+const MAGIC = 0x50534e4e;           // "NNSP"
+const VERSION = 1;
+
+const FLAG_ABNORMAL = 1;
+const FLAG_TRIGGERED = 2;
+const FLAG_SUMMARY = 4;
+const FLAG_SUMMARY_ABNORMAL = 8;
+
+/**
+ * FNV-1a, as used by the C program
+ * @param {Buffer} buf - Data
+ * @returns {Number} Unsigned 32-bit hash
+ */
+function fnv1a(buf) {
+    let h = 2166136261;
+    for (const b of buf) {
+        h = Math.imul(h ^ b, 16777619) >>> 0;
+    }
+    return h;
+}
+
+/**
+ * Sequential writer over a growing list of buffers
+ */
+class Writer {
+    constructor() {
+        this.parts = [];
+    }
+    u8(v) { const b = Buffer.alloc(1); b.writeUInt8(v); this.parts.push(b); }
+    u32(v) { const b = Buffer.alloc(4); b.writeUInt32LE(v); this.parts.push(b); }
+    f64(v) { const b = Buffer.alloc(8); b.writeDoubleLE(v); this.parts.push(b); }
+    str(s) {
+        const b = Buffer.from(s || '', 'utf8').subarray(0, 255);
+        this.u8(b.length);
+        this.parts.push(b);
+    }
+    buffer() { return Buffer.concat(this.parts); }
+}
+
+/**
+ * Sequential reader; throws on reads past the end
+ */
+class Reader {
+    constructor(buf) {
+        this.buf = buf;
+        this.pos = 0;
+    }
+    take(n) {
+        if (this.pos + n > this.buf.length) {
+            throw new Error('truncated');
+        }
+        this.pos += n;
+        return this.pos - n;
+    }
+    u8() { return this.buf.readUInt8(this.take(1)); }
+    u32() { return this.buf.readUInt32LE(this.take(4)); }
+    f64() { return this.buf.readDoubleLE(this.take(8)); }
+    str() {
+        const n = this.u8();
+        const at = this.take(n);
+        return this.buf.toString('utf8', at, at + n);
+    }
+}
+
+/**
+ * Write a snapshot atomically
+ * @param {string} filePath - Snapshot file
+ * @param {Array<Object>} sensors - { id, abnormal, policy: { triggered, windowEnd, periodStart, summary } }
+ */
+function writeSnapshot(filePath, sensors) {
+    const w = new Writer();
+    w.u32(MAGIC);
+    w.u32(VERSION);
+    w.f64(Date.now());
+    w.u32(sensors.length);
+    for (const s of sensors) {
+        const policy = s.policy || {};
+        const summary = policy.summary;
+        w.str(s.id);
+        w.u8((s.abnormal ? FLAG_ABNORMAL : 0) |
+             (policy.triggered ? FLAG_TRIGGERED : 0) |
+             (summary ? FLAG_SUMMARY : 0) |
+             (summary && summary.anyAbnormal ? FLAG_SUMMARY_ABNORMAL : 0));
+        w.f64(policy.windowEnd || 0);
+        w.f64(policy.periodStart || 0);
+        if (summary) {
+            w.u32(summary.frames);
+            w.f64(summary.minTemp);
+            w.f64(summary.maxTemp);
+            w.u8(summary.hotspot);
+            w.f64(summary.avgSum);
+            w.str(summary.date);
+            w.str(summary.time);
+        }
+    }
+    const body = w.buffer();
+    const sum = Buffer.alloc(4);
+    sum.writeUInt32LE(fnv1a(body));
+
+    fs.mkdirSync(path.dirname(filePath), { recursive: true });
+    const tmp = `${filePath}.tmp`;
+    const fd = fs.openSync(tmp, 'w', 0o644);
+    try {
+        fs.writeSync(fd, Buffer.concat([body, sum]));
+        fs.fsyncSync(fd);
+    } finally {
+        fs.closeSync(fd);
+    }
+    fs.renameSync(tmp, filePath);
+}
+
+/**
+ * Read a snapshot
+ * @param {string} filePath - Snapshot file
+ * @returns {Object|null} { writtenMs, sensors }, or null if there is none
+ * @throws {Error} If the file is truncated, corrupt or of another format
+ */
+function readSnapshot(filePath) {
+    let buf;
+    try {
+        buf = fs.readFileSync(filePath);
+    } catch (error) {
+        if (error.code === 'ENOENT') {
+            return null;
+        }
+        throw error;
+    }
+    if (buf.length < 24 || fnv1a(buf.subarray(0, buf.length - 4)) !== buf.readUInt32LE(buf.length - 4)) {
+        throw new Error(`${filePath} is corrupt`);
+    }
+    const r = new Reader(buf.subarray(0, buf.length - 4));
+    if (r.u32() !== MAGIC || r.u32() !== VERSION) {
+        throw new Error(`${filePath} has an unknown format`);
+    }
+    const writtenMs = r.f64();
+    const sensors = [];
+    for (let n = r.u32(); n > 0; n--) {
+        const id = r.str();
+        const flags = r.u8();
+        const policy = {
+            triggered: Boolean(flags & FLAG_TRIGGERED),
+            windowEnd: r.f64(),
+            periodStart: r.f64(),
+            summary: null
+        };
+        if (flags & FLAG_SUMMARY) {
+            policy.summary = {
+                frames: r.u32(),
+                minTemp: r.f64(),
+                maxTemp: r.f64(),
+                hotspot: r.u8(),
+                avgSum: r.f64(),
+                date: r.str(),
+                time: r.str(),
+                anyAbnormal: Boolean(flags & FLAG_SUMMARY_ABNORMAL)
+            };
+        }
+        sensors.push({ id, abnormal: Boolean(flags & FLAG_ABNORMAL), policy });
+    }
+    return { writtenMs, sensors };
+}
+
+module.exports = { writeSnapshot, readSnapshot };
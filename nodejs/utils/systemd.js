@@ -0,0 +1,45 @@
+/**
+ * systemd notification utility (Type=notify readiness and watchdog)
+ * Node.js cannot send on unix datagram sockets, so systemd-notify is used.
+ * All functions are no-ops when the process was not started by systemd.
+ */
+const { execFile } = require('child_process');
+const { getLogger } = require('./logger');
+
+const logger = getLogger('systemd');
+
+/**
+ * Send a state string such as READY=1 to systemd
+ * @param {string} state - Notification state
+ */
+function notify(state) {
+    if (!process.env.NOTIFY_SOCKET) {
+        return;
+    }
+    // --pid attributes the message to this process (requires NotifyAccess=all)
+    execFile('systemd-notify', [`--pid=${process.pid}`, state], (error) => {
+        if (error) {
+            logger.warn(`systemd-notify ${state} failed: ${error.message}`);
+        }
+    });
+}
+
+/**
+ * Ping the watchdog from the event loop at half of WatchdogSec.
+ * A blocked event loop stops the pings and systemd restarts the service.
+ */
+function startWatchdog() {
+    const usec = parseInt(process.env.WATCHDOG_USEC, 10);
+    const pid = process.env.WATCHDOG_PID;
+    if (!process.env.NOTIFY_SOCKET || !usec || (pid && parseInt(pid, 10) !== process.pid)) {
+        return;
+    }
+    const intervalMs = Math.max(1000, Math.floor(usec / 2000));
+    logger.info(`systemd watchdog enabled, pinging every ${intervalMs} ms`);
+    setInterval(() => notify('WATCHDOG=1'), intervalMs).unref();
+}
+
+module.exports = {
+    notify,
+    startWatchdog
+};
@@ -0,0 +1,157 @@
+/**
+ * Prioritised upload queue
+ * Alert and temperature records travel in separate lanes, each with its own
+ * queue and keep-alive connection pool, so an alert never waits behind a
+ * telemetry backlog. Telemetry requests are not started while alerts are
+ * queued or in flight.
+ */
+const http = require('http');
+const EventEmitter = require('events');
+const axios = require('axios');
+const { getLogger } = require('./logger');
+
+const logger = getLogger('upload');
+
+// Sockets per lane bound the requests in flight; alerts are few but must
+// not wait for a socket, telemetry gets enough to keep up with the pipe.
+const LANES = {
+    alert: { sockets: 2, timeout: 5000 },
+    telemetry: { sockets: 4, timeout: 10000 }
+};
+
+/**
+ * Create the upload queue
+ * @param {Object} config - Configuration object
+ * @returns {Object} Queue methods, an EventEmitter emitting 'saturated' and
+ *                   'drain' when the telemetry backlog crosses its limit
+ */
+function createUploadQueue(config) {
+    // Same default as the C uploader's telemetry queue
+    const limit = (config.uploader && config.uploader.queue) || 256;
+    const queue = new EventEmitter();
+    const lanes = {};
+    let saturated = false;
+
+    for (const [name, options] of Object.entries(LANES)) {
+        lanes[name] = {
+            name,
+            jobs: [],
+            inFlight: 0,
+            maxInFlight: options.sockets,
+            timeout: options.timeout,
+            agent: new http.Agent({ keepAlive: true, maxSockets: options.sockets })
+        };
+    }
+
+    logger.info(`Upload queue initialized (telemetry limit ${limit})`);
+
+    /**
+     * Whether any alert is queued or in flight
+     * @returns {Boolean}
+     */
+    function alertsPending() {
+        return lanes.alert.jobs.length > 0 || lanes.alert.inFlight > 0;
+    }
+
+    /**
+     * Report telemetry backlog changes so that the reader can stop pulling
+     * frames from the pipe instead of buffering them here
+     */
+    function updatePressure() {
+        const backlog = lanes.telemetry.jobs.length;
+        if (!saturated && backlog >= limit) {
+            saturated = true;
+            logger.warn(`Telemetry backlog at ${backlog} records, pausing input`);
+            queue.emit('saturated');
+        } else if (saturated && backlog <= limit / 2) {
+            saturated = false;
+            logger.info(`Telemetry backlog down to ${backlog} records, resuming input`);
+            queue.emit('drain');
+        }
+    }
+
+    /**
+     * Send one job on its lane's connection pool
+     * @param {Object} lane - Lane state
+     * @param {Object} job - Queued request
+     */
+    async function send(lane, job) {
+        lane.inFlight++;
+        try {
+            const response = await axios.post(job.url, job.data, {
+                httpAgent: lane.agent,
+                timeout: lane.timeout
+            });
+            job.resolve(response);
+        } catch (error) {
+            job.reject(error);
+        } finally {
+            lane.inFlight--;
+            pump();
+        }
+    }
+
+    /**
+     * Start as many requests as the lanes allow, alerts first
+     */
+    function pump() {
+        for (const lane of [lanes.alert, lanes.telemetry]) {
+            if (lane === lanes.telemetry && alertsPending()) {
+                break;
+            }
+            while (lane.inFlight < lane.maxInFlight && lane.jobs.length > 0) {
+                send(lane, lane.jobs.shift());
+            }
+        }
+        updatePressure();
+    }
+
+    /**
+     * Queue a POST request
+     * @param {String} laneName - 'alert' or 'telemetry'
+     * @param {String} url - Target URL
+     * @param {Object} data - JSON body
+     * @returns {Promise<Object>} axios response
+     */
+    function post(laneName, url, data) {
+        const lane = lanes[laneName];
+        return new Promise((resolve, reject) => {
+            lane.jobs.push({ url, data, resolve, reject });
+
+            // Input keeps arriving for a moment after a pause; beyond twice
+            // the limit the oldest telemetry is dropped
+            if (lane === lanes.telemetry && lane.jobs.length > 2 * limit) {
+                lane.jobs.shift().reject(new Error('telemetry queue full, oldest record dropped'));
+            }
+            pump();
+        });
+    }
+
+    /**
+     * Whether the telemetry backlog is over its limit
+     * @returns {Boolean}
+     */
+    function isSaturated() {
+        return saturated;
+    }
+
+    /**
+     * Get queue depths and requests in flight per lane
+     * @returns {Object} Lane statistics
+     */
+    function getStats() {
+        const stats = {};
+        for (const lane of Object.values(lanes)) {
+            stats[lane.name] = { queued: lane.jobs.length, inFlight: lane.inFlight };
+        }
+        return stats;
+    }
+
+    return Object.assign(queue, {
+        post,
+        isSaturated,
+        getStats
+    });
+}
+
+module.exports = { createUploadQueue };